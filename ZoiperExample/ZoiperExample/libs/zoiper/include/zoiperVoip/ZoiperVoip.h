@@ -9,18 +9,359 @@
 #import <Foundation/Foundation.h>
 
 
+// Planes of a decoded YUV 4:2:0 frame; only valid inside the handler
+typedef void (^ZoiperVideoFrameHandler)(int width, int height,
+                                        const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                                        int yStride, int uStride, int vStride);
+
 @interface ZoiperVoip : NSObject
 
 + (ZoiperVoip*)sharedInstance;
 
 - (void)registerSIPWithUser:(NSString*)user pass:(NSString*)pass server:(NSString*)server proxy:(NSString*)proxy;
 
-- (void)callNumber:(NSString*)tel;
+// Adds and registers another account; returns its UserHandler
+- (NSUInteger)addAccountWithUser:(NSString*)user pass:(NSString*)pass server:(NSString*)server proxy:(NSString*)proxy;
+
+// As above; completion runs on the main queue once the account registers or
+// REGISTER fails (causeCode), or after timeoutMs (0 waits indefinitely)
+// with causeCode -1. The completion-based methods are main thread only.
+- (NSUInteger)addAccountWithUser:(NSString*)user pass:(NSString*)pass server:(NSString*)server proxy:(NSString*)proxy timeoutMs:(int)timeoutMs completion:(void (^)(NSUInteger userId, BOOL registered, int causeCode))completion;
+
+- (void)removeAccount:(NSUInteger)userId;
+
+// Refresh period for accounts added afterwards, randomly shortened by up to
+// jitter percent so refreshes of many accounts spread out
+- (void)setRegistrationTime:(int)seconds jitterPercent:(int)jitter;
+
+// New accounts register with the SIP transport last found to work for their
+// server on the current network, or wait for a probe (TLS, TCP, UDP) when
+// there is none. Results persist across launches. The network name (Wi-Fi
+// SSID, nil when unknown) tells apart networks with the same addressing.
+- (void)setTransportProbingEnabled:(BOOL)enabled;
+- (void)setNetworkName:(NSString*)name;
+- (void)clearTransportCache;
+
+// lookups, cacheHits, probesStarted, probesJoined, successes, failures,
+// timeouts, errors, invalidations, meanProbeUs, maxProbeUs, running,
+// cacheEntries, fingerprint
+- (NSDictionary*)transportProbeStatistics;
+
+// STUN for the accounts' signalling and media: resolves in the background
+// and again on network changes, and keeps media ports ready so outgoing
+// calls never wait for NAT discovery. port / refreshMs 0 use 3478 / 30 s.
+// Returns NO if the library has no STUN support.
+- (BOOL)useStunServer:(NSString*)server port:(int)port refreshMs:(long)refreshMs;
+- (void)stopStun;
+
+// Resolve again now instead of at the next network check (every 5 s)
+- (void)networkChanged;
+
+// Ports kept ready for the account's outgoing calls (1 for audio, 2 for
+// video); the default account gets 1. NO if too many accounts are warmed.
+- (BOOL)setWarmStunPorts:(int)ports forAccount:(NSUInteger)userId;
+
+// state, networkType, externalAddress, externalPort, resolves,
+// networkChanges, resolveTimeLastUs, resolveTimeMaxUs, portsRequested,
+// portsReady, portsFailed, portsStale, meanPortUs, maxPortUs, warmPorts,
+// callsWarm, callsCold, firstMediaWarm, firstMediaCold (histogram JSON of
+// CallCreate() to early media or answer, with and without a warm port)
+- (NSDictionary*)stunStatistics;
+- (void)resetFirstMediaStatistics;
+
+// Accounts get their own codec list from the network quality of their
+// earlier calls on the current network: wideband Opus normally, low-bitrate
+// Opus with DTX after lossy or jittery calls. Disabled, every account uses
+// the default list.
+- (void)setCodecPolicyEnabled:(BOOL)enabled;
+
+// supportedCodecs, listsApplied, profileChanges, calls, callsConstrained,
+// bytesSent, bytesSaved (audio payload against the wideband codec),
+// baselineBps, and recentCalls: newest first, one dictionary per call with
+// callId, userId, profile, codec, durationMs, bytesSent, bytesSaved
+- (NSDictionary*)codecPolicyStatistics;
+
+// Presence of up to 16384 contacts. Subscriptions go out paced (32 every
+// 50 ms) with jittered expiries; contacts deactivated by the server are
+// re-subscribed after 30 s. Changes are coalesced per poll cycle and
+// delivered in batches on the main queue, one dictionary per contact:
+// contact, status (eContactState_t), phase (ZSDKContactPhase), note.
+- (void)setPresenceHandler:(void (^)(NSArray * changes))handler;
+
+// Contact id, -1 if the table is full
+- (NSInteger)addContact:(NSString*)number forAccount:(NSUInteger)userId;
+- (void)removeContact:(NSInteger)contactId;
+- (void)refreshContacts;
+
+// status is an eContactState_t (0 offline, 1 online)
+- (BOOL)publishStatus:(int)status note:(NSString*)note forAccount:(NSUInteger)userId;
+
+// contacts, subscribed, pending, subscribes, refreshes, statusCallbacks,
+// changesDelivered, batches, maxBatch, terminations, publications,
+// publicationFailures
+- (NSDictionary*)presenceStatistics;
+
+// Busy lamp field for up to 1024 peers. Add peers before the account
+// registers; the library subscribes to their dialogs on registration.
+// Returns the peer id, -1 on failure.
+- (NSInteger)addPeer:(NSString*)number name:(NSString*)name forAccount:(NSUInteger)userId;
+- (void)removePeer:(NSInteger)peerId;
+
+// Called on the main queue at most once per poll cycle when peers changed;
+// pull the changes with peerChangesSinceVersion:
+- (void)setPeerChangedHandler:(void (^)(NSUInteger version))handler;
+
+// Peers whose lamp or dialog count changed after version (0: every peer),
+// one entry per peer however often it changed: version (pass it next
+// time), peers (peer, lamp, dialogs, name, number). lamp is 0 unknown,
+// 1 idle, 2 alerting, 3 busy, 4 removed.
+- (NSDictionary*)peerChangesSinceVersion:(NSUInteger)version;
+
+// peers, dialogs, version, callbacks, updates, flushes, dialogTableFull,
+// unknownDialogs
+- (NSDictionary*)peerStatistics;
+
+// Instant messages to contacts added with addContact:forAccount:. Sent in
+// order per contact with up to 4 in flight, retried with backoff; outcomes
+// and received messages arrive in batches on the main queue, one dictionary
+// each: kind (sent, failed, received), message, contact, attempts,
+// causeCode, body, from.
+- (void)setMessageHandler:(void (^)(NSArray * messages))handler;
+
+// Message id, 0 if the queue is full or the text is over 1024 bytes
+- (NSUInteger)sendMessage:(NSString*)text toContact:(NSInteger)contactId;
 
+// Typing notification; repeated states are not sent
+- (void)setComposing:(BOOL)active toContact:(NSInteger)contactId;
+
+// queued, inFlight, arenaBytes, arenaHighWater, sent, failed, retries,
+// received, receivedDropped, queueFull, composingSent, composingSuppressed,
+// batches
+- (NSDictionary*)messagingStatistics;
+
+// One dictionary per account: userId, user, server, state, transport,
+// registrationSeconds
+- (NSArray*)accounts;
+
+// Returns the CallHandler of the new call
+- (NSUInteger)callNumber:(NSString*)tel;
+
+- (NSUInteger)callNumber:(NSString*)tel fromAccount:(NSUInteger)userId;
+
+// completion runs once the call is answered, or ends first (causeCode), or
+// after timeoutMs (0 waits indefinitely) with causeCode -1. Returns
+// INVALID_HANDLE without calling completion if the call was not placed.
+- (NSUInteger)callNumber:(NSString*)tel fromAccount:(NSUInteger)userId timeoutMs:(int)timeoutMs completion:(void (^)(NSUInteger callId, BOOL accepted, int causeCode))completion;
+
+// Hangs up the most recent call
 - (void)callHangout;
 
+- (void)hangupCall:(NSUInteger)callId;
+
+- (void)answerCall:(NSUInteger)callId;
+
+- (void)holdCall:(NSUInteger)callId;
+
+- (void)unholdCall:(NSUInteger)callId;
+
+// completion gets YES once the remote side confirmed the hold/unhold
+- (void)holdCall:(NSUInteger)callId completion:(void (^)(BOOL done))completion;
+
+- (void)unholdCall:(NSUInteger)callId completion:(void (^)(BOOL done))completion;
+
+// Pending completion-based operations: started, succeeded, failed,
+// timedOut, cancelled, exhausted, pending, maxPending
+- (NSDictionary*)asyncOperationStatistics;
+
+- (void)transferCall:(NSUInteger)callId toNumber:(NSString*)number;
+
+- (void)transferCall:(NSUInteger)callId toCall:(NSUInteger)otherCallId;
+
+// One dictionary per call: callId, userId, state, incoming, codec, video, peer
+- (NSArray*)activeCalls;
+
 - (void)setupSIP;
 
 - (void)activationRegister:(NSString*)user password:(NSString*)pass;
 
+// Hands the latest received frame of the call to the handler without
+// copying it. Returns NO if no new frame arrived since the last call.
+- (BOOL)takeVideoFrameForCall:(NSUInteger)callId handler:(ZoiperVideoFrameHandler)handler;
+
+// framesReceived, framesDelivered, framesDropped, copyBytes
+- (NSDictionary*)videoStatisticsForCall:(NSUInteger)callId;
+
+// Camera frames for the call's outgoing video, converted to I420 at the
+// negotiated size. Paced to the negotiated fps; returns NO when the frame
+// was skipped (too early, or the encoder is lagging).
+- (BOOL)sendVideoFrameForCall:(NSUInteger)callId bgra:(const uint8_t *)pixels stride:(int)stride width:(int)width height:(int)height;
+
+- (BOOL)sendVideoFrameForCall:(NSUInteger)callId nv12Y:(const uint8_t *)y yStride:(int)yStride uv:(const uint8_t *)uv uvStride:(int)uvStride width:(int)width height:(int)height;
+
+// framesSubmitted, framesSent, droppedPacing, droppedBusy, droppedLag,
+// sendErrors, sendLatencyMaxUs, queueLatencyMaxUs, width, height, fps, skip
+- (NSDictionary*)videoSendStatisticsForCall:(NSUInteger)callId;
+
+// Adapt each video call's bitrate, frame rate and resolution to the video
+// channel's loss and jitter (default YES)
+- (void)setAdaptiveVideoEnabled:(BOOL)enabled;
+
+// level, bitrate, width, height, fps, lossPermil, jitterMs, quality,
+// changes, impairedMs, and recentChanges: the last 16 changes pushed to the
+// encoder, oldest first, each with timeMs, level, bitrate, width, height,
+// fps and the lossPermil, jitterMs and quality that caused it
+- (NSDictionary*)videoRateStateForCall:(NSUInteger)callId;
+
+// Runs recorded statistics through the rate controller. Samples are
+// dictionaries with timeMs, lossPermil and jitterMs and/or quality
+// (eNetworkQualityLevel_t); returns level, bitrate, width, height, fps
+// after each sample.
+- (NSArray*)replayVideoRateTrace:(NSArray*)samples;
+
+// Quality time series of a call (also after it ended, until its slot is
+// reused): network statistics and quality changes per channel plus audio
+// levels. The binary form is a 40 byte header ("ZTLM" magic, version,
+// sample size, callId, start time, per-channel counts) followed by 32 byte
+// samples; nil if nothing is kept for the call.
+- (NSData*)telemetryDataForCall:(NSUInteger)callId;
+
+- (NSString*)telemetryCSVForCall:(NSUInteger)callId;
+
+// External audio mode; call before setupSIP. The SDK no longer opens the
+// audio device: a real-time thread exchanges fixed frames with it while
+// audio is needed, fed from the input ring and draining into the output
+// ring. Returns NO if the frame size is unsupported (max 960 samples).
+- (BOOL)useExternalAudioWithSampleRate:(int)sampleRate samplesPerFrame:(int)samplesPerFrame;
+
+// Microphone samples in, mixer samples out (mono 16 bit at the configured
+// rate), each from one thread. Return the number of samples moved.
+- (int)writeExternalAudioInput:(const int16_t *)samples count:(int)count;
+
+- (int)readExternalAudioOutput:(int16_t *)samples count:(int)count;
+
+// Latency of the device or source outside the rings, added to the latency
+// reported to the SDK for echo cancellation
+- (void)setExternalAudioDeviceLatency:(int)latencyMs;
+
+// frames, underruns, overruns, lateFrames, processMaxUs, latencyMs,
+// latencyMaxMs, sampleRate, samplesPerFrame, running
+- (NSDictionary*)externalAudioStatistics;
+
+// Conference bridges (up to 4, 32 calls each). Calls that end leave their
+// bridge automatically. Returns INVALID_HANDLE when no bridge is available.
+- (NSUInteger)createConference;
+
+- (BOOL)destroyConference:(NSUInteger)conferenceId;
+
+- (BOOL)holdConference:(NSUInteger)conferenceId;
+
+- (BOOL)unholdConference:(NSUInteger)conferenceId;
+
+- (BOOL)joinCall:(NSUInteger)callId toConference:(NSUInteger)conferenceId;
+
+- (BOOL)removeCall:(NSUInteger)callId fromConference:(NSUInteger)conferenceId;
+
+- (BOOL)setMuted:(BOOL)muted forCall:(NSUInteger)callId inConference:(NSUInteger)conferenceId;
+
+// Linear gain of the participant towards the others, 0 .. 4 (default 1).
+// Applies to mixConference:; the library's own conference mix has no
+// per-call gain.
+- (BOOL)setGain:(float)gain forCall:(NSUInteger)callId inConference:(NSUInteger)conferenceId;
+
+// One dictionary per participant in join order: callId, gain, muted
+- (NSArray*)conferenceParticipants:(NSUInteger)conferenceId;
+
+// N-minus-one mix of application owned audio (e.g. external audio mode):
+// one 16 bit mono frame per participant in conferenceParticipants: order,
+// each output gets everyone else at their gain. count must match the
+// participant count; one mixing thread per bridge.
+- (BOOL)mixConference:(NSUInteger)conferenceId inputs:(const int16_t * const *)inputs outputs:(int16_t * const *)outputs count:(int)count samples:(int)samples;
+
+// frames, mixMaxUs, mixAvgUs
+- (NSDictionary*)conferenceMixStatistics:(NSUInteger)conferenceId;
+
+// Minimum SNR in dB the startup resampler policy asks for (default 50);
+// set before setupSIP
+- (void)setResamplerQualityFloor:(double)snrDb;
+
+// Recordings streamed to WAV files (16 bit PCM, or IMA ADPCM when
+// compressed) by one background writer through a bounded block pool.
+// Returns the recording id or -1. The microphone variant drains the
+// library's recordings; the other takes interleaved samples from
+// writeRecording:, one thread per recording, and refuses (drops) a write
+// when the pool is full.
+- (NSInteger)startMicrophoneRecordingToFile:(NSString*)path compressed:(BOOL)compressed sampleRate:(int)sampleRate channels:(int)channels;
+
+- (NSInteger)openRecordingToFile:(NSString*)path compressed:(BOOL)compressed sampleRate:(int)sampleRate channels:(int)channels;
+
+- (BOOL)writeRecording:(NSInteger)recordingId samples:(const int16_t *)samples frames:(int)frames;
+
+// The file is complete once the writer has caught up
+- (void)closeRecording:(NSInteger)recordingId;
+
+// Records the call (both sides mixed, or local left and remote right when
+// stereo) until it ends or stopCallRecording:. The library writes the file
+// as the call goes; a compressed recording is re-encoded by the background
+// writer afterwards. Any number of calls can record at once, up to 128.
+- (BOOL)startCallRecording:(NSUInteger)callId toFile:(NSString*)path compressed:(BOOL)compressed stereo:(BOOL)stereo;
+
+- (void)stopCallRecording:(NSUInteger)callId;
+
+// framesWritten, framesDropped, bytesWritten, writeErrors; recordingId -1
+// gives the totals plus blocksInUse and blocksInUseMax
+- (NSDictionary*)recordingStatistics:(NSInteger)recordingId;
+
+// Cached library sounds for ringtones and prompts, reused while the file
+// keeps its modification time and size. Returns INVALID_HANDLE if the file
+// cannot be loaded; ready is NO while a preload of it is still running.
+// Each sound returned must be given back with releaseSound: once it is
+// no longer played.
+- (NSUInteger)acquireSound:(NSString*)path repeat:(BOOL)repeat pauseMs:(int)pauseMs ready:(BOOL*)ready;
+
+- (void)releaseSound:(NSUInteger)soundId;
+
+// Loads the sounds in the background (non repeating)
+- (void)preloadSounds:(NSArray*)paths;
+
+// Sounds preloaded by every later setupSIP
+- (void)setSoundManifest:(NSArray*)paths;
+
+// Bytes of decoded audio kept for sounds nobody holds (default 8 MB)
+- (void)setSoundCacheBudget:(NSUInteger)bytes;
+
+// entries, loading, bytes, budget, hits, misses, evictions, loadFailures
+- (NSDictionary*)soundCacheStatistics;
+
+// Debug log (library onDebugLog messages and logDebugMessage:) written in
+// the background to <directory>/zoiper.log, rotated at maxFileBytes with
+// keepFiles files in all (0 = 4 MB, 4 files). Messages are dropped rather
+// than delayed when the writer falls behind.
+- (BOOL)startDebugLogInDirectory:(NSString*)directory maxFileBytes:(NSUInteger)maxFileBytes keepFiles:(int)keepFiles;
+
+- (void)stopDebugLog;
+
+- (void)logDebugMessage:(NSString*)message;
+
+// Keep one message in keepOneIn for subsystem general, sip, transport,
+// dns or media (1 keeps all, 0 none)
+- (BOOL)setDebugLogSampling:(int)keepOneIn forSubsystem:(NSString*)subsystem;
+
+// messages, written, dropped, sampledOut, truncated, bytes, batches,
+// rotations, writeErrors
+- (NSDictionary*)debugLogStatistics;
+
+// Library events delivered in batches on the main queue. Each event is a
+// dictionary: type, handle (call/user id), codec, causeCode, arg0, arg1, text
+- (void)setEventHandler:(void (^)(NSArray * events))handler;
+
+// Keep posting the ZSDKctxDid* notifications (default YES)
+- (void)setLegacyNotificationsEnabled:(BOOL)enabled;
+
+// pushed, dropped (events other than outcomes refused while only the
+// reserve is left), outcomesDeferred, outcomesDropped, batches, maxBatch
+- (NSDictionary*)eventQueueStatistics;
+
+// Poll engine counters: polls, wakeups, dispatched events and latencies (us)
+- (NSDictionary*)pollStatistics;
+
 @end
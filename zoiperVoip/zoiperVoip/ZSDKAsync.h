@@ -0,0 +1,73 @@
+//
+//  ZSDKAsync.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Completion-based waits on library operations.  Instead of firing
+//  CallCreate() and watching the notifications for the outcome, a caller
+//  awaits the state it wants for a handle and gets exactly one completion:
+//
+//      ZSDKAsyncCall           CallAccepted, or the call ends first
+//      ZSDKAsyncRegistration   UserRegistered or a REGISTER failure
+//      ZSDKAsyncHold           CallHeld (remote status), or the call ends
+//      ZSDKAsyncUnhold         CallUnheld (remote status), or the call ends
+//
+//  Operations are records in a fixed pool chained per handle, so any number
+//  up to kZSDKAsyncMaxOps can be in flight without allocation.  They are
+//  resolved from the event queue monitor on the main queue; the poll thread
+//  only queues events as before.  Everything here is main queue only, which
+//  also means an operation started right after the library call that it
+//  awaits cannot miss its event.
+//
+//  Completions rather than C++20 coroutines: the target compiles C++ as
+//  gnu++0x against the old libstdc++, which has no coroutine support, and
+//  its GCC_INPUT_FILETYPE override used to compile every source, .mm
+//  included, as plain Objective-C.  A coroutine awaiter can be layered on
+//  ZSDKAsyncAwait() once the dialect allows it.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+
+#define kZSDKAsyncMaxOps        256
+#define kZSDKAsyncTableBits     9       // >= 2 * kZSDKAsyncMaxOps
+#define kZSDKAsyncCauseTimeout  (-1)
+#define kZSDKAsyncHoldTimeoutMs 32000   // SIP transaction timeout
+
+typedef enum {
+    ZSDKAsyncCall = 0
+,   ZSDKAsyncRegistration
+,   ZSDKAsyncHold
+,   ZSDKAsyncUnhold
+,   ZSDKAsyncKindCount
+} ZSDKAsyncKind;
+
+// Slot and generation; 0 when no operation was started
+typedef uint32_t ZSDKAsyncOp;
+
+// result L_OK when the awaited state was reached, otherwise L_FAIL (or the
+// remote status for hold/unhold) with the library cause code, or
+// kZSDKAsyncCauseTimeout
+typedef void (^ZSDKAsyncCompletion)(Handler handle, LIBRESULT result, int causeCode);
+
+typedef struct {
+    uint64_t    started;
+    uint64_t    succeeded;
+    uint64_t    failed;
+    uint64_t    timedOut;
+    uint64_t    cancelled;
+    uint64_t    exhausted;          // pool full, not started
+    int         pending;
+    int         maxPending;
+} ZSDKAsyncStats;
+
+// timeoutMs 0 waits for the event however long it takes.  Returns 0 when
+// the pool is full; the completion is not called then.
+ZSDKAsyncOp ZSDKAsyncAwait(ZSDKAsyncKind kind, Handler handle, int timeoutMs,
+                           ZSDKAsyncCompletion completion);
+
+// Drops a pending operation without calling its completion
+BOOL ZSDKAsyncCancel(ZSDKAsyncOp op);
+
+void ZSDKAsyncGetStats(ZSDKAsyncStats * pStats);
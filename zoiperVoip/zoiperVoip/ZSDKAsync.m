@@ -0,0 +1,227 @@
+//
+//  ZSDKAsync.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKAsync.h"
+#import "ZSDKEventQueue.h"
+#import "ZSDKHandleMap.h"
+
+#define kNoSlot     (-1)
+
+typedef struct {
+    BOOL            used;
+    ZSDKAsyncKind   kind;
+    Handler         handle;
+    uint16_t        generation;
+    int             next;           // same kind and handle, or free list
+} ZSDKAsyncRecord;
+
+// Main queue only
+static ZSDKAsyncRecord      gOps[kZSDKAsyncMaxOps];
+static ZSDKAsyncCompletion  gCompletions[kZSDKAsyncMaxOps];
+static ZSDKHandleBucket     gBuckets[ZSDKAsyncKindCount][1 << kZSDKAsyncTableBits];
+static ZSDKHandleMap        gWaiting[ZSDKAsyncKindCount];    // handle -> first op
+static int                  gFreeHead = kNoSlot;
+static BOOL                 gInitialized = NO;
+static ZSDKAsyncStats       gStats;
+
+static void asyncMonitor(const ZSDKEvent * events, int count);
+
+static void initOnce(void)
+{
+    if (gInitialized)
+        return;
+    for (int i = 0; i < kZSDKAsyncMaxOps; i++)
+        gOps[i].next = (i + 1 < kZSDKAsyncMaxOps) ? i + 1 : kNoSlot;
+    gFreeHead = 0;
+    for (int k = 0; k < ZSDKAsyncKindCount; k++)
+        ZSDKHandleMapInit(&gWaiting[k], gBuckets[k], kZSDKAsyncTableBits);
+    ZSDKEventQueueAddMonitor(asyncMonitor);
+    gInitialized = YES;
+}
+
+static ZSDKAsyncOp opId(int slot)
+{
+    return ((uint32_t)gOps[slot].generation << 16) | (uint32_t)(slot + 1);
+}
+
+static void freeRecord(int slot)
+{
+    gOps[slot].used = NO;
+    gOps[slot].next = gFreeHead;
+    gFreeHead = slot;
+    gCompletions[slot] = nil;
+    gStats.pending--;
+}
+
+// Takes slot out of the chain of its handle
+static void unlinkOp(int slot)
+{
+    ZSDKAsyncRecord * op = &gOps[slot];
+    ZSDKHandleMap * map = &gWaiting[op->kind];
+    int head = ZSDKHandleMapFind(map, op->handle);
+    if (head == slot)
+    {
+        ZSDKHandleMapRemove(map, op->handle);
+        if (op->next != kNoSlot)
+            ZSDKHandleMapInsert(map, op->handle, op->next);
+        return;
+    }
+    for (int prev = head; prev != kNoSlot; prev = gOps[prev].next)
+    {
+        if (gOps[prev].next == slot)
+        {
+            gOps[prev].next = op->next;
+            return;
+        }
+    }
+}
+
+static void finish(int slot, LIBRESULT result, int causeCode)
+{
+    ZSDKAsyncCompletion completion = gCompletions[slot];
+    Handler handle = gOps[slot].handle;
+    freeRecord(slot);
+
+    if (result == L_OK)
+        gStats.succeeded++;
+    else if (causeCode == kZSDKAsyncCauseTimeout)
+        gStats.timedOut++;
+    else
+        gStats.failed++;
+
+    if (completion)
+        completion(handle, result, causeCode);
+}
+
+// Completes every operation of kind waiting on handle.  The chain is
+// detached first so completions may start new operations.
+static void resolve(ZSDKAsyncKind kind, Handler handle, LIBRESULT result, int causeCode)
+{
+    int slot = ZSDKHandleMapRemove(&gWaiting[kind], handle);
+    while (slot != ZSDK_HANDLE_MAP_EMPTY && slot != kNoSlot)
+    {
+        int next = gOps[slot].next;
+        finish(slot, result, causeCode);
+        slot = next;
+    }
+}
+
+static void asyncMonitor(const ZSDKEvent * events, int count)
+{
+    if (gStats.pending == 0)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        const ZSDKEvent * ev = &events[i];
+        switch (ev->type)
+        {
+            case ZSDKEventCallAccepted:
+                resolve(ZSDKAsyncCall, ev->handle, L_OK, 0);
+                break;
+            case ZSDKEventCallHangup:
+            case ZSDKEventCallRejected:
+            case ZSDKEventCallFailed:
+                resolve(ZSDKAsyncCall, ev->handle, L_FAIL, ev->causeCode);
+                resolve(ZSDKAsyncHold, ev->handle, L_FAIL, ev->causeCode);
+                resolve(ZSDKAsyncUnhold, ev->handle, L_FAIL, ev->causeCode);
+                break;
+            case ZSDKEventCallHeld:
+                resolve(ZSDKAsyncHold, ev->handle, (LIBRESULT)ev->arg0, 0);
+                break;
+            case ZSDKEventCallUnheld:
+                resolve(ZSDKAsyncUnhold, ev->handle, (LIBRESULT)ev->arg0, 0);
+                break;
+            case ZSDKEventUserRegistered:
+                resolve(ZSDKAsyncRegistration, ev->handle, L_OK, 0);
+                break;
+            case ZSDKEventUserRegistrationFailed:
+                // arg0 is isRegister; unregistration failures are not awaited
+                if (ev->arg0)
+                    resolve(ZSDKAsyncRegistration, ev->handle, L_FAIL, ev->causeCode);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static int liveSlot(ZSDKAsyncOp op)
+{
+    int slot = (int)(op & 0xFFFF) - 1;
+    if (slot < 0 || slot >= kZSDKAsyncMaxOps || !gOps[slot].used || opId(slot) != op)
+        return kNoSlot;
+    return slot;
+}
+
+ZSDKAsyncOp ZSDKAsyncAwait(ZSDKAsyncKind kind, Handler handle, int timeoutMs,
+                           ZSDKAsyncCompletion completion)
+{
+    initOnce();
+    if (kind >= ZSDKAsyncKindCount || handle == INVALID_HANDLE)
+        return 0;
+    if (gFreeHead == kNoSlot)
+    {
+        gStats.exhausted++;
+        return 0;
+    }
+
+    int slot = gFreeHead;
+    ZSDKAsyncRecord * op = &gOps[slot];
+    gFreeHead = op->next;
+
+    // Appended to an existing chain so completions run in start order
+    int head = ZSDKHandleMapFind(&gWaiting[kind], handle);
+    op->used   = YES;
+    op->kind   = kind;
+    op->handle = handle;
+    op->next   = kNoSlot;
+    op->generation++;
+    gCompletions[slot] = completion;
+    if (head == ZSDK_HANDLE_MAP_EMPTY)
+        ZSDKHandleMapInsert(&gWaiting[kind], handle, slot);
+    else
+    {
+        while (gOps[head].next != kNoSlot)
+            head = gOps[head].next;
+        gOps[head].next = slot;
+    }
+
+    gStats.started++;
+    if (++gStats.pending > gStats.maxPending)
+        gStats.maxPending = gStats.pending;
+
+    ZSDKAsyncOp result = opId(slot);
+    if (timeoutMs > 0)
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutMs * NSEC_PER_MSEC),
+                       dispatch_get_main_queue(), ^{
+            int live = liveSlot(result);
+            if (live == kNoSlot)
+                return;
+            unlinkOp(live);
+            finish(live, L_FAIL, kZSDKAsyncCauseTimeout);
+        });
+    }
+    return result;
+}
+
+BOOL ZSDKAsyncCancel(ZSDKAsyncOp op)
+{
+    int slot = liveSlot(op);
+    if (slot == kNoSlot)
+        return NO;
+    unlinkOp(slot);
+    freeRecord(slot);
+    gStats.cancelled++;
+    return YES;
+}
+
+void ZSDKAsyncGetStats(ZSDKAsyncStats * pStats)
+{
+    *pStats = gStats;
+}
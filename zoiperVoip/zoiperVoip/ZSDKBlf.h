@@ -0,0 +1,85 @@
+//
+//  ZSDKBlf.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Busy lamp field: dialog state of monitored peers (AddPeer()).  Peers and
+//  their dialogs sit in two preallocated tables, found through ZSDKHandleMaps
+//  keyed by PeerHandler and DialogHandler; a peer's dialogs are chained
+//  through the dialog table, so a callback touches one or two entries.
+//
+//  Callbacks only update dialogs and mark the peer dirty.  At the end of
+//  each poll cycle (PollLibrary()) the dirty peers get their lamp worked out
+//  again, and those whose lamp or dialog count really changed get the next
+//  table version: however many callbacks a peer had in the cycle, it changes
+//  at most once.  The UI pulls everything newer than the version it has
+//  (ZSDKBlfChangesSince()); the changed handler only says there is more.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKBlfMaxPeers        1024
+#define kZSDKBlfPeerBits        11      // 2048 buckets
+#define kZSDKBlfMaxDialogs      4096
+#define kZSDKBlfDialogBits      13      // 8192 buckets
+#define kZSDKBlfNameLen         48
+#define kZSDKBlfNumberLen       32
+
+typedef int ZSDKBlfPeerId;              // -1: invalid
+
+typedef enum {
+    ZSDKBlfLampUnknown = 0              // nothing heard since AddPeer()
+,   ZSDKBlfLampIdle
+,   ZSDKBlfLampAlerting                 // trying, proceeding or early dialogs
+,   ZSDKBlfLampBusy                     // a confirmed dialog
+,   ZSDKBlfLampRemoved                  // peer removed; the id may be reused
+} ZSDKBlfLamp;
+
+typedef struct {
+    ZSDKBlfPeerId       peer;
+    uint8_t             lamp;           // ZSDKBlfLamp
+    uint16_t            dialogs;        // NewCount from the library
+    uint32_t            version;        // table version of the change
+    char                name[kZSDKBlfNameLen];
+    char                number[kZSDKBlfNumberLen];
+} ZSDKBlfPeerState;
+
+typedef struct {
+    int                 peers;
+    int                 dialogs;
+    uint32_t            version;
+    uint64_t            callbacks;
+    uint64_t            updates;            // peer changes published
+    uint64_t            flushes;            // poll cycles with dirty peers
+    uint64_t            dialogTableFull;    // dialogs not tracked
+    uint64_t            unknownDialogs;     // callbacks for dialogs not in the table
+} ZSDKBlfStats;
+
+// Main queue; called at most once per poll cycle with the newest version
+typedef void (^ZSDKBlfChangedHandler)(uint32_t version);
+
+void ZSDKBlfSetChangedHandler(ZSDKBlfChangedHandler handler);
+
+// The library subscribes on registration: add peers before RegisterUser().
+// Returns -1 when the table is full or AddPeer() fails.
+ZSDKBlfPeerId ZSDKBlfAddPeer(UserHandler userId, const char * pName, const char * pNumber);
+void ZSDKBlfRemovePeer(ZSDKBlfPeerId peer);
+
+// Peers changed after sinceVersion (0: all of them), oldest change first.
+// Returns how many went into pStates; *pVersion is the version to ask from
+// next time, so a full buffer is continued by the following call.
+int ZSDKBlfChangesSince(uint32_t sinceVersion, ZSDKBlfPeerState * pStates, int maxStates,
+                        uint32_t * pVersion);
+
+void ZSDKBlfGetStats(ZSDKBlfStats * pStats);
+
+// End of a poll cycle (poll thread)
+void ZSDKBlfFlush(void);
+
+// Callbacks (poll thread)
+void ZSDKBlfOnDialogAdded(PeerHandler peerId, DialogHandler dialogId, int newCount);
+void ZSDKBlfOnDialogChanged(DialogHandler dialogId, ePeerState_t state);
+void ZSDKBlfOnDialogRemoved(PeerHandler peerId, DialogHandler dialogId, int newCount);
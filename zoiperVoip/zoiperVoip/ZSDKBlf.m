@@ -0,0 +1,398 @@
+//
+//  ZSDKBlf.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKBlf.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKHandleMap.h"
+#import <pthread.h>
+
+#define kNone   (-1)
+
+static pthread_mutex_t      gBlfLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Peers
+static PeerHandler          gPeerHandle[kZSDKBlfMaxPeers];     // INVALID_HANDLE: free
+static uint8_t              gLamp[kZSDKBlfMaxPeers];           // as published
+static uint8_t              gDirty[kZSDKBlfMaxPeers];
+static uint16_t             gCount[kZSDKBlfMaxPeers];          // NewCount, live
+static uint16_t             gShownCount[kZSDKBlfMaxPeers];     // as published
+static uint32_t             gVersion[kZSDKBlfMaxPeers];
+static int                  gFirstDialog[kZSDKBlfMaxPeers];
+static int                  gOlder[kZSDKBlfMaxPeers];          // change list, by version
+static int                  gNewer[kZSDKBlfMaxPeers];
+static char                 gName[kZSDKBlfMaxPeers][kZSDKBlfNameLen];
+static char                 gNumber[kZSDKBlfMaxPeers][kZSDKBlfNumberLen];
+static ZSDKHandleBucket     gPeerBuckets[1 << kZSDKBlfPeerBits];
+static ZSDKHandleMap        gPeerMap;
+static int                  gFreePeers[kZSDKBlfMaxPeers];
+static int                  gFreePeerCount = 0;
+
+// Dialogs, chained per peer
+static DialogHandler        gDialogHandle[kZSDKBlfMaxDialogs];
+static int                  gDialogPeer[kZSDKBlfMaxDialogs];
+static int                  gDialogNext[kZSDKBlfMaxDialogs];
+static uint8_t              gDialogState[kZSDKBlfMaxDialogs];  // ePeerState_t
+static ZSDKHandleBucket     gDialogBuckets[1 << kZSDKBlfDialogBits];
+static ZSDKHandleMap        gDialogMap;
+static int                  gFreeDialogs[kZSDKBlfMaxDialogs];
+static int                  gFreeDialogCount = 0;
+
+static int                  gDirtyList[kZSDKBlfMaxPeers];
+static int                  gDirtyCount = 0;
+static int                  gOldest = kNone;
+static int                  gNewest = kNone;
+static uint32_t             gTableVersion = 0;
+static BOOL                 gTableReady = NO;
+static BOOL                 gDispatchPending = NO;
+static ZSDKBlfStats         gStats;
+
+static ZSDKBlfChangedHandler gChangedHandler = nil;    // main queue only
+
+static void lockBlf(void)
+{
+    pthread_mutex_lock(&gBlfLock);
+    if (!gTableReady)
+    {
+        ZSDKHandleMapInit(&gPeerMap, gPeerBuckets, kZSDKBlfPeerBits);
+        ZSDKHandleMapInit(&gDialogMap, gDialogBuckets, kZSDKBlfDialogBits);
+        for (int i = 0; i < kZSDKBlfMaxPeers; i++)
+        {
+            gPeerHandle[i] = INVALID_HANDLE;
+            gOlder[i]      = kNone;
+            gNewer[i]      = kNone;
+            gFreePeers[i]  = kZSDKBlfMaxPeers - 1 - i;
+        }
+        for (int i = 0; i < kZSDKBlfMaxDialogs; i++)
+            gFreeDialogs[i] = kZSDKBlfMaxDialogs - 1 - i;
+        gFreePeerCount   = kZSDKBlfMaxPeers;
+        gFreeDialogCount = kZSDKBlfMaxDialogs;
+        gTableReady = YES;
+    }
+}
+
+static void unlockBlf(void)
+{
+    pthread_mutex_unlock(&gBlfLock);
+}
+
+//==============================================================================
+//  Table (lock held)
+//==============================================================================
+static void unlinkChange(int peer)
+{
+    if (gOlder[peer] != kNone)
+        gNewer[gOlder[peer]] = gNewer[peer];
+    else if (gOldest == peer)
+        gOldest = gNewer[peer];
+    if (gNewer[peer] != kNone)
+        gOlder[gNewer[peer]] = gOlder[peer];
+    else if (gNewest == peer)
+        gNewest = gOlder[peer];
+    gOlder[peer] = gNewer[peer] = kNone;
+}
+
+// Gives the peer the next version and moves it to the new end of the list
+static void publish(int peer, ZSDKBlfLamp lamp)
+{
+    unlinkChange(peer);
+    gLamp[peer]       = lamp;
+    gShownCount[peer] = gCount[peer];
+    gVersion[peer]    = ++gTableVersion;
+    gOlder[peer]      = gNewest;
+    if (gNewest != kNone)
+        gNewer[gNewest] = peer;
+    else
+        gOldest = peer;
+    gNewest = peer;
+    gStats.updates++;
+}
+
+static ZSDKBlfLamp peerLamp(int peer)
+{
+    ZSDKBlfLamp lamp = ZSDKBlfLampIdle;
+    for (int d = gFirstDialog[peer]; d != kNone; d = gDialogNext[d])
+    {
+        switch (gDialogState[d])
+        {
+            case E_PEER_CONFIRMED:
+                return ZSDKBlfLampBusy;
+            case E_PEER_TRYING:
+            case E_PEER_PROCEEDING:
+            case E_PEER_EARLY:
+                lamp = ZSDKBlfLampAlerting;
+                break;
+            default:
+                break;
+        }
+    }
+    return lamp;
+}
+
+static void markDirty(int peer)
+{
+    if (gDirty[peer])
+        return;
+    gDirty[peer] = 1;
+    gDirtyList[gDirtyCount++] = peer;
+}
+
+static void freeDialog(int d)
+{
+    ZSDKHandleMapRemove(&gDialogMap, gDialogHandle[d]);
+    gDialogHandle[d] = INVALID_HANDLE;
+    gFreeDialogs[gFreeDialogCount++] = d;
+}
+
+//==============================================================================
+//  Peers (main thread)
+//==============================================================================
+ZSDKBlfPeerId ZSDKBlfAddPeer(UserHandler userId, const char * pName, const char * pNumber)
+{
+    PeerHandler handle = INVALID_HANDLE;
+    if (!pNumber || !gWrapperCtx.AddPeer ||
+        gWrapperCtx.AddPeer(userId, pName ? pName : pNumber, pNumber, &handle) != L_OK)
+    {
+        NSLog(@"ZOIPER: AddPeer failed for %s", pNumber ? pNumber : "");
+        return -1;
+    }
+
+    lockBlf();
+    int peer = -1;
+    if (gFreePeerCount > 0)
+    {
+        peer = gFreePeers[gFreePeerCount - 1];
+        if (ZSDKHandleMapInsert(&gPeerMap, handle, peer))
+            gFreePeerCount--;
+        else
+            peer = -1;
+    }
+    if (peer >= 0)
+    {
+        gPeerHandle[peer]  = handle;
+        gCount[peer]       = 0;
+        gFirstDialog[peer] = kNone;
+        if (gDirty[peer])
+        {
+            // Still listed from before a removal; nothing has been heard yet
+            for (int i = 0; i < gDirtyCount; i++)
+                if (gDirtyList[i] == peer)
+                    gDirtyList[i] = gDirtyList[--gDirtyCount];
+            gDirty[peer] = 0;
+        }
+        strlcpy(gName[peer], pName ? pName : pNumber, sizeof(gName[peer]));
+        strlcpy(gNumber[peer], pNumber, sizeof(gNumber[peer]));
+        publish(peer, ZSDKBlfLampUnknown);
+        gStats.peers++;
+    }
+    unlockBlf();
+
+    if (peer < 0)
+    {
+        NSLog(@"ZOIPER: peer table full");
+        gWrapperCtx.RemovePeer(handle);
+    }
+    return peer;
+}
+
+void ZSDKBlfRemovePeer(ZSDKBlfPeerId peer)
+{
+    lockBlf();
+    PeerHandler handle = INVALID_HANDLE;
+    if (peer >= 0 && peer < kZSDKBlfMaxPeers && gPeerHandle[peer] != INVALID_HANDLE)
+    {
+        handle = gPeerHandle[peer];
+        ZSDKHandleMapRemove(&gPeerMap, handle);
+        gPeerHandle[peer] = INVALID_HANDLE;
+        for (int d = gFirstDialog[peer]; d != kNone; )
+        {
+            int next = gDialogNext[d];
+            freeDialog(d);
+            gStats.dialogs--;
+            d = next;
+        }
+        gFirstDialog[peer] = kNone;
+        gCount[peer] = 0;
+        // A dirty entry left behind is skipped by the flush
+        publish(peer, ZSDKBlfLampRemoved);
+        gFreePeers[gFreePeerCount++] = peer;
+        gStats.peers--;
+    }
+    unlockBlf();
+
+    if (handle != INVALID_HANDLE)
+        gWrapperCtx.RemovePeer(handle);
+}
+
+int ZSDKBlfChangesSince(uint32_t sinceVersion, ZSDKBlfPeerState * pStates, int maxStates,
+                        uint32_t * pVersion)
+{
+    lockBlf();
+    // Walk back from the newest change to the first one after sinceVersion
+    int peer = gNewest;
+    int start = kNone;
+    while (peer != kNone && gVersion[peer] > sinceVersion)
+    {
+        start = peer;
+        peer = gOlder[peer];
+    }
+
+    int count = 0;
+    uint32_t version = (gTableVersion > sinceVersion) ? gTableVersion : sinceVersion;
+    for (peer = start; peer != kNone && count < maxStates; peer = gNewer[peer])
+    {
+        ZSDKBlfPeerState * state = &pStates[count++];
+        state->peer    = peer;
+        state->lamp    = gLamp[peer];
+        state->dialogs = gShownCount[peer];
+        state->version = gVersion[peer];
+        memcpy(state->name, gName[peer], sizeof(state->name));
+        memcpy(state->number, gNumber[peer], sizeof(state->number));
+    }
+    if (peer != kNone && count > 0)
+        version = pStates[count - 1].version;     // buffer full: continue from here
+    unlockBlf();
+
+    if (pVersion)
+        *pVersion = version;
+    return count;
+}
+
+void ZSDKBlfGetStats(ZSDKBlfStats * pStats)
+{
+    lockBlf();
+    *pStats = gStats;
+    pStats->version = gTableVersion;
+    unlockBlf();
+}
+
+//==============================================================================
+//  Delivery
+//==============================================================================
+void ZSDKBlfSetChangedHandler(ZSDKBlfChangedHandler handler)
+{
+    gChangedHandler = handler;
+}
+
+void ZSDKBlfFlush(void)
+{
+    lockBlf();
+    if (gDirtyCount == 0)
+    {
+        unlockBlf();
+        return;
+    }
+
+    uint32_t before = gTableVersion;
+    for (int i = 0; i < gDirtyCount; i++)
+    {
+        int peer = gDirtyList[i];
+        if (!gDirty[peer])
+            continue;
+        gDirty[peer] = 0;
+        if (gPeerHandle[peer] == INVALID_HANDLE)
+            continue;
+        ZSDKBlfLamp lamp = peerLamp(peer);
+        if (lamp != gLamp[peer] || gCount[peer] != gShownCount[peer])
+            publish(peer, lamp);
+    }
+    gDirtyCount = 0;
+    gStats.flushes++;
+
+    BOOL dispatch = gTableVersion != before && !gDispatchPending;
+    if (dispatch)
+        gDispatchPending = YES;
+    unlockBlf();
+
+    if (dispatch)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            lockBlf();
+            gDispatchPending = NO;
+            uint32_t version = gTableVersion;
+            unlockBlf();
+            if (gChangedHandler)
+                gChangedHandler(version);
+        });
+    }
+}
+
+//==============================================================================
+//  Callbacks (poll thread)
+//==============================================================================
+void ZSDKBlfOnDialogAdded(PeerHandler peerId, DialogHandler dialogId, int newCount)
+{
+    lockBlf();
+    gStats.callbacks++;
+    int peer = ZSDKHandleMapFind(&gPeerMap, peerId);
+    if (peer != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        gCount[peer] = (uint16_t)newCount;
+        if (ZSDKHandleMapFind(&gDialogMap, dialogId) == ZSDK_HANDLE_MAP_EMPTY)
+        {
+            int d = (gFreeDialogCount > 0) ? gFreeDialogs[gFreeDialogCount - 1] : kNone;
+            if (d != kNone && ZSDKHandleMapInsert(&gDialogMap, dialogId, d))
+            {
+                gFreeDialogCount--;
+                gDialogHandle[d] = dialogId;
+                gDialogPeer[d]   = peer;
+                gDialogState[d]  = E_PEER_TRYING;
+                gDialogNext[d]   = gFirstDialog[peer];
+                gFirstDialog[peer] = d;
+                gStats.dialogs++;
+            }
+            else
+            {
+                gStats.dialogTableFull++;
+            }
+        }
+        markDirty(peer);
+    }
+    unlockBlf();
+}
+
+void ZSDKBlfOnDialogChanged(DialogHandler dialogId, ePeerState_t state)
+{
+    lockBlf();
+    gStats.callbacks++;
+    int d = ZSDKHandleMapFind(&gDialogMap, dialogId);
+    if (d != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        if (gDialogState[d] != state)
+        {
+            gDialogState[d] = state;
+            markDirty(gDialogPeer[d]);
+        }
+    }
+    else
+    {
+        gStats.unknownDialogs++;
+    }
+    unlockBlf();
+}
+
+void ZSDKBlfOnDialogRemoved(PeerHandler peerId, DialogHandler dialogId, int newCount)
+{
+    lockBlf();
+    gStats.callbacks++;
+    int peer = ZSDKHandleMapFind(&gPeerMap, peerId);
+    if (peer != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        gCount[peer] = (uint16_t)newCount;
+        int * link = &gFirstDialog[peer];
+        while (*link != kNone && gDialogHandle[*link] != dialogId)
+            link = &gDialogNext[*link];
+        if (*link != kNone)
+        {
+            int d = *link;
+            *link = gDialogNext[d];
+            freeDialog(d);
+            gStats.dialogs--;
+        }
+        markDirty(peer);
+    }
+    unlockBlf();
+}
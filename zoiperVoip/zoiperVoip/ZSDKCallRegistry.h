@@ -0,0 +1,81 @@
+//
+//  ZSDKCallRegistry.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Table of the calls currently known to the library, keyed by CallHandler.
+//  Call records live in a preallocated slot array; a ZSDKHandleMap maps
+//  CallHandler -> slot, so lookups from the onCall* callbacks are O(1) and
+//  never allocate.
+//
+//  The slot index of a call is stable for its lifetime and can be used by
+//  other per-call subsystems to index their own dense arrays.
+//
+//  All functions except Lock/Unlock and Slot expect the registry lock to be
+//  held.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKMaxCalls           32
+#define kZSDKCallTableBits      6
+#define kZSDKCallTableSize      (1 << kZSDKCallTableBits)   // >= 2 * kZSDKMaxCalls
+#define kZSDKCallPeerLen        64
+
+typedef enum {
+    ZSDKCallStateFree = 0
+,   ZSDKCallStateDialing            // outgoing, CallCreate() sent
+,   ZSDKCallStateIncoming           // incoming, not answered yet
+,   ZSDKCallStateRinging            // outgoing, remote is ringing
+,   ZSDKCallStateEarlyMedia
+,   ZSDKCallStateActive
+,   ZSDKCallStateHeld
+,   ZSDKCallStateEnded
+} ZSDKCallState;
+
+typedef struct {
+    CallHandler      callId;
+    UserHandler      userId;
+    int              slot;
+    ZSDKCallState    state;
+    eCallDirection_t direction;
+    CodecEnum_t      codec;
+    void *           videoThreadId;
+    int              causeCode;
+    uint64_t         createdUs;
+    uint64_t         ringingUs;
+    uint64_t         acceptedUs;
+    uint64_t         endedUs;
+    char             peer[kZSDKCallPeerLen];
+} ZSDKCall;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+void ZSDKCallRegistryLock(void);
+void ZSDKCallRegistryUnlock(void);
+
+// Returns the existing record for callId or claims a free slot for it.
+// Returns NULL when all kZSDKMaxCalls slots are in use.
+ZSDKCall * ZSDKCallRegistryAdd(CallHandler callId, UserHandler userId,
+                               eCallDirection_t dir, const char * pPeer);
+ZSDKCall * ZSDKCallRegistryFind(CallHandler callId);
+ZSDKCall * ZSDKCallRegistryAtSlot(int slot);
+
+// Slot of the call, or -1 if it is not in the table.  Takes the lock.
+int ZSDKCallRegistrySlot(CallHandler callId);
+void ZSDKCallRegistryRemove(CallHandler callId);
+
+// Most recently added call that is still in the table, or NULL
+ZSDKCall * ZSDKCallRegistryCurrent(void);
+
+int ZSDKCallRegistryCount(void);
+int ZSDKCallRegistrySnapshot(ZSDKCall * pOut, int maxCalls);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,141 @@
+//
+//  ZSDKCallRegistry.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKCallRegistry.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKHandleMap.h"
+#import <pthread.h>
+
+#define EMPTY_SLOT  (-1)
+
+static pthread_mutex_t  gCallLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKCall         gCalls[kZSDKMaxCalls];
+static ZSDKHandleBucket gCallBuckets[kZSDKCallTableSize];
+static ZSDKHandleMap    gCallMap;
+static int              gFreeSlots[kZSDKMaxCalls];
+static int              gFreeCount = -1;    // -1 until first use
+static int              gCurrentSlot = EMPTY_SLOT;
+
+static void initTables(void)
+{
+    ZSDKHandleMapInit(&gCallMap, gCallBuckets, kZSDKCallTableBits);
+    // Hand out low slots first
+    for (int i = 0; i < kZSDKMaxCalls; i++)
+        gFreeSlots[i] = kZSDKMaxCalls - 1 - i;
+    gFreeCount = kZSDKMaxCalls;
+}
+
+void ZSDKCallRegistryLock(void)
+{
+    pthread_mutex_lock(&gCallLock);
+    if (gFreeCount < 0)
+        initTables();
+}
+
+void ZSDKCallRegistryUnlock(void)
+{
+    pthread_mutex_unlock(&gCallLock);
+}
+
+ZSDKCall * ZSDKCallRegistryFind(CallHandler callId)
+{
+    int slot = ZSDKHandleMapFind(&gCallMap, callId);
+    return (slot == ZSDK_HANDLE_MAP_EMPTY) ? NULL : &gCalls[slot];
+}
+
+ZSDKCall * ZSDKCallRegistryAtSlot(int slot)
+{
+    if (slot < 0 || slot >= kZSDKMaxCalls || gCalls[slot].state == ZSDKCallStateFree)
+        return NULL;
+    return &gCalls[slot];
+}
+
+int ZSDKCallRegistrySlot(CallHandler callId)
+{
+    ZSDKCallRegistryLock();
+    int slot = ZSDKHandleMapFind(&gCallMap, callId);
+    ZSDKCallRegistryUnlock();
+    return (slot == ZSDK_HANDLE_MAP_EMPTY) ? -1 : slot;
+}
+
+ZSDKCall * ZSDKCallRegistryAdd(CallHandler callId, UserHandler userId,
+                               eCallDirection_t dir, const char * pPeer)
+{
+    ZSDKCall * call = ZSDKCallRegistryFind(callId);
+    if (call)
+        return call;
+
+    if (gFreeCount == 0)
+    {
+        NSLog(@"ZOIPER: call registry full, dropping call %lu", callId);
+        return NULL;
+    }
+
+    int slot = gFreeSlots[--gFreeCount];
+    call = &gCalls[slot];
+    memset(call, 0, sizeof(*call));
+    call->callId    = callId;
+    call->userId    = userId;
+    call->slot      = slot;
+    call->direction = dir;
+    call->state     = (dir == eIncommingCall) ? ZSDKCallStateIncoming : ZSDKCallStateDialing;
+    call->codec     = CODEC_UNKNOWN;
+    call->createdUs = ZSDKMonotonicMicros();
+    if (pPeer)
+        strlcpy(call->peer, pPeer, sizeof(call->peer));
+
+    ZSDKHandleMapInsert(&gCallMap, callId, slot);
+
+    gCurrentSlot = slot;
+    return call;
+}
+
+void ZSDKCallRegistryRemove(CallHandler callId)
+{
+    int slot = ZSDKHandleMapRemove(&gCallMap, callId);
+    if (slot == ZSDK_HANDLE_MAP_EMPTY)
+        return;
+
+    gCalls[slot].state = ZSDKCallStateFree;
+    gFreeSlots[gFreeCount++] = slot;
+
+    if (gCurrentSlot == slot)
+    {
+        // Fall back to the newest remaining call
+        gCurrentSlot = EMPTY_SLOT;
+        uint64_t newest = 0;
+        for (int i = 0; i < kZSDKMaxCalls; i++)
+        {
+            if (gCalls[i].state != ZSDKCallStateFree && gCalls[i].createdUs >= newest)
+            {
+                newest = gCalls[i].createdUs;
+                gCurrentSlot = i;
+            }
+        }
+    }
+}
+
+ZSDKCall * ZSDKCallRegistryCurrent(void)
+{
+    return ZSDKCallRegistryAtSlot(gCurrentSlot);
+}
+
+int ZSDKCallRegistryCount(void)
+{
+    return kZSDKMaxCalls - gFreeCount;
+}
+
+int ZSDKCallRegistrySnapshot(ZSDKCall * pOut, int maxCalls)
+{
+    int n = 0;
+    for (int i = 0; i < kZSDKMaxCalls && n < maxCalls; i++)
+    {
+        if (gCalls[i].state != ZSDKCallStateFree)
+            pOut[n++] = gCalls[i];
+    }
+    return n;
+}
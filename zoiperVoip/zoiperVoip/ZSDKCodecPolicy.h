@@ -0,0 +1,119 @@
+//
+//  ZSDKCodecPolicy.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Per-account codec selection from network history.  The library's codec
+//  capabilities (bitrate range, VBR/DTX support) are queried once and
+//  cached.  Audio statistics and quality levels of every call update a
+//  smoothed loss/jitter/poor-quality history of its account; when a call
+//  ends the history picks one of two profiles for the account's next calls:
+//
+//  - Wideband: Opus full/wide/narrow with VBR at the default bitrate, then
+//    PCMU and GSM (the default list of configureMediaDefaults).
+//  - Constrained: Opus narrow/wide at low bitrates with DTX and VBR, then
+//    GSM and PCMU.
+//
+//  The profile is applied with ClearUserCodecList/AddUserCodec and
+//  SetUserCodecParameters.  Entering the constrained profile needs a worse
+//  link than leaving it, so a marginal link does not flip every call.  The
+//  history is tied to the network fingerprint (ZSDKTransportProbe) and
+//  starts over, at wideband, on another network.
+//
+//  Each finished call reports the audio payload it sent against what the
+//  wideband codec would have sent at its default bitrate for the same
+//  duration.  Packet headers saved by DTX are not counted.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKCodecHistoryUsers          64
+#define kZSDKCodecCallReports           16
+#define kZSDKCodecNameLen               32
+
+#define kZSDKCodecLossConstrainedPermil 50      // enter the constrained profile
+#define kZSDKCodecLossClearPermil       20      // leave it
+#define kZSDKCodecJitterConstrainedMs   80
+#define kZSDKCodecJitterClearMs         40
+#define kZSDKCodecPoorConstrainedPermil 500     // share of bad quality levels
+#define kZSDKCodecPoorClearPermil       200
+
+#define kZSDKCodecConstrainedBps        12000   // Opus narrow
+#define kZSDKCodecConstrainedWideBps    16000   // Opus wide
+
+typedef enum {
+    ZSDKCodecProfileWideband = 0
+,   ZSDKCodecProfileConstrained
+} ZSDKCodecProfile;
+
+typedef struct {
+    BOOL        supported;
+    int         minBps;
+    int         maxBps;
+    int         defaultBps;
+    int         flags;                  // eCodecFlags_t
+    char        name[kZSDKCodecNameLen];
+} ZSDKCodecCaps;
+
+// Smoothed network history of an account
+typedef struct {
+    int                 lossPermil;
+    int                 jitterMs;
+    int                 poorPermil;
+    int                 samples;
+    ZSDKCodecProfile    profile;
+} ZSDKCodecHistory;
+
+typedef struct {
+    CallHandler         callId;
+    UserHandler         userId;
+    ZSDKCodecProfile    profile;
+    CodecEnum_t         codec;
+    uint64_t            durationMs;     // answer to end
+    uint64_t            bytesSent;      // audio payload
+    int64_t             bytesSaved;     // against the wideband codec; may be < 0
+} ZSDKCodecCallReport;
+
+typedef struct {
+    int                 supportedCodecs;
+    uint64_t            listsApplied;
+    uint64_t            profileChanges;
+    uint64_t            calls;
+    uint64_t            callsConstrained;
+    uint64_t            bytesSent;
+    int64_t             bytesSaved;
+    int                 baselineBps;    // default bitrate of the wideband codec
+} ZSDKCodecPolicyStats;
+
+// Queries the codec capabilities; later calls return the cached count of
+// supported codecs
+int  ZSDKCodecPolicyInit(void);
+const ZSDKCodecCaps * ZSDKCodecPolicyCaps(CodecEnum_t codec);
+
+// Disabled: accounts get their own list cleared and use the default list
+void ZSDKCodecPolicySetEnabled(BOOL enabled);
+
+// Applies the account's profile; called for new accounts and after calls
+void ZSDKCodecPolicyApply(UserHandler userId);
+
+// Decision step: the profile for a history, given the current one
+ZSDKCodecProfile ZSDKCodecPolicyDecide(ZSDKCodecProfile current, int lossPermil,
+                                       int jitterMs, int poorPermil);
+
+BOOL ZSDKCodecPolicyGetHistory(UserHandler userId, ZSDKCodecHistory * pHistory);
+void ZSDKCodecPolicyGetStats(ZSDKCodecPolicyStats * pStats);
+
+// Most recent finished calls, newest first; returns the number copied
+int  ZSDKCodecPolicyCallReports(ZSDKCodecCallReport * pOut, int maxReports);
+
+//==============================================================================
+//  Live calls (poll thread)
+//==============================================================================
+void ZSDKCodecPolicyOnCallAccept(CallHandler callId, int callSlot, UserHandler userId, CodecEnum_t codec);
+void ZSDKCodecPolicyOnStatistics(CallHandler callId, int callSlot, unsigned long outputPayloadBytes,
+                                 int lossPermil, int jitterMs);
+void ZSDKCodecPolicyOnQuality(CallHandler callId, int callSlot, eNetworkQualityLevel_t quality);
+void ZSDKCodecPolicyOnCallEnded(CallHandler callId, int callSlot);
@@ -0,0 +1,412 @@
+//
+//  ZSDKCodecPolicy.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKCodecPolicy.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import "ZSDKTransportProbe.h"
+#import <pthread.h>
+
+typedef struct {
+    CodecEnum_t codec;
+    int         bps;                    // 0: codec default
+    BOOL        dtx;
+} ZSDKCodecChoice;
+
+// Same order as the default list of configureMediaDefaults
+static const ZSDKCodecChoice kWideband[] = {
+    { CODEC_OPUS_FULL,   0, NO }
+,   { CODEC_OPUS_WIDE,   0, NO }
+,   { CODEC_OPUS_NARROW, 0, NO }
+,   { CODEC_PCMU,        0, NO }
+,   { CODEC_GSM,         0, NO }
+,   { CODEC_H263,        0, NO }
+,   { CODEC_H263_PLUS,   0, NO }
+};
+
+static const ZSDKCodecChoice kConstrained[] = {
+    { CODEC_OPUS_NARROW, kZSDKCodecConstrainedBps,     YES }
+,   { CODEC_OPUS_WIDE,   kZSDKCodecConstrainedWideBps, YES }
+,   { CODEC_GSM,         0, NO }
+,   { CODEC_PCMU,        0, NO }
+,   { CODEC_H263,        0, NO }
+,   { CODEC_H263_PLUS,   0, NO }
+};
+
+// Reference for the saved bandwidth: first supported of these
+static const CodecEnum_t kBaselineCodecs[] = { CODEC_OPUS_FULL, CODEC_OPUS_WIDE, CODEC_PCMU };
+
+typedef struct {
+    UserHandler         userId;         // INVALID_HANDLE: entry free
+    uint64_t            fingerprint;    // network the history belongs to
+    uint64_t            lastUsedUs;
+    ZSDKCodecProfile    applied;        // list the library has for the account
+    ZSDKCodecHistory    history;
+} ZSDKCodecUser;
+
+typedef struct {
+    CallHandler         callId;
+    UserHandler         userId;
+    BOOL                active;
+    ZSDKCodecProfile    profile;
+    CodecEnum_t         codec;
+    uint64_t            acceptedUs;
+    unsigned long       payloadBytes;
+} ZSDKCodecCall;
+
+static pthread_mutex_t      gPolicyLock = PTHREAD_MUTEX_INITIALIZER;
+static BOOL                 gCapsReady = NO;
+static ZSDKCodecCaps        gCaps[CODEC_COUNT];
+static BOOL                 gEnabled = YES;
+static ZSDKCodecUser        gUsers[kZSDKCodecHistoryUsers];
+static BOOL                 gUsersReady = NO;
+static ZSDKCodecCall        gCalls[kZSDKMaxCalls];
+static ZSDKCodecCallReport  gReports[kZSDKCodecCallReports];
+static int                  gReportCount = 0;
+static int                  gReportNext = 0;
+static ZSDKCodecPolicyStats gStats;
+
+static void lockPolicy(void)
+{
+    pthread_mutex_lock(&gPolicyLock);
+    if (!gUsersReady)
+    {
+        for (int i = 0; i < kZSDKCodecHistoryUsers; i++)
+            gUsers[i].userId = INVALID_HANDLE;
+        gUsersReady = YES;
+    }
+}
+
+static void unlockPolicy(void)
+{
+    pthread_mutex_unlock(&gPolicyLock);
+}
+
+//==============================================================================
+//  Capabilities
+//==============================================================================
+// Expects the lock to be held
+static void loadCaps(void)
+{
+    if (gCapsReady || !gWrapperCtx.GetCodecCapabilities)
+        return;
+
+    int count = gWrapperCtx.GetCodecCount ? gWrapperCtx.GetCodecCount() : CODEC_COUNT;
+    if (count > CODEC_COUNT)
+        count = CODEC_COUNT;
+    for (int i = 0; i < count; i++)
+    {
+        ZSDKCodecCaps * caps = &gCaps[i];
+        caps->supported = (gWrapperCtx.GetCodecCapabilities((CodecEnum_t)i, &caps->minBps, &caps->maxBps,
+                                                            &caps->defaultBps, &caps->flags,
+                                                            caps->name, sizeof(caps->name)) == L_OK);
+        if (caps->supported)
+            gStats.supportedCodecs++;
+    }
+    for (int i = 0; i < sizeof(kBaselineCodecs) / sizeof(kBaselineCodecs[0]); i++)
+    {
+        if (gCaps[kBaselineCodecs[i]].supported)
+        {
+            gStats.baselineBps = gCaps[kBaselineCodecs[i]].defaultBps;
+            break;
+        }
+    }
+    gCapsReady = YES;
+}
+
+int ZSDKCodecPolicyInit(void)
+{
+    lockPolicy();
+    loadCaps();
+    int supported = gStats.supportedCodecs;
+    unlockPolicy();
+    return supported;
+}
+
+const ZSDKCodecCaps * ZSDKCodecPolicyCaps(CodecEnum_t codec)
+{
+    // Written once under the lock, read-only afterwards
+    if (!gCapsReady || codec < 0 || codec >= CODEC_COUNT)
+        return NULL;
+    return &gCaps[codec];
+}
+
+//==============================================================================
+//  Decision
+//==============================================================================
+ZSDKCodecProfile ZSDKCodecPolicyDecide(ZSDKCodecProfile current, int lossPermil,
+                                       int jitterMs, int poorPermil)
+{
+    if (current == ZSDKCodecProfileWideband)
+    {
+        if (lossPermil >= kZSDKCodecLossConstrainedPermil || jitterMs >= kZSDKCodecJitterConstrainedMs ||
+            poorPermil >= kZSDKCodecPoorConstrainedPermil)
+            return ZSDKCodecProfileConstrained;
+        return ZSDKCodecProfileWideband;
+    }
+
+    if (lossPermil <= kZSDKCodecLossClearPermil && jitterMs <= kZSDKCodecJitterClearMs &&
+        poorPermil <= kZSDKCodecPoorClearPermil)
+        return ZSDKCodecProfileWideband;
+    return ZSDKCodecProfileConstrained;
+}
+
+static int smooth(int average, int sample, int samples)
+{
+    // 1/8 weight: the history spans calls, so one bad call does not flip it
+    return samples ? average + (sample - average) / 8 : sample;
+}
+
+//==============================================================================
+//  Accounts (lock held)
+//==============================================================================
+static ZSDKCodecUser * findUser(UserHandler userId)
+{
+    for (int i = 0; i < kZSDKCodecHistoryUsers; i++)
+    {
+        if (gUsers[i].userId == userId)
+            return &gUsers[i];
+    }
+    return NULL;
+}
+
+// Existing entry or a fresh one, replacing the least recently used
+static ZSDKCodecUser * claimUser(UserHandler userId)
+{
+    ZSDKCodecUser * user = findUser(userId);
+    if (user)
+        return user;
+
+    user = &gUsers[0];
+    for (int i = 0; i < kZSDKCodecHistoryUsers; i++)
+    {
+        if (gUsers[i].userId == INVALID_HANDLE)
+        {
+            user = &gUsers[i];
+            break;
+        }
+        if (gUsers[i].lastUsedUs < user->lastUsedUs)
+            user = &gUsers[i];
+    }
+    memset(user, 0, sizeof(*user));
+    user->userId = userId;
+    return user;
+}
+
+static void applyList(ZSDKCodecUser * user, ZSDKCodecProfile profile)
+{
+    UserHandler userId = user->userId;
+    user->applied = profile;
+    if (!gWrapperCtx.AddUserCodec || !gWrapperCtx.ClearUserCodecList)
+        return;
+
+    gWrapperCtx.ClearUserCodecList(userId);
+    if (!gEnabled)
+        return;
+
+    const ZSDKCodecChoice * list = (profile == ZSDKCodecProfileConstrained) ? kConstrained : kWideband;
+    int count = (profile == ZSDKCodecProfileConstrained) ? sizeof(kConstrained) / sizeof(kConstrained[0])
+                                                         : sizeof(kWideband) / sizeof(kWideband[0]);
+    for (int i = 0; i < count; i++)
+    {
+        const ZSDKCodecCaps * caps = &gCaps[list[i].codec];
+        if (gCapsReady && !caps->supported)
+            continue;
+        if (gWrapperCtx.AddUserCodec(userId, list[i].codec) != L_OK)
+            continue;
+        if (!gCapsReady || !gWrapperCtx.SetUserCodecParameters ||
+            !(caps->flags & (E_CODEC_HAS_VBR_SUPPORT | E_CODEC_HAS_DTX_SUPPORT)))
+            continue;
+
+        int bps = list[i].bps ? list[i].bps : caps->defaultBps;
+        if (bps < caps->minBps)
+            bps = caps->minBps;
+        if (caps->maxBps > 0 && bps > caps->maxBps)
+            bps = caps->maxBps;
+        gWrapperCtx.SetUserCodecParameters(userId, list[i].codec, bps,
+                                           list[i].dtx && (caps->flags & E_CODEC_HAS_DTX_SUPPORT),
+                                           (caps->flags & E_CODEC_HAS_VBR_SUPPORT) != 0);
+    }
+    gStats.listsApplied++;
+}
+
+void ZSDKCodecPolicySetEnabled(BOOL enabled)
+{
+    lockPolicy();
+    gEnabled = enabled;
+    unlockPolicy();
+}
+
+void ZSDKCodecPolicyApply(UserHandler userId)
+{
+    uint64_t fingerprint = ZSDKTransportProbeFingerprint();
+
+    lockPolicy();
+    loadCaps();
+    ZSDKCodecUser * user = claimUser(userId);
+    if (user->fingerprint != fingerprint)
+    {
+        // Another network: what we learnt does not apply
+        memset(&user->history, 0, sizeof(user->history));
+        user->fingerprint = fingerprint;
+    }
+    user->lastUsedUs = ZSDKMonotonicMicros();
+    applyList(user, user->history.profile);
+    unlockPolicy();
+}
+
+BOOL ZSDKCodecPolicyGetHistory(UserHandler userId, ZSDKCodecHistory * pHistory)
+{
+    lockPolicy();
+    ZSDKCodecUser * user = findUser(userId);
+    if (user)
+        *pHistory = user->history;
+    unlockPolicy();
+    return user != NULL;
+}
+
+void ZSDKCodecPolicyGetStats(ZSDKCodecPolicyStats * pStats)
+{
+    lockPolicy();
+    *pStats = gStats;
+    unlockPolicy();
+}
+
+int ZSDKCodecPolicyCallReports(ZSDKCodecCallReport * pOut, int maxReports)
+{
+    lockPolicy();
+    int count = (gReportCount < maxReports) ? gReportCount : maxReports;
+    for (int i = 0; i < count; i++)
+        pOut[i] = gReports[(gReportNext - 1 - i + kZSDKCodecCallReports) % kZSDKCodecCallReports];
+    unlockPolicy();
+    return count;
+}
+
+//==============================================================================
+//  Live calls (poll thread)
+//==============================================================================
+static ZSDKCodecCall * activeCall(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NULL;
+    ZSDKCodecCall * call = &gCalls[callSlot];
+    return (call->active && call->callId == callId) ? call : NULL;
+}
+
+void ZSDKCodecPolicyOnCallAccept(CallHandler callId, int callSlot, UserHandler userId, CodecEnum_t codec)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls || userId == INVALID_HANDLE)
+        return;
+    uint64_t fingerprint = ZSDKTransportProbeFingerprint();
+
+    lockPolicy();
+    ZSDKCodecUser * user = claimUser(userId);
+    if (user->fingerprint != fingerprint)
+    {
+        // The list in use was picked for another network; this call starts
+        // the history of the new one
+        memset(&user->history, 0, sizeof(user->history));
+        user->fingerprint = fingerprint;
+    }
+    user->lastUsedUs = ZSDKMonotonicMicros();
+
+    ZSDKCodecCall * call = &gCalls[callSlot];
+    call->callId       = callId;
+    call->userId       = userId;
+    call->active       = YES;
+    call->profile      = user->applied;
+    call->codec        = codec;
+    call->acceptedUs   = ZSDKMonotonicMicros();
+    call->payloadBytes = 0;
+    unlockPolicy();
+}
+
+void ZSDKCodecPolicyOnStatistics(CallHandler callId, int callSlot, unsigned long outputPayloadBytes,
+                                 int lossPermil, int jitterMs)
+{
+    lockPolicy();
+    ZSDKCodecCall * call = activeCall(callId, callSlot);
+    ZSDKCodecUser * user = call ? findUser(call->userId) : NULL;
+    if (call)
+        call->payloadBytes = outputPayloadBytes;
+    if (user)
+    {
+        ZSDKCodecHistory * history = &user->history;
+        history->lossPermil = smooth(history->lossPermil, lossPermil, history->samples);
+        history->jitterMs   = smooth(history->jitterMs, jitterMs, history->samples);
+        history->samples++;
+    }
+    unlockPolicy();
+}
+
+void ZSDKCodecPolicyOnQuality(CallHandler callId, int callSlot, eNetworkQualityLevel_t quality)
+{
+    if (quality == E_NET_QUALITY_PENDING)
+        return;
+
+    lockPolicy();
+    ZSDKCodecCall * call = activeCall(callId, callSlot);
+    ZSDKCodecUser * user = call ? findUser(call->userId) : NULL;
+    if (user)
+    {
+        ZSDKCodecHistory * history = &user->history;
+        int poor = (quality <= E_NET_QUALITY_BAD) ? 1000 : 0;
+        history->poorPermil = smooth(history->poorPermil, poor, history->samples);
+    }
+    unlockPolicy();
+}
+
+void ZSDKCodecPolicyOnCallEnded(CallHandler callId, int callSlot)
+{
+    lockPolicy();
+    ZSDKCodecCall * call = activeCall(callId, callSlot);
+    if (!call)
+    {
+        unlockPolicy();
+        return;
+    }
+    call->active = NO;
+
+    uint64_t durationMs = (ZSDKMonotonicMicros() - call->acceptedUs) / 1000;
+    int64_t  baseline = (int64_t)gStats.baselineBps * (int64_t)durationMs / 8000;
+    ZSDKCodecCallReport * report = &gReports[gReportNext];
+    report->callId     = call->callId;
+    report->userId     = call->userId;
+    report->profile    = call->profile;
+    report->codec      = call->codec;
+    report->durationMs = durationMs;
+    report->bytesSent  = call->payloadBytes;
+    report->bytesSaved = baseline - (int64_t)call->payloadBytes;
+    gReportNext = (gReportNext + 1) % kZSDKCodecCallReports;
+    if (gReportCount < kZSDKCodecCallReports)
+        gReportCount++;
+
+    gStats.calls++;
+    if (call->profile == ZSDKCodecProfileConstrained)
+        gStats.callsConstrained++;
+    gStats.bytesSent  += report->bytesSent;
+    gStats.bytesSaved += report->bytesSaved;
+
+    // The next call of the account gets the profile its history calls for
+    ZSDKCodecUser * user = findUser(call->userId);
+    if (user && user->history.samples > 0)
+    {
+        ZSDKCodecHistory * history = &user->history;
+        ZSDKCodecProfile profile = ZSDKCodecPolicyDecide(history->profile, history->lossPermil,
+                                                         history->jitterMs, history->poorPermil);
+        history->profile = profile;
+        if (profile != user->applied)
+        {
+            NSLog(@"ZOIPER: codec profile %s for user %lu",
+                  profile == ZSDKCodecProfileConstrained ? "constrained" : "wideband", call->userId);
+            gStats.profileChanges++;
+            applyList(user, profile);
+        }
+    }
+    unlockPolicy();
+}
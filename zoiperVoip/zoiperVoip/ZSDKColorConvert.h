@@ -0,0 +1,80 @@
+//
+//  ZSDKColorConvert.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Capture-side pixel format conversion into the I420 (YUV420p) layout
+//  VideoSendFrame2() expects: NV12 -> I420, BGRA -> I420 (BT.601 limited
+//  range) and plane downscaling.  Row kernels exist in scalar, SSE4.1, AVX2
+//  and NEON flavours; ZSDKColorConvertInit() picks the best one the CPU
+//  supports at runtime.  All kernels produce bit-identical output.
+//
+//  Widths and heights of I420 frames must be even.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef enum {
+    ZSDKKernelAuto = 0
+,   ZSDKKernelScalar
+,   ZSDKKernelSSE4
+,   ZSDKKernelAVX2
+,   ZSDKKernelNEON
+,   ZSDKKernelSSE2                      // audio mix only
+} ZSDKKernel;
+
+typedef enum {
+    ZSDKConvertBenchNV12 = 0            // ZSDKConvertNV12ToI420()
+,   ZSDKConvertBenchBGRA                // ZSDKConvertBGRAToI420()
+,   ZSDKConvertBenchHalve               // ZSDKDownscalePlane2x() of the luma plane
+} ZSDKConvertBenchOp;
+
+typedef struct {
+    uint8_t *   y;
+    uint8_t *   u;
+    uint8_t *   v;
+    int         yStride;
+    int         uStride;
+    int         vStride;
+} ZSDKI420Planes;
+
+// Selects the kernels; ZSDKKernelAuto picks the fastest supported one.
+// Returns the kernel actually in use (falls back when unsupported).
+ZSDKKernel ZSDKColorConvertInit(ZSDKKernel kernel);
+const char * ZSDKColorConvertKernelName(ZSDKKernel kernel);
+
+// Bytes needed for a tightly packed width x height I420 frame
+size_t ZSDKI420FrameSize(int width, int height);
+// Plane pointers of a tightly packed I420 buffer
+void ZSDKI420PlanesInBuffer(uint8_t * pBuffer, int width, int height, ZSDKI420Planes * pPlanes);
+
+void ZSDKConvertNV12ToI420(const uint8_t * pSrcY, int srcYStride,
+                           const uint8_t * pSrcUV, int srcUVStride,
+                           const ZSDKI420Planes * pDst, int width, int height);
+
+void ZSDKConvertBGRAToI420(const uint8_t * pSrc, int srcStride,
+                           const ZSDKI420Planes * pDst, int width, int height);
+
+// Box filter, exactly half size in each direction
+void ZSDKDownscalePlane2x(const uint8_t * pSrc, int srcStride,
+                          uint8_t * pDst, int dstStride, int dstWidth, int dstHeight);
+
+// Any ratio: repeated 2x box steps while the target is at most half the
+// source, then bilinear for the remainder.  pScratch must hold
+// ZSDKScaleScratchSize(srcWidth, srcHeight) bytes when the 2x path is taken.
+size_t ZSDKScaleScratchSize(int srcWidth, int srcHeight);
+void ZSDKScalePlane(const uint8_t * pSrc, int srcStride, int srcWidth, int srcHeight,
+                    uint8_t * pDst, int dstStride, int dstWidth, int dstHeight,
+                    uint8_t * pScratch);
+
+// I420 -> I420 at another size, plane by plane
+void ZSDKScaleI420(const ZSDKI420Planes * pSrc, int srcWidth, int srcHeight,
+                   const ZSDKI420Planes * pDst, int dstWidth, int dstHeight,
+                   uint8_t * pScratch);
+
+// Benchmark: runs op over a random width x height source frames times with
+// the given kernel (not changing the selected one).  Returns nanoseconds
+// per frame, or a negative value if the kernel is not supported here.
+double ZSDKColorConvertBenchmark(ZSDKKernel kernel, ZSDKConvertBenchOp op,
+                                 int width, int height, int frames);
@@ -0,0 +1,605 @@
+//
+//  ZSDKColorConvert.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKColorConvert.h"
+#import "ZSDKPollEngine.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ZSDK_HAVE_X86   1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ZSDK_HAVE_NEON  1
+#include <arm_neon.h>
+#endif
+
+// BT.601 limited range, 8 bit fixed point.  The chroma terms work on the
+// sum of a 2x2 block, hence the extra 2 bits of shift.
+//   Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+//   U = ((112 B - 74 G - 38 R + 512) >> 10) + 128
+//   V = ((112 R - 94 G - 18 B + 512) >> 10) + 128
+
+typedef struct {
+    ZSDKKernel  kernel;
+    void (* splitUV)(const uint8_t * pUV, uint8_t * pU, uint8_t * pV, int count);
+    void (* bgraToY)(const uint8_t * pBGRA, uint8_t * pY, int width);
+    void (* bgraToUV)(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pU, uint8_t * pV, int width);
+    void (* halveRow)(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pDst, int dstWidth);
+} ZSDKConvertKernels;
+
+static inline uint8_t clamp255(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+//==============================================================================
+//  Scalar reference
+//==============================================================================
+static void splitUVScalar(const uint8_t * pUV, uint8_t * pU, uint8_t * pV, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        pU[i] = pUV[2 * i];
+        pV[i] = pUV[2 * i + 1];
+    }
+}
+
+static void bgraToYScalar(const uint8_t * pBGRA, uint8_t * pY, int width)
+{
+    for (int x = 0; x < width; x++, pBGRA += 4)
+        pY[x] = (uint8_t)(((66 * pBGRA[2] + 129 * pBGRA[1] + 25 * pBGRA[0] + 128) >> 8) + 16);
+}
+
+static void bgraToUVScalar(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pU, uint8_t * pV, int width)
+{
+    for (int x = 0; x < width / 2; x++, pRow0 += 8, pRow1 += 8)
+    {
+        int b = pRow0[0] + pRow0[4] + pRow1[0] + pRow1[4];
+        int g = pRow0[1] + pRow0[5] + pRow1[1] + pRow1[5];
+        int r = pRow0[2] + pRow0[6] + pRow1[2] + pRow1[6];
+        pU[x] = clamp255(((112 * b - 74 * g - 38 * r + 512) >> 10) + 128);
+        pV[x] = clamp255(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+    }
+}
+
+static void halveRowScalar(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pDst, int dstWidth)
+{
+    for (int x = 0; x < dstWidth; x++)
+        pDst[x] = (uint8_t)((pRow0[2 * x] + pRow0[2 * x + 1] + pRow1[2 * x] + pRow1[2 * x + 1] + 2) >> 2);
+}
+
+static const ZSDKConvertKernels kScalarKernels = {
+    ZSDKKernelScalar, splitUVScalar, bgraToYScalar, bgraToUVScalar, halveRowScalar
+};
+
+//==============================================================================
+//  SSE4.1 / AVX2 (simulator, macOS hosts)
+//==============================================================================
+#if ZSDK_HAVE_X86
+
+#define ZSDK_SSE4   __attribute__((target("sse4.1")))
+#define ZSDK_AVX2   __attribute__((target("avx2")))
+
+ZSDK_SSE4 static void splitUVSSE4(const uint8_t * pUV, uint8_t * pU, uint8_t * pV, int count)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pUV + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(pUV + 2 * i + 16));
+        __m128i u = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+        __m128i v = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(pU + i), u);
+        _mm_storeu_si128((__m128i *)(pV + i), v);
+    }
+    splitUVScalar(pUV + 2 * i, pU + i, pV + i, count - i);
+}
+
+// Four BGRA pixels widened to 16 bit are two madd pairs per pixel; hadd
+// folds the pairs into one 32 bit luma sum per pixel.
+ZSDK_SSE4 static void bgraToYSSE4(const uint8_t * pBGRA, uint8_t * pY, int width)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i coef  = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i bias  = _mm_set1_epi16(16);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(pBGRA + 4 * x));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(pBGRA + 4 * x + 16));
+        __m128i y0 = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(p0, zero), coef),
+                                    _mm_madd_epi16(_mm_unpackhi_epi8(p0, zero), coef));
+        __m128i y1 = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(p1, zero), coef),
+                                    _mm_madd_epi16(_mm_unpackhi_epi8(p1, zero), coef));
+        y0 = _mm_srli_epi32(_mm_add_epi32(y0, round), 8);
+        y1 = _mm_srli_epi32(_mm_add_epi32(y1, round), 8);
+        __m128i y = _mm_add_epi16(_mm_packs_epi32(y0, y1), bias);
+        _mm_storel_epi64((__m128i *)(pY + x), _mm_packus_epi16(y, y));
+    }
+    bgraToYScalar(pBGRA + 4 * x, pY + x, width - x);
+}
+
+// Sums a 2x2 block per channel: 4 pixels of two rows -> [B G R A] sums of
+// pixel pairs (0,1) and (2,3)
+ZSDK_SSE4 static inline __m128i blockSums(__m128i row0, __m128i row1)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+    return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+ZSDK_SSE4 static inline int packChroma(__m128i q0, __m128i q1, __m128i coef)
+{
+    __m128i c = _mm_hadd_epi32(_mm_madd_epi16(q0, coef), _mm_madd_epi16(q1, coef));
+    c = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(512)), 10), _mm_set1_epi32(128));
+    c = _mm_packs_epi32(c, c);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+}
+
+ZSDK_SSE4 static void bgraToUVSSE4(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pU, uint8_t * pV, int width)
+{
+    const __m128i uCoef = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i vCoef = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i q0 = blockSums(_mm_loadu_si128((const __m128i *)(pRow0 + 4 * x)),
+                               _mm_loadu_si128((const __m128i *)(pRow1 + 4 * x)));
+        __m128i q1 = blockSums(_mm_loadu_si128((const __m128i *)(pRow0 + 4 * x + 16)),
+                               _mm_loadu_si128((const __m128i *)(pRow1 + 4 * x + 16)));
+        int u = packChroma(q0, q1, uCoef);
+        int v = packChroma(q0, q1, vCoef);
+        memcpy(pU + x / 2, &u, 4);
+        memcpy(pV + x / 2, &v, 4);
+    }
+    bgraToUVScalar(pRow0 + 4 * x, pRow1 + 4 * x, pU + x / 2, pV + x / 2, width - x);
+}
+
+ZSDK_SSE4 static void halveRowSSE4(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pDst, int dstWidth)
+{
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i two  = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 8 <= dstWidth; x += 8)
+    {
+        __m128i s = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i *)(pRow0 + 2 * x)), ones),
+                                  _mm_maddubs_epi16(_mm_loadu_si128((const __m128i *)(pRow1 + 2 * x)), ones));
+        s = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+        _mm_storel_epi64((__m128i *)(pDst + x), _mm_packus_epi16(s, s));
+    }
+    halveRowScalar(pRow0 + 2 * x, pRow1 + 2 * x, pDst + x, dstWidth - x);
+}
+
+static const ZSDKConvertKernels kSSE4Kernels = {
+    ZSDKKernelSSE4, splitUVSSE4, bgraToYSSE4, bgraToUVSSE4, halveRowSSE4
+};
+
+// The 256 bit packs work per 128 bit lane; permute4x64 restores the order
+ZSDK_AVX2 static void splitUVAVX2(const uint8_t * pUV, uint8_t * pU, uint8_t * pV, int count)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    int i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pUV + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(pUV + 2 * i + 32));
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, lowBytes), _mm256_and_si256(b, lowBytes));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(pU + i), _mm256_permute4x64_epi64(u, 0xD8));
+        _mm256_storeu_si256((__m256i *)(pV + i), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    splitUVSSE4(pUV + 2 * i, pU + i, pV + i, count - i);
+}
+
+ZSDK_AVX2 static void bgraToYAVX2(const uint8_t * pBGRA, uint8_t * pY, int width)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i coef  = _mm256_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0, 25, 129, 66, 0, 25, 129, 66, 0);
+    const __m256i round = _mm256_set1_epi32(128);
+    const __m256i bias  = _mm256_set1_epi16(16);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i p0 = _mm256_loadu_si256((const __m256i *)(pBGRA + 4 * x));
+        __m256i p1 = _mm256_loadu_si256((const __m256i *)(pBGRA + 4 * x + 32));
+        // Lane 0 holds pixels 0-3 / 8-11, lane 1 pixels 4-7 / 12-15
+        __m256i y0 = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(p0, zero), coef),
+                                       _mm256_madd_epi16(_mm256_unpackhi_epi8(p0, zero), coef));
+        __m256i y1 = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(p1, zero), coef),
+                                       _mm256_madd_epi16(_mm256_unpackhi_epi8(p1, zero), coef));
+        y0 = _mm256_srli_epi32(_mm256_add_epi32(y0, round), 8);
+        y1 = _mm256_srli_epi32(_mm256_add_epi32(y1, round), 8);
+        __m256i y = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), 0xD8);
+        y = _mm256_add_epi16(y, bias);
+        y = _mm256_permute4x64_epi64(_mm256_packus_epi16(y, y), 0xD8);
+        _mm_storeu_si128((__m128i *)(pY + x), _mm256_castsi256_si128(y));
+    }
+    bgraToYSSE4(pBGRA + 4 * x, pY + x, width - x);
+}
+
+ZSDK_AVX2 static void halveRowAVX2(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pDst, int dstWidth)
+{
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i two  = _mm256_set1_epi16(2);
+    int x = 0;
+    for (; x + 16 <= dstWidth; x += 16)
+    {
+        __m256i s = _mm256_add_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *)(pRow0 + 2 * x)), ones),
+                                     _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *)(pRow1 + 2 * x)), ones));
+        s = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2);
+        s = _mm256_permute4x64_epi64(_mm256_packus_epi16(s, s), 0xD8);
+        _mm_storeu_si128((__m128i *)(pDst + x), _mm256_castsi256_si128(s));
+    }
+    halveRowSSE4(pRow0 + 2 * x, pRow1 + 2 * x, pDst + x, dstWidth - x);
+}
+
+// Chroma rows are a quarter of the work; the SSE4.1 kernel is kept there
+static const ZSDKConvertKernels kAVX2Kernels = {
+    ZSDKKernelAVX2, splitUVAVX2, bgraToYAVX2, bgraToUVSSE4, halveRowAVX2
+};
+
+#endif // ZSDK_HAVE_X86
+
+//==============================================================================
+//  NEON (devices)
+//==============================================================================
+#if ZSDK_HAVE_NEON
+
+static void splitUVNEON(const uint8_t * pUV, uint8_t * pU, uint8_t * pV, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16x2_t uv = vld2q_u8(pUV + 2 * i);
+        vst1q_u8(pU + i, uv.val[0]);
+        vst1q_u8(pV + i, uv.val[1]);
+    }
+    splitUVScalar(pUV + 2 * i, pU + i, pV + i, count - i);
+}
+
+static void bgraToYNEON(const uint8_t * pBGRA, uint8_t * pY, int width)
+{
+    const uint8x8_t cr = vdup_n_u8(66);
+    const uint8x8_t cg = vdup_n_u8(129);
+    const uint8x8_t cb = vdup_n_u8(25);
+    const uint8x8_t bias = vdup_n_u8(16);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        uint8x8x4_t p = vld4_u8(pBGRA + 4 * x);
+        uint16x8_t s = vmull_u8(p.val[2], cr);
+        s = vmlal_u8(s, p.val[1], cg);
+        s = vmlal_u8(s, p.val[0], cb);
+        vst1_u8(pY + x, vadd_u8(vrshrn_n_u16(s, 8), bias));
+    }
+    bgraToYScalar(pBGRA + 4 * x, pY + x, width - x);
+}
+
+static inline uint8x8_t chromaNEON(int16x8_t a, int16_t ca, int16x8_t g, int16_t cg, int16x8_t c, int16_t cc)
+{
+    int32x4_t lo = vmull_n_s16(vget_low_s16(a), ca);
+    lo = vmlal_n_s16(lo, vget_low_s16(g), cg);
+    lo = vmlal_n_s16(lo, vget_low_s16(c), cc);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(a), ca);
+    hi = vmlal_n_s16(hi, vget_high_s16(g), cg);
+    hi = vmlal_n_s16(hi, vget_high_s16(c), cc);
+    int16x8_t s = vcombine_s16(vmovn_s32(vrshrq_n_s32(lo, 10)), vmovn_s32(vrshrq_n_s32(hi, 10)));
+    return vqmovun_s16(vaddq_s16(s, vdupq_n_s16(128)));
+}
+
+static void bgraToUVNEON(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pU, uint8_t * pV, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t p0 = vld4q_u8(pRow0 + 4 * x);
+        uint8x16x4_t p1 = vld4q_u8(pRow1 + 4 * x);
+        int16x8_t b = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]));
+        int16x8_t g = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]));
+        int16x8_t r = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]));
+        vst1_u8(pU + x / 2, chromaNEON(b, 112, g, -74, r, -38));
+        vst1_u8(pV + x / 2, chromaNEON(r, 112, g, -94, b, -18));
+    }
+    bgraToUVScalar(pRow0 + 4 * x, pRow1 + 4 * x, pU + x / 2, pV + x / 2, width - x);
+}
+
+static void halveRowNEON(const uint8_t * pRow0, const uint8_t * pRow1, uint8_t * pDst, int dstWidth)
+{
+    int x = 0;
+    for (; x + 8 <= dstWidth; x += 8)
+    {
+        uint16x8_t s = vpadalq_u8(vpaddlq_u8(vld1q_u8(pRow0 + 2 * x)), vld1q_u8(pRow1 + 2 * x));
+        vst1_u8(pDst + x, vrshrn_n_u16(s, 2));
+    }
+    halveRowScalar(pRow0 + 2 * x, pRow1 + 2 * x, pDst + x, dstWidth - x);
+}
+
+static const ZSDKConvertKernels kNEONKernels = {
+    ZSDKKernelNEON, splitUVNEON, bgraToYNEON, bgraToUVNEON, halveRowNEON
+};
+
+#endif // ZSDK_HAVE_NEON
+
+//==============================================================================
+//  Dispatch
+//==============================================================================
+static const ZSDKConvertKernels * gKernels = &kScalarKernels;
+
+static const ZSDKConvertKernels * supportedKernels(ZSDKKernel kernel)
+{
+#if ZSDK_HAVE_NEON
+    if (kernel == ZSDKKernelAuto || kernel == ZSDKKernelNEON)
+        return &kNEONKernels;
+#endif
+#if ZSDK_HAVE_X86
+    __builtin_cpu_init();
+    BOOL avx2 = __builtin_cpu_supports("avx2") != 0;
+    BOOL sse4 = __builtin_cpu_supports("sse4.1") != 0;
+    if ((kernel == ZSDKKernelAuto || kernel == ZSDKKernelAVX2) && avx2)
+        return &kAVX2Kernels;
+    if ((kernel == ZSDKKernelAuto || kernel == ZSDKKernelAVX2 || kernel == ZSDKKernelSSE4) && sse4)
+        return &kSSE4Kernels;
+#endif
+    return &kScalarKernels;
+}
+
+ZSDKKernel ZSDKColorConvertInit(ZSDKKernel kernel)
+{
+    const ZSDKConvertKernels * kernels = supportedKernels(kernel);
+    __atomic_store_n(&gKernels, kernels, __ATOMIC_RELEASE);
+    return kernels->kernel;
+}
+
+const char * ZSDKColorConvertKernelName(ZSDKKernel kernel)
+{
+    switch (kernel)
+    {
+        case ZSDKKernelAuto:    return "auto";
+        case ZSDKKernelScalar:  return "scalar";
+        case ZSDKKernelSSE4:    return "sse4.1";
+        case ZSDKKernelAVX2:    return "avx2";
+        case ZSDKKernelNEON:    return "neon";
+        case ZSDKKernelSSE2:    return "sse2";
+    }
+    return "unknown";
+}
+
+static inline const ZSDKConvertKernels * kernels(void)
+{
+    return __atomic_load_n(&gKernels, __ATOMIC_ACQUIRE);
+}
+
+//==============================================================================
+//  Frame level
+//==============================================================================
+size_t ZSDKI420FrameSize(int width, int height)
+{
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    return (size_t)width * height + 2 * chroma;
+}
+
+void ZSDKI420PlanesInBuffer(uint8_t * pBuffer, int width, int height, ZSDKI420Planes * pPlanes)
+{
+    int chromaWidth = (width + 1) / 2;
+    pPlanes->y       = pBuffer;
+    pPlanes->u       = pBuffer + (size_t)width * height;
+    pPlanes->v       = pPlanes->u + (size_t)chromaWidth * ((height + 1) / 2);
+    pPlanes->yStride = width;
+    pPlanes->uStride = chromaWidth;
+    pPlanes->vStride = chromaWidth;
+}
+
+static void copyPlane(const uint8_t * pSrc, int srcStride, uint8_t * pDst, int dstStride, int width, int height)
+{
+    if (srcStride == width && dstStride == width)
+    {
+        memcpy(pDst, pSrc, (size_t)width * height);
+        return;
+    }
+    for (int y = 0; y < height; y++)
+        memcpy(pDst + (size_t)y * dstStride, pSrc + (size_t)y * srcStride, width);
+}
+
+static void convertNV12(const ZSDKConvertKernels * k,
+                        const uint8_t * pSrcY, int srcYStride,
+                        const uint8_t * pSrcUV, int srcUVStride,
+                        const ZSDKI420Planes * pDst, int width, int height)
+{
+    copyPlane(pSrcY, srcYStride, pDst->y, pDst->yStride, width, height);
+    for (int y = 0; y < height / 2; y++)
+    {
+        k->splitUV(pSrcUV + (size_t)y * srcUVStride,
+                   pDst->u + (size_t)y * pDst->uStride,
+                   pDst->v + (size_t)y * pDst->vStride, width / 2);
+    }
+}
+
+static void convertBGRA(const ZSDKConvertKernels * k, const uint8_t * pSrc, int srcStride,
+                        const ZSDKI420Planes * pDst, int width, int height)
+{
+    // Row pairs keep both source rows in cache for the chroma pass
+    for (int y = 0; y + 1 < height; y += 2)
+    {
+        const uint8_t * row0 = pSrc + (size_t)y * srcStride;
+        const uint8_t * row1 = row0 + srcStride;
+        k->bgraToY(row0, pDst->y + (size_t)y * pDst->yStride, width);
+        k->bgraToY(row1, pDst->y + (size_t)(y + 1) * pDst->yStride, width);
+        k->bgraToUV(row0, row1,
+                    pDst->u + (size_t)(y / 2) * pDst->uStride,
+                    pDst->v + (size_t)(y / 2) * pDst->vStride, width);
+    }
+}
+
+static void downscale2x(const ZSDKConvertKernels * k, const uint8_t * pSrc, int srcStride,
+                        uint8_t * pDst, int dstStride, int dstWidth, int dstHeight)
+{
+    for (int y = 0; y < dstHeight; y++)
+    {
+        const uint8_t * row0 = pSrc + (size_t)(2 * y) * srcStride;
+        k->halveRow(row0, row0 + srcStride, pDst + (size_t)y * dstStride, dstWidth);
+    }
+}
+
+void ZSDKConvertNV12ToI420(const uint8_t * pSrcY, int srcYStride,
+                           const uint8_t * pSrcUV, int srcUVStride,
+                           const ZSDKI420Planes * pDst, int width, int height)
+{
+    convertNV12(kernels(), pSrcY, srcYStride, pSrcUV, srcUVStride, pDst, width, height);
+}
+
+void ZSDKConvertBGRAToI420(const uint8_t * pSrc, int srcStride,
+                           const ZSDKI420Planes * pDst, int width, int height)
+{
+    convertBGRA(kernels(), pSrc, srcStride, pDst, width, height);
+}
+
+void ZSDKDownscalePlane2x(const uint8_t * pSrc, int srcStride,
+                          uint8_t * pDst, int dstStride, int dstWidth, int dstHeight)
+{
+    downscale2x(kernels(), pSrc, srcStride, pDst, dstStride, dstWidth, dstHeight);
+}
+
+// 16.16 fixed point, corners aligned
+static void scalePlaneBilinear(const uint8_t * pSrc, int srcStride, int srcWidth, int srcHeight,
+                               uint8_t * pDst, int dstStride, int dstWidth, int dstHeight)
+{
+    int64_t stepX = (dstWidth > 1) ? ((int64_t)(srcWidth - 1) << 16) / (dstWidth - 1) : 0;
+    int64_t stepY = (dstHeight > 1) ? ((int64_t)(srcHeight - 1) << 16) / (dstHeight - 1) : 0;
+
+    for (int y = 0; y < dstHeight; y++)
+    {
+        int64_t fy = y * stepY;
+        int y0 = (int)(fy >> 16);
+        int y1 = (y0 + 1 < srcHeight) ? y0 + 1 : y0;
+        int wy = (int)((fy >> 8) & 0xFF);
+        const uint8_t * row0 = pSrc + (size_t)y0 * srcStride;
+        const uint8_t * row1 = pSrc + (size_t)y1 * srcStride;
+        uint8_t * out = pDst + (size_t)y * dstStride;
+
+        for (int x = 0; x < dstWidth; x++)
+        {
+            int64_t fx = x * stepX;
+            int x0 = (int)(fx >> 16);
+            int x1 = (x0 + 1 < srcWidth) ? x0 + 1 : x0;
+            int wx = (int)((fx >> 8) & 0xFF);
+            int top    = row0[x0] * (256 - wx) + row0[x1] * wx;
+            int bottom = row1[x0] * (256 - wx) + row1[x1] * wx;
+            out[x] = (uint8_t)((top * (256 - wy) + bottom * wy + 32768) >> 16);
+        }
+    }
+}
+
+size_t ZSDKScaleScratchSize(int srcWidth, int srcHeight)
+{
+    // Two ping-pong buffers: half size and quarter size
+    return (size_t)(srcWidth / 2) * (srcHeight / 2) + (size_t)(srcWidth / 4) * (srcHeight / 4);
+}
+
+void ZSDKScalePlane(const uint8_t * pSrc, int srcStride, int srcWidth, int srcHeight,
+                    uint8_t * pDst, int dstStride, int dstWidth, int dstHeight,
+                    uint8_t * pScratch)
+{
+    uint8_t * halves[2] = { pScratch, pScratch + (size_t)(srcWidth / 2) * (srcHeight / 2) };
+    int pass = 0;
+
+    while (dstWidth * 2 <= srcWidth && dstHeight * 2 <= srcHeight)
+    {
+        int w = srcWidth / 2;
+        int h = srcHeight / 2;
+        if (w == dstWidth && h == dstHeight)
+        {
+            ZSDKDownscalePlane2x(pSrc, srcStride, pDst, dstStride, w, h);
+            return;
+        }
+        uint8_t * next = halves[pass++ & 1];
+        ZSDKDownscalePlane2x(pSrc, srcStride, next, w, w, h);
+        pSrc = next;
+        srcStride = w;
+        srcWidth = w;
+        srcHeight = h;
+    }
+
+    if (srcWidth == dstWidth && srcHeight == dstHeight)
+        copyPlane(pSrc, srcStride, pDst, dstStride, dstWidth, dstHeight);
+    else
+        scalePlaneBilinear(pSrc, srcStride, srcWidth, srcHeight, pDst, dstStride, dstWidth, dstHeight);
+}
+
+void ZSDKScaleI420(const ZSDKI420Planes * pSrc, int srcWidth, int srcHeight,
+                   const ZSDKI420Planes * pDst, int dstWidth, int dstHeight,
+                   uint8_t * pScratch)
+{
+    int scw = (srcWidth + 1) / 2, sch = (srcHeight + 1) / 2;
+    int dcw = (dstWidth + 1) / 2, dch = (dstHeight + 1) / 2;
+    ZSDKScalePlane(pSrc->y, pSrc->yStride, srcWidth, srcHeight, pDst->y, pDst->yStride, dstWidth, dstHeight, pScratch);
+    ZSDKScalePlane(pSrc->u, pSrc->uStride, scw, sch, pDst->u, pDst->uStride, dcw, dch, pScratch);
+    ZSDKScalePlane(pSrc->v, pSrc->vStride, scw, sch, pDst->v, pDst->vStride, dcw, dch, pScratch);
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+static void runOp(const ZSDKConvertKernels * k, ZSDKConvertBenchOp op, const uint8_t * pSrc,
+                  const ZSDKI420Planes * pDst, int width, int height)
+{
+    switch (op)
+    {
+        case ZSDKConvertBenchNV12:
+            convertNV12(k, pSrc, width, pSrc + (size_t)width * height, width, pDst, width, height);
+            break;
+        case ZSDKConvertBenchBGRA:
+            convertBGRA(k, pSrc, width * 4, pDst, width, height);
+            break;
+        case ZSDKConvertBenchHalve:
+            downscale2x(k, pSrc, width, pDst->y, pDst->yStride, width / 2, height / 2);
+            break;
+    }
+}
+
+double ZSDKColorConvertBenchmark(ZSDKKernel kernel, ZSDKConvertBenchOp op,
+                                 int width, int height, int frames)
+{
+    const ZSDKConvertKernels * k = supportedKernels(kernel);
+    if (kernel != ZSDKKernelAuto && k->kernel != kernel)
+        return -1;
+    width  &= ~1;
+    height &= ~1;
+    if (width <= 0 || height <= 0 || frames <= 0 || op > ZSDKConvertBenchHalve)
+        return -1;
+
+    // BGRA is the largest source; NV12 and a single plane fit in it
+    size_t srcBytes = (size_t)width * height * 4;
+    uint8_t * src = malloc(srcBytes);
+    uint8_t * dst = malloc(ZSDKI420FrameSize(width, height));
+    if (!src || !dst)
+    {
+        free(src); free(dst);
+        return -1;
+    }
+
+    uint32_t seed = 0x2545F491;
+    for (size_t i = 0; i < srcBytes; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        src[i] = (uint8_t)(seed >> 24);
+    }
+    ZSDKI420Planes planes;
+    ZSDKI420PlanesInBuffer(dst, width, height, &planes);
+
+    runOp(k, op, src, &planes, width, height);     // warm up
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int f = 0; f < frames; f++)
+        runOp(k, op, src, &planes, width, height);
+    uint64_t elapsedUs = ZSDKMonotonicMicros() - startUs;
+
+    free(src); free(dst);
+    return (double)elapsedUs * 1000.0 / frames;
+}
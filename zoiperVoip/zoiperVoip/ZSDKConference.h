@@ -0,0 +1,67 @@
+//
+//  ZSDKConference.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Conference bridges on top of the library's CreateConference() family.
+//  Keeps the participant list of every bridge (calls that end are dropped
+//  automatically) with a mute flag and a gain per participant.
+//
+//  The library mixes the calls of its own conferences internally and does
+//  not hand out per-participant audio.  For sources the application owns
+//  (external audio mode, media server legs) ZSDKConferenceMix() produces
+//  the N-minus-one mix of a bridge with the participants' gains and mutes
+//  applied, see ZSDKMix.h.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+#import "ZSDKCallRegistry.h"
+
+#define kZSDKMaxConferences         4
+#define kZSDKMaxParticipants        kZSDKMaxCalls
+
+typedef struct {
+    CallHandler callId;
+    float       gain;           // linear, 1.0 = unchanged
+    BOOL        muted;
+} ZSDKParticipant;
+
+typedef struct {
+    uint64_t    frames;
+    uint64_t    mixMaxUs;
+    uint64_t    mixTotalUs;
+} ZSDKConferenceMixStats;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Created started; INVALID_HANDLE if the library or the table is full
+ConferenceHandler ZSDKConferenceCreate(void);
+LIBRESULT ZSDKConferenceDestroy(ConferenceHandler confId);
+LIBRESULT ZSDKConferenceHold(ConferenceHandler confId, BOOL held);
+
+LIBRESULT ZSDKConferenceJoin(ConferenceHandler confId, CallHandler callId);
+LIBRESULT ZSDKConferenceLeave(ConferenceHandler confId, CallHandler callId);
+LIBRESULT ZSDKConferenceSetMuted(ConferenceHandler confId, CallHandler callId, BOOL muted);
+// Linear gain towards the others, clamped to 0 .. 4 (+12 dB)
+LIBRESULT ZSDKConferenceSetGain(ConferenceHandler confId, CallHandler callId, float gain);
+
+// Participants in join order; returns the count or -1 for an unknown bridge
+int  ZSDKConferenceParticipants(ConferenceHandler confId, ZSDKParticipant * pOut, int maxCount);
+
+// From call end (poll thread)
+void ZSDKConferenceOnCallEnded(CallHandler callId);
+
+// One frame of every participant, in the order ZSDKConferenceParticipants()
+// reports; count must match it.  One mixing thread per bridge.
+BOOL ZSDKConferenceMix(ConferenceHandler confId, const int16_t * const * pInputs,
+                       int16_t * const * pOutputs, int count, int samples);
+void ZSDKConferenceGetMixStats(ConferenceHandler confId, ZSDKConferenceMixStats * pStats);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,320 @@
+//
+//  ZSDKConference.mm
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Library calls go through ZSDKWrapper.hpp and are made outside gConfLock:
+//  the poll thread takes it from the call end callback, possibly while the
+//  library is waiting for that callback to return.
+//
+
+#import "ZSDKConference.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKMix.h"
+#import "ZSDKWrapper.hpp"
+#import <pthread.h>
+
+#define kMixScratchWords    ((kZSDKMixBlockSamples * sizeof(int32_t) + \
+                              kZSDKMaxParticipants * (kZSDKMixBlockSamples * sizeof(int16_t) + sizeof(int16_t *)) + \
+                              sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+typedef struct {
+    BOOL                    used;                           // also while being created
+    ConferenceHandler       confId;
+    int                     count;
+    CallHandler             callIds[kZSDKMaxParticipants];
+    int                     gains[kZSDKMaxParticipants];    // Q12, as set
+    BOOL                    muted[kZSDKMaxParticipants];
+    ZSDKConferenceMixStats  stats;
+    uint64_t                scratch[kMixScratchWords];      // mixing thread only
+} ZSDKConference;
+
+static pthread_mutex_t  gConfLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKConference   gConferences[kZSDKMaxConferences];
+
+// Expects gConfLock
+static ZSDKConference * findConference(ConferenceHandler confId)
+{
+    if (confId == INVALID_HANDLE)
+        return NULL;
+    for (int i = 0; i < kZSDKMaxConferences; i++)
+    {
+        if (gConferences[i].used && gConferences[i].confId == confId)
+            return &gConferences[i];
+    }
+    return NULL;
+}
+
+static int findParticipant(ZSDKConference * conf, CallHandler callId)
+{
+    for (int i = 0; i < conf->count; i++)
+    {
+        if (conf->callIds[i] == callId)
+            return i;
+    }
+    return -1;
+}
+
+// Keeps join order, the mix inputs are positional
+static void removeParticipant(ZSDKConference * conf, int index)
+{
+    int tail = conf->count - index - 1;
+    memmove(&conf->callIds[index], &conf->callIds[index + 1], tail * sizeof(conf->callIds[0]));
+    memmove(&conf->gains[index],   &conf->gains[index + 1],   tail * sizeof(conf->gains[0]));
+    memmove(&conf->muted[index],   &conf->muted[index + 1],   tail * sizeof(conf->muted[0]));
+    conf->count--;
+}
+
+//==============================================================================
+//  Bridges
+//==============================================================================
+ConferenceHandler ZSDKConferenceCreate(void)
+{
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = NULL;
+    for (int i = 0; i < kZSDKMaxConferences && !conf; i++)
+    {
+        if (!gConferences[i].used)
+            conf = &gConferences[i];
+    }
+    if (conf)
+    {
+        memset(conf, 0, sizeof(*conf));
+        conf->used   = YES;
+        conf->confId = INVALID_HANDLE;
+    }
+    pthread_mutex_unlock(&gConfLock);
+    if (!conf)
+    {
+        NSLog(@"ZOIPER: conference table full");
+        return INVALID_HANDLE;
+    }
+
+    // Destroyed again by going out of scope unless it starts
+    zsdk::Result<zsdk::Conference> created = zsdk::createConference(gWrapperCtx, 0, 0);
+    if (!created.ok() || !zsdk::start(gWrapperCtx, created.value()).ok())
+    {
+        pthread_mutex_lock(&gConfLock);
+        conf->used = NO;
+        pthread_mutex_unlock(&gConfLock);
+        NSLog(@"ZOIPER: CreateConference failed");
+        return INVALID_HANDLE;
+    }
+
+    ConferenceHandler confId = created.value().release();
+    pthread_mutex_lock(&gConfLock);
+    conf->confId = confId;
+    pthread_mutex_unlock(&gConfLock);
+    return confId;
+}
+
+LIBRESULT ZSDKConferenceDestroy(ConferenceHandler confId)
+{
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    if (conf)
+    {
+        conf->used  = NO;
+        conf->count = 0;
+    }
+    pthread_mutex_unlock(&gConfLock);
+    if (!conf)
+        return L_FAIL;
+
+    zsdk::Conference conference(gWrapperCtx, confId);
+    (void)zsdk::stop(gWrapperCtx, conference);
+    return conference.reset().code();
+}
+
+LIBRESULT ZSDKConferenceHold(ConferenceHandler confId, BOOL held)
+{
+    pthread_mutex_lock(&gConfLock);
+    BOOL known = findConference(confId) != NULL;
+    pthread_mutex_unlock(&gConfLock);
+    if (!known)
+        return L_FAIL;
+
+    zsdk::ConferenceId conference(confId);
+    zsdk::Status res = held ? zsdk::hold(gWrapperCtx, conference) : zsdk::unhold(gWrapperCtx, conference);
+    return res.code();
+}
+
+//==============================================================================
+//  Participants
+//==============================================================================
+// Expects gConfLock; the call may have ended while it was being joined
+static BOOL callAlive(CallHandler callId)
+{
+    return ZSDKCallRegistrySlot(callId) >= 0;
+}
+
+LIBRESULT ZSDKConferenceJoin(ConferenceHandler confId, CallHandler callId)
+{
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    BOOL joinable = conf && conf->count < kZSDKMaxParticipants && findParticipant(conf, callId) < 0;
+    pthread_mutex_unlock(&gConfLock);
+    if (!joinable)
+        return L_FAIL;
+
+    zsdk::ConferenceId conference(confId);
+    zsdk::CallId call(callId);
+    zsdk::Status res = zsdk::join(gWrapperCtx, conference, call);
+    if (!res.ok())
+        return res.code();
+
+    // Checked again: the bridge may have been destroyed or the call ended
+    pthread_mutex_lock(&gConfLock);
+    conf = findConference(confId);
+    BOOL added = conf && conf->count < kZSDKMaxParticipants &&
+                 findParticipant(conf, callId) < 0 && callAlive(callId);
+    if (added)
+    {
+        conf->callIds[conf->count] = callId;
+        conf->gains[conf->count]   = kZSDKMixUnityGain;
+        conf->muted[conf->count]   = NO;
+        conf->count++;
+    }
+    pthread_mutex_unlock(&gConfLock);
+    if (!added)
+    {
+        (void)zsdk::leave(gWrapperCtx, conference, call);
+        return L_FAIL;
+    }
+    return L_OK;
+}
+
+LIBRESULT ZSDKConferenceLeave(ConferenceHandler confId, CallHandler callId)
+{
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    int index = conf ? findParticipant(conf, callId) : -1;
+    if (index >= 0)
+        removeParticipant(conf, index);
+    pthread_mutex_unlock(&gConfLock);
+    if (index < 0)
+        return L_FAIL;
+
+    return zsdk::leave(gWrapperCtx, zsdk::ConferenceId(confId), zsdk::CallId(callId)).code();
+}
+
+LIBRESULT ZSDKConferenceSetMuted(ConferenceHandler confId, CallHandler callId, BOOL muted)
+{
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    BOOL known = conf && findParticipant(conf, callId) >= 0;
+    pthread_mutex_unlock(&gConfLock);
+    if (!known)
+        return L_FAIL;
+
+    zsdk::ConferenceId conference(confId);
+    zsdk::CallId call(callId);
+    zsdk::Status res = muted ? zsdk::mute(gWrapperCtx, conference, call)
+                             : zsdk::unmute(gWrapperCtx, conference, call);
+    if (!res.ok())
+        return res.code();
+
+    pthread_mutex_lock(&gConfLock);
+    conf = findConference(confId);
+    int index = conf ? findParticipant(conf, callId) : -1;
+    if (index >= 0)
+        conf->muted[index] = muted;
+    pthread_mutex_unlock(&gConfLock);
+    return L_OK;
+}
+
+LIBRESULT ZSDKConferenceSetGain(ConferenceHandler confId, CallHandler callId, float gain)
+{
+    int q12 = (int)(gain * kZSDKMixUnityGain + 0.5f);
+    if (q12 < 0)
+        q12 = 0;
+    if (q12 > kZSDKMixMaxGain)
+        q12 = kZSDKMixMaxGain;
+
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    int index = conf ? findParticipant(conf, callId) : -1;
+    if (index >= 0)
+        conf->gains[index] = q12;
+    pthread_mutex_unlock(&gConfLock);
+    return (index >= 0) ? L_OK : L_FAIL;
+}
+
+int ZSDKConferenceParticipants(ConferenceHandler confId, ZSDKParticipant * pOut, int maxCount)
+{
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    int count = -1;
+    if (conf)
+    {
+        count = (conf->count < maxCount) ? conf->count : maxCount;
+        for (int i = 0; i < count; i++)
+        {
+            pOut[i].callId = conf->callIds[i];
+            pOut[i].gain   = (float)conf->gains[i] / kZSDKMixUnityGain;
+            pOut[i].muted  = conf->muted[i];
+        }
+    }
+    pthread_mutex_unlock(&gConfLock);
+    return count;
+}
+
+void ZSDKConferenceOnCallEnded(CallHandler callId)
+{
+    pthread_mutex_lock(&gConfLock);
+    for (int i = 0; i < kZSDKMaxConferences; i++)
+    {
+        ZSDKConference * conf = &gConferences[i];
+        if (!conf->used)
+            continue;
+        int index = findParticipant(conf, callId);
+        if (index >= 0)
+            removeParticipant(conf, index);
+    }
+    pthread_mutex_unlock(&gConfLock);
+}
+
+//==============================================================================
+//  Mixing
+//==============================================================================
+BOOL ZSDKConferenceMix(ConferenceHandler confId, const int16_t * const * pInputs,
+                       int16_t * const * pOutputs, int count, int samples)
+{
+    int gains[kZSDKMaxParticipants];
+
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    if (!conf || conf->count != count)
+    {
+        pthread_mutex_unlock(&gConfLock);
+        return NO;
+    }
+    for (int i = 0; i < count; i++)
+        gains[i] = conf->muted[i] ? 0 : conf->gains[i];
+    pthread_mutex_unlock(&gConfLock);
+
+    // The scratch belongs to the bridge's mixing thread; the slot stays
+    // valid memory even if the bridge is destroyed meanwhile
+    uint64_t startUs = ZSDKMonotonicMicros();
+    ZSDKMixMinusOne(pInputs, gains, count, pOutputs, samples, conf->scratch);
+    uint64_t mixUs = ZSDKMonotonicMicros() - startUs;
+
+    conf->stats.frames++;
+    conf->stats.mixTotalUs += mixUs;
+    if (mixUs > conf->stats.mixMaxUs)
+        conf->stats.mixMaxUs = mixUs;
+    return YES;
+}
+
+// Written by the mixing thread; the copy may mix consecutive frames
+void ZSDKConferenceGetMixStats(ConferenceHandler confId, ZSDKConferenceMixStats * pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    pthread_mutex_lock(&gConfLock);
+    ZSDKConference * conf = findConference(confId);
+    if (conf)
+        *pStats = conf->stats;
+    pthread_mutex_unlock(&gConfLock);
+}
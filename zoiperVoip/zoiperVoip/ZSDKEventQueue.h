@@ -0,0 +1,119 @@
+//
+//  ZSDKEventQueue.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Typed single-producer/single-consumer ring of library events.  The
+//  WrapperCallbacks handlers (poll thread) push fixed-size records; a
+//  dispatcher on the main queue drains them in batches and hands each batch
+//  to the registered handler and, when enabled, to the legacy
+//  NSNotificationCenter bridge.  Only one dispatch to the main queue is
+//  outstanding at any time no matter how many events are pushed.
+//
+//  Outcome events (registration results, call created, accepted, hangup,
+//  rejected, failed, activation) are never dropped for lack of room: the last
+//  kZSDKEventReserved slots of the ring only take outcomes, and outcomes
+//  that still find it full wait in an overflow list moved into the ring by
+//  later pushes and at the end of each poll cycle.  Other events are dropped
+//  and counted when only the reserve is left.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+
+#define kZSDKEventQueueSize     1024    // power of two
+#define kZSDKEventTextLen       32
+#define kZSDKEventMonitors      4
+#define kZSDKEventReserved      128     // ring slots kept for outcome events
+#define kZSDKEventOverflow      256     // outcomes waiting for a full ring
+
+typedef enum {
+    ZSDKEventUserRegistered = 0
+,   ZSDKEventUserUnregistered
+,   ZSDKEventUserRegistrationFailed
+,   ZSDKEventUserRegistrationRetrying
+,   ZSDKEventCallCreate                 // outgoing call created
+,   ZSDKEventCallCreated                // incoming call
+,   ZSDKEventCallRinging
+,   ZSDKEventCallEarlyMedia
+,   ZSDKEventCallAccepted
+,   ZSDKEventCallHangup
+,   ZSDKEventCallRejected
+,   ZSDKEventCallFailed
+,   ZSDKEventCallHeld
+,   ZSDKEventCallUnheld
+,   ZSDKEventVideoStarted
+,   ZSDKEventVideoStopped
+,   ZSDKEventVideoOffered
+,   ZSDKEventVideoFormatSelected
+,   ZSDKEventActivationCompleted
+,   ZSDKEventGeneralFailure
+,   ZSDKEventTypeCount
+} ZSDKEventType;
+
+// 64 bytes; field meaning depends on the type:
+//   handle     CallHandler for call/video events, UserHandler for user events
+//   codec      negotiated codec (accepted, early media, video started)
+//   causeCode  hangup/reject/failure/registration failure cause, fps for
+//              VideoFormatSelected
+//   arg0       UserHandler (call create/created), direction (accepted),
+//              newMsg (registered), retry seconds, isRegister (failure),
+//              remote status (hold/unhold), width (video format),
+//              activation status, error source (general failure)
+//   arg1       oldMsg (registered), auto answer seconds (created),
+//              height (video format)
+//   text       AoR / peer number / callee / error message, truncated
+typedef struct {
+    uint64_t    timestampUs;
+    Handler     handle;
+    uint16_t    type;
+    int16_t     codec;
+    int32_t     causeCode;
+    int32_t     arg0;
+    int32_t     arg1;
+    char        text[kZSDKEventTextLen];
+} ZSDKEvent;
+
+typedef struct {
+    uint64_t    pushed;
+    uint64_t    dropped;            // other events, only the reserve left
+    uint64_t    outcomesDeferred;   // ring full, went through the overflow list
+    uint64_t    outcomesDropped;    // ring and overflow list full
+    uint64_t    batches;            // main-queue drains
+    uint64_t    maxBatch;
+} ZSDKEventQueueStats;
+
+typedef void (^ZSDKEventBatchHandler)(const ZSDKEvent * events, int count);
+
+// Internal observers (async operations, load generator) called before the
+// handler
+typedef void (* ZSDKEventMonitor)(const ZSDKEvent * events, int count);
+
+// Producer side (poll thread only).  Returns NO if the event was dropped.
+BOOL ZSDKEventQueuePush(ZSDKEventType type, Handler handle, int codec,
+                        int causeCode, int arg0, int arg1, const char * pText);
+
+// End of a poll cycle (poll thread): moves deferred outcomes into the ring
+void ZSDKEventQueueFlush(void);
+
+// Consumer side (main queue only, which keeps it single-consumer alongside
+// the dispatcher).  Copies up to maxEvents records; returns the count.
+int  ZSDKEventQueueDrain(ZSDKEvent * pOut, int maxEvents);
+
+// Handler called on the main queue with every drained batch
+void ZSDKEventQueueSetHandler(ZSDKEventBatchHandler handler);
+
+// Monitors called on the main queue with every drained batch.  Called on
+// the main thread these take effect at once, so no batch drained after the
+// call is missed; from other threads they are queued to the main queue.
+void ZSDKEventQueueAddMonitor(ZSDKEventMonitor monitor);
+void ZSDKEventQueueRemoveMonitor(ZSDKEventMonitor monitor);
+
+// Re-post the events the old callbacks used to post as NSNotifications
+// (payload in userInfo).  Enabled by default.
+void ZSDKEventQueueSetNotificationBridge(BOOL enabled);
+
+void ZSDKEventQueueGetStats(ZSDKEventQueueStats * pStats);
+
+const char * ZSDKEventTypeName(ZSDKEventType type);
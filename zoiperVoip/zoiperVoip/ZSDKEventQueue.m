@@ -0,0 +1,312 @@
+//
+//  ZSDKEventQueue.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKEventQueue.h"
+#import "ZSDKPollEngine.h"
+
+#define kZSDKEventDrainBatch    64
+
+typedef struct {
+    // Written by the producer, read by the consumer
+    volatile uint32_t   head __attribute__((aligned(64)));
+    // Written by the consumer, read by the producer
+    volatile uint32_t   tail __attribute__((aligned(64)));
+    ZSDKEvent           events[kZSDKEventQueueSize] __attribute__((aligned(64)));
+} ZSDKEventRing;
+
+static ZSDKEventRing            gRing;
+static ZSDKEventQueueStats      gQueueStats;
+static int                      gDispatchPending = 0;
+static ZSDKEventBatchHandler    gBatchHandler = nil;    // main queue only
+static ZSDKEventMonitor         gMonitors[kZSDKEventMonitors];  // main queue only
+static int                      gMonitorCount = 0;
+static BOOL                     gNotificationBridge = YES;
+
+static const char * const kEventNames[ZSDKEventTypeCount] = {
+    "UserRegistered", "UserUnregistered", "UserRegistrationFailed",
+    "UserRegistrationRetrying", "CallCreate", "CallCreated", "CallRinging",
+    "CallEarlyMedia", "CallAccepted", "CallHangup", "CallRejected",
+    "CallFailed", "CallHeld", "CallUnheld", "VideoStarted", "VideoStopped",
+    "VideoOffered", "VideoFormatSelected", "ActivationCompleted",
+    "GeneralFailure",
+};
+
+const char * ZSDKEventTypeName(ZSDKEventType type)
+{
+    return (type < ZSDKEventTypeCount) ? kEventNames[type] : "Unknown";
+}
+
+//==============================================================================
+//  Legacy notification bridge
+//==============================================================================
+static NSString * notificationNameFor(ZSDKEventType type)
+{
+    switch (type)
+    {
+        case ZSDKEventUserRegistered:
+        case ZSDKEventUserUnregistered:
+            return @"ZSDKctxDidRegistrationSucceeded";
+        case ZSDKEventCallCreate:
+        case ZSDKEventCallCreated:
+        case ZSDKEventCallAccepted:
+        case ZSDKEventCallHangup:
+        case ZSDKEventCallRejected:
+        case ZSDKEventCallFailed:
+        case ZSDKEventCallHeld:
+        case ZSDKEventCallUnheld:
+            return @"ZSDKctxDidCallStatusChanged";
+        case ZSDKEventVideoStarted:
+            return @"ZSDKctxDidVideoStarted";
+        case ZSDKEventVideoStopped:
+            return @"ZSDKctxDidVideoStopped";
+        case ZSDKEventVideoOffered:
+            return @"ZSDKctxDidVideoOffered";
+        case ZSDKEventActivationCompleted:
+            return @"ZSDKctxDidActivationStatusUpdated";
+        default:
+            return nil;
+    }
+}
+
+static void postNotifications(const ZSDKEvent * events, int count)
+{
+    NSNotificationCenter * center = [NSNotificationCenter defaultCenter];
+    for (int i = 0; i < count; i++)
+    {
+        NSString * name = notificationNameFor(events[i].type);
+        if (!name)
+            continue;
+        [center postNotificationName:name object:nil
+                            userInfo:@{ @"event"     : @(events[i].type),
+                                        @"handle"    : @(events[i].handle),
+                                        @"codec"     : @(events[i].codec),
+                                        @"causeCode" : @(events[i].causeCode) }];
+    }
+}
+
+//==============================================================================
+//  Ring
+//==============================================================================
+// Producer side only
+static ZSDKEvent                gOverflow[kZSDKEventOverflow];
+static int                      gOverflowFirst = 0;
+static int                      gOverflowCount = 0;
+
+static BOOL isOutcome(ZSDKEventType type)
+{
+    switch (type)
+    {
+        case ZSDKEventUserRegistered:
+        case ZSDKEventUserUnregistered:
+        case ZSDKEventUserRegistrationFailed:
+        case ZSDKEventCallCreate:
+        case ZSDKEventCallCreated:
+        case ZSDKEventCallAccepted:
+        case ZSDKEventCallHangup:
+        case ZSDKEventCallRejected:
+        case ZSDKEventCallFailed:
+        case ZSDKEventActivationCompleted:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+static void scheduleDispatch(void)
+{
+    // One main-queue dispatch drains everything pushed until it runs
+    if (__atomic_exchange_n(&gDispatchPending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            __atomic_store_n(&gDispatchPending, 0, __ATOMIC_RELEASE);
+
+            ZSDKEvent batch[kZSDKEventDrainBatch];
+            int count;
+            while ((count = ZSDKEventQueueDrain(batch, kZSDKEventDrainBatch)) > 0)
+            {
+                gQueueStats.batches++;
+                if ((uint64_t)count > gQueueStats.maxBatch)
+                    gQueueStats.maxBatch = count;
+                for (int m = 0; m < gMonitorCount; m++)
+                    gMonitors[m](batch, count);
+                if (gBatchHandler)
+                    gBatchHandler(batch, count);
+                if (gNotificationBridge)
+                    postNotifications(batch, count);
+            }
+        });
+    }
+}
+
+static void publish(uint32_t head)
+{
+    __atomic_store_n(&gRing.head, head, __ATOMIC_RELEASE);
+    scheduleDispatch();
+}
+
+// Moves deferred outcomes into the ring, oldest first; returns the new head
+static uint32_t moveOverflow(uint32_t head, uint32_t tail)
+{
+    while (gOverflowCount > 0 && head - tail < kZSDKEventQueueSize)
+    {
+        gRing.events[head & (kZSDKEventQueueSize - 1)] = gOverflow[gOverflowFirst];
+        gOverflowFirst = (gOverflowFirst + 1) % kZSDKEventOverflow;
+        gOverflowCount--;
+        head++;
+    }
+    return head;
+}
+
+BOOL ZSDKEventQueuePush(ZSDKEventType type, Handler handle, int codec,
+                        int causeCode, int arg0, int arg1, const char * pText)
+{
+    uint32_t head = gRing.head;
+    uint32_t tail = __atomic_load_n(&gRing.tail, __ATOMIC_ACQUIRE);
+    if (gOverflowCount > 0)
+        head = moveOverflow(head, tail);
+
+    // Outcomes may use the reserve; once they overflow, later outcomes queue
+    // behind them so the order holds
+    BOOL outcome = isOutcome(type);
+    uint32_t limit = outcome ? kZSDKEventQueueSize : kZSDKEventQueueSize - kZSDKEventReserved;
+    ZSDKEvent * ev;
+    BOOL deferred = NO;
+    if (gOverflowCount == 0 && head - tail < limit)
+    {
+        ev = &gRing.events[head & (kZSDKEventQueueSize - 1)];
+    }
+    else if (outcome && gOverflowCount < kZSDKEventOverflow)
+    {
+        ev = &gOverflow[(gOverflowFirst + gOverflowCount) % kZSDKEventOverflow];
+        deferred = YES;
+        __atomic_fetch_add(&gQueueStats.outcomesDeferred, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        if (outcome)
+        {
+            __atomic_fetch_add(&gQueueStats.outcomesDropped, 1, __ATOMIC_RELAXED);
+            NSLog(@"ZOIPER: event queue full, %s for %lu lost",
+                  ZSDKEventTypeName(type), (unsigned long)handle);
+        }
+        else
+        {
+            __atomic_fetch_add(&gQueueStats.dropped, 1, __ATOMIC_RELAXED);
+        }
+        if (head != gRing.head)
+            publish(head);
+        return NO;
+    }
+
+    ev->timestampUs = ZSDKMonotonicMicros();
+    ev->handle      = handle;
+    ev->type        = (uint16_t)type;
+    ev->codec       = (int16_t)codec;
+    ev->causeCode   = causeCode;
+    ev->arg0        = arg0;
+    ev->arg1        = arg1;
+    if (pText)
+        strlcpy(ev->text, pText, sizeof(ev->text));
+    else
+        ev->text[0] = '\0';
+    __atomic_fetch_add(&gQueueStats.pushed, 1, __ATOMIC_RELAXED);
+
+    if (deferred)
+        gOverflowCount++;
+    else
+        head++;
+    if (head != gRing.head)
+        publish(head);
+    return YES;
+}
+
+void ZSDKEventQueueFlush(void)
+{
+    if (gOverflowCount == 0)
+        return;
+
+    uint32_t head = gRing.head;
+    uint32_t tail = __atomic_load_n(&gRing.tail, __ATOMIC_ACQUIRE);
+    head = moveOverflow(head, tail);
+    if (head != gRing.head)
+        publish(head);
+}
+
+int ZSDKEventQueueDrain(ZSDKEvent * pOut, int maxEvents)
+{
+    uint32_t tail = gRing.tail;
+    uint32_t head = __atomic_load_n(&gRing.head, __ATOMIC_ACQUIRE);
+    uint32_t avail = head - tail;
+    int count = (avail < (uint32_t)maxEvents) ? (int)avail : maxEvents;
+
+    for (int i = 0; i < count; i++)
+        pOut[i] = gRing.events[(tail + i) & (kZSDKEventQueueSize - 1)];
+
+    __atomic_store_n(&gRing.tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+void ZSDKEventQueueSetHandler(ZSDKEventBatchHandler handler)
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        gBatchHandler = handler;
+    });
+}
+
+static void onMainQueue(dispatch_block_t block)
+{
+    if ([NSThread isMainThread])
+        block();
+    else
+        dispatch_async(dispatch_get_main_queue(), block);
+}
+
+void ZSDKEventQueueAddMonitor(ZSDKEventMonitor monitor)
+{
+    onMainQueue(^{
+        for (int m = 0; m < gMonitorCount; m++)
+        {
+            if (gMonitors[m] == monitor)
+                return;
+        }
+        if (gMonitorCount < kZSDKEventMonitors)
+            gMonitors[gMonitorCount++] = monitor;
+        else
+            NSLog(@"ERROR SETUP event monitor");
+    });
+}
+
+void ZSDKEventQueueRemoveMonitor(ZSDKEventMonitor monitor)
+{
+    onMainQueue(^{
+        for (int m = 0; m < gMonitorCount; m++)
+        {
+            if (gMonitors[m] == monitor)
+            {
+                gMonitors[m] = gMonitors[--gMonitorCount];
+                return;
+            }
+        }
+    });
+}
+
+void ZSDKEventQueueSetNotificationBridge(BOOL enabled)
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        gNotificationBridge = enabled;
+    });
+}
+
+void ZSDKEventQueueGetStats(ZSDKEventQueueStats * pStats)
+{
+    pStats->pushed   = __atomic_load_n(&gQueueStats.pushed, __ATOMIC_RELAXED);
+    pStats->dropped  = __atomic_load_n(&gQueueStats.dropped, __ATOMIC_RELAXED);
+    pStats->outcomesDeferred = __atomic_load_n(&gQueueStats.outcomesDeferred, __ATOMIC_RELAXED);
+    pStats->outcomesDropped  = __atomic_load_n(&gQueueStats.outcomesDropped, __ATOMIC_RELAXED);
+    pStats->batches  = gQueueStats.batches;
+    pStats->maxBatch = gQueueStats.maxBatch;
+}
@@ -0,0 +1,65 @@
+//
+//  ZSDKExternalAudio.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  External audio mode (E_AUDIO_DRV_EXTERNAL).  Instead of the SDK opening
+//  the audio device, a real-time thread owned by us calls
+//  ExternalAudioFrame() once per frame on a fixed clock between
+//  onExternalAudioRequested and the synchronous stop callback.
+//
+//  The application feeds microphone samples into the input ring and drains
+//  mixer output from the output ring; both are single-producer /
+//  single-consumer and lock-free, so any source (device, file, virtual
+//  loopback) can drive them from its own thread.  A frame with too little
+//  input is sent as silence and output that does not fit is dropped, both
+//  counted.  The latency reported to the SDK is what is actually queued in
+//  the rings plus the device latency set by the application.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKExtAudioRingSamples    8192    // per direction, power of two
+#define kZSDKExtAudioMaxFrame       960     // 20 ms at 48 kHz
+
+typedef struct {
+    uint64_t    frames;             // ExternalAudioFrame() calls
+    uint64_t    underruns;          // input short of a frame, silence sent
+    uint64_t    overruns;           // output ring full, frame dropped
+    uint64_t    lateFrames;         // woke up more than a frame late
+    uint64_t    processMaxUs;       // duration of ExternalAudioFrame()
+    int         latencyMs;          // last reported to the SDK
+    int         latencyMaxMs;
+    int         sampleRate;
+    int         samplesPerFrame;
+    BOOL        running;
+} ZSDKExtAudioStats;
+
+// Selects external mode; must be called before InitLibrary.  Returns NO if
+// the frame size is out of range.
+BOOL ZSDKExternalAudioConfigure(int sampleRateHz, int samplesPerFrame);
+BOOL ZSDKExternalAudioEnabled(void);
+
+// From InitLibrary: switches the driver and calls ExternalAudioInit()
+LIBRESULT ZSDKExternalAudioInstall(void);
+
+// From onExternalAudioRequested (poll thread): installs the stop callback
+// and starts the audio thread
+void ZSDKExternalAudioOnRequested(void);
+
+// Application side, one thread per direction.  Return the samples moved.
+int  ZSDKExternalAudioWrite(const int16_t * pSamples, int count);
+int  ZSDKExternalAudioRead(int16_t * pSamples, int count);
+
+// Latency of the device or source outside the rings, added to the report
+void ZSDKExternalAudioSetDeviceLatency(int latencyMs);
+
+// Optional observer of every mixer output frame and the time its
+// ExternalAudioFrame() took; runs on the audio thread, must not block
+typedef void (* ZSDKExtAudioTap)(const int16_t * pOut, int samples, uint64_t processUs);
+void ZSDKExternalAudioSetTap(ZSDKExtAudioTap tap);
+
+void ZSDKExternalAudioGetStats(ZSDKExtAudioStats * pStats);
@@ -0,0 +1,329 @@
+//
+//  ZSDKExternalAudio.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKExternalAudio.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import <pthread.h>
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import <mach/thread_policy.h>
+
+#define kRingMask           (kZSDKExtAudioRingSamples - 1)
+#define kResyncFrames       4       // further behind than this: restart the clock
+
+typedef struct {
+    int16_t     samples[kZSDKExtAudioRingSamples];
+    uint32_t    head;               // advanced by the producer only
+    uint32_t    tail;               // advanced by the consumer only
+} ZSDKSampleRing;
+
+static ZSDKSampleRing       gInput;     // application -> audio thread
+static ZSDKSampleRing       gOutput;    // audio thread -> application
+static int16_t              gInFrame[kZSDKExtAudioMaxFrame];
+static int16_t              gOutFrame[kZSDKExtAudioMaxFrame];
+
+static BOOL                 gEnabled = NO;
+static int                  gSampleRate;
+static int                  gFrameSamples;
+static int                  gDeviceLatencyMs;
+static ZSDKExtAudioTap      gTap;
+
+static pthread_mutex_t      gAudioLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t            gAudioThread;
+static BOOL                 gThreadCreated = NO;   // not joined yet
+static int                  gStopRequested;
+
+// Written by the audio thread only
+static ZSDKExtAudioStats    gStats;
+
+//==============================================================================
+//  Sample rings
+//==============================================================================
+static uint32_t ringFill(ZSDKSampleRing * ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t ringWrite(ZSDKSampleRing * ring, const int16_t * pSamples, uint32_t count)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t room = kZSDKExtAudioRingSamples - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    if (count > room)
+        count = room;
+
+    uint32_t at = head & kRingMask;
+    uint32_t first = kZSDKExtAudioRingSamples - at;
+    if (first > count)
+        first = count;
+    memcpy(&ring->samples[at], pSamples, first * sizeof(int16_t));
+    memcpy(ring->samples, pSamples + first, (count - first) * sizeof(int16_t));
+
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+// pSamples NULL discards
+static uint32_t ringRead(ZSDKSampleRing * ring, int16_t * pSamples, uint32_t count)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t fill = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    if (count > fill)
+        count = fill;
+
+    if (pSamples)
+    {
+        uint32_t at = tail & kRingMask;
+        uint32_t first = kZSDKExtAudioRingSamples - at;
+        if (first > count)
+            first = count;
+        memcpy(pSamples, &ring->samples[at], first * sizeof(int16_t));
+        memcpy(pSamples + first, ring->samples, (count - first) * sizeof(int16_t));
+    }
+
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+//==============================================================================
+//  Audio thread
+//==============================================================================
+static uint64_t microsToTicks(uint64_t us)
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return us * 1000 * timebase.denom / timebase.numer;
+}
+
+// Time constraint scheduling: the thread needs a slice every frame period
+static void setRealtime(uint64_t periodUs)
+{
+    thread_time_constraint_policy_data_t policy;
+    policy.period      = (uint32_t)microsToTicks(periodUs);
+    policy.computation = (uint32_t)microsToTicks(periodUs / 4);
+    policy.constraint  = (uint32_t)microsToTicks(periodUs / 2);
+    policy.preemptible = 1;
+
+    if (thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                          (thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT) != KERN_SUCCESS)
+        NSLog(@"ZOIPER: external audio thread runs without time constraint policy");
+}
+
+static void * audioThreadMain( void * arg )
+{
+    pthread_setname_np("zsdk.audio");
+
+    const int n = gFrameSamples;
+    const uint64_t frameUs = (uint64_t)n * 1000000 / gSampleRate;
+    setRealtime(frameUs);
+
+    // Whatever queued up while stopped is stale; keep at most one frame
+    uint32_t stale = ringFill(&gInput);
+    if (stale > (uint32_t)n)
+        ringRead(&gInput, NULL, stale - n);
+
+    uint64_t startUs = ZSDKMonotonicMicros();
+    uint64_t frames = 0;
+    int latencyQ4 = -1;     // smoothed, 1/16 ms
+
+    while (!__atomic_load_n(&gStopRequested, __ATOMIC_ACQUIRE))
+    {
+        // Due times derive from the sample count so the rate does not drift
+        uint64_t dueUs = startUs + frames * n * 1000000 / gSampleRate;
+        uint64_t now = ZSDKMonotonicMicros();
+        if (now < dueUs)
+        {
+            mach_wait_until(microsToTicks(dueUs));
+        }
+        else if (now - dueUs > frameUs)
+        {
+            gStats.lateFrames++;
+            if (now - dueUs > kResyncFrames * frameUs)
+            {
+                startUs = now;
+                frames = 0;
+            }
+        }
+
+        if (ringFill(&gInput) >= (uint32_t)n)
+        {
+            ringRead(&gInput, gInFrame, n);
+        }
+        else
+        {
+            memset(gInFrame, 0, n * sizeof(int16_t));
+            gStats.underruns++;
+        }
+
+        // What the rings hold now is what the frame waits behind on each side
+        int queued = (int)((ringFill(&gInput) + ringFill(&gOutput)) * 1000 / gSampleRate) +
+                     __atomic_load_n(&gDeviceLatencyMs, __ATOMIC_RELAXED);
+        latencyQ4 = (latencyQ4 < 0) ? queued * 16 : latencyQ4 + (queued * 16 - latencyQ4) / 8;
+        int latencyMs = (latencyQ4 + 8) / 16;
+
+        uint64_t t0 = ZSDKMonotonicMicros();
+        LIBRESULT res = gWrapperCtx.ExternalAudioFrame(gInFrame, gOutFrame, n, latencyMs);
+        uint64_t processUs = ZSDKMonotonicMicros() - t0;
+
+        gStats.frames++;
+        gStats.latencyMs = latencyMs;
+        if (latencyMs > gStats.latencyMaxMs)
+            gStats.latencyMaxMs = latencyMs;
+        if (processUs > gStats.processMaxUs)
+            gStats.processMaxUs = processUs;
+
+        if (res != L_OK)
+        {
+            NSLog(@"ZOIPER: external audio stopped by the library");
+            break;
+        }
+
+        ZSDKExtAudioTap tap = __atomic_load_n(&gTap, __ATOMIC_ACQUIRE);
+        if (tap)
+            tap(gOutFrame, n, processUs);
+
+        if (kZSDKExtAudioRingSamples - ringFill(&gOutput) >= (uint32_t)n)
+            ringWrite(&gOutput, gOutFrame, n);
+        else
+            gStats.overruns++;
+
+        frames++;
+    }
+
+    __atomic_store_n(&gStats.running, NO, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Expects gAudioLock
+static void joinAudioThread(void)
+{
+    if (!gThreadCreated)
+        return;
+    __atomic_store_n(&gStopRequested, 1, __ATOMIC_RELEASE);
+    pthread_join(gAudioThread, NULL);
+    gThreadCreated = NO;
+}
+
+// pfExternalAudioSyncStopCbk: must not return before ExternalAudioFrame()
+// calls have ended
+static void onExternalAudioSyncStop( void * pUserData )
+{
+    pthread_mutex_lock(&gAudioLock);
+    if (gThreadCreated && pthread_equal(pthread_self(), gAudioThread))
+    {
+        // Stopped from inside ExternalAudioFrame(); the loop ends once it
+        // returns and the thread is joined by the next start
+        __atomic_store_n(&gStopRequested, 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        joinAudioThread();
+    }
+    pthread_mutex_unlock(&gAudioLock);
+}
+
+//==============================================================================
+//  Setup
+//==============================================================================
+BOOL ZSDKExternalAudioConfigure(int sampleRateHz, int samplesPerFrame)
+{
+    if (sampleRateHz <= 0 || samplesPerFrame <= 0 || samplesPerFrame > kZSDKExtAudioMaxFrame)
+        return NO;
+
+    gSampleRate   = sampleRateHz;
+    gFrameSamples = samplesPerFrame;
+    gEnabled      = YES;
+    return YES;
+}
+
+BOOL ZSDKExternalAudioEnabled(void)
+{
+    return gEnabled;
+}
+
+LIBRESULT ZSDKExternalAudioInstall(void)
+{
+    gWrapperCtx.SetAudioDriverConfiguration(E_AUDIO_DRV_EXTERNAL, gSampleRate, gFrameSamples);
+
+    LIBRESULT res = gWrapperCtx.ExternalAudioInit(gSampleRate, gFrameSamples);
+    if (res != L_OK)
+        NSLog(@"ERROR SETUP ExternalAudioInit");
+    return res;
+}
+
+void ZSDKExternalAudioOnRequested(void)
+{
+    // Set after each request, before the first ExternalAudioFrame(); not
+    // under gAudioLock, which the stop callback takes
+    gWrapperCtx.SetExternalAudioSyncStopCallback(onExternalAudioSyncStop, NULL);
+
+    pthread_mutex_lock(&gAudioLock);
+    if (__atomic_load_n(&gStats.running, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_unlock(&gAudioLock);
+        return;
+    }
+
+    // A thread that ended on its own (L_FAIL, stop from inside) is reaped here
+    joinAudioThread();
+
+    __atomic_store_n(&gStopRequested, 0, __ATOMIC_RELEASE);
+    gStats.sampleRate      = gSampleRate;
+    gStats.samplesPerFrame = gFrameSamples;
+    __atomic_store_n(&gStats.running, YES, __ATOMIC_RELEASE);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_set_qos_class_np(&attr, QOS_CLASS_USER_INTERACTIVE, 0);
+    if (pthread_create(&gAudioThread, &attr, audioThreadMain, NULL) == 0)
+    {
+        gThreadCreated = YES;
+    }
+    else
+    {
+        NSLog(@"ERROR SETUP external audio thread");
+        __atomic_store_n(&gStats.running, NO, __ATOMIC_RELEASE);
+    }
+    pthread_attr_destroy(&attr);
+    pthread_mutex_unlock(&gAudioLock);
+}
+
+//==============================================================================
+//  Application side
+//==============================================================================
+int ZSDKExternalAudioWrite(const int16_t * pSamples, int count)
+{
+    if (count <= 0)
+        return 0;
+    return (int)ringWrite(&gInput, pSamples, (uint32_t)count);
+}
+
+int ZSDKExternalAudioRead(int16_t * pSamples, int count)
+{
+    if (count <= 0)
+        return 0;
+    return (int)ringRead(&gOutput, pSamples, (uint32_t)count);
+}
+
+void ZSDKExternalAudioSetDeviceLatency(int latencyMs)
+{
+    __atomic_store_n(&gDeviceLatencyMs, latencyMs < 0 ? 0 : latencyMs, __ATOMIC_RELAXED);
+}
+
+void ZSDKExternalAudioSetTap(ZSDKExtAudioTap tap)
+{
+    __atomic_store_n(&gTap, tap, __ATOMIC_RELEASE);
+}
+
+// Counters are single words written by the audio thread; the copy may mix
+// values from consecutive frames
+void ZSDKExternalAudioGetStats(ZSDKExtAudioStats * pStats)
+{
+    *pStats = gStats;
+}
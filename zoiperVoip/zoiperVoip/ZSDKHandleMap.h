@@ -0,0 +1,38 @@
+//
+//  ZSDKHandleMap.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Fixed-size open-addressing map from a library Handler to a slot index.
+//  Linear probing with backward-shift deletion, Fibonacci hashing.  The
+//  bucket array is supplied by the owner (usually a static array) so the
+//  map never allocates.  Not thread safe; owners provide their own locking.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+
+#define ZSDK_HANDLE_MAP_EMPTY   (-1)
+
+typedef struct {
+    Handler     handle;
+    int         slot;           // ZSDK_HANDLE_MAP_EMPTY when the bucket is free
+} ZSDKHandleBucket;
+
+typedef struct {
+    ZSDKHandleBucket *  buckets;
+    unsigned            bits;   // table size is 1 << bits
+    int                 count;
+} ZSDKHandleMap;
+
+void ZSDKHandleMapInit(ZSDKHandleMap * pMap, ZSDKHandleBucket * pBuckets, unsigned bits);
+
+// Slot stored for handle, or ZSDK_HANDLE_MAP_EMPTY
+int  ZSDKHandleMapFind(const ZSDKHandleMap * pMap, Handler handle);
+
+// Fails when the table is full or the handle is already present
+BOOL ZSDKHandleMapInsert(ZSDKHandleMap * pMap, Handler handle, int slot);
+
+// Returns the slot that was stored for handle, or ZSDK_HANDLE_MAP_EMPTY
+int  ZSDKHandleMapRemove(ZSDKHandleMap * pMap, Handler handle);
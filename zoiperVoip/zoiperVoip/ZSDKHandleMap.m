@@ -0,0 +1,87 @@
+//
+//  ZSDKHandleMap.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKHandleMap.h"
+
+static inline unsigned bucketFor(const ZSDKHandleMap * pMap, Handler handle)
+{
+    // Handlers are mostly small sequential integers; spread them out
+    return (unsigned)(((uint64_t)handle * 11400714819323198485ull) >> (64 - pMap->bits));
+}
+
+static int findBucket(const ZSDKHandleMap * pMap, Handler handle)
+{
+    unsigned mask = (1u << pMap->bits) - 1;
+    unsigned b = bucketFor(pMap, handle);
+    for (unsigned n = 0; n <= mask; n++)
+    {
+        if (pMap->buckets[b].slot == ZSDK_HANDLE_MAP_EMPTY)
+            return -1;
+        if (pMap->buckets[b].handle == handle)
+            return (int)b;
+        b = (b + 1) & mask;
+    }
+    return -1;
+}
+
+void ZSDKHandleMapInit(ZSDKHandleMap * pMap, ZSDKHandleBucket * pBuckets, unsigned bits)
+{
+    pMap->buckets = pBuckets;
+    pMap->bits    = bits;
+    pMap->count   = 0;
+    for (unsigned i = 0; i < (1u << bits); i++)
+        pBuckets[i].slot = ZSDK_HANDLE_MAP_EMPTY;
+}
+
+int ZSDKHandleMapFind(const ZSDKHandleMap * pMap, Handler handle)
+{
+    int b = findBucket(pMap, handle);
+    return (b < 0) ? ZSDK_HANDLE_MAP_EMPTY : pMap->buckets[b].slot;
+}
+
+BOOL ZSDKHandleMapInsert(ZSDKHandleMap * pMap, Handler handle, int slot)
+{
+    unsigned mask = (1u << pMap->bits) - 1;
+    if ((unsigned)pMap->count >= mask || findBucket(pMap, handle) >= 0)
+        return NO;
+
+    unsigned b = bucketFor(pMap, handle);
+    while (pMap->buckets[b].slot != ZSDK_HANDLE_MAP_EMPTY)
+        b = (b + 1) & mask;
+    pMap->buckets[b].handle = handle;
+    pMap->buckets[b].slot   = slot;
+    pMap->count++;
+    return YES;
+}
+
+int ZSDKHandleMapRemove(ZSDKHandleMap * pMap, Handler handle)
+{
+    int b = findBucket(pMap, handle);
+    if (b < 0)
+        return ZSDK_HANDLE_MAP_EMPTY;
+
+    unsigned mask = (1u << pMap->bits) - 1;
+    int slot = pMap->buckets[b].slot;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    unsigned hole = (unsigned)b;
+    unsigned next = (hole + 1) & mask;
+    while (pMap->buckets[next].slot != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        unsigned home = bucketFor(pMap, pMap->buckets[next].handle);
+        // Move the entry back unless its home bucket lies in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            pMap->buckets[hole] = pMap->buckets[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    pMap->buckets[hole].slot = ZSDK_HANDLE_MAP_EMPTY;
+    pMap->count--;
+    return slot;
+}
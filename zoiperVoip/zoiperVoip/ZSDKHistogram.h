@@ -0,0 +1,39 @@
+//
+//  ZSDKHistogram.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Fixed-size latency histogram in the HdrHistogram layout: values below
+//  2 * 2^kZSDKHistogramSubBits get a bucket each, above that every power of
+//  two is split into 2^kZSDKHistogramSubBits linear sub-buckets, so any
+//  64-bit value is recorded with a relative error under 1 / 2^SubBits (about
+//  3%) without allocation.  Percentiles report the highest value equivalent
+//  to the bucket, clamped to the recorded maximum.  Not thread safe.
+//
+
+#import <Foundation/Foundation.h>
+
+#define kZSDKHistogramSubBits   5
+#define kZSDKHistogramBuckets   ((2 << kZSDKHistogramSubBits) + \
+                                 (63 - kZSDKHistogramSubBits) * (1 << kZSDKHistogramSubBits))
+
+typedef struct {
+    uint64_t    count;
+    uint64_t    min;
+    uint64_t    max;
+    uint64_t    sum;
+    uint32_t    buckets[kZSDKHistogramBuckets];
+} ZSDKHistogram;
+
+void     ZSDKHistogramReset(ZSDKHistogram * pHist);
+void     ZSDKHistogramRecord(ZSDKHistogram * pHist, uint64_t value);
+
+// percentile in 0..100; 0 when nothing was recorded
+uint64_t ZSDKHistogramPercentile(const ZSDKHistogram * pHist, double percentile);
+double   ZSDKHistogramMean(const ZSDKHistogram * pHist);
+
+// {"count":..,"minUs":..,"meanUs":..,"p50Us":..,"p90Us":..,"p99Us":..,
+//  "p999Us":..,"maxUs":..} into pBuf; returns the length snprintf() would
+// have written
+int      ZSDKHistogramFormatJSON(const ZSDKHistogram * pHist, char * pBuf, size_t size);
@@ -0,0 +1,94 @@
+//
+//  ZSDKHistogram.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKHistogram.h"
+#import <math.h>
+
+#define kSubCount       (1 << kZSDKHistogramSubBits)
+#define kLinearCount    (2 << kZSDKHistogramSubBits)
+
+static int bucketIndex(uint64_t value)
+{
+    if (value < kLinearCount)
+        return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kZSDKHistogramSubBits;
+    int sub = (int)(value >> shift) - kSubCount;
+    return kLinearCount + (shift - 1) * kSubCount + sub;
+}
+
+// Highest value that lands in bucket index
+static uint64_t bucketHighest(int index)
+{
+    if (index < kLinearCount)
+        return (uint64_t)index;
+    int shift = (index - kLinearCount) / kSubCount + 1;
+    uint64_t sub = (uint64_t)(kSubCount + (index - kLinearCount) % kSubCount);
+    return (sub << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+void ZSDKHistogramReset(ZSDKHistogram * pHist)
+{
+    memset(pHist, 0, sizeof(*pHist));
+}
+
+void ZSDKHistogramRecord(ZSDKHistogram * pHist, uint64_t value)
+{
+    if (pHist->count == 0 || value < pHist->min)
+        pHist->min = value;
+    if (value > pHist->max)
+        pHist->max = value;
+    pHist->count++;
+    pHist->sum += value;
+    pHist->buckets[bucketIndex(value)]++;
+}
+
+uint64_t ZSDKHistogramPercentile(const ZSDKHistogram * pHist, double percentile)
+{
+    if (pHist->count == 0)
+        return 0;
+    if (percentile < 0.0)
+        percentile = 0.0;
+    if (percentile > 100.0)
+        percentile = 100.0;
+
+    uint64_t target = (uint64_t)ceil(percentile / 100.0 * (double)pHist->count);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kZSDKHistogramBuckets; i++)
+    {
+        seen += pHist->buckets[i];
+        if (seen >= target)
+        {
+            uint64_t value = bucketHighest(i);
+            return value < pHist->max ? value : pHist->max;
+        }
+    }
+    return pHist->max;
+}
+
+double ZSDKHistogramMean(const ZSDKHistogram * pHist)
+{
+    return pHist->count ? (double)pHist->sum / (double)pHist->count : 0.0;
+}
+
+int ZSDKHistogramFormatJSON(const ZSDKHistogram * pHist, char * pBuf, size_t size)
+{
+    return snprintf(pBuf, size,
+                    "{\"count\":%llu,\"minUs\":%llu,\"meanUs\":%.1f,\"p50Us\":%llu,"
+                    "\"p90Us\":%llu,\"p99Us\":%llu,\"p999Us\":%llu,\"maxUs\":%llu}",
+                    (unsigned long long)pHist->count,
+                    (unsigned long long)pHist->min,
+                    ZSDKHistogramMean(pHist),
+                    (unsigned long long)ZSDKHistogramPercentile(pHist, 50.0),
+                    (unsigned long long)ZSDKHistogramPercentile(pHist, 90.0),
+                    (unsigned long long)ZSDKHistogramPercentile(pHist, 99.0),
+                    (unsigned long long)ZSDKHistogramPercentile(pHist, 99.9),
+                    (unsigned long long)pHist->max);
+}
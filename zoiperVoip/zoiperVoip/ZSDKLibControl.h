@@ -12,14 +12,28 @@
 
 @class ZSDKLibControl;
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 extern WrapperContext gWrapperCtx;
-extern int  gUserId;
+extern UserHandler gUserId;     // default account, INVALID_HANDLE if none
 extern BOOL gbRegistrationOk;
-extern BOOL gbInCall;
 extern BOOL gbActivated;
-extern CallHandler gCallId;
 
-extern void * gVideoThreadId;
+// LoadWrapperContext() unless replaced (e.g. ZSDKStubLoadWrapperContext)
+// before InitLibrary()
+typedef LIBRESULT (* ZSDKLibraryLoader)( WrapperContext * ctx );
+void SetLibraryLoader(ZSDKLibraryLoader loader);
 
 void InitLibrary(int SIPPort, int IAXPort);
 void PollLibrary();
+
+// onDebugLog is only installed while ZSDKLog runs, so the library does not
+// format messages nobody writes.  Before InitLibrary() this is picked up
+// from ZSDKLogRunning().
+void SetDebugLogEnabled(BOOL enabled);
+
+#if defined(__cplusplus)
+}
+#endif
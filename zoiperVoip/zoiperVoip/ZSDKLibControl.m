@@ -9,18 +9,33 @@
 
 
 #import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import "ZSDKUserManager.h"
+#import "ZSDKEventQueue.h"
+#import "ZSDKVideoReceiver.h"
+#import "ZSDKVideoSender.h"
+#import "ZSDKRateControl.h"
+#import "ZSDKTelemetry.h"
+#import "ZSDKExternalAudio.h"
+#import "ZSDKConference.h"
+#import "ZSDKSoundCache.h"
+#import "ZSDKLog.h"
+#import "ZSDKTransportProbe.h"
+#import "ZSDKStunManager.h"
+#import "ZSDKCodecPolicy.h"
+#import "ZSDKPresence.h"
+#import "ZSDKBlf.h"
+#import "ZSDKMessaging.h"
+#import "ZSDKRecorder.h"
 WrapperContext gWrapperCtx;
 WrapperCallbacks * gWrapperCbk;
 BOOL gInitialized = NO;
 BOOL gLogStarted = NO;
 BOOL gbRegistrationOk = NO;
-BOOL gbInCall = NO;
 BOOL gbActivated = NO;
-int  gUserId = 0;
-CallHandler gCallId;
-
-// Video call settings
-void * gVideoThreadId = NULL;
+UserHandler gUserId = INVALID_HANDLE;
+static ZSDKLibraryLoader gLibraryLoader = LoadWrapperContext;
 
 //==============================================================================
 //  Callback declarations
@@ -45,7 +60,18 @@ void onCallRinging( CallHandler CallID );
 void onEarlyMedia( CallHandler CallID, AudioCodecEnum_t codec );
 void onCallReject( CallHandler CallID, int CauseCode );
 void onCallFailure( CallHandler CallID, int CauseCode );
+void onCallHoldCompleted( CallHandler CallID, LIBRESULT remoteStatus );
+void onCallUnholdCompleted( CallHandler CallID, LIBRESULT remoteStatus );
 void onCallDTMFResult( CallHandler CallID, LIBRESULT lRes );
+void onCallNetworkQualityLevel( CallHandler CallId, eCallChannel_t CallChannel,
+                                eNetworkQualityLevel_t QualityLevel );
+void onCallAudioLevels( CallHandler CallId, double inlevel, double outlevel );
+void onCallNetworkStatistics( CallHandler CallId, eCallChannel_t CallChannel,
+        unsigned long TotalInputPackets, unsigned long TotalInputBytes, unsigned long TotalInputBytesPayload,
+        unsigned long CurrentInputBitrate, unsigned long AverageInputBitrate,
+        unsigned long TotalOutputPackets, unsigned long TotalOutputBytes, unsigned long TotalOutputBytesPayload,
+        unsigned long CurrentOutputBitrate, unsigned long AverageOutputBitrate,
+        int CurrentInputLossPermil, int CurrentInputJitterMs );
 void onGeneralFailure( ErrorSources_t errsrc, const char * msg, int causeCode );
 static void onActivationCompleted( eActivationStatus_t status, const char * reason,
                            const char * certificate, const char * build,
@@ -56,13 +82,44 @@ void onVideoStopped( CallHandler CallId, void * pThreadId);
 void onVideoFormatSelected( CallHandler CallId, eCallDirection_t dir,
                                 int width, int height, float fps );
 void onVideoOffered( CallHandler CallId );
-
+void onExternalAudioRequested( void );
+void onSoundLoadCompleted( SoundHandler soundId, LIBRESULT result, int causeCode );
+void onDebugLog( const char * pMessage );
+void onProbeState( ProbeHandler ProbeId, eProbeState_t newState );
+void onProbeError( ProbeHandler ProbeId, eProbeState_t curState, int causeCode );
+void onProbeSuccess( ProbeHandler ProbeId, eUserTransport_t Trans );
+void onProbeFailed( ProbeHandler ProbeId, int CauseCode );
+void onContactStatus( UserHandler UserId, ContactHandler ContactId, eContactState_t eStatus,
+                     const char * pNote );
+void onContactTerminated( UserHandler UserId, ContactHandler ContactId,
+                         eRejectionType_t eType, const char * pReason );
+void onContactRetrying( UserHandler UserId, ContactHandler ContactId );
+void onPublicationSucceeded( UserHandler UserId );
+void onPublicationRetrying( UserHandler UserId );
+void onPublicationFailed( UserHandler UserId );
+void onPeerDialogAdded( PeerHandler PeerId, DialogHandler DialogId, const char * pDialogIdStr,
+                       int NewCount );
+void onPeerDialogChanged( DialogHandler DialogId, ePeerState_t NewState );
+void onPeerDialogRemoved( PeerHandler PeerId, DialogHandler DialogId, int NewCount );
+void onMessageReceived( UserHandler UserId, ContactHandler ContactId, const char * contactPhone,
+                       const char * contactName, const char * contentType, int contentLength,
+                       const char * body );
+void onMessageSent( UserHandler UserId, ContactHandler ContactId, MessageHandler MessageId,
+                   int contentLength, const char * body );
+void onMessageFailed( UserHandler UserId, ContactHandler ContactId, MessageHandler MessageId,
+                     int contentLength, const char * body, int releaseCause );
+
+
+void SetLibraryLoader(ZSDKLibraryLoader loader)
+{
+    gLibraryLoader = loader ? loader : LoadWrapperContext;
+}
 
 void InitLibrary(int SIPPort, int IAXPort)
 {
 	memset( &gWrapperCtx, 0, sizeof( gWrapperCtx ) );
 	gWrapperCtx.ctxVersion = WRAPPER_CONTEXT_VERSION;
-	if( LoadWrapperContext( &gWrapperCtx ) != L_OK )
+	if( gLibraryLoader( &gWrapperCtx ) != L_OK )
 	{
 		return;
 	}
@@ -96,13 +153,23 @@ void InitLibrary(int SIPPort, int IAXPort)
 	gWrapperCbk->onCallRejected             = onCallReject;
 	gWrapperCbk->onCallFailure              = onCallFailure;
 	gWrapperCbk->onUnknownCall              = onUnknownCall;
+	gWrapperCbk->onCallHoldCompleted        = onCallHoldCompleted;
+	gWrapperCbk->onCallUnholdCompleted      = onCallUnholdCompleted;
     
     // Handle DTMF callbacks
 	gWrapperCbk->onCallDTMFResult           = onCallDTMFResult;
     
+    // Handle network quality callbacks
+	gWrapperCbk->onCallNetworkQualityLevel  = onCallNetworkQualityLevel;
+	gWrapperCbk->onCallNetworkStatistics    = onCallNetworkStatistics;
+	gWrapperCbk->onCallAudioLevels          = onCallAudioLevels;
+    
     // Handle failure callback
 	gWrapperCbk->onGeneralFailure           = onGeneralFailure;
     
+    // Handle debug log messages, only while ZSDKLog runs
+	gWrapperCbk->onDebugLog                 = ZSDKLogRunning() ? onDebugLog : NULL;
+    
     // Handle video management callbacks
     gWrapperCbk->onVideoStarted             = onVideoStarted;
     gWrapperCbk->onVideoStopped             = onVideoStopped;
@@ -112,9 +179,55 @@ void InitLibrary(int SIPPort, int IAXPort)
     // Handle Activation status callback
     gWrapperCbk->onActivationCompleted      = onActivationCompleted;
     
+    // Handle external audio requests
+    gWrapperCbk->onExternalAudioRequested   = onExternalAudioRequested;
+    
+    // Handle asynchronous sound loads (sound cache preloading)
+    gWrapperCbk->onSoundLoadCompleted       = onSoundLoadCompleted;
+    
+    // Handle transport probes (ZSDKTransportProbe)
+    gWrapperCbk->onProbeState               = onProbeState;
+    gWrapperCbk->onProbeError               = onProbeError;
+    gWrapperCbk->onProbeSuccess             = onProbeSuccess;
+    gWrapperCbk->onProbeFailed              = onProbeFailed;
+    
+    // Handle STUN discovery and port pre-warming (ZSDKStunManager)
+    gWrapperCbk->onStunNetworkDiscovered    = onStunNetworkDiscovered;
+    gWrapperCbk->onStunPortReady            = onStunPortReady;
+    
+    // Handle presence (ZSDKPresence)
+    gWrapperCbk->onContactStatus            = onContactStatus;
+    gWrapperCbk->onContactTerminated        = onContactTerminated;
+    gWrapperCbk->onContactRetrying          = onContactRetrying;
+    gWrapperCbk->onPublicationSucceeded     = onPublicationSucceeded;
+    gWrapperCbk->onPublicationRetrying      = onPublicationRetrying;
+    gWrapperCbk->onPublicationFailed        = onPublicationFailed;
+    
+    // Handle BLF peer dialogs (ZSDKBlf)
+    gWrapperCbk->onPeerDialogAdded          = onPeerDialogAdded;
+    gWrapperCbk->onPeerDialogChanged        = onPeerDialogChanged;
+    gWrapperCbk->onPeerDialogRemoved        = onPeerDialogRemoved;
+    
+    // Handle instant messages (ZSDKMessaging)
+    gWrapperCbk->onMessageReceived          = onMessageReceived;
+    gWrapperCbk->onMessageSent              = onMessageSent;
+    gWrapperCbk->onMessageFailed            = onMessageFailed;
+
 
     //
-    gWrapperCtx.SetAudioDriverConfiguration(E_AUDIO_DRV_DEFAULT, 8000, 0);
+    if (ZSDKExternalAudioEnabled())
+    {
+        // The application drives the audio through the rings; no device
+        // fallback
+        if (ZSDKExternalAudioInstall() != L_OK)
+        {
+            NSLog(@"ERROR SETUP external audio");
+            gInitialized = NO;
+            return;
+        }
+    }
+    else
+        gWrapperCtx.SetAudioDriverConfiguration(E_AUDIO_DRV_DEFAULT, 8000, 0);
     //gWrapperCtx.SetAudioResamplerType(E_AUDIO_DRV_RESAMPLER_IPHONE);
     
 	res = gWrapperCtx.InitCallManager( gWrapperCbk, SIPPort, IAXPort );
@@ -133,7 +246,13 @@ void InitLibrary(int SIPPort, int IAXPort)
 void PollLibrary()
 {
     if (gInitialized)
+    {
         gWrapperCtx.PollEvents();
+        ZSDKPresenceFlush();
+        ZSDKBlfFlush();
+        ZSDKMessagingFlush();
+        ZSDKEventQueueFlush();
+    }
 }
 
 //==============================================================================
@@ -142,30 +261,42 @@ void PollLibrary()
 void onUserRegistered( UserHandler userId, const char * pAor, int newMsg,
                         int oldMsg )
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKUserManagerOnRegistered(userId, newMsg, oldMsg);
     gbRegistrationOk = YES;
     NSLog(@"ZOIPER: onUserRegistered");
-    [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidRegistrationSucceeded" object:nil];
+    ZSDKEventQueuePush(ZSDKEventUserRegistered, userId, CODEC_UNKNOWN, 0,
+                       newMsg, oldMsg, pAor);
 }
 
 void onUserRegistrationFailure(UserHandler userId, int isRegister, int causeCode)
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKUserManagerOnFailure(userId, isRegister, causeCode);
     gbRegistrationOk = NO;
     NSLog(@"ZOIPER: onUserRegistrationFailure");
+    ZSDKEventQueuePush(ZSDKEventUserRegistrationFailed, userId, CODEC_UNKNOWN,
+                       causeCode, isRegister, 0, NULL);
 }
 
 void onUserRegistrationRetrying( UserHandler UserId, int IsRegistering,
                                 int RetrySeconds )
 {
+    ZSDKPollEngineNoteEvent();
+    if (IsRegistering)
+        ZSDKUserManagerOnRetrying(UserId, RetrySeconds);
     NSLog(@"ZOIPER: onUserRegistrationRetrying");
+    ZSDKEventQueuePush(ZSDKEventUserRegistrationRetrying, UserId, CODEC_UNKNOWN,
+                       0, RetrySeconds, IsRegistering, NULL);
 }
 
 void onUserUnregistered( UserHandler userId )
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKUserManagerOnUnregistered(userId);
     gbRegistrationOk = NO;
     NSLog(@"ZOIPER: onUserUnregistered");
-    [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidRegistrationSucceeded" object:nil];
+    ZSDKEventQueuePush(ZSDKEventUserUnregistered, userId, CODEC_UNKNOWN, 0, 0, 0, NULL);
 }
 
 //==============================================================================
@@ -173,59 +304,169 @@ void onUserUnregistered( UserHandler userId )
 //==============================================================================
 void onCallCreate( UserHandler UserID, CallHandler CallID, const char * pCallee )
 {
-    gbInCall = YES;
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryAdd(CallID, UserID, eOutgoingCall, pCallee);
+    int slot = call ? call->slot : -1;
+    uint64_t createdUs = call ? call->createdUs : 0;
+    ZSDKCallRegistryUnlock();
+    if (!call)
+    {
+        // No free slot: hang up rather than lose track of the call
+        gWrapperCtx.CallHangup(CallID);
+        return;
+    }
+    ZSDKStunManagerOnCallCreate(UserID, CallID, slot, createdUs);
+    ZSDKTelemetryStart(CallID, slot);
+    ZSDKPollEngineSetActive(YES);
     NSLog(@"ZOIPER: onCallCreate");
-    [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidCallStatusChanged" object:nil];
+    ZSDKEventQueuePush(ZSDKEventCallCreate, CallID, CODEC_UNKNOWN, 0,
+                       (int)UserID, 0, pCallee);
 }
 
 void onCallCreated( UserHandler UserID, CallHandler CallID, const char * pPeer,
                    const char * pPeerNumber, const char * pPeerURI,
                    const char * pDNID, int AutoAnswerSecs )
 {
-     NSLog(@"ZOIPER: onCallCreated");
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryAdd(CallID, UserID, eIncommingCall,
+                                          pPeerNumber ? pPeerNumber : pPeer);
+    int slot = call ? call->slot : -1;
+    ZSDKCallRegistryUnlock();
+    if (!call)
+    {
+        // No free slot: refuse rather than lose track of the call
+        gWrapperCtx.CallReject(CallID);
+        return;
+    }
+    ZSDKTelemetryStart(CallID, slot);
+    ZSDKPollEngineSetActive(YES);
+    NSLog(@"ZOIPER: onCallCreated");
+    ZSDKEventQueuePush(ZSDKEventCallCreated, CallID, CODEC_UNKNOWN, 0,
+                       (int)UserID, AutoAnswerSecs, pPeerNumber ? pPeerNumber : pPeer);
 }
 
 void onUnknownCall( CallHandler CallID, const char * pPeer,
                    const char * pPeerNumber, const char * pPeerURI,
                    const char * pDNID )
 {
+    ZSDKPollEngineNoteEvent();
 }
 
 void onCallAccept( CallHandler CallID, AudioCodecEnum_t codec,
                   eCallDirection_t call_direction )
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallID);
+    int slot = call ? call->slot : -1;
+    UserHandler userId = call ? call->userId : INVALID_HANDLE;
+    if (call)
+    {
+        call->state      = ZSDKCallStateActive;
+        call->codec      = codec;
+        call->direction  = call_direction;
+        call->acceptedUs = ZSDKMonotonicMicros();
+    }
+    ZSDKCallRegistryUnlock();
+    ZSDKStunManagerOnFirstMedia(CallID, slot);
+    ZSDKCodecPolicyOnCallAccept(CallID, slot, userId, codec);
+    ZSDKEventQueuePush(ZSDKEventCallAccepted, CallID, codec, 0, call_direction, 0, NULL);
+}
+
+// Common tail of hangup/reject/failure: the call is gone from the library
+static void callEnded( CallHandler CallID, ZSDKEventType type, int CauseCode )
+{
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallID);
+    int slot = call ? call->slot : -1;
+    if (call && call->videoThreadId)
+    {
+        ZSDKVideoReceiverDetach(CallID, call->slot);
+        ZSDKVideoSenderDetach(CallID, call->slot);
+        ZSDKRateControlStop(CallID, call->slot);
+    }
+    ZSDKCallRegistryRemove(CallID);
+    int remaining = ZSDKCallRegistryCount();
+    ZSDKCallRegistryUnlock();
+    ZSDKConferenceOnCallEnded(CallID);
+    ZSDKRecorderOnCallEnded(CallID);
+    ZSDKCodecPolicyOnCallEnded(CallID, slot);
+    ZSDKPollEngineSetActive(remaining > 0);
+    ZSDKEventQueuePush(type, CallID, CODEC_UNKNOWN, CauseCode, 0, 0, NULL);
 }
 
 void onCallHangup( CallHandler CallID, int CauseCode )
 {
-    gbInCall = NO;
-    [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidCallStatusChanged" object:nil];
+    ZSDKPollEngineNoteEvent();
+    callEnded(CallID, ZSDKEventCallHangup, CauseCode);
 }
 
 void onCallRinging( CallHandler CallID )
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallID);
+    if (call)
+    {
+        call->state     = ZSDKCallStateRinging;
+        call->ringingUs = ZSDKMonotonicMicros();
+    }
+    ZSDKCallRegistryUnlock();
+    ZSDKEventQueuePush(ZSDKEventCallRinging, CallID, CODEC_UNKNOWN, 0, 0, 0, NULL);
 }
 
 void onEarlyMedia( CallHandler CallID, AudioCodecEnum_t codec )
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallID);
+    int slot = call ? call->slot : -1;
+    if (call)
+    {
+        call->state = ZSDKCallStateEarlyMedia;
+        call->codec = codec;
+    }
+    ZSDKCallRegistryUnlock();
+    ZSDKStunManagerOnFirstMedia(CallID, slot);
+    ZSDKEventQueuePush(ZSDKEventCallEarlyMedia, CallID, codec, 0, 0, 0, NULL);
 }
 
 void onCallReject( CallHandler CallID, int CauseCode )
 {
-    gbInCall = NO;
+    ZSDKPollEngineNoteEvent();
     NSLog(@"ZOIPER: onCallReject");
-    [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidCallStatusChanged" object:nil];
+    callEnded(CallID, ZSDKEventCallRejected, CauseCode);
 }
 
 void onCallFailure( CallHandler CallID, int CauseCode )
 {
-    gbInCall = NO;
+    ZSDKPollEngineNoteEvent();
     NSLog(@"ZOIPER: onCallFailure");
-    [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidCallStatusChanged" object:nil];
+    callEnded(CallID, ZSDKEventCallFailed, CauseCode);
+}
+
+void onCallHoldCompleted( CallHandler CallID, LIBRESULT remoteStatus )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallID);
+    if (call)
+        call->state = ZSDKCallStateHeld;
+    ZSDKCallRegistryUnlock();
+    ZSDKEventQueuePush(ZSDKEventCallHeld, CallID, CODEC_UNKNOWN, 0, (int)remoteStatus, 0, NULL);
+}
+
+void onCallUnholdCompleted( CallHandler CallID, LIBRESULT remoteStatus )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallID);
+    if (call)
+        call->state = ZSDKCallStateActive;
+    ZSDKCallRegistryUnlock();
+    ZSDKEventQueuePush(ZSDKEventCallUnheld, CallID, CODEC_UNKNOWN, 0, (int)remoteStatus, 0, NULL);
 }
 
 //==============================================================================
@@ -233,6 +474,49 @@ void onCallFailure( CallHandler CallID, int CauseCode )
 //==============================================================================
 void onCallDTMFResult( CallHandler CallID, LIBRESULT lRes )
 {
+    ZSDKPollEngineNoteEvent();
+}
+
+//==============================================================================
+// Network quality callbacks
+//==============================================================================
+void onCallNetworkQualityLevel( CallHandler CallId, eCallChannel_t CallChannel,
+                                eNetworkQualityLevel_t QualityLevel )
+{
+    ZSDKPollEngineNoteEvent();
+    int slot = ZSDKCallRegistrySlot(CallId);
+    ZSDKTelemetryOnQuality(CallId, slot, CallChannel, QualityLevel);
+    if (CallChannel == E_CHANNEL_VIDEO)
+        ZSDKRateControlOnQuality(CallId, slot, QualityLevel);
+    else
+        ZSDKCodecPolicyOnQuality(CallId, slot, QualityLevel);
+}
+
+void onCallNetworkStatistics( CallHandler CallId, eCallChannel_t CallChannel,
+        unsigned long TotalInputPackets, unsigned long TotalInputBytes, unsigned long TotalInputBytesPayload,
+        unsigned long CurrentInputBitrate, unsigned long AverageInputBitrate,
+        unsigned long TotalOutputPackets, unsigned long TotalOutputBytes, unsigned long TotalOutputBytesPayload,
+        unsigned long CurrentOutputBitrate, unsigned long AverageOutputBitrate,
+        int CurrentInputLossPermil, int CurrentInputJitterMs )
+{
+    ZSDKPollEngineNoteEvent();
+    int slot = ZSDKCallRegistrySlot(CallId);
+    ZSDKTelemetryOnStatistics(CallId, slot, CallChannel, CurrentInputBitrate, CurrentOutputBitrate,
+                              TotalInputPackets, TotalOutputPackets,
+                              CurrentInputLossPermil, CurrentInputJitterMs);
+    if (CallChannel == E_CHANNEL_VIDEO)
+        ZSDKRateControlOnStatistics(CallId, slot, CurrentInputLossPermil, CurrentInputJitterMs);
+    else
+        ZSDKCodecPolicyOnStatistics(CallId, slot, TotalOutputBytesPayload,
+                                    CurrentInputLossPermil, CurrentInputJitterMs);
+}
+
+void onCallAudioLevels( CallHandler CallId, double inlevel, double outlevel )
+{
+    ZSDKPollEngineNoteEvent();
+    if (CallId == INVALID_HANDLE)
+        return;
+    ZSDKTelemetryOnAudioLevels(CallId, ZSDKCallRegistrySlot(CallId), inlevel, outlevel);
 }
 
 //==============================================================================
@@ -243,35 +527,69 @@ void onCallDTMFResult( CallHandler CallID, LIBRESULT lRes )
 // video frames
 void onVideoStarted( CallHandler CallId, void * pThreadId, AudioCodecEnum_t codec)
 {
-    if (gCallId == CallId)
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallId);
+    if (call)
     {
-        gVideoThreadId = pThreadId;
-        [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidVideoStarted" object:nil];
+        call->videoThreadId = pThreadId;
+        ZSDKVideoReceiverAttach(CallId, call->slot);
+        ZSDKVideoSenderAttach(CallId, call->slot, pThreadId);
+        ZSDKRateControlStart(CallId, call->slot);
+    }
+    ZSDKCallRegistryUnlock();
+    if (call)
+    {
+        ZSDKEventQueuePush(ZSDKEventVideoStarted, CallId, codec, 0, 0, 0, NULL);
     }
 }
 
 void onVideoStopped( CallHandler CallId, void * pThreadId )
 {
-    if ((gCallId == CallId) && (gVideoThreadId == pThreadId))
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallId);
+    BOOL matched = call && (call->videoThreadId == pThreadId);
+    if (matched)
+    {
+        call->videoThreadId = NULL;
+        ZSDKVideoReceiverDetach(CallId, call->slot);
+        ZSDKVideoSenderDetach(CallId, call->slot);
+        ZSDKRateControlStop(CallId, call->slot);
+    }
+    ZSDKCallRegistryUnlock();
+    ZSDKVideoSenderRelease(pThreadId);
+    if (matched)
     {
-        [[NSNotificationCenter defaultCenter]
-            postNotificationName:@"ZSDKctxDidVideoStopped" object:nil];
+        ZSDKEventQueuePush(ZSDKEventVideoStopped, CallId, CODEC_UNKNOWN, 0, 0, 0, NULL);
     }
 }
 
 void onVideoFormatSelected( CallHandler CallId, eCallDirection_t dir,
                             int width, int height, float fps )
 {
-    // Nothing to do...
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryFind(CallId);
+    if (call)
+    {
+        ZSDKVideoSenderSetFormat(CallId, call->slot, width, height, fps);
+        ZSDKRateControlSetFormat(CallId, call->slot, width, height, fps);
+    }
+    ZSDKCallRegistryUnlock();
+    ZSDKEventQueuePush(ZSDKEventVideoFormatSelected, CallId, CODEC_UNKNOWN,
+                       (int)fps, width, height, NULL);
 }
 
 void onVideoOffered( CallHandler CallId )
 {
-    if (gCallId == CallId)
+    ZSDKPollEngineNoteEvent();
+    ZSDKCallRegistryLock();
+    BOOL known = ZSDKCallRegistryFind(CallId) != NULL;
+    ZSDKCallRegistryUnlock();
+    if (known)
     {
-        [[NSNotificationCenter defaultCenter]
-         postNotificationName:@"ZSDKctxDidVideoOffered" object:nil];
+        ZSDKEventQueuePush(ZSDKEventVideoOffered, CallId, CODEC_UNKNOWN, 0, 0, 0, NULL);
     }
 }
 
@@ -283,13 +601,14 @@ void onActivationCompleted( eActivationStatus_t status, const char * reason,
                             const char * hddSerial, const char * mac,
                             const char * checksum )
 {
+    ZSDKPollEngineNoteEvent();
     if (E_ACT_SUCCESS == status)
     {
         gbActivated = YES;
     }
     NSLog(@"ZOIPER: onActivationCompleted");
-    [[NSNotificationCenter defaultCenter]
-        postNotificationName:@"ZSDKctxDidActivationStatusUpdated" object:nil];
+    ZSDKEventQueuePush(ZSDKEventActivationCompleted, 0, CODEC_UNKNOWN, 0,
+                       status, 0, reason);
 }
 
 //==============================================================================
@@ -297,7 +616,181 @@ void onActivationCompleted( eActivationStatus_t status, const char * reason,
 //==============================================================================
 void onGeneralFailure( ErrorSources_t errsrc, const char * msg, int causeCode )
 {
+    ZSDKPollEngineNoteEvent();
+    ZSDKEventQueuePush(ZSDKEventGeneralFailure, 0, CODEC_UNKNOWN, causeCode,
+                       errsrc, 0, msg);
 }
 
 
+//==============================================================================
+// Debug log callback
+//==============================================================================
+// Not counted as a poll event: log lines say nothing about the poll rate
+void onDebugLog( const char * pMessage )
+{
+    ZSDKLogMessage(pMessage);
+}
+
+void SetDebugLogEnabled(BOOL enabled)
+{
+    if (gWrapperCbk)
+        gWrapperCbk->onDebugLog = enabled ? onDebugLog : NULL;
+}
+
+
+
+
+//==============================================================================
+// External audio callback
+//==============================================================================
+void onExternalAudioRequested( void )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onExternalAudioRequested");
+    ZSDKExternalAudioOnRequested();
+}
 
+//==============================================================================
+// Sound load callback
+//==============================================================================
+void onSoundLoadCompleted( SoundHandler soundId, LIBRESULT result, int causeCode )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKSoundCacheOnLoadCompleted(soundId, result, causeCode);
+}
+
+//==============================================================================
+// Transport probe callbacks
+//==============================================================================
+void onProbeState( ProbeHandler ProbeId, eProbeState_t newState )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKTransportProbeOnState(ProbeId, newState);
+}
+
+void onProbeError( ProbeHandler ProbeId, eProbeState_t curState, int causeCode )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onProbeError state %d cause %d", curState, causeCode);
+    ZSDKTransportProbeOnError(ProbeId, curState, causeCode);
+}
+
+void onProbeSuccess( ProbeHandler ProbeId, eUserTransport_t Trans )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKTransportProbeOnSuccess(ProbeId, Trans);
+}
+
+void onProbeFailed( ProbeHandler ProbeId, int CauseCode )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onProbeFailed cause %d", CauseCode);
+    ZSDKTransportProbeOnFailed(ProbeId, CauseCode);
+}
+
+//==============================================================================
+// STUN callbacks
+//==============================================================================
+void onStunNetworkDiscovered( StunHandler StunId, eNetworkTypeEnum_t netType )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onStunNetworkDiscovered type %d", netType);
+    ZSDKStunManagerOnNetworkDiscovered(StunId, netType);
+}
+
+void onStunPortReady( UserHandler user_handler, CallHandler call_handler,
+                     void* user_data, LIBRESULT result )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKStunManagerOnPortReady(user_handler, user_data, result);
+}
+
+//==============================================================================
+// Presence callbacks
+//==============================================================================
+void onContactStatus( UserHandler UserId, ContactHandler ContactId, eContactState_t eStatus,
+                     const char * pNote )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKPresenceOnStatus(ContactId, eStatus, pNote);
+}
+
+void onContactTerminated( UserHandler UserId, ContactHandler ContactId,
+                         eRejectionType_t eType, const char * pReason )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onContactTerminated type %d %s", eType, pReason ? pReason : "");
+    ZSDKPresenceOnTerminated(ContactId, eType);
+}
+
+void onContactRetrying( UserHandler UserId, ContactHandler ContactId )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKPresenceOnRetrying(ContactId);
+}
+
+void onPublicationSucceeded( UserHandler UserId )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKPresenceOnPublication(UserId, YES);
+}
+
+void onPublicationRetrying( UserHandler UserId )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onPublicationRetrying");
+}
+
+void onPublicationFailed( UserHandler UserId )
+{
+    ZSDKPollEngineNoteEvent();
+    NSLog(@"ZOIPER: onPublicationFailed");
+    ZSDKPresenceOnPublication(UserId, NO);
+}
+
+//==============================================================================
+// BLF callbacks
+//==============================================================================
+void onPeerDialogAdded( PeerHandler PeerId, DialogHandler DialogId, const char * pDialogIdStr,
+                       int NewCount )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKBlfOnDialogAdded(PeerId, DialogId, NewCount);
+}
+
+void onPeerDialogChanged( DialogHandler DialogId, ePeerState_t NewState )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKBlfOnDialogChanged(DialogId, NewState);
+}
+
+void onPeerDialogRemoved( PeerHandler PeerId, DialogHandler DialogId, int NewCount )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKBlfOnDialogRemoved(PeerId, DialogId, NewCount);
+}
+
+//==============================================================================
+// Instant message callbacks
+//==============================================================================
+void onMessageReceived( UserHandler UserId, ContactHandler ContactId, const char * contactPhone,
+                       const char * contactName, const char * contentType, int contentLength,
+                       const char * body )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKMessagingOnReceived(ContactId, contactPhone, body, contentLength);
+}
+
+void onMessageSent( UserHandler UserId, ContactHandler ContactId, MessageHandler MessageId,
+                   int contentLength, const char * body )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKMessagingOnSent(MessageId);
+}
+
+void onMessageFailed( UserHandler UserId, ContactHandler ContactId, MessageHandler MessageId,
+                     int contentLength, const char * body, int releaseCause )
+{
+    ZSDKPollEngineNoteEvent();
+    ZSDKMessagingOnFailed(MessageId, releaseCause);
+}
@@ -0,0 +1,98 @@
+//
+//  ZSDKLoadGen.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Call-setup load generator.  A background thread places outgoing calls
+//  following a calls-per-second pattern (constant, linear ramp, or periodic
+//  bursts over a base rate), hangs each call up holdMs after it is accepted,
+//  and times every state change from the events the poll thread queues:
+//
+//      CallCreate() -> CallCreate event     create_to_created
+//      CallCreate() -> CallRinging          create_to_ringing
+//      CallRinging  -> CallAccepted         ringing_to_accepted
+//      CallCreate() -> CallAccepted         create_to_accepted
+//      CallHangup() -> CallHangup event     hangup_to_ended
+//      event queued -> seen on main queue   event_delivery
+//
+//  The load is open loop: calls that fall due while maxInFlight calls are
+//  up are counted as throttled rather than delayed.  Transitions go into
+//  ZSDKHistogram and the run ends with a JSON report.  Meant to run against
+//  the simulated library (ZSDKStubWrapper.h) or a local SIP stand-in; the
+//  call registry caps the calls in flight at kZSDKMaxCalls.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "ZSDKCallRegistry.h"
+
+#define kZSDKLoadGenMaxCalls    kZSDKMaxCalls
+#define kZSDKLoadGenCalleeLen   64
+#define kZSDKLoadGenTickUs      1000
+#define kZSDKLoadGenDrainMs     5000    // after the last call, beyond holdMs
+#define kZSDKLoadGenJSONBytes   4096
+
+typedef enum {
+    ZSDKLoadPatternConstant = 0     // callsPerSecond
+,   ZSDKLoadPatternRamp             // callsPerSecond to peakCallsPerSecond
+,   ZSDKLoadPatternBurst            // peak for burstMs of every burstPeriodMs
+,   ZSDKLoadPatternCount
+} ZSDKLoadPattern;
+
+typedef enum {
+    ZSDKLoadCreateToCreated = 0
+,   ZSDKLoadCreateToRinging
+,   ZSDKLoadRingingToAccepted
+,   ZSDKLoadCreateToAccepted
+,   ZSDKLoadHangupToEnded
+,   ZSDKLoadEventDelivery
+,   ZSDKLoadTransitionCount
+} ZSDKLoadTransition;
+
+typedef struct {
+    ZSDKLoadPattern pattern;
+    double          callsPerSecond;
+    double          peakCallsPerSecond;
+    int             burstMs;
+    int             burstPeriodMs;
+    int             durationMs;
+    int             holdMs;             // accepted to local hangup
+    int             maxInFlight;
+    char            callee[kZSDKLoadGenCalleeLen];
+} ZSDKLoadGenConfig;
+
+typedef struct {
+    uint64_t    offered;            // calls the pattern asked for
+    uint64_t    created;
+    uint64_t    createErrors;       // CallCreate() failed
+    uint64_t    throttled;          // maxInFlight reached
+    uint64_t    accepted;
+    uint64_t    completed;          // ended after the local hangup
+    uint64_t    remoteEnded;        // remote hangup before holdMs
+    uint64_t    rejected;
+    uint64_t    failed;
+    uint64_t    timedOut;           // still up when the drain ended
+    int         inFlight;
+} ZSDKLoadGenStats;
+
+// Called on the main queue with the report; the string is freed afterwards
+typedef void (^ZSDKLoadGenCompletion)(const char * pJSON);
+
+const char * ZSDKLoadPatternName(ZSDKLoadPattern pattern);
+const char * ZSDKLoadTransitionName(ZSDKLoadTransition transition);
+
+// Defaults: constant 10 calls/s for 10 s, peak 50 calls/s in 1 s bursts
+// every 5 s, hung up on answer, 24 calls in flight, callee "loadgen"
+void ZSDKLoadGenDefaultConfig(ZSDKLoadGenConfig * pConfig);
+
+// Calls from userId.  Returns NO if a run is in progress or the
+// configuration is unusable.
+BOOL ZSDKLoadGenStart(UserHandler userId, const ZSDKLoadGenConfig * pConfig,
+                      ZSDKLoadGenCompletion completion);
+
+// Stops placing calls; the calls in flight are drained and the report
+// delivered as usual
+void ZSDKLoadGenStop(void);
+
+void ZSDKLoadGenGetStats(ZSDKLoadGenStats * pStats);
@@ -0,0 +1,400 @@
+//
+//  ZSDKLoadGen.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKLoadGen.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKEventQueue.h"
+#import "ZSDKHandleMap.h"
+#import "ZSDKHistogram.h"
+#import "ZSDKPollEngine.h"
+#import <pthread.h>
+#import <unistd.h>
+
+#define kLoadTableBits      6       // >= 2 * kZSDKLoadGenMaxCalls
+
+typedef struct {
+    BOOL        used;
+    CallHandler callId;
+    uint64_t    createUs;
+    uint64_t    ringingUs;
+    uint64_t    acceptedUs;
+    uint64_t    hangupDueUs;
+    uint64_t    hangupUs;           // local CallHangup() issued
+} ZSDKLoadCall;
+
+static pthread_mutex_t      gLoadLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKLoadCall         gCalls[kZSDKLoadGenMaxCalls];
+static ZSDKHandleBucket     gBuckets[1 << kLoadTableBits];
+static ZSDKHandleMap        gCallMap;
+static ZSDKHistogram        gHist[ZSDKLoadTransitionCount];
+static ZSDKLoadGenStats     gStats;
+static ZSDKLoadGenConfig    gConfig;
+static UserHandler          gLoadUserId;
+static ZSDKLoadGenCompletion gCompletion = nil;
+static int                  gRunning = 0;
+static int                  gStopRequested = 0;
+static uint64_t             gElapsedUs = 0;     // generation phase
+static pthread_t            gLoadThread;
+
+static const char * const kPatternNames[ZSDKLoadPatternCount] = {
+    "constant", "ramp", "burst",
+};
+
+static const char * const kTransitionNames[ZSDKLoadTransitionCount] = {
+    "create_to_created", "create_to_ringing", "ringing_to_accepted",
+    "create_to_accepted", "hangup_to_ended", "event_delivery",
+};
+
+const char * ZSDKLoadPatternName(ZSDKLoadPattern pattern)
+{
+    return (pattern < ZSDKLoadPatternCount) ? kPatternNames[pattern] : "unknown";
+}
+
+const char * ZSDKLoadTransitionName(ZSDKLoadTransition transition)
+{
+    return (transition < ZSDKLoadTransitionCount) ? kTransitionNames[transition] : "unknown";
+}
+
+void ZSDKLoadGenDefaultConfig(ZSDKLoadGenConfig * pConfig)
+{
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->pattern            = ZSDKLoadPatternConstant;
+    pConfig->callsPerSecond     = 10.0;
+    pConfig->peakCallsPerSecond = 50.0;
+    pConfig->burstMs            = 1000;
+    pConfig->burstPeriodMs      = 5000;
+    pConfig->durationMs         = 10000;
+    pConfig->holdMs             = 0;
+    pConfig->maxInFlight        = 24;
+    strlcpy(pConfig->callee, "loadgen", sizeof(pConfig->callee));
+}
+
+//==============================================================================
+//  Call table (gLoadLock held)
+//==============================================================================
+static ZSDKLoadCall * findCall(CallHandler callId)
+{
+    int slot = ZSDKHandleMapFind(&gCallMap, callId);
+    return (slot == ZSDK_HANDLE_MAP_EMPTY) ? NULL : &gCalls[slot];
+}
+
+static void releaseCall(ZSDKLoadCall * call)
+{
+    ZSDKHandleMapRemove(&gCallMap, call->callId);
+    call->used = NO;
+    gStats.inFlight--;
+}
+
+static void placeCall(uint64_t nowUs)
+{
+    int slot = 0;
+    while (slot < kZSDKLoadGenMaxCalls && gCalls[slot].used)
+        slot++;
+    if (slot == kZSDKLoadGenMaxCalls || gStats.inFlight >= gConfig.maxInFlight)
+    {
+        gStats.throttled++;
+        return;
+    }
+
+    // Under gLoadLock so the events of the call cannot be seen first
+    CallHandler callId = INVALID_HANDLE;
+    if (gWrapperCtx.CallCreate(gLoadUserId, gConfig.callee, &callId) != L_OK)
+    {
+        gStats.createErrors++;
+        return;
+    }
+
+    // As callNumber: onCallCreate adds the registry record
+    ZSDKPollEngineWakeup();
+
+    ZSDKLoadCall * call = &gCalls[slot];
+    memset(call, 0, sizeof(*call));
+    call->used     = YES;
+    call->callId   = callId;
+    call->createUs = nowUs;
+    ZSDKHandleMapInsert(&gCallMap, callId, slot);
+    gStats.created++;
+    gStats.inFlight++;
+}
+
+static void hangupDueCalls(uint64_t nowUs)
+{
+    for (int i = 0; i < kZSDKLoadGenMaxCalls; i++)
+    {
+        ZSDKLoadCall * call = &gCalls[i];
+        if (call->used && call->acceptedUs && !call->hangupUs && call->hangupDueUs <= nowUs)
+        {
+            call->hangupUs = ZSDKMonotonicMicros();
+            gWrapperCtx.CallHangup(call->callId);
+        }
+    }
+}
+
+// Main queue, ahead of the application's handler
+static void loadGenMonitor(const ZSDKEvent * events, int count)
+{
+    uint64_t nowUs = ZSDKMonotonicMicros();
+
+    pthread_mutex_lock(&gLoadLock);
+    for (int i = 0; i < count; i++)
+    {
+        const ZSDKEvent * ev = &events[i];
+        ZSDKLoadCall * call = findCall(ev->handle);
+        if (!call)
+            continue;
+
+        uint64_t ts = ev->timestampUs;
+        ZSDKHistogramRecord(&gHist[ZSDKLoadEventDelivery], nowUs > ts ? nowUs - ts : 0);
+        switch (ev->type)
+        {
+            case ZSDKEventCallCreate:
+                ZSDKHistogramRecord(&gHist[ZSDKLoadCreateToCreated], ts - call->createUs);
+                break;
+            case ZSDKEventCallRinging:
+                if (call->ringingUs)
+                    break;
+                call->ringingUs = ts;
+                ZSDKHistogramRecord(&gHist[ZSDKLoadCreateToRinging], ts - call->createUs);
+                break;
+            case ZSDKEventCallAccepted:
+                call->acceptedUs  = ts;
+                call->hangupDueUs = ts + (uint64_t)gConfig.holdMs * 1000;
+                if (call->ringingUs)
+                    ZSDKHistogramRecord(&gHist[ZSDKLoadRingingToAccepted], ts - call->ringingUs);
+                ZSDKHistogramRecord(&gHist[ZSDKLoadCreateToAccepted], ts - call->createUs);
+                gStats.accepted++;
+                break;
+            case ZSDKEventCallHangup:
+                if (call->hangupUs)
+                {
+                    ZSDKHistogramRecord(&gHist[ZSDKLoadHangupToEnded],
+                                        ts > call->hangupUs ? ts - call->hangupUs : 0);
+                    gStats.completed++;
+                }
+                else
+                    gStats.remoteEnded++;
+                releaseCall(call);
+                break;
+            case ZSDKEventCallRejected:
+                gStats.rejected++;
+                releaseCall(call);
+                break;
+            case ZSDKEventCallFailed:
+                gStats.failed++;
+                releaseCall(call);
+                break;
+            default:
+                break;
+        }
+    }
+    pthread_mutex_unlock(&gLoadLock);
+}
+
+//==============================================================================
+//  Generator thread
+//==============================================================================
+static double rateAt(uint64_t elapsedUs)
+{
+    switch (gConfig.pattern)
+    {
+        case ZSDKLoadPatternRamp:
+        {
+            double f = (double)elapsedUs / ((double)gConfig.durationMs * 1000.0);
+            return gConfig.callsPerSecond + (gConfig.peakCallsPerSecond - gConfig.callsPerSecond) * f;
+        }
+        case ZSDKLoadPatternBurst:
+        {
+            uint64_t phaseUs = elapsedUs % ((uint64_t)gConfig.burstPeriodMs * 1000);
+            return (phaseUs < (uint64_t)gConfig.burstMs * 1000) ? gConfig.peakCallsPerSecond
+                                                                : gConfig.callsPerSecond;
+        }
+        default:
+            return gConfig.callsPerSecond;
+    }
+}
+
+static int appendJSON(char * pBuf, int len, const char * pFormat, ...)
+{
+    if (len >= kZSDKLoadGenJSONBytes)
+        return len;
+    va_list args;
+    va_start(args, pFormat);
+    len += vsnprintf(pBuf + len, kZSDKLoadGenJSONBytes - len, pFormat, args);
+    va_end(args);
+    return len;
+}
+
+static char * buildReport(void)
+{
+    char * pJSON = malloc(kZSDKLoadGenJSONBytes);
+    if (!pJSON)
+        return NULL;
+
+    double seconds = gElapsedUs / 1e6;
+    int len = appendJSON(pJSON, 0,
+                         "{\"pattern\":\"%s\",\"callsPerSecond\":%.2f,\"peakCallsPerSecond\":%.2f,"
+                         "\"burstMs\":%d,\"burstPeriodMs\":%d,\"durationMs\":%d,\"holdMs\":%d,"
+                         "\"maxInFlight\":%d,\"elapsedMs\":%llu,\"achievedCallsPerSecond\":%.2f,",
+                         ZSDKLoadPatternName(gConfig.pattern), gConfig.callsPerSecond,
+                         gConfig.peakCallsPerSecond, gConfig.burstMs, gConfig.burstPeriodMs,
+                         gConfig.durationMs, gConfig.holdMs, gConfig.maxInFlight,
+                         (unsigned long long)(gElapsedUs / 1000),
+                         seconds > 0 ? gStats.created / seconds : 0.0);
+    len = appendJSON(pJSON, len,
+                     "\"calls\":{\"offered\":%llu,\"created\":%llu,\"createErrors\":%llu,"
+                     "\"throttled\":%llu,\"accepted\":%llu,\"completed\":%llu,\"remoteEnded\":%llu,"
+                     "\"rejected\":%llu,\"failed\":%llu,\"timedOut\":%llu},\"transitions\":{",
+                     (unsigned long long)gStats.offered, (unsigned long long)gStats.created,
+                     (unsigned long long)gStats.createErrors, (unsigned long long)gStats.throttled,
+                     (unsigned long long)gStats.accepted, (unsigned long long)gStats.completed,
+                     (unsigned long long)gStats.remoteEnded, (unsigned long long)gStats.rejected,
+                     (unsigned long long)gStats.failed, (unsigned long long)gStats.timedOut);
+    for (int t = 0; t < ZSDKLoadTransitionCount; t++)
+    {
+        len = appendJSON(pJSON, len, "%s\"%s\":", t ? "," : "", ZSDKLoadTransitionName(t));
+        if (len < kZSDKLoadGenJSONBytes)
+            len += ZSDKHistogramFormatJSON(&gHist[t], pJSON + len, kZSDKLoadGenJSONBytes - len);
+    }
+    len = appendJSON(pJSON, len, "}}");
+
+    if (len >= kZSDKLoadGenJSONBytes)
+    {
+        NSLog(@"ZOIPER: load report truncated");
+        free(pJSON);
+        return NULL;
+    }
+    return pJSON;
+}
+
+static void * loadGenMain(void * arg)
+{
+    pthread_setname_np("zsdk.loadgen");
+
+    uint64_t startUs = ZSDKMonotonicMicros();
+    uint64_t endUs = startUs + (uint64_t)gConfig.durationMs * 1000;
+    uint64_t lastUs = startUs;
+    uint64_t nowUs = startUs;
+    double credit = 0.0;
+
+    while (!__atomic_load_n(&gStopRequested, __ATOMIC_ACQUIRE) && nowUs < endUs)
+    {
+        credit += rateAt(nowUs - startUs) * (double)(nowUs - lastUs) / 1e6;
+        lastUs = nowUs;
+
+        pthread_mutex_lock(&gLoadLock);
+        for (; credit >= 1.0; credit -= 1.0)
+        {
+            gStats.offered++;
+            placeCall(nowUs);
+        }
+        hangupDueCalls(nowUs);
+        pthread_mutex_unlock(&gLoadLock);
+
+        usleep(kZSDKLoadGenTickUs);
+        nowUs = ZSDKMonotonicMicros();
+    }
+    gElapsedUs = nowUs - startUs;
+
+    // Let the calls in flight finish
+    uint64_t drainEndUs = nowUs + ((uint64_t)kZSDKLoadGenDrainMs + gConfig.holdMs) * 1000;
+    for (;;)
+    {
+        pthread_mutex_lock(&gLoadLock);
+        hangupDueCalls(nowUs);
+        int inFlight = gStats.inFlight;
+        pthread_mutex_unlock(&gLoadLock);
+        if (inFlight == 0 || nowUs >= drainEndUs)
+            break;
+        usleep(kZSDKLoadGenTickUs);
+        nowUs = ZSDKMonotonicMicros();
+    }
+
+    ZSDKEventQueueRemoveMonitor(loadGenMonitor);
+
+    pthread_mutex_lock(&gLoadLock);
+    for (int i = 0; i < kZSDKLoadGenMaxCalls; i++)
+    {
+        if (!gCalls[i].used)
+            continue;
+        if (!gCalls[i].hangupUs)
+            gWrapperCtx.CallHangup(gCalls[i].callId);
+        gStats.timedOut++;
+        releaseCall(&gCalls[i]);
+    }
+    char * pJSON = buildReport();
+    pthread_mutex_unlock(&gLoadLock);
+
+    NSLog(@"ZOIPER: load run done, %llu calls created, %llu completed",
+          (unsigned long long)gStats.created, (unsigned long long)gStats.completed);
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (gCompletion)
+            gCompletion(pJSON ? pJSON : "{}");
+        free(pJSON);
+        gCompletion = nil;
+        __atomic_store_n(&gRunning, 0, __ATOMIC_RELEASE);
+    });
+    return NULL;
+}
+
+BOOL ZSDKLoadGenStart(UserHandler userId, const ZSDKLoadGenConfig * pConfig,
+                      ZSDKLoadGenCompletion completion)
+{
+    if (pConfig->durationMs <= 0 || pConfig->callsPerSecond < 0.0 ||
+        pConfig->peakCallsPerSecond < 0.0 || pConfig->pattern >= ZSDKLoadPatternCount ||
+        (pConfig->pattern == ZSDKLoadPatternBurst &&
+         (pConfig->burstPeriodMs <= 0 || pConfig->burstMs < 0)))
+        return NO;
+    if (!gWrapperCtx.CallCreate || !gWrapperCtx.CallHangup)
+        return NO;
+    if (__atomic_exchange_n(&gRunning, 1, __ATOMIC_ACQ_REL))
+        return NO;
+
+    pthread_mutex_lock(&gLoadLock);
+    gConfig = *pConfig;
+    gConfig.callee[kZSDKLoadGenCalleeLen - 1] = '\0';
+    if (gConfig.maxInFlight <= 0 || gConfig.maxInFlight > kZSDKLoadGenMaxCalls)
+        gConfig.maxInFlight = kZSDKLoadGenMaxCalls;
+    if (gConfig.holdMs < 0)
+        gConfig.holdMs = 0;
+    gLoadUserId = userId;
+    memset(gCalls, 0, sizeof(gCalls));
+    memset(&gStats, 0, sizeof(gStats));
+    ZSDKHandleMapInit(&gCallMap, gBuckets, kLoadTableBits);
+    for (int t = 0; t < ZSDKLoadTransitionCount; t++)
+        ZSDKHistogramReset(&gHist[t]);
+    gElapsedUs = 0;
+    gCompletion = completion;
+    pthread_mutex_unlock(&gLoadLock);
+
+    __atomic_store_n(&gStopRequested, 0, __ATOMIC_RELEASE);
+    ZSDKEventQueueAddMonitor(loadGenMonitor);
+
+    if (pthread_create(&gLoadThread, NULL, loadGenMain, NULL) != 0)
+    {
+        NSLog(@"ERROR SETUP load generator thread");
+        ZSDKEventQueueRemoveMonitor(loadGenMonitor);
+        gCompletion = nil;
+        __atomic_store_n(&gRunning, 0, __ATOMIC_RELEASE);
+        return NO;
+    }
+    pthread_detach(gLoadThread);
+    NSLog(@"ZOIPER: load run started, %s pattern", ZSDKLoadPatternName(gConfig.pattern));
+    return YES;
+}
+
+void ZSDKLoadGenStop(void)
+{
+    __atomic_store_n(&gStopRequested, 1, __ATOMIC_RELEASE);
+}
+
+void ZSDKLoadGenGetStats(ZSDKLoadGenStats * pStats)
+{
+    pthread_mutex_lock(&gLoadLock);
+    *pStats = gStats;
+    pthread_mutex_unlock(&gLoadLock);
+}
@@ -0,0 +1,66 @@
+//
+//  ZSDKLog.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Asynchronous debug log.  Messages from onDebugLog (and the application)
+//  are copied into a bounded lock-free ring (multiple producers, one
+//  consumer; per-slot sequence numbers) and written by a background thread,
+//  so the library threads never wait on the file system.  When the ring is
+//  full a message is dropped and counted rather than blocking its caller.
+//
+//  The writer hands whole batches to writev() and rotates the files by
+//  size: zoiper.log, zoiper.log.1, ... zoiper.log.<keep - 1>.
+//
+//  Each message is put into a subsystem by keywords near its start; a
+//  subsystem can be sampled to keep only one message in N.
+//
+
+#import <Foundation/Foundation.h>
+
+#define kZSDKLogSlots           1024    // power of two
+#define kZSDKLogSlotText        1000    // longer messages are truncated
+#define kZSDKLogFlushMs         100
+#define kZSDKLogDefaultMaxBytes (4 * 1024 * 1024)
+#define kZSDKLogDefaultKeep     4
+
+typedef enum {
+    ZSDKLogGeneral = 0
+,   ZSDKLogSip
+,   ZSDKLogTransport
+,   ZSDKLogDns
+,   ZSDKLogMedia
+,   ZSDKLogSubsystemCount
+} ZSDKLogSubsystem;
+
+typedef struct {
+    uint64_t    messages;           // offered
+    uint64_t    written;
+    uint64_t    dropped;            // ring full
+    uint64_t    sampledOut;
+    uint64_t    truncated;
+    uint64_t    bytes;
+    uint64_t    batches;
+    uint64_t    rotations;
+    uint64_t    writeErrors;
+} ZSDKLogStats;
+
+const char * ZSDKLogSubsystemName(ZSDKLogSubsystem subsystem);
+
+// Opens <pDir>/zoiper.log and starts the writer.  maxFileBytes 0 and
+// keepFiles 0 select the defaults.
+BOOL ZSDKLogStart(const char * pDir, size_t maxFileBytes, int keepFiles);
+
+// Writes what is queued, closes the file
+void ZSDKLogStop(void);
+
+BOOL ZSDKLogRunning(void);
+
+// Any thread; never blocks.  Ignored while the log is stopped.
+void ZSDKLogMessage(const char * pMessage);
+
+// Keep one message in keepOneIn (1 keeps all, 0 drops all)
+void ZSDKLogSetSampling(ZSDKLogSubsystem subsystem, int keepOneIn);
+
+void ZSDKLogGetStats(ZSDKLogStats * pStats);
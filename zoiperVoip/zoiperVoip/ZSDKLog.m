@@ -0,0 +1,359 @@
+//
+//  ZSDKLog.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKLog.h"
+#import <pthread.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <time.h>
+#import <sys/time.h>
+#import <sys/stat.h>
+#import <sys/uio.h>
+
+#define kSlotMask           (kZSDKLogSlots - 1)
+#define kWakeEvery          (kZSDKLogSlots / 4)     // messages between wakeups
+#define kBatchMessages      64
+#define kHeaderBytes        40
+#define kClassifyChars      80
+#define kPathBytes          1024
+
+#define STAT_ADD(field, v)  __atomic_fetch_add(&gStats.field, (v), __ATOMIC_RELAXED)
+
+typedef struct {
+    uint64_t    seq;                // == position when free, position + 1 when full
+    uint64_t    timeUs;             // wall clock
+    uint16_t    length;
+    uint8_t     subsystem;
+    char        text[kZSDKLogSlotText];
+} ZSDKLogSlot;
+
+static ZSDKLogSlot *         gSlots;
+static uint64_t              gEnqueuePos;       // producers
+static uint64_t              gDequeuePos;       // writer only
+
+static int                   gRunning;
+static int                   gStopRequested;
+static pthread_mutex_t       gLogLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t             gWriterThread;
+static dispatch_semaphore_t  gWakeup;
+
+static int                   gKeepOneIn[ZSDKLogSubsystemCount] = { 1, 1, 1, 1, 1 };
+static uint32_t              gSampleCount[ZSDKLogSubsystemCount];
+static ZSDKLogStats          gStats;
+
+// Writer thread only
+static int                   gFd = -1;
+static char                  gPath[kPathBytes];
+static size_t                gFileBytes;
+static size_t                gMaxBytes;
+static int                   gKeepFiles;
+
+static const char * const kSubsystemNames[ZSDKLogSubsystemCount] = {
+    "general", "sip", "transport", "dns", "media"
+};
+
+const char * ZSDKLogSubsystemName(ZSDKLogSubsystem subsystem)
+{
+    return (subsystem >= 0 && subsystem < ZSDKLogSubsystemCount) ? kSubsystemNames[subsystem] : "?";
+}
+
+//==============================================================================
+//  Producers
+//==============================================================================
+static ZSDKLogSubsystem classify(const char * pMessage)
+{
+    static const struct { const char * keyword; ZSDKLogSubsystem subsystem; } kKeywords[] = {
+        { "transport", ZSDKLogTransport }, { "tcp", ZSDKLogTransport }, { "udp", ZSDKLogTransport },
+        { "tls", ZSDKLogTransport },       { "socket", ZSDKLogTransport },
+        { "dns", ZSDKLogDns },             { "resolv", ZSDKLogDns },
+        { "rtp", ZSDKLogMedia },           { "audio", ZSDKLogMedia },     { "video", ZSDKLogMedia },
+        { "codec", ZSDKLogMedia },         { "media", ZSDKLogMedia },
+        { "sip", ZSDKLogSip },             { "dum", ZSDKLogSip },         { "invite", ZSDKLogSip },
+        { "register", ZSDKLogSip },        { "dialog", ZSDKLogSip },
+    };
+
+    char head[kClassifyChars + 1];
+    int n = 0;
+    for (; n < kClassifyChars && pMessage[n]; n++)
+        head[n] = (pMessage[n] >= 'A' && pMessage[n] <= 'Z') ? pMessage[n] + ('a' - 'A') : pMessage[n];
+    head[n] = 0;
+
+    for (int i = 0; i < (int)(sizeof(kKeywords) / sizeof(kKeywords[0])); i++)
+    {
+        if (strstr(head, kKeywords[i].keyword))
+            return kKeywords[i].subsystem;
+    }
+    return ZSDKLogGeneral;
+}
+
+void ZSDKLogMessage(const char * pMessage)
+{
+    if (!pMessage || !__atomic_load_n(&gRunning, __ATOMIC_ACQUIRE))
+        return;
+    STAT_ADD(messages, 1);
+
+    ZSDKLogSubsystem subsystem = classify(pMessage);
+    int keep = __atomic_load_n(&gKeepOneIn[subsystem], __ATOMIC_RELAXED);
+    if (keep <= 0 || __atomic_fetch_add(&gSampleCount[subsystem], 1, __ATOMIC_RELAXED) % keep != 0)
+    {
+        STAT_ADD(sampledOut, 1);
+        return;
+    }
+
+    // Claim a slot; a slot still holding an unwritten message means full
+    uint64_t pos = __atomic_load_n(&gEnqueuePos, __ATOMIC_RELAXED);
+    ZSDKLogSlot * slot;
+    for (;;)
+    {
+        slot = &gSlots[pos & kSlotMask];
+        int64_t diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&gEnqueuePos, &pos, pos + 1, YES,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            STAT_ADD(dropped, 1);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&gEnqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    slot->timeUs = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    slot->subsystem = (uint8_t)subsystem;
+
+    size_t length = strlen(pMessage);
+    while (length > 0 && (pMessage[length - 1] == '\n' || pMessage[length - 1] == '\r'))
+        length--;
+    if (length > kZSDKLogSlotText)
+    {
+        length = kZSDKLogSlotText;
+        STAT_ADD(truncated, 1);
+    }
+    memcpy(slot->text, pMessage, length);
+    slot->length = (uint16_t)length;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    if ((pos & (kWakeEvery - 1)) == kWakeEvery - 1)
+        dispatch_semaphore_signal(gWakeup);
+}
+
+void ZSDKLogSetSampling(ZSDKLogSubsystem subsystem, int keepOneIn)
+{
+    if (subsystem >= 0 && subsystem < ZSDKLogSubsystemCount)
+        __atomic_store_n(&gKeepOneIn[subsystem], keepOneIn < 0 ? 0 : keepOneIn, __ATOMIC_RELAXED);
+}
+
+//==============================================================================
+//  Writer
+//==============================================================================
+static BOOL openLogFile(BOOL truncate)
+{
+    gFd = open(gPath, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+    if (gFd < 0)
+        return NO;
+    struct stat info;
+    gFileBytes = (fstat(gFd, &info) == 0) ? (size_t)info.st_size : 0;
+    return YES;
+}
+
+static void rotate(void)
+{
+    close(gFd);
+    char from[kPathBytes + 8], to[kPathBytes + 8];
+    for (int i = gKeepFiles - 1; i >= 1; i--)
+    {
+        if (i == 1)
+            strlcpy(from, gPath, sizeof(from));
+        else
+            snprintf(from, sizeof(from), "%s.%d", gPath, i - 1);
+        snprintf(to, sizeof(to), "%s.%d", gPath, i);
+        rename(from, to);
+    }
+    STAT_ADD(rotations, 1);
+    if (!openLogFile(YES))
+        STAT_ADD(writeErrors, 1);
+}
+
+static int formatHeader(char * pOut, uint64_t timeUs, int subsystem)
+{
+    static time_t   lastSecond = -1;
+    static char     lastText[24];
+
+    time_t second = (time_t)(timeUs / 1000000);
+    if (second != lastSecond)
+    {
+        struct tm local;
+        localtime_r(&second, &local);
+        strftime(lastText, sizeof(lastText), "%Y-%m-%d %H:%M:%S", &local);
+        lastSecond = second;
+    }
+    return snprintf(pOut, kHeaderBytes, "%s.%03d %-9s ", lastText,
+                    (int)(timeUs % 1000000 / 1000), kSubsystemNames[subsystem]);
+}
+
+// Writes up to one batch; returns the number of messages taken
+static int writeBatch(void)
+{
+    static char     headers[kBatchMessages][kHeaderBytes];
+    struct iovec    iov[kBatchMessages * 3];
+    uint64_t        pos = gDequeuePos;
+    size_t          bytes = 0;
+    int             count = 0;
+
+    while (count < kBatchMessages)
+    {
+        ZSDKLogSlot * slot = &gSlots[(pos + count) & kSlotMask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + count + 1)
+            break;
+
+        int header = formatHeader(headers[count], slot->timeUs, slot->subsystem);
+        iov[count * 3].iov_base     = headers[count];
+        iov[count * 3].iov_len      = header;
+        iov[count * 3 + 1].iov_base = slot->text;
+        iov[count * 3 + 1].iov_len  = slot->length;
+        iov[count * 3 + 2].iov_base = "\n";
+        iov[count * 3 + 2].iov_len  = 1;
+        bytes += header + slot->length + 1;
+        count++;
+    }
+    if (count == 0)
+        return 0;
+
+    if (gFd >= 0 && gFileBytes + bytes > gMaxBytes && gFileBytes > 0)
+        rotate();
+    if (gFd >= 0 && writev(gFd, iov, count * 3) == (ssize_t)bytes)
+    {
+        gFileBytes += bytes;
+        STAT_ADD(written, count);
+        STAT_ADD(bytes, bytes);
+        STAT_ADD(batches, 1);
+    }
+    else
+    {
+        STAT_ADD(writeErrors, 1);
+    }
+
+    // Hand the slots back to the producers
+    for (int i = 0; i < count; i++)
+        __atomic_store_n(&gSlots[(pos + i) & kSlotMask].seq, pos + i + kZSDKLogSlots, __ATOMIC_RELEASE);
+    gDequeuePos = pos + count;
+    return count;
+}
+
+static void * logWriterMain( void * arg )
+{
+    pthread_setname_np("zsdk.log");
+
+    while (!__atomic_load_n(&gStopRequested, __ATOMIC_ACQUIRE))
+    {
+        dispatch_semaphore_wait(gWakeup, dispatch_time(DISPATCH_TIME_NOW, kZSDKLogFlushMs * NSEC_PER_MSEC));
+        while (writeBatch() == kBatchMessages)
+            ;
+    }
+
+    while (writeBatch() > 0)
+        ;
+    return NULL;
+}
+
+//==============================================================================
+//  Control
+//==============================================================================
+BOOL ZSDKLogStart(const char * pDir, size_t maxFileBytes, int keepFiles)
+{
+    pthread_mutex_lock(&gLogLock);
+    if (__atomic_load_n(&gRunning, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_unlock(&gLogLock);
+        return YES;
+    }
+
+    if (!gSlots)
+    {
+        gSlots = malloc(kZSDKLogSlots * sizeof(ZSDKLogSlot));
+        if (!gSlots)
+        {
+            pthread_mutex_unlock(&gLogLock);
+            NSLog(@"ERROR SETUP log ring");
+            return NO;
+        }
+        for (int i = 0; i < kZSDKLogSlots; i++)
+            gSlots[i].seq = i;
+        gWakeup = dispatch_semaphore_create(0);
+    }
+
+    snprintf(gPath, sizeof(gPath), "%s/zoiper.log", pDir);
+    gMaxBytes  = maxFileBytes ? maxFileBytes : kZSDKLogDefaultMaxBytes;
+    gKeepFiles = keepFiles > 0 ? keepFiles : kZSDKLogDefaultKeep;
+    if (!openLogFile(NO))
+    {
+        pthread_mutex_unlock(&gLogLock);
+        NSLog(@"ZOIPER: cannot open %s", gPath);
+        return NO;
+    }
+
+    __atomic_store_n(&gStopRequested, 0, __ATOMIC_RELEASE);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_set_qos_class_np(&attr, QOS_CLASS_BACKGROUND, 0);
+    BOOL ok = pthread_create(&gWriterThread, &attr, logWriterMain, NULL) == 0;
+    pthread_attr_destroy(&attr);
+
+    if (ok)
+    {
+        __atomic_store_n(&gRunning, 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        close(gFd);
+        gFd = -1;
+        NSLog(@"ERROR SETUP log writer thread");
+    }
+    pthread_mutex_unlock(&gLogLock);
+    return ok;
+}
+
+void ZSDKLogStop(void)
+{
+    pthread_mutex_lock(&gLogLock);
+    if (__atomic_load_n(&gRunning, __ATOMIC_ACQUIRE))
+    {
+        __atomic_store_n(&gRunning, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&gStopRequested, 1, __ATOMIC_RELEASE);
+        dispatch_semaphore_signal(gWakeup);
+        pthread_join(gWriterThread, NULL);
+        close(gFd);
+        gFd = -1;
+    }
+    pthread_mutex_unlock(&gLogLock);
+}
+
+BOOL ZSDKLogRunning(void)
+{
+    return __atomic_load_n(&gRunning, __ATOMIC_ACQUIRE) != 0;
+}
+
+void ZSDKLogGetStats(ZSDKLogStats * pStats)
+{
+    pStats->messages    = __atomic_load_n(&gStats.messages, __ATOMIC_RELAXED);
+    pStats->written     = __atomic_load_n(&gStats.written, __ATOMIC_RELAXED);
+    pStats->dropped     = __atomic_load_n(&gStats.dropped, __ATOMIC_RELAXED);
+    pStats->sampledOut  = __atomic_load_n(&gStats.sampledOut, __ATOMIC_RELAXED);
+    pStats->truncated   = __atomic_load_n(&gStats.truncated, __ATOMIC_RELAXED);
+    pStats->bytes       = __atomic_load_n(&gStats.bytes, __ATOMIC_RELAXED);
+    pStats->batches     = __atomic_load_n(&gStats.batches, __ATOMIC_RELAXED);
+    pStats->rotations   = __atomic_load_n(&gStats.rotations, __ATOMIC_RELAXED);
+    pStats->writeErrors = __atomic_load_n(&gStats.writeErrors, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,123 @@
+//
+//  ZSDKMessaging.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Instant messages (SIP MESSAGE) to ZSDKPresence contacts.  Messages and
+//  their bodies are kept in a preallocated record ring and byte arena,
+//  both released in queue order, so queuing never allocates.  Each contact
+//  has its own FIFO; a pump on the poll thread sends round-robin over the
+//  contacts with at most kZSDKMessageWindow messages in flight to each.
+//  A failed message goes back to the front of its contact's queue and the
+//  contact is held off with exponential backoff; 4xx answers other than
+//  408/429/480 fail at once.
+//
+//  Outcomes and received messages are handed to the main queue once per
+//  poll cycle (PollLibrary()), in batches.  Composing notifications are
+//  only sent when they change something.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+#import "ZSDKPresence.h"
+
+#define kZSDKMessageRecords         4096    // queued, in flight and undelivered
+#define kZSDKMessageArenaBytes      (1 << 20)
+#define kZSDKMessageMaxBody         1024    // fits a UDP SIP MESSAGE
+#define kZSDKMessageWindow          4       // in flight per contact
+#define kZSDKMessageBurst           64      // sends per pump tick
+#define kZSDKMessageMaxAttempts     5
+#define kZSDKMessageBackoffMs       500     // doubled per attempt
+#define kZSDKMessageMaxBackoffMs    30000
+#define kZSDKMessageComposingSecs   60      // active notification refresh
+#define kZSDKMessageBatch           256     // events per handler call
+
+typedef uint32_t ZSDKMessageId;             // 0: invalid
+
+typedef enum {
+    ZSDKMessageSent = 0
+,   ZSDKMessageFailed                       // after the last attempt
+,   ZSDKMessageReceived
+} ZSDKMessageEventKind;
+
+// body and from point into the arena and are valid during the handler call
+// only; body is 0-terminated.
+typedef struct {
+    ZSDKMessageId           message;        // 0 for received messages
+    ZSDKContactId           contact;        // -1: sender not in the contact table
+    uint8_t                 kind;           // ZSDKMessageEventKind
+    uint8_t                 attempts;
+    int                     causeCode;      // last failure
+    int                     length;
+    const char *            body;
+    const char *            from;           // received: sender number
+} ZSDKMessageEvent;
+
+typedef struct {
+    int                     queued;
+    int                     inFlight;
+    int                     arenaBytes;     // in use
+    int                     arenaHighWater;
+    uint64_t                sent;
+    uint64_t                failed;
+    uint64_t                retries;
+    uint64_t                received;
+    uint64_t                receivedDropped;    // arena full
+    uint64_t                queueFull;      // ZSDKMessagingSend() refused
+    uint64_t                composingSent;
+    uint64_t                composingSuppressed;
+    uint64_t                batches;
+} ZSDKMessagingStats;
+
+typedef void (^ZSDKMessageHandler)(const ZSDKMessageEvent * events, int count);
+
+// Main queue
+void ZSDKMessagingSetHandler(ZSDKMessageHandler handler);
+
+// Queues a message to the contact; it goes out once the contact has a
+// subscription handle.  Returns 0 if the queue or the arena is full or the
+// body is longer than kZSDKMessageMaxBody.
+ZSDKMessageId ZSDKMessagingSend(ZSDKContactId contact, const char * pBody, int length);
+
+// Typing notification.  Not sent when the contact already has that state
+// (active ones are repeated every kZSDKMessageComposingSecs), and active is
+// not sent while messages to the contact are queued.
+void ZSDKMessagingSetComposing(ZSDKContactId contact, BOOL active);
+
+void ZSDKMessagingGetStats(ZSDKMessagingStats * pStats);
+
+// End of a poll cycle (poll thread)
+void ZSDKMessagingFlush(void);
+
+// Callbacks (poll thread)
+void ZSDKMessagingOnSent(MessageHandler messageId);
+void ZSDKMessagingOnFailed(MessageHandler messageId, int causeCode);
+void ZSDKMessagingOnReceived(ContactHandler contactId, const char * pFrom,
+                             const char * pBody, int length);
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+typedef struct {
+    int         contacts;
+    int         messages;
+    int         bodyBytes;
+    int         failPercent;        // attempts failed by the stand-in
+    double      messagesPerSecond;  // queue to sent, through pump and callbacks
+    double      queueNs;            // per ZSDKMessagingSend()
+    int         pumpTicks;
+    int         maxInFlight;
+    uint64_t    retries;
+    uint64_t    failed;             // out of attempts
+    int         arenaHighWater;
+} ZSDKMessagingBenchResult;
+
+// Sends messages spread over contacts (ids 0..contacts-1, not looked up in
+// ZSDKPresence) through a stand-in SendPlainMessage() that completes every
+// message in flight after each pump tick, failing failPercent of the
+// attempts with a 503.  Backoff delays are skipped.  Main thread; returns
+// NO if messages are queued.
+BOOL ZSDKMessagingBenchmark(int contacts, int messages, int bodyBytes, int failPercent,
+                            ZSDKMessagingBenchResult * pResult);
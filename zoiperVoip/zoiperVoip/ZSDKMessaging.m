@@ -0,0 +1,730 @@
+//
+//  ZSDKMessaging.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKMessaging.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKHandleMap.h"
+#import <pthread.h>
+
+#define kNone           (-1)
+#define kInFlightBits   13          // 8192 buckets for up to kZSDKMessageRecords
+#define kContacts       kZSDKPresenceMaxContacts
+
+typedef enum {
+    RecFree = 0
+,   RecQueued
+,   RecInFlight
+,   RecSent                         // waiting for the main queue
+,   RecFailed
+,   RecReceived
+} RecState;
+
+static pthread_mutex_t      gMessagingLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Records, allocated and released in ring order along with their bytes
+static uint8_t              gRecState[kZSDKMessageRecords];
+static uint8_t              gRecAttempts[kZSDKMessageRecords];
+static int                  gRecContact[kZSDKMessageRecords];
+static int                  gRecOffset[kZSDKMessageRecords];
+static int                  gRecLength[kZSDKMessageRecords];
+static int                  gRecCause[kZSDKMessageRecords];
+static int                  gRecNext[kZSDKMessageRecords];     // contact FIFO
+static ZSDKMessageId        gRecId[kZSDKMessageRecords];
+static int                  gRecFirst = 0;
+static int                  gRecLive = 0;
+
+static char                 gArena[kZSDKMessageArenaBytes];
+static int                  gArenaTail = 0;
+
+// Contacts
+static int                  gHead[kContacts];
+static int                  gTail[kContacts];
+static uint8_t              gInFlight[kContacts];
+static uint8_t              gReadyFlag[kContacts];
+static uint8_t              gComposing[kContacts];
+static uint32_t             gComposingAt[kContacts];           // seconds
+static uint64_t             gNotBefore[kContacts];             // ms, backoff
+static int                  gReady[kContacts];                 // round-robin ring
+static int                  gReadyFirst = 0;
+static int                  gReadyCount = 0;
+static BOOL                 gTableReady = NO;
+
+static ZSDKHandleBucket     gInFlightBuckets[1 << kInFlightBits];
+static ZSDKHandleMap        gInFlightMap;                      // MessageHandler -> record
+
+static int                  gEvents[kZSDKMessageRecords];      // records for the main queue
+static int                  gEventFirst = 0;
+static int                  gEventCount = 0;
+static BOOL                 gDispatchPending = NO;
+
+static ZSDKMessageId        gNextId = 0;
+static uint64_t             gPumpDueMs = UINT64_MAX;
+static int                  gQueued = 0;
+static ZSDKMessagingStats   gStats;
+
+// The benchmark swaps in its own library functions and contact lookup
+static WrapperContext *     gMessagingCtx = &gWrapperCtx;
+static ContactHandler       (* gResolve)(ZSDKContactId contact) = ZSDKPresenceContactHandle;
+static BOOL                 gBenchRunning = NO;
+
+static ZSDKMessageHandler   gHandler = nil;         // main queue only
+static ZSDKMessageEvent     gDrainBuf[kZSDKMessageBatch];
+static int                  gDrainRecs[kZSDKMessageBatch];
+
+static void lockMessaging(void)
+{
+    pthread_mutex_lock(&gMessagingLock);
+    if (!gTableReady)
+    {
+        ZSDKHandleMapInit(&gInFlightMap, gInFlightBuckets, kInFlightBits);
+        for (int i = 0; i < kContacts; i++)
+            gHead[i] = gTail[i] = kNone;
+        gTableReady = YES;
+    }
+}
+
+static void unlockMessaging(void)
+{
+    pthread_mutex_unlock(&gMessagingLock);
+}
+
+static uint64_t nowMs(void)
+{
+    return ZSDKMonotonicMicros() / 1000;
+}
+
+//==============================================================================
+//  Record ring and arena (lock held)
+//==============================================================================
+static int allocRecord(int bytes)
+{
+    if (gRecLive == kZSDKMessageRecords)
+        return kNone;
+    if (bytes < 1)
+        bytes = 1;
+
+    int offset;
+    if (gRecLive == 0)
+    {
+        offset = 0;
+    }
+    else
+    {
+        int head = gRecOffset[gRecFirst];
+        if (gArenaTail > head)
+        {
+            // Not wrapped: room at the end, or else before the oldest record
+            if (kZSDKMessageArenaBytes - gArenaTail >= bytes)
+                offset = gArenaTail;
+            else if (bytes < head)
+                offset = 0;
+            else
+                return kNone;
+        }
+        else if (gArenaTail + bytes < head)
+        {
+            offset = gArenaTail;
+        }
+        else
+        {
+            return kNone;
+        }
+    }
+
+    int rec = (gRecFirst + gRecLive) % kZSDKMessageRecords;
+    gRecLive++;
+    gRecOffset[rec] = offset;
+    gArenaTail = offset + bytes;
+
+    int head = gRecOffset[gRecFirst];
+    int used = (gArenaTail > head) ? gArenaTail - head : kZSDKMessageArenaBytes - head + gArenaTail;
+    if (used > gStats.arenaHighWater)
+        gStats.arenaHighWater = used;
+    return rec;
+}
+
+static void releaseRecord(int rec)
+{
+    gRecState[rec] = RecFree;
+    while (gRecLive > 0 && gRecState[gRecFirst] == RecFree)
+    {
+        gRecFirst = (gRecFirst + 1) % kZSDKMessageRecords;
+        gRecLive--;
+    }
+    if (gRecLive == 0)
+        gArenaTail = 0;
+}
+
+static void pushEvent(int rec)
+{
+    gEvents[(gEventFirst + gEventCount) % kZSDKMessageRecords] = rec;
+    gEventCount++;
+}
+
+//==============================================================================
+//  Contact queues (lock held)
+//==============================================================================
+static void pushBack(int contact, int rec)
+{
+    gRecNext[rec] = kNone;
+    if (gTail[contact] != kNone)
+        gRecNext[gTail[contact]] = rec;
+    else
+        gHead[contact] = rec;
+    gTail[contact] = rec;
+}
+
+static void pushFront(int contact, int rec)
+{
+    gRecNext[rec] = gHead[contact];
+    gHead[contact] = rec;
+    if (gTail[contact] == kNone)
+        gTail[contact] = rec;
+}
+
+static int popFront(int contact)
+{
+    int rec = gHead[contact];
+    gHead[contact] = gRecNext[rec];
+    if (gHead[contact] == kNone)
+        gTail[contact] = kNone;
+    return rec;
+}
+
+static void markReady(int contact)
+{
+    if (gReadyFlag[contact])
+        return;
+    gReadyFlag[contact] = 1;
+    gReady[(gReadyFirst + gReadyCount) % kContacts] = contact;
+    gReadyCount++;
+}
+
+static int popReady(void)
+{
+    int contact = gReady[gReadyFirst];
+    gReadyFirst = (gReadyFirst + 1) % kContacts;
+    gReadyCount--;
+    gReadyFlag[contact] = 0;
+    return contact;
+}
+
+//==============================================================================
+//  Pump (poll thread)
+//==============================================================================
+static void onPumpTick( void * pUserData );
+
+// Expects the lock to be held
+static void schedulePump(uint64_t delayMs)
+{
+    if (gBenchRunning)
+        return;
+    uint64_t due = nowMs() + delayMs;
+    if (due >= gPumpDueMs)
+        return;
+    gPumpDueMs = due;
+    ZSDKPollEngineAddTimedEvent(onPumpTick, NULL, (long)delayMs);
+}
+
+static BOOL isPermanent(int causeCode)
+{
+    // Timeout, rate limited and temporarily unavailable are worth another go
+    return causeCode >= 400 && causeCode < 500 &&
+           causeCode != 408 && causeCode != 429 && causeCode != 480;
+}
+
+static void failRecord(int rec, int causeCode)
+{
+    gRecState[rec] = RecFailed;
+    gRecCause[rec] = causeCode;
+    gStats.failed++;
+    pushEvent(rec);
+}
+
+// A send attempt failed; the message goes back to the front of its queue
+static void retryOrFail(int rec, int causeCode)
+{
+    int contact = gRecContact[rec];
+    if (gRecAttempts[rec] >= kZSDKMessageMaxAttempts || isPermanent(causeCode))
+    {
+        failRecord(rec, causeCode);
+        return;
+    }
+
+    uint64_t backoff = (uint64_t)kZSDKMessageBackoffMs << (gRecAttempts[rec] - 1);
+    if (backoff > kZSDKMessageMaxBackoffMs)
+        backoff = kZSDKMessageMaxBackoffMs;
+    gRecState[rec] = RecQueued;
+    gRecCause[rec] = causeCode;
+    gQueued++;
+    pushFront(contact, rec);
+    gNotBefore[contact] = gBenchRunning ? 0 : nowMs() + backoff;
+    gStats.retries++;
+    markReady(contact);
+    schedulePump(gBenchRunning ? 0 : backoff);
+}
+
+// The contact was removed or refused the subscription: nothing can go out
+static BOOL contactGone(int contact)
+{
+    ZSDKContactPhase phase;
+    return !ZSDKPresenceGet(contact, NULL, &phase, NULL, 0) || phase == ZSDKContactRejected;
+}
+
+// Sends up to kZSDKMessageBurst messages, visiting every ready contact at
+// most once.  Returns the delay until the next pass is worth it, or -1.
+static long pumpOnce(uint64_t now)
+{
+    int sent = 0;
+    uint64_t nextDue = UINT64_MAX;
+
+    for (int visits = gReadyCount; visits > 0 && sent < kZSDKMessageBurst; visits--)
+    {
+        int contact = popReady();
+        if (gHead[contact] == kNone || gInFlight[contact] >= kZSDKMessageWindow)
+            continue;       // back on the ring when a message completes or is queued
+        if (gNotBefore[contact] > now)
+        {
+            if (gNotBefore[contact] < nextDue)
+                nextDue = gNotBefore[contact];
+            markReady(contact);
+            continue;
+        }
+
+        ContactHandler handle = gResolve(contact);
+        if (handle == INVALID_HANDLE)
+        {
+            if (contactGone(contact))
+            {
+                while (gHead[contact] != kNone)
+                {
+                    int rec = popFront(contact);
+                    gQueued--;
+                    failRecord(rec, 0);
+                }
+                continue;
+            }
+            // Still subscribing
+            if (now + 1000 < nextDue)
+                nextDue = now + 1000;
+            markReady(contact);
+            continue;
+        }
+
+        while (gHead[contact] != kNone && gInFlight[contact] < kZSDKMessageWindow &&
+               sent < kZSDKMessageBurst)
+        {
+            int rec = popFront(contact);
+            gQueued--;
+            gRecAttempts[rec]++;
+
+            MessageHandler messageId = INVALID_HANDLE;
+            LIBRESULT res = gMessagingCtx->SendPlainMessage(handle, gRecLength[rec],
+                                                            gArena + gRecOffset[rec], &messageId);
+            if (res == L_OK && messageId != INVALID_HANDLE &&
+                ZSDKHandleMapInsert(&gInFlightMap, messageId, rec))
+            {
+                gRecState[rec] = RecInFlight;
+                gInFlight[contact]++;
+                gStats.inFlight++;
+                gComposing[contact] = 0;        // implied by the message
+                sent++;
+            }
+            else
+            {
+                retryOrFail(rec, 0);
+                break;
+            }
+        }
+        if (gHead[contact] != kNone && gInFlight[contact] < kZSDKMessageWindow)
+            markReady(contact);
+    }
+
+    if (sent > 0 && gReadyCount > 0)
+        return 0;
+    if (nextDue != UINT64_MAX)
+        return (long)(nextDue > now ? nextDue - now : 0);
+    return -1;
+}
+
+static void onPumpTick( void * pUserData )
+{
+    lockMessaging();
+    uint64_t now = nowMs();
+    // Forget the due time even if a later tick is still out: one tick too
+    // many is cheap, a missing one stalls the queue
+    gPumpDueMs = UINT64_MAX;
+    if (!gBenchRunning)
+    {
+        long delay = pumpOnce(now);
+        if (delay >= 0)
+            schedulePump(delay);
+    }
+    unlockMessaging();
+}
+
+//==============================================================================
+//  Main thread
+//==============================================================================
+ZSDKMessageId ZSDKMessagingSend(ZSDKContactId contact, const char * pBody, int length)
+{
+    if (contact < 0 || contact >= kContacts || !pBody || length < 0 || length > kZSDKMessageMaxBody)
+        return 0;
+
+    lockMessaging();
+    int rec = allocRecord(length + 1);
+    if (rec == kNone)
+    {
+        gStats.queueFull++;
+        unlockMessaging();
+        return 0;
+    }
+    memcpy(gArena + gRecOffset[rec], pBody, length);
+    gArena[gRecOffset[rec] + length] = '\0';
+    if (++gNextId == 0)
+        gNextId = 1;
+    gRecId[rec]       = gNextId;
+    gRecState[rec]    = RecQueued;
+    gRecAttempts[rec] = 0;
+    gRecContact[rec]  = contact;
+    gRecLength[rec]   = length;
+    gRecCause[rec]    = 0;
+    gQueued++;
+    pushBack(contact, rec);
+    markReady(contact);
+    schedulePump(0);
+    ZSDKMessageId messageId = gNextId;
+    unlockMessaging();
+    return messageId;
+}
+
+void ZSDKMessagingSetComposing(ZSDKContactId contact, BOOL active)
+{
+    if (contact < 0 || contact >= kContacts)
+        return;
+
+    lockMessaging();
+    uint32_t now = (uint32_t)(nowMs() / 1000);
+    BOOL send;
+    if (active)
+        send = gHead[contact] == kNone &&
+               (!gComposing[contact] || now - gComposingAt[contact] >= kZSDKMessageComposingSecs);
+    else
+        send = gComposing[contact];
+
+    ContactHandler handle = send ? gResolve(contact) : INVALID_HANDLE;
+    LIBRESULT (* setComposing)( ContactHandler, int ) = gMessagingCtx->SetMessageComposingState;
+    if (handle != INVALID_HANDLE && setComposing)
+    {
+        gComposing[contact]   = active ? 1 : 0;
+        gComposingAt[contact] = now;
+        gStats.composingSent++;
+    }
+    else
+    {
+        handle = INVALID_HANDLE;
+        gStats.composingSuppressed++;
+    }
+    unlockMessaging();
+
+    // Not under the lock: the poll thread may be waiting for it inside the
+    // library
+    if (handle != INVALID_HANDLE)
+        setComposing(handle, active ? 1 : 0);
+}
+
+void ZSDKMessagingGetStats(ZSDKMessagingStats * pStats)
+{
+    lockMessaging();
+    *pStats = gStats;
+    pStats->queued = gQueued;
+    if (gRecLive == 0)
+        pStats->arenaBytes = 0;
+    else if (gArenaTail > gRecOffset[gRecFirst])
+        pStats->arenaBytes = gArenaTail - gRecOffset[gRecFirst];
+    else
+        pStats->arenaBytes = kZSDKMessageArenaBytes - gRecOffset[gRecFirst] + gArenaTail;
+    unlockMessaging();
+}
+
+//==============================================================================
+//  Delivery
+//==============================================================================
+// Main queue.  The records stay allocated until the handler has returned, so
+// the body pointers it gets stay valid while the poll thread keeps queuing.
+static void drainMessages(ZSDKMessageHandler handler)
+{
+    lockMessaging();
+    gDispatchPending = NO;
+    unlockMessaging();
+
+    for (;;)
+    {
+        lockMessaging();
+        int count = (gEventCount < kZSDKMessageBatch) ? gEventCount : kZSDKMessageBatch;
+        for (int i = 0; i < count; i++)
+        {
+            int rec = gEvents[(gEventFirst + i) % kZSDKMessageRecords];
+            ZSDKMessageEvent * event = &gDrainBuf[i];
+            gDrainRecs[i] = rec;
+            const char * data = gArena + gRecOffset[rec];
+            event->contact   = gRecContact[rec];
+            event->attempts  = gRecAttempts[rec];
+            event->causeCode = gRecCause[rec];
+            event->length    = gRecLength[rec];
+            event->body      = data;
+            if (gRecState[rec] == RecReceived)
+            {
+                event->kind    = ZSDKMessageReceived;
+                event->message = 0;
+                event->from    = data + gRecLength[rec] + 1;
+            }
+            else
+            {
+                event->kind    = (gRecState[rec] == RecSent) ? ZSDKMessageSent : ZSDKMessageFailed;
+                event->message = gRecId[rec];
+                event->from    = "";
+            }
+        }
+        gEventFirst = (gEventFirst + count) % kZSDKMessageRecords;
+        gEventCount -= count;
+        if (count > 0)
+            gStats.batches++;
+        unlockMessaging();
+
+        if (count == 0)
+            break;
+        if (handler)
+            handler(gDrainBuf, count);
+
+        lockMessaging();
+        for (int i = 0; i < count; i++)
+            releaseRecord(gDrainRecs[i]);
+        unlockMessaging();
+    }
+}
+
+void ZSDKMessagingSetHandler(ZSDKMessageHandler handler)
+{
+    gHandler = handler;
+}
+
+void ZSDKMessagingFlush(void)
+{
+    lockMessaging();
+    BOOL dispatch = gEventCount > 0 && !gDispatchPending && !gBenchRunning;
+    if (dispatch)
+        gDispatchPending = YES;
+    unlockMessaging();
+
+    if (dispatch)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            drainMessages(gHandler);
+        });
+    }
+}
+
+//==============================================================================
+//  Callbacks (poll thread)
+//==============================================================================
+static void completed(MessageHandler messageId, BOOL ok, int causeCode)
+{
+    lockMessaging();
+    int rec = ZSDKHandleMapRemove(&gInFlightMap, messageId);
+    if (rec != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        int contact = gRecContact[rec];
+        gInFlight[contact]--;
+        gStats.inFlight--;
+        if (ok)
+        {
+            gRecState[rec] = RecSent;
+            gStats.sent++;
+            pushEvent(rec);
+        }
+        else
+        {
+            retryOrFail(rec, causeCode);
+        }
+        if (gHead[contact] != kNone)
+        {
+            markReady(contact);
+            schedulePump(0);
+        }
+    }
+    unlockMessaging();
+}
+
+void ZSDKMessagingOnSent(MessageHandler messageId)
+{
+    completed(messageId, YES, 0);
+}
+
+void ZSDKMessagingOnFailed(MessageHandler messageId, int causeCode)
+{
+    completed(messageId, NO, causeCode);
+}
+
+void ZSDKMessagingOnReceived(ContactHandler contactId, const char * pFrom,
+                             const char * pBody, int length)
+{
+    if (!pBody || length < 0)
+        return;
+    const char * from = pFrom ? pFrom : "";
+    int fromLength = (int)strlen(from);
+    ZSDKContactId contact = ZSDKPresenceFindContact(contactId);
+
+    lockMessaging();
+    int rec = allocRecord(length + 1 + fromLength + 1);
+    if (rec == kNone)
+    {
+        gStats.receivedDropped++;
+        unlockMessaging();
+        return;
+    }
+    char * data = gArena + gRecOffset[rec];
+    memcpy(data, pBody, length);
+    data[length] = '\0';
+    memcpy(data + length + 1, from, fromLength + 1);
+    gRecState[rec]    = RecReceived;
+    gRecAttempts[rec] = 0;
+    gRecContact[rec]  = contact;
+    gRecLength[rec]   = length;
+    gRecCause[rec]    = 0;
+    gStats.received++;
+    pushEvent(rec);
+    unlockMessaging();
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+static WrapperContext       gBenchCtx;
+static MessageHandler       gBenchNextHandle;
+static MessageHandler       gBenchPending[kZSDKMessageRecords];
+static int                  gBenchPendingCount;
+static int                  gBenchFailPercent;
+static uint32_t             gBenchRandom;
+static uint64_t             gBenchDone;
+
+// SIP MESSAGE stand-in: takes the body like the library would and answers
+// after the pump tick
+static LIBRESULT benchSend(ContactHandler contactId, int length, const char * pBody,
+                           MessageHandler * pMessageId)
+{
+    volatile char sink = (length > 0) ? pBody[length - 1] : 0;
+    (void)sink;
+    *pMessageId = gBenchNextHandle++;
+    gBenchPending[gBenchPendingCount++] = *pMessageId;
+    return L_OK;
+}
+
+static ContactHandler benchResolve(ZSDKContactId contact)
+{
+    return contact + 1;
+}
+
+static void benchHandler(const ZSDKMessageEvent * events, int count)
+{
+    gBenchDone += count;
+}
+
+static BOOL benchFails(void)
+{
+    gBenchRandom ^= gBenchRandom << 13;
+    gBenchRandom ^= gBenchRandom >> 17;
+    gBenchRandom ^= gBenchRandom << 5;
+    return (int)(gBenchRandom % 100) < gBenchFailPercent;
+}
+
+BOOL ZSDKMessagingBenchmark(int contacts, int messages, int bodyBytes, int failPercent,
+                            ZSDKMessagingBenchResult * pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    if (contacts <= 0 || contacts > kContacts || messages <= 0 ||
+        bodyBytes < 0 || bodyBytes > kZSDKMessageMaxBody || failPercent < 0 || failPercent >= 100)
+        return NO;
+
+    lockMessaging();
+    if (gRecLive > 0 || gBenchRunning)
+    {
+        unlockMessaging();
+        return NO;
+    }
+    memset(&gBenchCtx, 0, sizeof(gBenchCtx));
+    gBenchCtx.SendPlainMessage = benchSend;
+    gBenchNextHandle   = 0x10000;
+    gBenchPendingCount = 0;
+    gBenchFailPercent  = failPercent;
+    gBenchRandom       = 2463534242u;
+    gBenchDone         = 0;
+    ZSDKMessagingStats savedStats = gStats;
+    memset(&gStats, 0, sizeof(gStats));
+    gMessagingCtx = &gBenchCtx;
+    gResolve      = benchResolve;
+    gBenchRunning = YES;
+    unlockMessaging();
+
+    char body[kZSDKMessageMaxBody];
+    memset(body, 'x', sizeof(body));
+
+    int queued = 0;
+    uint64_t queueUs = 0;
+    MessageHandler inFlight[kZSDKMessageRecords];
+    uint64_t startUs = ZSDKMonotonicMicros();
+    while (gBenchDone < (uint64_t)messages)
+    {
+        // Queue until the ring or the arena is full
+        uint64_t queueStartUs = ZSDKMonotonicMicros();
+        while (queued < messages && ZSDKMessagingSend(queued % contacts, body, bodyBytes))
+            queued++;
+        queueUs += ZSDKMonotonicMicros() - queueStartUs;
+
+        lockMessaging();
+        pumpOnce(nowMs());
+        pResult->pumpTicks++;
+        int count = gBenchPendingCount;
+        memcpy(inFlight, gBenchPending, count * sizeof(MessageHandler));
+        gBenchPendingCount = 0;
+        if (count > pResult->maxInFlight)
+            pResult->maxInFlight = count;
+        unlockMessaging();
+
+        for (int i = 0; i < count; i++)
+        {
+            if (benchFails())
+                ZSDKMessagingOnFailed(inFlight[i], 503);
+            else
+                ZSDKMessagingOnSent(inFlight[i]);
+        }
+        drainMessages(benchHandler);
+    }
+    uint64_t elapsedUs = ZSDKMonotonicMicros() - startUs;
+
+    lockMessaging();
+    pResult->contacts          = contacts;
+    pResult->messages          = messages;
+    pResult->bodyBytes         = bodyBytes;
+    pResult->failPercent       = failPercent;
+    pResult->messagesPerSecond = elapsedUs ? messages * 1e6 / elapsedUs : 0;
+    pResult->queueNs           = (double)queueUs * 1000.0 / messages;
+    pResult->retries           = gStats.retries;
+    pResult->failed            = gStats.failed;
+    pResult->arenaHighWater    = gStats.arenaHighWater;
+
+    // Every queue is empty again; leave nothing on the ready ring
+    while (gReadyCount > 0)
+        popReady();
+    gMessagingCtx = &gWrapperCtx;
+    gResolve      = ZSDKPresenceContactHandle;
+    gBenchRunning = NO;
+    gStats        = savedStats;
+    unlockMessaging();
+    return YES;
+}
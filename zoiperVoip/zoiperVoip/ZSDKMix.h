@@ -0,0 +1,51 @@
+//
+//  ZSDKMix.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  N-minus-one mixing of 16 bit PCM frames.  Every input is scaled by its
+//  own gain, the scaled inputs are summed once in 32 bit, and each output
+//  is that sum minus its own contribution, saturated back to 16 bit, so a
+//  frame costs O(N) instead of O(N^2) whatever the party count.  Work is
+//  done in blocks of kZSDKMixBlockSamples to keep the accumulator in L1.
+//
+//  Row kernels exist in scalar, SSE2, AVX2 and NEON flavours and produce
+//  bit-identical output; the kernel choice uses the ZSDKKernel values of
+//  ZSDKColorConvert.h (ZSDKKernelSSE2 rather than ZSDKKernelSSE4, which
+//  the mix has no kernels for).
+//
+
+#import <Foundation/Foundation.h>
+#import "ZSDKColorConvert.h"
+
+#define kZSDKMixBlockSamples    256
+#define kZSDKMixGainShift       12
+#define kZSDKMixUnityGain       (1 << kZSDKMixGainShift)   // Q12
+#define kZSDKMixMaxGain         (4 * kZSDKMixUnityGain)    // +12 dB
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Selects the kernels; returns the kernel actually in use
+ZSDKKernel ZSDKMixInit(ZSDKKernel kernel);
+const char * ZSDKMixKernelName(ZSDKKernel kernel);
+
+// Bytes of scratch ZSDKMixMinusOne() needs for count inputs
+size_t ZSDKMixScratchSize(int count);
+
+// pOutputs[i] receives the mix of every input but pInputs[i].  pGains are
+// Q12 (kZSDKMixUnityGain = 1.0, 0 = muted); NULL means unity for all.
+// Outputs must not alias inputs.
+void ZSDKMixMinusOne(const int16_t * const * pInputs, const int * pGains, int count,
+                     int16_t * const * pOutputs, int samples, void * pScratch);
+
+// Benchmark: mixes random frames of count parties with the given kernel
+// (not changing the selected one).  Returns nanoseconds per participant
+// per frame, or a negative value if the kernel is not supported here.
+double ZSDKMixBenchmark(ZSDKKernel kernel, int count, int samplesPerFrame, int frames);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,426 @@
+//
+//  ZSDKMix.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKMix.h"
+#import "ZSDKPollEngine.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ZSDK_HAVE_X86   1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ZSDK_HAVE_NEON  1
+#include <arm_neon.h>
+#endif
+
+#define kGainRound      (1 << (kZSDKMixGainShift - 1))
+
+// Scaling is (x * gain + 2048) >> 12 saturated, the same in every flavour
+typedef struct {
+    ZSDKKernel  kernel;
+    void (* scale)(const int16_t * pIn, int gain, int16_t * pOut, int count);
+    void (* load)(int32_t * pAcc, const int16_t * pIn, int count);
+    void (* accumulate)(int32_t * pAcc, const int16_t * pIn, int count);
+    void (* minus)(const int32_t * pAcc, const int16_t * pOwn, int16_t * pOut, int count);
+} ZSDKMixKernels;
+
+static const int16_t kSilence[kZSDKMixBlockSamples];
+
+//==============================================================================
+//  Scalar
+//==============================================================================
+static inline int16_t sat16(int32_t v)
+{
+    return (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+}
+
+static void scaleScalar(const int16_t * pIn, int gain, int16_t * pOut, int count)
+{
+    for (int i = 0; i < count; i++)
+        pOut[i] = sat16((pIn[i] * gain + kGainRound) >> kZSDKMixGainShift);
+}
+
+static void loadScalar(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    for (int i = 0; i < count; i++)
+        pAcc[i] = pIn[i];
+}
+
+static void accumulateScalar(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    for (int i = 0; i < count; i++)
+        pAcc[i] += pIn[i];
+}
+
+static void minusScalar(const int32_t * pAcc, const int16_t * pOwn, int16_t * pOut, int count)
+{
+    for (int i = 0; i < count; i++)
+        pOut[i] = sat16(pAcc[i] - pOwn[i]);
+}
+
+static const ZSDKMixKernels kScalarKernels = {
+    ZSDKKernelScalar, scaleScalar, loadScalar, accumulateScalar, minusScalar
+};
+
+//==============================================================================
+//  SSE2 / AVX2 (simulator, macOS hosts)
+//==============================================================================
+#if ZSDK_HAVE_X86
+
+#define ZSDK_SSE2   __attribute__((target("sse2")))
+#define ZSDK_AVX2   __attribute__((target("avx2")))
+
+ZSDK_SSE2 static void scaleSSE2(const int16_t * pIn, int gain, int16_t * pOut, int count)
+{
+    const __m128i g = _mm_set1_epi16((short)gain);
+    const __m128i round = _mm_set1_epi32(kGainRound);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i *)(pIn + i));
+        __m128i lo = _mm_mullo_epi16(x, g);
+        __m128i hi = _mm_mulhi_epi16(x, g);
+        __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), kZSDKMixGainShift);
+        __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), kZSDKMixGainShift);
+        _mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(p0, p1));
+    }
+    scaleScalar(pIn + i, gain, pOut + i, count - i);
+}
+
+ZSDK_SSE2 static void loadSSE2(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(pIn + i));
+        _mm_storeu_si128((__m128i *)(pAcc + i),     _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        _mm_storeu_si128((__m128i *)(pAcc + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+    }
+    loadScalar(pAcc + i, pIn + i, count - i);
+}
+
+ZSDK_SSE2 static void accumulateSSE2(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i *)(pIn + i));
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(pAcc + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(pAcc + i + 4));
+        a0 = _mm_add_epi32(a0, _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        a1 = _mm_add_epi32(a1, _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        _mm_storeu_si128((__m128i *)(pAcc + i),     a0);
+        _mm_storeu_si128((__m128i *)(pAcc + i + 4), a1);
+    }
+    accumulateScalar(pAcc + i, pIn + i, count - i);
+}
+
+ZSDK_SSE2 static void minusSSE2(const int32_t * pAcc, const int16_t * pOwn, int16_t * pOut, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i *)(pOwn + i));
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(pAcc + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(pAcc + i + 4));
+        a0 = _mm_sub_epi32(a0, _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        a1 = _mm_sub_epi32(a1, _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        _mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(a0, a1));
+    }
+    minusScalar(pAcc + i, pOwn + i, pOut + i, count - i);
+}
+
+static const ZSDKMixKernels kSSE2Kernels = {
+    ZSDKKernelSSE2, scaleSSE2, loadSSE2, accumulateSSE2, minusSSE2
+};
+
+// Unpack and pack both work within 128 bit lanes, so scaling keeps the
+// sample order; the 32 bit paths widen whole halves instead
+ZSDK_AVX2 static void scaleAVX2(const int16_t * pIn, int gain, int16_t * pOut, int count)
+{
+    const __m256i g = _mm256_set1_epi16((short)gain);
+    const __m256i round = _mm256_set1_epi32(kGainRound);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i x  = _mm256_loadu_si256((const __m256i *)(pIn + i));
+        __m256i lo = _mm256_mullo_epi16(x, g);
+        __m256i hi = _mm256_mulhi_epi16(x, g);
+        __m256i p0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round), kZSDKMixGainShift);
+        __m256i p1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round), kZSDKMixGainShift);
+        _mm256_storeu_si256((__m256i *)(pOut + i), _mm256_packs_epi32(p0, p1));
+    }
+    scaleScalar(pIn + i, gain, pOut + i, count - i);
+}
+
+ZSDK_AVX2 static void loadAVX2(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pIn + i)));
+        _mm256_storeu_si256((__m256i *)(pAcc + i), x);
+    }
+    loadScalar(pAcc + i, pIn + i, count - i);
+}
+
+ZSDK_AVX2 static void accumulateAVX2(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pIn + i)));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pAcc + i));
+        _mm256_storeu_si256((__m256i *)(pAcc + i), _mm256_add_epi32(a, x));
+    }
+    accumulateScalar(pAcc + i, pIn + i, count - i);
+}
+
+ZSDK_AVX2 static void minusAVX2(const int32_t * pAcc, const int16_t * pOwn, int16_t * pOut, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i x0 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pOwn + i)));
+        __m256i x1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pOwn + i + 8)));
+        __m256i a0 = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(pAcc + i)), x0);
+        __m256i a1 = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(pAcc + i + 8)), x1);
+        // packs interleaves the lanes: a0 lo, a1 lo, a0 hi, a1 hi
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a0, a1), 0xD8);
+        _mm256_storeu_si256((__m256i *)(pOut + i), packed);
+    }
+    minusScalar(pAcc + i, pOwn + i, pOut + i, count - i);
+}
+
+static const ZSDKMixKernels kAVX2Kernels = {
+    ZSDKKernelAVX2, scaleAVX2, loadAVX2, accumulateAVX2, minusAVX2
+};
+
+#endif // ZSDK_HAVE_X86
+
+//==============================================================================
+//  NEON (devices)
+//==============================================================================
+#if ZSDK_HAVE_NEON
+
+static void scaleNEON(const int16_t * pIn, int gain, int16_t * pOut, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(pIn + i);
+        int32x4_t p0 = vmull_n_s16(vget_low_s16(x), (int16_t)gain);
+        int32x4_t p1 = vmull_n_s16(vget_high_s16(x), (int16_t)gain);
+        vst1q_s16(pOut + i, vcombine_s16(vqrshrn_n_s32(p0, kZSDKMixGainShift),
+                                         vqrshrn_n_s32(p1, kZSDKMixGainShift)));
+    }
+    scaleScalar(pIn + i, gain, pOut + i, count - i);
+}
+
+static void loadNEON(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(pIn + i);
+        vst1q_s32(pAcc + i,     vmovl_s16(vget_low_s16(x)));
+        vst1q_s32(pAcc + i + 4, vmovl_s16(vget_high_s16(x)));
+    }
+    loadScalar(pAcc + i, pIn + i, count - i);
+}
+
+static void accumulateNEON(int32_t * pAcc, const int16_t * pIn, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(pIn + i);
+        vst1q_s32(pAcc + i,     vaddw_s16(vld1q_s32(pAcc + i),     vget_low_s16(x)));
+        vst1q_s32(pAcc + i + 4, vaddw_s16(vld1q_s32(pAcc + i + 4), vget_high_s16(x)));
+    }
+    accumulateScalar(pAcc + i, pIn + i, count - i);
+}
+
+static void minusNEON(const int32_t * pAcc, const int16_t * pOwn, int16_t * pOut, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(pOwn + i);
+        int32x4_t a0 = vsubw_s16(vld1q_s32(pAcc + i),     vget_low_s16(x));
+        int32x4_t a1 = vsubw_s16(vld1q_s32(pAcc + i + 4), vget_high_s16(x));
+        vst1q_s16(pOut + i, vcombine_s16(vqmovn_s32(a0), vqmovn_s32(a1)));
+    }
+    minusScalar(pAcc + i, pOwn + i, pOut + i, count - i);
+}
+
+static const ZSDKMixKernels kNEONKernels = {
+    ZSDKKernelNEON, scaleNEON, loadNEON, accumulateNEON, minusNEON
+};
+
+#endif // ZSDK_HAVE_NEON
+
+//==============================================================================
+//  Dispatch
+//==============================================================================
+static const ZSDKMixKernels * gKernels = &kScalarKernels;
+
+static const ZSDKMixKernels * supportedKernels(ZSDKKernel kernel)
+{
+#if ZSDK_HAVE_NEON
+    if (kernel == ZSDKKernelAuto || kernel == ZSDKKernelNEON)
+        return &kNEONKernels;
+#endif
+#if ZSDK_HAVE_X86
+    __builtin_cpu_init();
+    BOOL avx2 = __builtin_cpu_supports("avx2") != 0;
+    BOOL sse2 = __builtin_cpu_supports("sse2") != 0;
+    if ((kernel == ZSDKKernelAuto || kernel == ZSDKKernelAVX2) && avx2)
+        return &kAVX2Kernels;
+    if ((kernel == ZSDKKernelAuto || kernel == ZSDKKernelAVX2 || kernel == ZSDKKernelSSE2) && sse2)
+        return &kSSE2Kernels;
+#endif
+    return &kScalarKernels;
+}
+
+ZSDKKernel ZSDKMixInit(ZSDKKernel kernel)
+{
+    const ZSDKMixKernels * kernels = supportedKernels(kernel);
+    __atomic_store_n(&gKernels, kernels, __ATOMIC_RELEASE);
+    return kernels->kernel;
+}
+
+const char * ZSDKMixKernelName(ZSDKKernel kernel)
+{
+    switch (kernel)
+    {
+        case ZSDKKernelAuto:    return "auto";
+        case ZSDKKernelScalar:  return "scalar";
+        case ZSDKKernelSSE2:    return "sse2";
+        case ZSDKKernelAVX2:    return "avx2";
+        case ZSDKKernelNEON:    return "neon";
+        default:                return "unknown";
+    }
+}
+
+//==============================================================================
+//  Frame level
+//==============================================================================
+
+// Scratch: block accumulator, then a scaled block and a source pointer per
+// input
+size_t ZSDKMixScratchSize(int count)
+{
+    return kZSDKMixBlockSamples * sizeof(int32_t) +
+           (size_t)count * (kZSDKMixBlockSamples * sizeof(int16_t) + sizeof(int16_t *));
+}
+
+static void mixMinusOne(const ZSDKMixKernels * k,
+                        const int16_t * const * pInputs, const int * pGains, int count,
+                        int16_t * const * pOutputs, int samples, void * pScratch)
+{
+    int32_t * acc = (int32_t *)pScratch;
+    int16_t * scaled = (int16_t *)(acc + kZSDKMixBlockSamples);
+    const int16_t ** own = (const int16_t **)(scaled + (size_t)count * kZSDKMixBlockSamples);
+
+    for (int offset = 0; offset < samples; offset += kZSDKMixBlockSamples)
+    {
+        int n = samples - offset;
+        if (n > kZSDKMixBlockSamples)
+            n = kZSDKMixBlockSamples;
+
+        BOOL empty = YES;
+        for (int i = 0; i < count; i++)
+        {
+            int gain = pGains ? pGains[i] : kZSDKMixUnityGain;
+            if (gain <= 0)
+            {
+                own[i] = kSilence;
+                continue;
+            }
+            if (gain > kZSDKMixMaxGain)
+                gain = kZSDKMixMaxGain;
+
+            const int16_t * src = pInputs[i] + offset;
+            if (gain != kZSDKMixUnityGain)
+            {
+                int16_t * dst = scaled + (size_t)i * kZSDKMixBlockSamples;
+                k->scale(src, gain, dst, n);
+                src = dst;
+            }
+            own[i] = src;
+
+            if (empty)
+                k->load(acc, src, n);
+            else
+                k->accumulate(acc, src, n);
+            empty = NO;
+        }
+        if (empty)
+            memset(acc, 0, n * sizeof(int32_t));
+
+        for (int i = 0; i < count; i++)
+            k->minus(acc, own[i], pOutputs[i] + offset, n);
+    }
+}
+
+void ZSDKMixMinusOne(const int16_t * const * pInputs, const int * pGains, int count,
+                     int16_t * const * pOutputs, int samples, void * pScratch)
+{
+    mixMinusOne(__atomic_load_n(&gKernels, __ATOMIC_ACQUIRE),
+                pInputs, pGains, count, pOutputs, samples, pScratch);
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+double ZSDKMixBenchmark(ZSDKKernel kernel, int count, int samplesPerFrame, int frames)
+{
+    const ZSDKMixKernels * k = supportedKernels(kernel);
+    if (kernel != ZSDKKernelAuto && k->kernel != kernel)
+        return -1;
+    if (count <= 0 || samplesPerFrame <= 0 || frames <= 0)
+        return -1;
+
+    size_t frameBytes = (size_t)samplesPerFrame * sizeof(int16_t);
+    int16_t * inputs = malloc(frameBytes * count);
+    int16_t * outputs = malloc(frameBytes * count);
+    const int16_t ** inPtrs = malloc(count * sizeof(int16_t *));
+    int16_t ** outPtrs = malloc(count * sizeof(int16_t *));
+    int * gains = malloc(count * sizeof(int));
+    void * scratch = malloc(ZSDKMixScratchSize(count));
+    if (!inputs || !outputs || !inPtrs || !outPtrs || !gains || !scratch)
+    {
+        free(inputs); free(outputs); free(inPtrs); free(outPtrs); free(gains); free(scratch);
+        return -1;
+    }
+
+    // Speech-level noise; every other party at a non-unity gain so both
+    // the scaled and the pass-through paths are measured
+    uint32_t seed = 0x2545F491;
+    for (int i = 0; i < samplesPerFrame * count; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        inputs[i] = (int16_t)((int32_t)(seed >> 16) - 32768) / 4;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        inPtrs[i]  = inputs + (size_t)i * samplesPerFrame;
+        outPtrs[i] = outputs + (size_t)i * samplesPerFrame;
+        gains[i]   = (i & 1) ? kZSDKMixUnityGain * 7 / 10 : kZSDKMixUnityGain;
+    }
+
+    mixMinusOne(k, inPtrs, gains, count, outPtrs, samplesPerFrame, scratch);   // warm up
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int f = 0; f < frames; f++)
+        mixMinusOne(k, inPtrs, gains, count, outPtrs, samplesPerFrame, scratch);
+    uint64_t elapsedUs = ZSDKMonotonicMicros() - startUs;
+
+    free(inputs); free(outputs); free(inPtrs); free(outPtrs); free(gains); free(scratch);
+    return (double)elapsedUs * 1000.0 / ((double)frames * count);
+}
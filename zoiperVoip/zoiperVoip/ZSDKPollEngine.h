@@ -0,0 +1,69 @@
+//
+//  ZSDKPollEngine.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Dedicated thread driving PollLibrary(). While calls are active the thread
+//  polls on a short fixed interval; while idle the interval doubles after
+//  every empty poll up to kZSDKPollIdleMaxMs. ZSDKPollEngineWakeup() and
+//  timed custom events scheduled through ZSDKPollEngineAddTimedEvent() cut
+//  the current wait short.  Network traffic does not wake the thread (the
+//  library only sees it when polled), so kZSDKPollIdleMaxMs bounds how long
+//  an incoming INVITE or NOTIFY can wait while idle.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKPollActiveIntervalMs   5
+#define kZSDKPollIdleMinMs          20
+#define kZSDKPollIdleMaxMs          250
+#define kZSDKPollMaxTimedEvents     64
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t polls;                 // PollEvents() invocations
+    uint64_t wakeups;               // polls started by ZSDKPollEngineWakeup()
+    uint64_t timeouts;              // polls started by the interval expiring
+    uint64_t events;                // callbacks dispatched by the library
+    uint64_t emptyPolls;            // polls that dispatched nothing
+    uint64_t wakeupLatencyTotalUs;  // wakeup signal -> PollEvents() start
+    uint64_t wakeupLatencyMaxUs;
+    uint64_t timedEvents;           // timed custom events fired
+    uint64_t timedLatencyTotalUs;   // due time -> callback
+    uint64_t timedLatencyMaxUs;
+    uint32_t currentIntervalMs;     // interval used for the last wait
+    BOOL     active;
+} ZSDKPollStats;
+
+uint64_t ZSDKMonotonicMicros(void);
+
+// Main thread
+void ZSDKPollEngineStart(void);
+void ZSDKPollEngineStop(void);
+
+// Interrupts the current wait so the next PollEvents() happens right away.
+// Safe to call from any thread.
+void ZSDKPollEngineWakeup(void);
+
+// Switches between the tight (calls in progress) and backing-off idle mode.
+void ZSDKPollEngineSetActive(BOOL active);
+
+// Called by every library callback so the engine knows a poll was not empty.
+void ZSDKPollEngineNoteEvent(void);
+
+// AddTimedCustomEvent() wrapper that makes sure the engine is awake when the
+// event becomes due.
+LIBRESULT ZSDKPollEngineAddTimedEvent(pfCustomEventCbk pCbk, void * pUserData,
+                                      long delayMs);
+
+void ZSDKPollEngineGetStats(ZSDKPollStats * pStats);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,253 @@
+//
+//  ZSDKPollEngine.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKPollEngine.h"
+#import "ZSDKLibControl.h"
+#import <pthread.h>
+#import <mach/mach_time.h>
+
+typedef struct {
+    pfCustomEventCbk pCbk;
+    void *           pUserData;
+    uint64_t         dueUs;
+    BOOL             inUse;
+} ZSDKTimedEvent;
+
+static pthread_t            gPollThread;
+static int                  gPollRunning = 0;       // read from any thread
+static dispatch_semaphore_t gPollSignal;
+static int                  gPollWakePending = 0;
+static uint64_t             gPollWakeSignalUs = 0;
+static int                  gPollActive = 0;
+static ZSDKPollStats        gPollStats;
+
+static pthread_mutex_t      gTimedLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKTimedEvent       gTimedEvents[kZSDKPollMaxTimedEvents];
+
+#define STAT_ADD(field, v)  __atomic_fetch_add(&gPollStats.field, (v), __ATOMIC_RELAXED)
+#define STAT_MAX(field, v)  statMax(&gPollStats.field, (v))
+
+static inline void statMax(uint64_t * pField, uint64_t v)
+{
+    // Retry until v is stored or another thread has published a larger maximum
+    uint64_t seen = __atomic_load_n(pField, __ATOMIC_RELAXED);
+    while (v > seen &&
+           !__atomic_compare_exchange_n(pField, &seen, v, YES, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+uint64_t ZSDKMonotonicMicros(void)
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+}
+
+//==============================================================================
+//  Timed custom events
+//==============================================================================
+static void onTimedEventFired( void * pUserData )
+{
+    ZSDKTimedEvent * ev = (ZSDKTimedEvent *)pUserData;
+    uint64_t now = ZSDKMonotonicMicros();
+
+    pthread_mutex_lock(&gTimedLock);
+    pfCustomEventCbk pCbk = ev->pCbk;
+    void * pData = ev->pUserData;
+    uint64_t late = (now > ev->dueUs) ? now - ev->dueUs : 0;
+    ev->inUse = NO;
+    pthread_mutex_unlock(&gTimedLock);
+
+    STAT_ADD(timedEvents, 1);
+    STAT_ADD(timedLatencyTotalUs, late);
+    STAT_MAX(timedLatencyMaxUs, late);
+
+    if (pCbk)
+        pCbk(pData);
+}
+
+// Returns the number of ms until the earliest pending timed event is due, or
+// `limitMs` if nothing is due sooner.
+static uint32_t nextTimedEventMs( uint32_t limitMs )
+{
+    uint64_t now = ZSDKMonotonicMicros();
+    uint64_t best = now + (uint64_t)limitMs * 1000;
+
+    pthread_mutex_lock(&gTimedLock);
+    for (int i = 0; i < kZSDKPollMaxTimedEvents; i++)
+    {
+        if (gTimedEvents[i].inUse && gTimedEvents[i].dueUs < best)
+            best = gTimedEvents[i].dueUs;
+    }
+    pthread_mutex_unlock(&gTimedLock);
+
+    return (best <= now) ? 0 : (uint32_t)((best - now + 999) / 1000);
+}
+
+LIBRESULT ZSDKPollEngineAddTimedEvent( pfCustomEventCbk pCbk, void * pUserData,
+                                       long delayMs )
+{
+    ZSDKTimedEvent * ev = NULL;
+
+    pthread_mutex_lock(&gTimedLock);
+    for (int i = 0; i < kZSDKPollMaxTimedEvents; i++)
+    {
+        if (!gTimedEvents[i].inUse)
+        {
+            ev = &gTimedEvents[i];
+            ev->pCbk = pCbk;
+            ev->pUserData = pUserData;
+            ev->dueUs = ZSDKMonotonicMicros() + (uint64_t)(delayMs > 0 ? delayMs : 0) * 1000;
+            ev->inUse = YES;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gTimedLock);
+
+    LIBRESULT res;
+    if (ev)
+    {
+        res = gWrapperCtx.AddTimedCustomEvent(onTimedEventFired, ev, delayMs);
+        if (res != L_OK)
+        {
+            pthread_mutex_lock(&gTimedLock);
+            ev->inUse = NO;
+            pthread_mutex_unlock(&gTimedLock);
+        }
+    }
+    else
+    {
+        // Slot table exhausted; the event still fires, just without the
+        // engine knowing its due time (it is picked up by the next poll).
+        res = gWrapperCtx.AddTimedCustomEvent(pCbk, pUserData, delayMs);
+    }
+
+    // Re-evaluate the wait so the new due time is honoured
+    ZSDKPollEngineWakeup();
+    return res;
+}
+
+//==============================================================================
+//  Poll thread
+//==============================================================================
+static void * pollThreadMain( void * arg )
+{
+    pthread_setname_np("zsdk.poll");
+
+    uint32_t idleMs = kZSDKPollIdleMinMs;
+
+    while (__atomic_load_n(&gPollRunning, __ATOMIC_ACQUIRE))
+    {
+        BOOL active = __atomic_load_n(&gPollActive, __ATOMIC_RELAXED) != 0;
+        uint32_t waitMs = nextTimedEventMs(active ? kZSDKPollActiveIntervalMs : idleMs);
+        __atomic_store_n(&gPollStats.currentIntervalMs, waitMs, __ATOMIC_RELAXED);
+
+        long timedOut = dispatch_semaphore_wait(gPollSignal,
+                            dispatch_time(DISPATCH_TIME_NOW, (int64_t)waitMs * NSEC_PER_MSEC));
+
+        if (__atomic_exchange_n(&gPollWakePending, 0, __ATOMIC_ACQ_REL))
+        {
+            uint64_t now = ZSDKMonotonicMicros();
+            uint64_t signalled = __atomic_load_n(&gPollWakeSignalUs, __ATOMIC_RELAXED);
+            uint64_t latency = (now > signalled) ? now - signalled : 0;
+            STAT_ADD(wakeups, 1);
+            STAT_ADD(wakeupLatencyTotalUs, latency);
+            STAT_MAX(wakeupLatencyMaxUs, latency);
+        }
+        if (timedOut)
+            STAT_ADD(timeouts, 1);
+
+        uint64_t eventsBefore = __atomic_load_n(&gPollStats.events, __ATOMIC_RELAXED);
+        PollLibrary();
+        STAT_ADD(polls, 1);
+
+        if (__atomic_load_n(&gPollStats.events, __ATOMIC_RELAXED) != eventsBefore || !timedOut)
+        {
+            idleMs = kZSDKPollIdleMinMs;
+        }
+        else
+        {
+            STAT_ADD(emptyPolls, 1);
+            idleMs = (idleMs * 2 > kZSDKPollIdleMaxMs) ? kZSDKPollIdleMaxMs : idleMs * 2;
+        }
+    }
+    return NULL;
+}
+
+void ZSDKPollEngineStart(void)
+{
+    if (__atomic_load_n(&gPollRunning, __ATOMIC_ACQUIRE))
+        return;
+
+    memset(&gPollStats, 0, sizeof(gPollStats));
+    // Kept across restarts: a late wakeup must not signal a freed semaphore
+    if (!gPollSignal)
+        gPollSignal = dispatch_semaphore_create(0);
+    __atomic_store_n(&gPollWakePending, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&gPollRunning, 1, __ATOMIC_RELEASE);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_set_qos_class_np(&attr, QOS_CLASS_USER_INTERACTIVE, 0);
+    if (pthread_create(&gPollThread, &attr, pollThreadMain, NULL) != 0)
+    {
+        NSLog(@"ERROR SETUP poll thread");
+        __atomic_store_n(&gPollRunning, 0, __ATOMIC_RELEASE);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void ZSDKPollEngineStop(void)
+{
+    if (__atomic_exchange_n(&gPollRunning, 0, __ATOMIC_ACQ_REL) == 0)
+        return;
+
+    dispatch_semaphore_signal(gPollSignal);
+    pthread_join(gPollThread, NULL);
+}
+
+void ZSDKPollEngineWakeup(void)
+{
+    if (!__atomic_load_n(&gPollRunning, __ATOMIC_ACQUIRE))
+        return;
+
+    // Coalesce: only the first wakeup since the last poll signals the thread
+    if (__atomic_exchange_n(&gPollWakePending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        __atomic_store_n(&gPollWakeSignalUs, ZSDKMonotonicMicros(), __ATOMIC_RELAXED);
+        dispatch_semaphore_signal(gPollSignal);
+    }
+}
+
+void ZSDKPollEngineSetActive(BOOL active)
+{
+    int was = __atomic_exchange_n(&gPollActive, active ? 1 : 0, __ATOMIC_RELAXED);
+    if (active && !was)
+        ZSDKPollEngineWakeup();
+}
+
+void ZSDKPollEngineNoteEvent(void)
+{
+    STAT_ADD(events, 1);
+}
+
+void ZSDKPollEngineGetStats(ZSDKPollStats * pStats)
+{
+    pStats->polls                = __atomic_load_n(&gPollStats.polls, __ATOMIC_RELAXED);
+    pStats->wakeups              = __atomic_load_n(&gPollStats.wakeups, __ATOMIC_RELAXED);
+    pStats->timeouts             = __atomic_load_n(&gPollStats.timeouts, __ATOMIC_RELAXED);
+    pStats->events               = __atomic_load_n(&gPollStats.events, __ATOMIC_RELAXED);
+    pStats->emptyPolls           = __atomic_load_n(&gPollStats.emptyPolls, __ATOMIC_RELAXED);
+    pStats->wakeupLatencyTotalUs = __atomic_load_n(&gPollStats.wakeupLatencyTotalUs, __ATOMIC_RELAXED);
+    pStats->wakeupLatencyMaxUs   = __atomic_load_n(&gPollStats.wakeupLatencyMaxUs, __ATOMIC_RELAXED);
+    pStats->timedEvents          = __atomic_load_n(&gPollStats.timedEvents, __ATOMIC_RELAXED);
+    pStats->timedLatencyTotalUs  = __atomic_load_n(&gPollStats.timedLatencyTotalUs, __ATOMIC_RELAXED);
+    pStats->timedLatencyMaxUs    = __atomic_load_n(&gPollStats.timedLatencyMaxUs, __ATOMIC_RELAXED);
+    pStats->currentIntervalMs    = __atomic_load_n(&gPollStats.currentIntervalMs, __ATOMIC_RELAXED);
+    pStats->active               = __atomic_load_n(&gPollActive, __ATOMIC_RELAXED) != 0;
+}
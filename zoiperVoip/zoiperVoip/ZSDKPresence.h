@@ -0,0 +1,132 @@
+//
+//  ZSDKPresence.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Presence of large contact directories.  Contact state lives in a
+//  preallocated struct-of-arrays table: the fields touched by every status
+//  callback (handle, status, phase, flags) are dense arrays of their own, so
+//  updates and scans stay in a few cache lines per contact while numbers and
+//  notes sit in separate arrays.  A ZSDKHandleMap maps ContactHandler ->
+//  slot; the slot is the stable ZSDKContactId the application sees, also
+//  across re-subscriptions that give the contact a new handle.
+//
+//  SUBSCRIBEs never go out in one storm: AddContact2() for new contacts,
+//  re-subscriptions after a deactivation and RefreshContact() requests are
+//  released by a pacer in bursts, and every subscription gets a jittered
+//  expiry so the library's own refreshes spread out as well.
+//
+//  onContactStatus and friends only update the table and mark the contact
+//  dirty.  At the end of each poll cycle (PollLibrary()) the dirty set is
+//  handed to the main queue once; the handler gets one change per contact
+//  with its latest state, however many callbacks arrived in between.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKPresenceMaxContacts        16384
+#define kZSDKPresenceTableBits          15      // 32768 buckets
+#define kZSDKPresenceNumberLen          32
+#define kZSDKPresenceNoteLen            32
+
+#define kZSDKPresenceBurst              32      // SUBSCRIBEs per pace tick
+#define kZSDKPresencePaceMs             50
+#define kZSDKPresenceSubscribeSeconds   3600
+#define kZSDKPresenceJitterPercent      20
+#define kZSDKPresenceResubscribeSecs    30      // after a deactivation
+#define kZSDKPresenceBatch              1024    // changes per handler call
+
+typedef int ZSDKContactId;                      // -1: invalid
+
+typedef enum {
+    ZSDKContactFree = 0
+,   ZSDKContactQueued               // waiting for the pacer
+,   ZSDKContactSubscribing          // AddContact2() sent, no status yet
+,   ZSDKContactSubscribed
+,   ZSDKContactRetrying             // library retries on its own
+,   ZSDKContactWaiting              // deactivated; re-subscribed later
+,   ZSDKContactRejected             // refused by the remote side
+} ZSDKContactPhase;
+
+typedef struct {
+    ZSDKContactId       contact;
+    uint8_t             status;     // eContactState_t
+    uint8_t             phase;      // ZSDKContactPhase
+    char                note[kZSDKPresenceNoteLen];
+} ZSDKPresenceChange;
+
+typedef struct {
+    int                 contacts;
+    int                 subscribed;
+    int                 pending;            // queued, waiting or refresh due
+    uint64_t            subscribes;         // AddContact2() calls
+    uint64_t            refreshes;          // RefreshContact() calls
+    uint64_t            statusCallbacks;
+    uint64_t            changesDelivered;   // after coalescing
+    uint64_t            batches;
+    uint64_t            maxBatch;
+    uint64_t            terminations;
+    uint64_t            publications;
+    uint64_t            publicationFailures;
+} ZSDKPresenceStats;
+
+typedef void (^ZSDKPresenceHandler)(const ZSDKPresenceChange * changes, int count);
+
+// Main queue
+void ZSDKPresenceSetHandler(ZSDKPresenceHandler handler);
+
+// Queues the subscription; flags are CONTACT_SUBSCRIBE_* for AddContact2().
+// Returns -1 when the table is full.
+ZSDKContactId ZSDKPresenceAdd(UserHandler userId, const char * pNumber, int flags);
+void ZSDKPresenceRemove(ZSDKContactId contact);
+
+// Re-subscribes every subscribed contact, paced like new ones
+void ZSDKPresenceRefreshAll(void);
+
+BOOL ZSDKPresenceGet(ZSDKContactId contact, eContactState_t * pStatus, ZSDKContactPhase * pPhase,
+                     char * pNote, size_t noteSize);
+
+// Library handle of the contact's current subscription, INVALID_HANDLE
+// while it has none (queued, waiting, rejected)
+ContactHandler ZSDKPresenceContactHandle(ZSDKContactId contact);
+
+// Contact id for a library handle, -1 if it is not in the table
+ZSDKContactId ZSDKPresenceFindContact(ContactHandler contactId);
+
+// PublishStatus() with the jittered refresh
+BOOL ZSDKPresencePublish(UserHandler userId, eContactState_t status, const char * pNote);
+
+void ZSDKPresenceGetStats(ZSDKPresenceStats * pStats);
+
+// End of a poll cycle (poll thread): hands the dirty contacts to the main
+// queue if they are not on their way already
+void ZSDKPresenceFlush(void);
+
+// Callbacks (poll thread)
+void ZSDKPresenceOnStatus(ContactHandler contactId, eContactState_t status, const char * pNote);
+void ZSDKPresenceOnTerminated(ContactHandler contactId, eRejectionType_t type);
+void ZSDKPresenceOnRetrying(ContactHandler contactId);
+void ZSDKPresenceOnPublication(UserHandler userId, BOOL ok);
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+typedef struct {
+    int         contacts;
+    int         updates;            // status callbacks simulated
+    double      addNs;              // per ZSDKPresenceAdd()
+    double      subscribeMs;        // all contacts through the pacer, wall time at the pace
+    double      updateNs;           // per status callback
+    double      drainNs;            // per delivered change (flush + main queue drain)
+    uint64_t    delivered;          // changes after coalescing
+    size_t      tableBytes;
+} ZSDKPresenceBenchResult;
+
+// Runs the table, pacer and delivery paths against a stand-in library
+// (main thread, no contacts in the table).  updates status callbacks are
+// spread over random contacts, with a flush every kZSDKPresenceBatch.
+// Returns NO if the table is in use.
+BOOL ZSDKPresenceBenchmark(int contacts, int updates, ZSDKPresenceBenchResult * pResult);
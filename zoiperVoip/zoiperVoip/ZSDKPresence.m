@@ -0,0 +1,588 @@
+//
+//  ZSDKPresence.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKPresence.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKHandleMap.h"
+#import <pthread.h>
+
+#define kFlagDirty      0x01            // in gDirty, waiting for the main queue
+#define kFlagRefresh    0x02            // RefreshContact() due
+
+static pthread_mutex_t      gPresenceLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The table, one array per field
+static ContactHandler       gHandle[kZSDKPresenceMaxContacts];     // INVALID_HANDLE: no subscription
+static UserHandler          gUser[kZSDKPresenceMaxContacts];
+static uint8_t              gStatus[kZSDKPresenceMaxContacts];
+static uint8_t              gPhase[kZSDKPresenceMaxContacts];
+static uint8_t              gFlags[kZSDKPresenceMaxContacts];
+static uint8_t              gSubscribe[kZSDKPresenceMaxContacts];  // CONTACT_SUBSCRIBE_*
+static uint32_t             gRetryAt[kZSDKPresenceMaxContacts];    // seconds, ZSDKContactWaiting
+static char                 gNumber[kZSDKPresenceMaxContacts][kZSDKPresenceNumberLen];
+static char                 gNote[kZSDKPresenceMaxContacts][kZSDKPresenceNoteLen];
+
+static ZSDKHandleBucket     gBuckets[1 << kZSDKPresenceTableBits];
+static ZSDKHandleMap        gMap;
+static int                  gFreeSlots[kZSDKPresenceMaxContacts];
+static int                  gFreeCount = 0;
+static int                  gHighWater = 0;         // slots above were never used
+static BOOL                 gTableReady = NO;
+
+static int                  gDirty[kZSDKPresenceMaxContacts];
+static int                  gDirtyCount = 0;
+static BOOL                 gDispatchPending = NO;
+
+static int                  gPending = 0;           // queued, waiting or refresh due
+static int                  gPacerCursor = 0;
+static BOOL                 gPacerScheduled = NO;
+static ZSDKPresenceStats    gStats;
+
+// The benchmark swaps in its own library functions
+static WrapperContext *     gPresenceCtx = &gWrapperCtx;
+static BOOL                 gBenchRunning = NO;
+
+static ZSDKPresenceHandler  gHandler = nil;         // main queue only
+static ZSDKPresenceChange   gDrainBuf[kZSDKPresenceBatch];
+
+static void lockPresence(void)
+{
+    pthread_mutex_lock(&gPresenceLock);
+    if (!gTableReady)
+    {
+        ZSDKHandleMapInit(&gMap, gBuckets, kZSDKPresenceTableBits);
+        // Popped from the top: lowest slots first keeps the scans short
+        for (int i = 0; i < kZSDKPresenceMaxContacts; i++)
+            gFreeSlots[i] = kZSDKPresenceMaxContacts - 1 - i;
+        gFreeCount = kZSDKPresenceMaxContacts;
+        gTableReady = YES;
+    }
+}
+
+static void unlockPresence(void)
+{
+    pthread_mutex_unlock(&gPresenceLock);
+}
+
+static uint32_t nowSeconds(void)
+{
+    return (uint32_t)(ZSDKMonotonicMicros() / 1000000);
+}
+
+static int jitteredSeconds(void)
+{
+    int spread = kZSDKPresenceSubscribeSeconds * kZSDKPresenceJitterPercent / 100;
+    return kZSDKPresenceSubscribeSeconds - (int)arc4random_uniform(spread + 1);
+}
+
+//==============================================================================
+//  Table (lock held)
+//==============================================================================
+static BOOL isPendingPhase(uint8_t phase)
+{
+    return phase == ZSDKContactQueued || phase == ZSDKContactWaiting;
+}
+
+static void setPhase(int slot, ZSDKContactPhase phase)
+{
+    gPending += isPendingPhase(phase) - isPendingPhase(gPhase[slot]);
+    gPhase[slot] = phase;
+}
+
+static void clearRefresh(int slot)
+{
+    if (gFlags[slot] & kFlagRefresh)
+    {
+        gFlags[slot] &= ~kFlagRefresh;
+        gPending--;
+    }
+}
+
+static void markDirty(int slot)
+{
+    if (gFlags[slot] & kFlagDirty)
+        return;
+    gFlags[slot] |= kFlagDirty;
+    gDirty[gDirtyCount++] = slot;
+}
+
+static void dropHandle(int slot)
+{
+    if (gHandle[slot] == INVALID_HANDLE)
+        return;
+    ZSDKHandleMapRemove(&gMap, gHandle[slot]);
+    gHandle[slot] = INVALID_HANDLE;
+}
+
+static BOOL validContact(ZSDKContactId contact)
+{
+    return contact >= 0 && contact < gHighWater && gPhase[contact] != ZSDKContactFree;
+}
+
+//==============================================================================
+//  Subscription pacer
+//==============================================================================
+static void subscribe(int slot)
+{
+    ContactHandler handle = INVALID_HANDLE;
+    LIBRESULT res = L_FAIL;
+    if (gPresenceCtx->AddContact2)
+        res = gPresenceCtx->AddContact2(gUser[slot], gNumber[slot], &handle,
+                                        jitteredSeconds(), -1, gSubscribe[slot]);
+    else if (gPresenceCtx->AddContact)
+        res = gPresenceCtx->AddContact(gUser[slot], gNumber[slot], &handle, jitteredSeconds(), -1);
+    gStats.subscribes++;
+
+    if (res == L_OK && handle != INVALID_HANDLE && ZSDKHandleMapInsert(&gMap, handle, slot))
+    {
+        gHandle[slot] = handle;
+        setPhase(slot, ZSDKContactSubscribing);
+    }
+    else
+    {
+        setPhase(slot, ZSDKContactRejected);
+        gStatus[slot] = CONTACT_STATE_UNKNOWN;
+        markDirty(slot);
+    }
+}
+
+// Releases up to kZSDKPresenceBurst requests; returns how many went out
+static int paceOnce(uint32_t now)
+{
+    int released = 0;
+    for (int n = 0; n < gHighWater && gPending > 0 && released < kZSDKPresenceBurst; n++)
+    {
+        int slot = gPacerCursor;
+        gPacerCursor = (gPacerCursor + 1 < gHighWater) ? gPacerCursor + 1 : 0;
+
+        if (gPhase[slot] == ZSDKContactQueued ||
+            (gPhase[slot] == ZSDKContactWaiting && (int32_t)(now - gRetryAt[slot]) >= 0))
+        {
+            subscribe(slot);
+            released++;
+        }
+        else if ((gFlags[slot] & kFlagRefresh) && gHandle[slot] != INVALID_HANDLE)
+        {
+            clearRefresh(slot);
+            if (gPresenceCtx->RefreshContact)
+                gPresenceCtx->RefreshContact(gHandle[slot]);
+            gStats.refreshes++;
+            released++;
+        }
+    }
+    return released;
+}
+
+static void schedulePacer(long delayMs);
+
+static void onPacerTick( void * pUserData )
+{
+    lockPresence();
+    gPacerScheduled = NO;
+    if (!gBenchRunning && gPending > 0)
+    {
+        // Only re-subscriptions that are not due yet: look again later
+        int released = paceOnce(nowSeconds());
+        schedulePacer(released ? kZSDKPresencePaceMs : 1000);
+    }
+    unlockPresence();
+}
+
+// Expects the lock to be held
+static void schedulePacer(long delayMs)
+{
+    if (gPacerScheduled || gBenchRunning)
+        return;
+    gPacerScheduled = YES;
+    ZSDKPollEngineAddTimedEvent(onPacerTick, NULL, delayMs);
+}
+
+//==============================================================================
+//  Contacts (main thread)
+//==============================================================================
+ZSDKContactId ZSDKPresenceAdd(UserHandler userId, const char * pNumber, int flags)
+{
+    lockPresence();
+    if (gFreeCount == 0)
+    {
+        unlockPresence();
+        NSLog(@"ZOIPER: contact table full");
+        return -1;
+    }
+    int slot = gFreeSlots[--gFreeCount];
+    if (slot >= gHighWater)
+        gHighWater = slot + 1;
+
+    gHandle[slot]    = INVALID_HANDLE;
+    gUser[slot]      = userId;
+    gStatus[slot]    = CONTACT_STATE_UNKNOWN;
+    gPhase[slot]     = ZSDKContactFree;
+    gFlags[slot]    &= kFlagDirty;          // may still be on its way from a removed contact
+    gSubscribe[slot] = (uint8_t)flags;
+    gNote[slot][0]   = '\0';
+    strlcpy(gNumber[slot], pNumber ? pNumber : "", sizeof(gNumber[slot]));
+    setPhase(slot, ZSDKContactQueued);
+    gStats.contacts++;
+
+    schedulePacer(0);
+    unlockPresence();
+    return slot;
+}
+
+void ZSDKPresenceRemove(ZSDKContactId contact)
+{
+    lockPresence();
+    ContactHandler handle = INVALID_HANDLE;
+    LIBRESULT (* removeContact)( ContactHandler ) = gPresenceCtx->RemoveContact;
+    if (validContact(contact))
+    {
+        handle = gHandle[contact];
+        dropHandle(contact);
+        clearRefresh(contact);
+        setPhase(contact, ZSDKContactFree);
+        gStatus[contact] = CONTACT_STATE_UNKNOWN;
+        gFreeSlots[gFreeCount++] = contact;
+        gStats.contacts--;
+    }
+    unlockPresence();
+
+    // Not under the lock: the poll thread may be waiting for it inside the
+    // library
+    if (handle != INVALID_HANDLE && removeContact)
+        removeContact(handle);
+}
+
+void ZSDKPresenceRefreshAll(void)
+{
+    lockPresence();
+    for (int slot = 0; slot < gHighWater; slot++)
+    {
+        if (gHandle[slot] != INVALID_HANDLE && !(gFlags[slot] & kFlagRefresh))
+        {
+            gFlags[slot] |= kFlagRefresh;
+            gPending++;
+        }
+    }
+    if (gPending > 0)
+        schedulePacer(0);
+    unlockPresence();
+}
+
+BOOL ZSDKPresenceGet(ZSDKContactId contact, eContactState_t * pStatus, ZSDKContactPhase * pPhase,
+                     char * pNote, size_t noteSize)
+{
+    lockPresence();
+    BOOL valid = validContact(contact);
+    if (valid)
+    {
+        if (pStatus)
+            *pStatus = gStatus[contact];
+        if (pPhase)
+            *pPhase = gPhase[contact];
+        if (pNote && noteSize)
+            strlcpy(pNote, gNote[contact], noteSize);
+    }
+    unlockPresence();
+    return valid;
+}
+
+ContactHandler ZSDKPresenceContactHandle(ZSDKContactId contact)
+{
+    lockPresence();
+    ContactHandler handle = validContact(contact) ? gHandle[contact] : INVALID_HANDLE;
+    unlockPresence();
+    return handle;
+}
+
+ZSDKContactId ZSDKPresenceFindContact(ContactHandler contactId)
+{
+    lockPresence();
+    int slot = ZSDKHandleMapFind(&gMap, contactId);
+    unlockPresence();
+    return (slot != ZSDK_HANDLE_MAP_EMPTY) ? slot : -1;
+}
+
+BOOL ZSDKPresencePublish(UserHandler userId, eContactState_t status, const char * pNote)
+{
+    if (!gWrapperCtx.PublishStatus)
+        return NO;
+    return gWrapperCtx.PublishStatus(userId, status, pNote, jitteredSeconds()) == L_OK;
+}
+
+void ZSDKPresenceGetStats(ZSDKPresenceStats * pStats)
+{
+    lockPresence();
+    *pStats = gStats;
+    pStats->pending    = gPending;
+    pStats->subscribed = 0;
+    for (int slot = 0; slot < gHighWater; slot++)
+        pStats->subscribed += (gPhase[slot] == ZSDKContactSubscribed);
+    unlockPresence();
+}
+
+//==============================================================================
+//  Delivery
+//==============================================================================
+// Main queue.  Delivers what is dirty now; later changes go with the next
+// flush.
+static void drainChanges(ZSDKPresenceHandler handler)
+{
+    lockPresence();
+    gDispatchPending = NO;
+    unlockPresence();
+
+    for (;;)
+    {
+        lockPresence();
+        int count = (gDirtyCount < kZSDKPresenceBatch) ? gDirtyCount : kZSDKPresenceBatch;
+        for (int i = 0; i < count; i++)
+        {
+            int slot = gDirty[gDirtyCount - 1 - i];
+            ZSDKPresenceChange * change = &gDrainBuf[i];
+            change->contact = slot;
+            change->status  = gStatus[slot];
+            change->phase   = gPhase[slot];
+            memcpy(change->note, gNote[slot], sizeof(change->note));
+            gFlags[slot] &= ~kFlagDirty;
+        }
+        gDirtyCount -= count;
+        if (count > 0)
+        {
+            gStats.changesDelivered += count;
+            gStats.batches++;
+            if (count > gStats.maxBatch)
+                gStats.maxBatch = count;
+        }
+        unlockPresence();
+
+        if (count == 0)
+            break;
+        if (handler)
+            handler(gDrainBuf, count);
+    }
+}
+
+void ZSDKPresenceSetHandler(ZSDKPresenceHandler handler)
+{
+    gHandler = handler;
+}
+
+void ZSDKPresenceFlush(void)
+{
+    lockPresence();
+    BOOL dispatch = gDirtyCount > 0 && !gDispatchPending && !gBenchRunning;
+    if (dispatch)
+        gDispatchPending = YES;
+    unlockPresence();
+
+    if (dispatch)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            drainChanges(gHandler);
+        });
+    }
+}
+
+//==============================================================================
+//  Callbacks (poll thread)
+//==============================================================================
+void ZSDKPresenceOnStatus(ContactHandler contactId, eContactState_t status, const char * pNote)
+{
+    lockPresence();
+    gStats.statusCallbacks++;
+    int slot = ZSDKHandleMapFind(&gMap, contactId);
+    if (slot != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        const char * note = pNote ? pNote : "";
+        BOOL changed = gStatus[slot] != status || gPhase[slot] != ZSDKContactSubscribed ||
+                       strncmp(gNote[slot], note, kZSDKPresenceNoteLen - 1) != 0;
+        if (changed)
+        {
+            gStatus[slot] = status;
+            setPhase(slot, ZSDKContactSubscribed);
+            strlcpy(gNote[slot], note, sizeof(gNote[slot]));
+            markDirty(slot);
+        }
+    }
+    unlockPresence();
+}
+
+void ZSDKPresenceOnTerminated(ContactHandler contactId, eRejectionType_t type)
+{
+    lockPresence();
+    int slot = ZSDKHandleMapFind(&gMap, contactId);
+    if (slot != ZSDK_HANDLE_MAP_EMPTY)
+    {
+        // The handle is dead; a re-subscription gets a new one
+        dropHandle(slot);
+        clearRefresh(slot);
+        gStatus[slot] = CONTACT_STATE_UNKNOWN;
+        if (type == REJECTION_REJECT)
+        {
+            setPhase(slot, ZSDKContactRejected);
+        }
+        else
+        {
+            gRetryAt[slot] = nowSeconds() + kZSDKPresenceResubscribeSecs;
+            setPhase(slot, ZSDKContactWaiting);
+            schedulePacer(kZSDKPresenceResubscribeSecs * 1000);
+        }
+        gStats.terminations++;
+        markDirty(slot);
+    }
+    unlockPresence();
+}
+
+void ZSDKPresenceOnRetrying(ContactHandler contactId)
+{
+    lockPresence();
+    int slot = ZSDKHandleMapFind(&gMap, contactId);
+    if (slot != ZSDK_HANDLE_MAP_EMPTY && gPhase[slot] != ZSDKContactRetrying)
+    {
+        gStatus[slot] = CONTACT_STATE_UNKNOWN;
+        setPhase(slot, ZSDKContactRetrying);
+        markDirty(slot);
+    }
+    unlockPresence();
+}
+
+void ZSDKPresenceOnPublication(UserHandler userId, BOOL ok)
+{
+    lockPresence();
+    if (ok)
+        gStats.publications++;
+    else
+        gStats.publicationFailures++;
+    unlockPresence();
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+static WrapperContext       gBenchCtx;
+static ContactHandler       gBenchNextHandle;
+
+static LIBRESULT benchAddContact2(UserHandler userId, const char * pNumber, ContactHandler * pContact,
+                                  int subscribeSeconds, int refreshSeconds, int flags)
+{
+    *pContact = gBenchNextHandle++;
+    return L_OK;
+}
+
+static LIBRESULT benchContact(ContactHandler contactId)
+{
+    return L_OK;
+}
+
+static void benchHandler(const ZSDKPresenceChange * changes, int count)
+{
+}
+
+BOOL ZSDKPresenceBenchmark(int contacts, int updates, ZSDKPresenceBenchResult * pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    if (contacts <= 0 || contacts > kZSDKPresenceMaxContacts || updates <= 0)
+        return NO;
+
+    char (* numbers)[kZSDKPresenceNumberLen] = malloc(contacts * sizeof(*numbers));
+    uint32_t * targets = malloc(updates * sizeof(uint32_t));
+    ZSDKContactId * ids = malloc(contacts * sizeof(ZSDKContactId));
+    if (!numbers || !targets || !ids)
+    {
+        free(numbers);
+        free(targets);
+        free(ids);
+        return NO;
+    }
+    for (int i = 0; i < contacts; i++)
+        snprintf(numbers[i], sizeof(numbers[i]), "%d", 10000 + i);
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < updates; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        targets[i] = x % contacts;
+    }
+
+    lockPresence();
+    if (gStats.contacts > 0 || gBenchRunning)
+    {
+        unlockPresence();
+        free(numbers);
+        free(targets);
+        free(ids);
+        return NO;
+    }
+    memset(&gBenchCtx, 0, sizeof(gBenchCtx));
+    gBenchCtx.AddContact2    = benchAddContact2;
+    gBenchCtx.RefreshContact = benchContact;
+    gBenchCtx.RemoveContact  = benchContact;
+    gBenchNextHandle = 0x10000;
+    ContactHandler firstHandle = gBenchNextHandle;
+    ZSDKPresenceStats savedStats = gStats;
+    gPresenceCtx  = &gBenchCtx;
+    gBenchRunning = YES;
+    unlockPresence();
+
+    // Queue every contact
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int i = 0; i < contacts; i++)
+        ids[i] = ZSDKPresenceAdd(1, numbers[i], CONTACT_SUBSCRIBE_PRESENCE);
+    pResult->addNs = (double)(ZSDKMonotonicMicros() - startUs) * 1000.0 / contacts;
+
+    // Pacer ticks until everything is subscribed
+    int ticks = 0;
+    lockPresence();
+    while (gPending > 0 && paceOnce(nowSeconds()) > 0)
+        ticks++;
+    unlockPresence();
+    pResult->subscribeMs = (double)ticks * kZSDKPresencePaceMs;
+
+    // Status storm, delivered every kZSDKPresenceBatch callbacks
+    uint64_t updateUs = 0, drainUs = 0;
+    for (int done = 0; done < updates; )
+    {
+        int n = (updates - done < kZSDKPresenceBatch) ? updates - done : kZSDKPresenceBatch;
+        startUs = ZSDKMonotonicMicros();
+        for (int i = done; i < done + n; i++)
+            ZSDKPresenceOnStatus(firstHandle + targets[i], (eContactState_t)(i & 1), NULL);
+        uint64_t midUs = ZSDKMonotonicMicros();
+        drainChanges(benchHandler);
+        updateUs += midUs - startUs;
+        drainUs  += ZSDKMonotonicMicros() - midUs;
+        done += n;
+    }
+
+    lockPresence();
+    pResult->delivered = gStats.changesDelivered - savedStats.changesDelivered;
+    unlockPresence();
+    pResult->contacts = contacts;
+    pResult->updates  = updates;
+    pResult->updateNs = (double)updateUs * 1000.0 / updates;
+    pResult->drainNs  = pResult->delivered ? (double)drainUs * 1000.0 / pResult->delivered : 0;
+    pResult->tableBytes = sizeof(gHandle) + sizeof(gUser) + sizeof(gStatus) + sizeof(gPhase) +
+                          sizeof(gFlags) + sizeof(gSubscribe) + sizeof(gRetryAt) + sizeof(gNumber) +
+                          sizeof(gNote) + sizeof(gBuckets) + sizeof(gDirty) + sizeof(gFreeSlots);
+
+    // Backwards, so the free list hands out the same slots first again
+    for (int i = contacts - 1; i >= 0; i--)
+        ZSDKPresenceRemove(ids[i]);
+    drainChanges(benchHandler);
+
+    lockPresence();
+    gPresenceCtx  = &gWrapperCtx;
+    gBenchRunning = NO;
+    gStats        = savedStats;
+    unlockPresence();
+
+    free(numbers);
+    free(targets);
+    free(ids);
+    return YES;
+}
@@ -0,0 +1,111 @@
+//
+//  ZSDKRateControl.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Adaptive video rate control.  Video channel statistics (loss permil and
+//  jitter, every 5 s) and network quality level changes move each call along
+//  a ladder of encoder settings derived from the negotiated format: first the
+//  bitrate drops, then the frame rate, then the resolution.  Loss steps down
+//  immediately; stepping back up needs a run of clean samples and a hold
+//  time after the last step down, so a lossy link settles instead of
+//  oscillating.
+//
+//  The decision step is a pure function of its state and the sample, so
+//  recorded traces can be replayed through ZSDKRateControlReplay().
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKRateLevels                 5
+#define kZSDKRateUpgradeStreak          3       // clean samples before stepping up
+#define kZSDKRateUpgradeHoldMs          20000   // after the last step down
+#define kZSDKRateDegradedStreak         2       // degraded samples before stepping down
+
+#define kZSDKRateLossSeverePermil       150
+#define kZSDKRateLossCongestedPermil    50
+#define kZSDKRateLossDegradedPermil     20
+#define kZSDKRateLossCleanPermil        10
+#define kZSDKRateJitterCongestedMs      100
+#define kZSDKRateJitterDegradedMs       50
+#define kZSDKRateJitterCleanMs          30
+
+#define kZSDKRateMinBitrate             32000
+#define kZSDKRateMinFps                 5
+#define kZSDKRateHistory                16      // applied changes kept per call
+
+typedef struct {
+    uint64_t    timeMs;
+    int         lossPermil;     // -1 for a quality level only sample
+    int         jitterMs;
+    int         quality;        // eNetworkQualityLevel_t, -1 if unchanged
+} ZSDKRateSample;
+
+typedef struct {
+    int         level;          // 0 = negotiated settings
+    int         lossPermil;     // smoothed
+    int         jitterMs;       // smoothed
+    int         quality;
+    int         cleanStreak;
+    int         degradedStreak;
+    int         changes;
+    uint64_t    lastSampleMs;
+    uint64_t    lastDowngradeMs;
+    uint64_t    impairedMs;     // time spent at congested loss (freeze proxy)
+} ZSDKRateState;
+
+typedef struct {
+    int         bitrate;
+    int         width;
+    int         height;
+    float       fps;
+} ZSDKRateRung;
+
+// A level change pushed to a call's encoder, with the smoothed link state
+// that caused it
+typedef struct {
+    uint64_t        timeMs;
+    int             level;
+    int             lossPermil;
+    int             jitterMs;
+    int             quality;
+    ZSDKRateRung    rung;
+} ZSDKRateChange;
+
+void ZSDKRateStateInit(ZSDKRateState * pState);
+
+// One decision step; returns YES when the level changed
+BOOL ZSDKRateControlStep(ZSDKRateState * pState, const ZSDKRateSample * pSample);
+
+// Encoder settings of a level for the negotiated format and bitrate
+void ZSDKRateControlRung(int level, int width, int height, float fps, int bitrate,
+                         ZSDKRateRung * pRung);
+
+// Replays a trace from a fresh state; pLevels (optional) receives the level
+// after every sample.  Returns the number of level changes.
+int  ZSDKRateControlReplay(const ZSDKRateSample * pTrace, int count,
+                           int * pLevels, ZSDKRateState * pFinal);
+
+//==============================================================================
+//  Live calls (poll thread)
+//==============================================================================
+void ZSDKRateControlSetEnabled(BOOL enabled);
+void ZSDKRateControlSetBaseBitrate(int bps);
+void ZSDKRateControlSetFormat(CallHandler callId, int callSlot, int width, int height, float fps);
+void ZSDKRateControlStart(CallHandler callId, int callSlot);
+void ZSDKRateControlStop(CallHandler callId, int callSlot);
+
+// The library only reports what this end receives, so the uplink is
+// adapted on the downlink's (input) loss and jitter as a proxy for the
+// path.  An asymmetric link, lossy in one direction only, is misjudged.
+void ZSDKRateControlOnStatistics(CallHandler callId, int callSlot, int lossPermil, int jitterMs);
+void ZSDKRateControlOnQuality(CallHandler callId, int callSlot, eNetworkQualityLevel_t quality);
+
+void ZSDKRateControlGetState(int callSlot, ZSDKRateState * pState, ZSDKRateRung * pRung);
+
+// The call's last kZSDKRateHistory applied changes, oldest first; returns
+// how many went into pChanges.  Recorded whether or not the debug log runs.
+int  ZSDKRateControlGetChanges(int callSlot, ZSDKRateChange * pChanges, int maxChanges);
@@ -0,0 +1,336 @@
+//
+//  ZSDKRateControl.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKRateControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import "ZSDKVideoSender.h"
+#import "ZSDKLog.h"
+#import <pthread.h>
+
+// Ladder relative to the negotiated format: bitrate, fps and size factors
+typedef struct {
+    float   bitrate;
+    float   fps;
+    int     sizeShift;
+} ZSDKRateStep;
+
+static const ZSDKRateStep kRateLadder[kZSDKRateLevels] = {
+    { 1.00f, 1.00f, 0 }
+,   { 0.70f, 1.00f, 0 }
+,   { 0.50f, 0.67f, 0 }
+,   { 0.35f, 0.67f, 1 }
+,   { 0.25f, 0.50f, 1 }
+};
+
+typedef struct {
+    BOOL            active;
+    CallHandler     callId;
+    CallHandler     formatCallId;
+    int             width;          // negotiated
+    int             height;
+    float           fps;
+    ZSDKRateState   state;
+    ZSDKRateChange  history[kZSDKRateHistory];
+    int             historyCount;
+    int             historyNext;
+} ZSDKRateCall;
+
+static pthread_mutex_t  gRateLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKRateCall     gRateCalls[kZSDKMaxCalls];
+static BOOL             gRateEnabled = YES;
+static int              gBaseBitrate = 256000;
+
+//==============================================================================
+//  Decision step
+//==============================================================================
+void ZSDKRateStateInit(ZSDKRateState * pState)
+{
+    memset(pState, 0, sizeof(*pState));
+    pState->lossPermil = -1;
+    pState->quality    = E_NET_QUALITY_PENDING;
+}
+
+BOOL ZSDKRateControlStep(ZSDKRateState * pState, const ZSDKRateSample * pSample)
+{
+    int previous = pState->level;
+    int down = 0;
+
+    if (pSample->quality >= 0)
+        pState->quality = pSample->quality;
+
+    if (pSample->lossPermil >= 0)
+    {
+        if (pState->lastSampleMs && pSample->timeMs > pState->lastSampleMs &&
+            pSample->lossPermil >= kZSDKRateLossCongestedPermil)
+            pState->impairedMs += pSample->timeMs - pState->lastSampleMs;
+        pState->lastSampleMs = pSample->timeMs;
+
+        // Fast attack, slow release: a worse sample is taken as is so loss is
+        // acted on within one 5 s period; improvements are averaged in
+        if (pSample->lossPermil > pState->lossPermil)
+            pState->lossPermil = pSample->lossPermil;
+        else
+            pState->lossPermil = (pState->lossPermil + pSample->lossPermil + 1) / 2;
+        if (pSample->jitterMs > pState->jitterMs)
+            pState->jitterMs = pSample->jitterMs;
+        else
+            pState->jitterMs = (pState->jitterMs + pSample->jitterMs + 1) / 2;
+    }
+
+    int loss   = (pState->lossPermil < 0) ? 0 : pState->lossPermil;
+    int jitter = pState->jitterMs;
+
+    if (pState->quality == E_NET_QUALITY_VERY_BAD || loss >= kZSDKRateLossSeverePermil)
+    {
+        down = (loss >= kZSDKRateLossSeverePermil) ? 2 : 1;
+    }
+    else if (loss >= kZSDKRateLossCongestedPermil || jitter >= kZSDKRateJitterCongestedMs)
+    {
+        down = 1;
+    }
+    else if (pSample->lossPermil >= 0)
+    {
+        // Only statistics samples count towards the streaks
+        if (loss >= kZSDKRateLossDegradedPermil || jitter >= kZSDKRateJitterDegradedMs ||
+            pState->quality == E_NET_QUALITY_BAD)
+        {
+            pState->cleanStreak = 0;
+            if (++pState->degradedStreak >= kZSDKRateDegradedStreak)
+            {
+                pState->degradedStreak = 0;
+                down = 1;
+            }
+        }
+        else if (loss < kZSDKRateLossCleanPermil && jitter < kZSDKRateJitterCleanMs)
+        {
+            pState->degradedStreak = 0;
+            if (++pState->cleanStreak >= kZSDKRateUpgradeStreak && pState->level > 0 &&
+                pSample->timeMs >= pState->lastDowngradeMs + kZSDKRateUpgradeHoldMs)
+            {
+                pState->cleanStreak = 0;
+                pState->level--;
+            }
+        }
+        else
+        {
+            pState->cleanStreak = 0;
+            pState->degradedStreak = 0;
+        }
+    }
+
+    if (down)
+    {
+        pState->level += down;
+        if (pState->level >= kZSDKRateLevels)
+            pState->level = kZSDKRateLevels - 1;
+        pState->lastDowngradeMs = pSample->timeMs;
+        pState->cleanStreak = 0;
+    }
+
+    if (pState->level == previous)
+        return NO;
+    pState->changes++;
+    return YES;
+}
+
+void ZSDKRateControlRung(int level, int width, int height, float fps, int bitrate,
+                         ZSDKRateRung * pRung)
+{
+    if (level < 0)
+        level = 0;
+    if (level >= kZSDKRateLevels)
+        level = kZSDKRateLevels - 1;
+
+    const ZSDKRateStep * step = &kRateLadder[level];
+    pRung->bitrate = (int)(bitrate * step->bitrate);
+    if (pRung->bitrate < kZSDKRateMinBitrate)
+        pRung->bitrate = kZSDKRateMinBitrate;
+    pRung->fps = fps * step->fps;
+    if (pRung->fps < kZSDKRateMinFps)
+        pRung->fps = (fps < kZSDKRateMinFps) ? fps : kZSDKRateMinFps;
+    pRung->width  = (width >> step->sizeShift) & ~1;
+    pRung->height = (height >> step->sizeShift) & ~1;
+}
+
+int ZSDKRateControlReplay(const ZSDKRateSample * pTrace, int count,
+                          int * pLevels, ZSDKRateState * pFinal)
+{
+    ZSDKRateState state;
+    ZSDKRateStateInit(&state);
+    for (int i = 0; i < count; i++)
+    {
+        ZSDKRateControlStep(&state, &pTrace[i]);
+        if (pLevels)
+            pLevels[i] = state.level;
+    }
+    if (pFinal)
+        *pFinal = state;
+    return state.changes;
+}
+
+//==============================================================================
+//  Live calls
+//==============================================================================
+
+// Expects gRateLock; pushes the current level to the call's encoder and
+// records the change.  The log line is extra output for when the
+// asynchronous log runs; it never blocks the poll thread.
+static void applyLevel(ZSDKRateCall * rc, int callSlot, uint64_t timeMs)
+{
+    ZSDKRateRung rung;
+    ZSDKRateControlRung(rc->state.level, rc->width, rc->height, rc->fps, gBaseBitrate, &rung);
+
+    ZSDKRateChange * change = &rc->history[rc->historyNext];
+    change->timeMs     = timeMs;
+    change->level      = rc->state.level;
+    change->lossPermil = rc->state.lossPermil;
+    change->jitterMs   = rc->state.jitterMs;
+    change->quality    = rc->state.quality;
+    change->rung       = rung;
+    rc->historyNext = (rc->historyNext + 1) % kZSDKRateHistory;
+    if (rc->historyCount < kZSDKRateHistory)
+        rc->historyCount++;
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "ZOIPER: video level %d for call %lu: %dx%d@%.1f %d bps (loss %d permil, jitter %d ms)",
+             rc->state.level, (unsigned long)rc->callId, rung.width, rung.height, rung.fps, rung.bitrate,
+             rc->state.lossPermil, rc->state.jitterMs);
+    ZSDKLogMessage(message);
+    ZSDKVideoSenderReconfigure(rc->callId, callSlot, rung.width, rung.height, rung.fps, rung.bitrate);
+}
+
+static ZSDKRateCall * activeCall(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NULL;
+    ZSDKRateCall * rc = &gRateCalls[callSlot];
+    return (rc->active && rc->callId == callId) ? rc : NULL;
+}
+
+static void step(CallHandler callId, int callSlot, int lossPermil, int jitterMs, int quality)
+{
+    pthread_mutex_lock(&gRateLock);
+    ZSDKRateCall * rc = activeCall(callId, callSlot);
+    if (rc)
+    {
+        ZSDKRateSample sample = { ZSDKMonotonicMicros() / 1000, lossPermil, jitterMs, quality };
+        if (ZSDKRateControlStep(&rc->state, &sample) && gRateEnabled && rc->width > 0)
+            applyLevel(rc, callSlot, sample.timeMs);
+    }
+    pthread_mutex_unlock(&gRateLock);
+}
+
+void ZSDKRateControlSetEnabled(BOOL enabled)
+{
+    pthread_mutex_lock(&gRateLock);
+    gRateEnabled = enabled;
+    pthread_mutex_unlock(&gRateLock);
+}
+
+void ZSDKRateControlSetBaseBitrate(int bps)
+{
+    pthread_mutex_lock(&gRateLock);
+    gBaseBitrate = bps;
+    pthread_mutex_unlock(&gRateLock);
+}
+
+void ZSDKRateControlSetFormat(CallHandler callId, int callSlot, int width, int height, float fps)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    pthread_mutex_lock(&gRateLock);
+    ZSDKRateCall * rc = &gRateCalls[callSlot];
+    rc->formatCallId = callId;
+    rc->width  = width;
+    rc->height = height;
+    rc->fps    = fps;
+    pthread_mutex_unlock(&gRateLock);
+}
+
+void ZSDKRateControlStart(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    pthread_mutex_lock(&gRateLock);
+    ZSDKRateCall * rc = &gRateCalls[callSlot];
+    if (rc->formatCallId != callId)
+    {
+        // No format negotiated for this call; nothing to scale from
+        rc->formatCallId = callId;
+        rc->width  = 0;
+        rc->height = 0;
+        rc->fps    = 0;
+    }
+    rc->active = YES;
+    rc->callId = callId;
+    rc->historyCount = 0;
+    rc->historyNext  = 0;
+    ZSDKRateStateInit(&rc->state);
+    pthread_mutex_unlock(&gRateLock);
+}
+
+void ZSDKRateControlStop(CallHandler callId, int callSlot)
+{
+    pthread_mutex_lock(&gRateLock);
+    ZSDKRateCall * rc = activeCall(callId, callSlot);
+    if (rc)
+        rc->active = NO;
+    pthread_mutex_unlock(&gRateLock);
+}
+
+void ZSDKRateControlOnStatistics(CallHandler callId, int callSlot, int lossPermil, int jitterMs)
+{
+    step(callId, callSlot, lossPermil, jitterMs, -1);
+}
+
+void ZSDKRateControlOnQuality(CallHandler callId, int callSlot, eNetworkQualityLevel_t quality)
+{
+    // NONE means no packets at all, which says nothing about our encoder
+    if (quality == E_NET_QUALITY_NONE)
+        return;
+    step(callId, callSlot, -1, 0, quality);
+}
+
+void ZSDKRateControlGetState(int callSlot, ZSDKRateState * pState, ZSDKRateRung * pRung)
+{
+    ZSDKRateStateInit(pState);
+    memset(pRung, 0, sizeof(*pRung));
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    pthread_mutex_lock(&gRateLock);
+    ZSDKRateCall * rc = &gRateCalls[callSlot];
+    if (rc->active)
+    {
+        *pState = rc->state;
+        ZSDKRateControlRung(rc->state.level, rc->width, rc->height, rc->fps, gBaseBitrate, pRung);
+    }
+    pthread_mutex_unlock(&gRateLock);
+}
+
+int ZSDKRateControlGetChanges(int callSlot, ZSDKRateChange * pChanges, int maxChanges)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return 0;
+
+    int count = 0;
+    pthread_mutex_lock(&gRateLock);
+    ZSDKRateCall * rc = &gRateCalls[callSlot];
+    if (rc->active)
+    {
+        count = rc->historyCount < maxChanges ? rc->historyCount : maxChanges;
+        int first = (rc->historyNext - count + kZSDKRateHistory) % kZSDKRateHistory;
+        for (int i = 0; i < count; i++)
+            pChanges[i] = rc->history[(first + i) % kZSDKRateHistory];
+    }
+    pthread_mutex_unlock(&gRateLock);
+    return count;
+}
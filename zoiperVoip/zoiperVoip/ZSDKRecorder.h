@@ -0,0 +1,93 @@
+//
+//  ZSDKRecorder.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Streaming recorder.  Producers fill fixed-size blocks from a shared pool
+//  and queue them; one background I/O thread writes the blocks to their
+//  files and hands them back.  Memory is bounded by the pool whatever the
+//  length or number of recordings: when the pool runs dry, writes are
+//  refused and counted as dropped instead of growing.
+//
+//  Sources:
+//    - application PCM (ZSDKRecorderWrite), one producer thread per stream,
+//    - the library's microphone recordings (AddRecording2).  Those keep
+//      every sample in one library buffer, so the I/O thread drains two
+//      short recording objects alternately instead: it copies only the
+//      samples added since the last poll and switches objects before one
+//      fills up.  At a switch the outgoing object is cut where the incoming
+//      one starts, so at worst one audio frame appears twice.
+//
+//  Calls are recorded by the library itself (CallOpenFile()): its media
+//  path writes 16 bit PCM WAV as the call goes, so any number of calls
+//  record in parallel without touching the pool.  A compressed call goes to
+//  "<path>.pcm" first and is re-encoded on the I/O thread, a bounded slice
+//  per poll, once the recording ends; the PCM file is deleted afterwards.
+//
+//  Files are WAV, either 16 bit PCM or IMA ADPCM (4:1, WAVE_FORMAT_IMA_ADPCM).
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKRecorderBlockSamples   4096
+#define kZSDKRecorderPoolBlocks     512     // 4 MB for all recordings
+#define kZSDKRecorderMaxStreams     128
+#define kZSDKRecorderMaxCalls       128     // calls recording at once
+#define kZSDKRecorderSegmentMs      5000    // per library recording object
+#define kZSDKRecorderPollMs         100
+
+typedef enum {
+    ZSDKRecordPCM = 0
+,   ZSDKRecordIMAADPCM
+} ZSDKRecordFormat;
+
+typedef struct {
+    uint64_t    framesWritten;      // sample frames (all channels)
+    uint64_t    framesDropped;      // refused for lack of blocks
+    uint64_t    bytesWritten;
+    uint64_t    writeErrors;
+    int         blocksInUse;        // totals only
+    int         blocksInUseMax;
+} ZSDKRecorderStats;
+
+typedef struct {
+    int         recordings;
+    double      audioSeconds;       // recorded in total
+    double      wallSeconds;
+    double      realtimeFactor;     // audio seconds per wall second
+    double      megabytesPerSecond; // file bytes
+    uint64_t    stalls;             // producer waits for a free block
+} ZSDKRecorderBenchmarkResult;
+
+// Streams fed by the application (interleaved samples).  Open returns the
+// stream id or -1; Write returns NO (and drops the samples) if the pool
+// cannot take all of them.
+int  ZSDKRecorderOpen(const char * pPath, ZSDKRecordFormat format, int sampleRate, int channels);
+BOOL ZSDKRecorderWrite(int stream, const int16_t * pSamples, int frames);
+
+// Stream fed by library recording objects (microphone)
+int  ZSDKRecorderStartMicrophone(const char * pPath, ZSDKRecordFormat format, int sampleRate, int channels);
+
+// Records the call until it ends or ZSDKRecorderStopCall().  Returns NO if
+// the call is already recording, the table is full or the library refuses.
+BOOL ZSDKRecorderStartCall(CallHandler callId, const char * pPath, ZSDKRecordFormat format,
+                           eCallRecording_t sides);
+void ZSDKRecorderStopCall(CallHandler callId);
+
+// Call gone; the library has closed its file (poll thread)
+void ZSDKRecorderOnCallEnded(CallHandler callId);
+
+// Queues the rest and finalises the file on the I/O thread; the id is
+// free again afterwards
+void ZSDKRecorderClose(int stream);
+
+void ZSDKRecorderGetStats(int stream, ZSDKRecorderStats * pStats);
+void ZSDKRecorderGetTotals(ZSDKRecorderStats * pStats);
+
+// Records count streams of seconds of synthetic speech each into pDir as
+// fast as the I/O thread takes it, then deletes the files
+BOOL ZSDKRecorderBenchmark(const char * pDir, int count, int seconds, int sampleRate,
+                           ZSDKRecordFormat format, ZSDKRecorderBenchmarkResult * pResult);
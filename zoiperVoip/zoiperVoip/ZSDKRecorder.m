@@ -0,0 +1,1114 @@
+//
+//  ZSDKRecorder.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKRecorder.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import <pthread.h>
+#import <unistd.h>
+#import <math.h>
+
+#define kAdpcmBlockFrames   505     // 4 header bytes + 504 nibbles per channel
+#define kAdpcmBlockBytes    256     // per channel
+#define kPcmHeaderBytes     44
+#define kAdpcmHeaderBytes   60
+#define kRollNumerator      4       // switch microphone objects at 4/5 full
+#define kRollDenominator    5
+#define kBenchPathBytes     1024
+#define kTranscodeBlocks    16      // pool-sized reads per stream and poll
+
+typedef struct ZSDKRecBlock {
+    struct ZSDKRecBlock *   next;
+    int                     stream;
+    int                     frames;
+    int16_t                 samples[kZSDKRecorderBlockSamples];
+} ZSDKRecBlock;
+
+typedef enum {
+    ZSDKStreamFree = 0
+,   ZSDKStreamReserved              // being set up, ignored by the I/O thread
+,   ZSDKStreamOpen
+,   ZSDKStreamClosing               // finalised once its blocks are written
+} ZSDKStreamState;
+
+typedef struct {
+    ZSDKStreamState     state;
+    ZSDKRecordFormat    format;
+    int                 sampleRate;
+    int                 channels;
+    int                 queued;         // blocks in the write queue
+    ZSDKRecorderStats   stats;
+
+    // Producer side (application streams)
+    ZSDKRecBlock *      filling;
+
+    // Library recording objects (microphone streams), I/O thread only
+    BOOL                microphone;
+    BOOL                closeRequested;
+    RecordingHandler    recordings[2];
+    int                 active;
+    int                 offset;         // samples of the active object written
+    int                 segmentSamples;
+
+    // Call recordings being compressed (library PCM file as source), I/O
+    // thread only once published
+    BOOL                transcode;
+    char *              sourcePath;
+    char *              destPath;
+    FILE *              source;
+    uint64_t            sourceBytes;    // data chunk left
+
+    // I/O thread only
+    FILE *              file;
+    uint64_t            dataBytes;
+    int16_t *           adpcmPending;   // kAdpcmBlockFrames frames
+    int                 adpcmFrames;
+    int                 adpcmIndex[2];
+} ZSDKRecStream;
+
+static pthread_mutex_t      gRecLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t       gRecOnce = PTHREAD_ONCE_INIT;
+static pthread_t            gRecThread;
+static dispatch_semaphore_t gRecSignal;
+static BOOL                 gRecReady = NO;
+
+static ZSDKRecBlock *       gPool;
+static ZSDKRecBlock *       gFreeBlocks;
+static int                  gFreeCount;
+static ZSDKRecBlock *       gQueueHead;
+static ZSDKRecBlock *       gQueueTail;
+static ZSDKRecStream        gStreams[kZSDKRecorderMaxStreams];
+static ZSDKRecorderStats    gTotals;
+static int16_t              gTranscodeBuffer[kZSDKRecorderBlockSamples];   // I/O thread
+
+typedef enum {
+    ZSDKCallRecFree = 0
+,   ZSDKCallRecStarting             // library calls in progress, lock not held
+,   ZSDKCallRecActive
+} ZSDKCallRecState;
+
+typedef struct {
+    ZSDKCallRecState    state;
+    CallHandler         callId;
+    BOOL                ended;          // call ended while starting
+    char *              path;
+    char *              source;         // compressed: the library's PCM file
+} ZSDKCallRec;
+
+static ZSDKCallRec          gCalls[kZSDKRecorderMaxCalls];
+
+//==============================================================================
+//  IMA ADPCM
+//==============================================================================
+static const int16_t kImaSteps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+static const int8_t kImaIndex[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static uint8_t imaEncode(int sample, int * pPredictor, int * pIndex)
+{
+    int step = kImaSteps[*pIndex];
+    int diff = sample - *pPredictor;
+    uint8_t nibble = 0;
+    if (diff < 0)
+    {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    int delta = step >> 3;
+    if (diff >= step)
+    {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        nibble |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        nibble |= 1;
+        delta += step;
+    }
+
+    int predictor = *pPredictor + ((nibble & 8) ? -delta : delta);
+    *pPredictor = predictor > 32767 ? 32767 : (predictor < -32768 ? -32768 : predictor);
+    int index = *pIndex + kImaIndex[nibble];
+    *pIndex = index < 0 ? 0 : (index > 88 ? 88 : index);
+    return nibble;
+}
+
+// One WAVE_FORMAT_IMA_ADPCM block: per channel a header with the first
+// sample and step index, then groups of 8 samples as 4 bytes per channel
+static void imaEncodeBlock(const int16_t * pFrames, int channels, int * pIndex, uint8_t * pOut)
+{
+    int predictor[2];
+    for (int c = 0; c < channels; c++)
+    {
+        predictor[c] = pFrames[c];
+        *pOut++ = (uint8_t)(pFrames[c] & 0xFF);
+        *pOut++ = (uint8_t)((pFrames[c] >> 8) & 0xFF);
+        *pOut++ = (uint8_t)pIndex[c];
+        *pOut++ = 0;
+    }
+
+    for (int group = 0; group < (kAdpcmBlockFrames - 1) / 8; group++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            const int16_t * src = pFrames + (1 + group * 8) * channels + c;
+            for (int k = 0; k < 8; k += 2)
+            {
+                uint8_t lo = imaEncode(src[k * channels], &predictor[c], &pIndex[c]);
+                uint8_t hi = imaEncode(src[(k + 1) * channels], &predictor[c], &pIndex[c]);
+                *pOut++ = (uint8_t)(lo | (hi << 4));
+            }
+        }
+    }
+}
+
+//==============================================================================
+//  Files (I/O thread, or the opener before the stream is published)
+//==============================================================================
+static void put16(uint8_t * p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put32(uint8_t * p, uint32_t v) { put16(p, (uint16_t)v); put16(p + 2, (uint16_t)(v >> 16)); }
+
+static BOOL writeHeader(ZSDKRecStream * st, uint64_t frames)
+{
+    uint8_t h[kAdpcmHeaderBytes];
+    uint32_t data = (uint32_t)st->dataBytes;
+    int size;
+
+    memcpy(h, "RIFF", 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    if (st->format == ZSDKRecordPCM)
+    {
+        size = kPcmHeaderBytes;
+        put32(h + 16, 16);
+        put16(h + 20, 1);
+        put16(h + 22, st->channels);
+        put32(h + 24, st->sampleRate);
+        put32(h + 28, st->sampleRate * st->channels * 2);
+        put16(h + 32, st->channels * 2);
+        put16(h + 34, 16);
+        memcpy(h + 36, "data", 4);
+        put32(h + 40, data);
+    }
+    else
+    {
+        int blockAlign = kAdpcmBlockBytes * st->channels;
+        size = kAdpcmHeaderBytes;
+        put32(h + 16, 20);
+        put16(h + 20, 0x11);
+        put16(h + 22, st->channels);
+        put32(h + 24, st->sampleRate);
+        put32(h + 28, (uint32_t)((uint64_t)st->sampleRate * blockAlign / kAdpcmBlockFrames));
+        put16(h + 32, blockAlign);
+        put16(h + 34, 4);
+        put16(h + 36, 2);
+        put16(h + 38, kAdpcmBlockFrames);
+        memcpy(h + 40, "fact", 4);
+        put32(h + 44, 4);
+        put32(h + 48, (uint32_t)frames);
+        memcpy(h + 52, "data", 4);
+        put32(h + 56, data);
+    }
+    put32(h + 4, size - 8 + data);
+
+    return fseek(st->file, 0, SEEK_SET) == 0 && fwrite(h, size, 1, st->file) == 1 &&
+           fseek(st->file, 0, SEEK_END) == 0;
+}
+
+static BOOL openFile(ZSDKRecStream * st, const char * pPath)
+{
+    st->file = fopen(pPath, "wb");
+    if (!st->file)
+        return NO;
+    if (st->format == ZSDKRecordIMAADPCM)
+    {
+        st->adpcmPending = malloc(kAdpcmBlockFrames * st->channels * sizeof(int16_t));
+        if (!st->adpcmPending)
+        {
+            fclose(st->file);
+            st->file = NULL;
+            return NO;
+        }
+    }
+    if (!writeHeader(st, 0))
+    {
+        fclose(st->file);
+        st->file = NULL;
+        free(st->adpcmPending);
+        st->adpcmPending = NULL;
+        return NO;
+    }
+    return YES;
+}
+
+static uint64_t writtenFrames(ZSDKRecStream * st)
+{
+    if (st->format == ZSDKRecordPCM)
+        return st->dataBytes / (2 * st->channels);
+    return st->dataBytes / (kAdpcmBlockBytes * st->channels) * kAdpcmBlockFrames + st->adpcmFrames;
+}
+
+// Returns the file bytes written
+static size_t writeFrames(ZSDKRecStream * st, const int16_t * pFrames, int frames)
+{
+    if (st->format == ZSDKRecordPCM)
+    {
+        size_t bytes = (size_t)frames * st->channels * sizeof(int16_t);
+        if (fwrite(pFrames, bytes, 1, st->file) != 1)
+            return 0;
+        st->dataBytes += bytes;
+        return bytes;
+    }
+
+    size_t bytes = 0;
+    uint8_t block[kAdpcmBlockBytes * 2];
+    while (frames > 0)
+    {
+        int n = kAdpcmBlockFrames - st->adpcmFrames;
+        if (n > frames)
+            n = frames;
+        memcpy(st->adpcmPending + st->adpcmFrames * st->channels, pFrames,
+               n * st->channels * sizeof(int16_t));
+        st->adpcmFrames += n;
+        pFrames += n * st->channels;
+        frames -= n;
+
+        if (st->adpcmFrames == kAdpcmBlockFrames)
+        {
+            imaEncodeBlock(st->adpcmPending, st->channels, st->adpcmIndex, block);
+            st->adpcmFrames = 0;
+            if (fwrite(block, kAdpcmBlockBytes * st->channels, 1, st->file) != 1)
+                return bytes;
+            bytes += kAdpcmBlockBytes * st->channels;
+            st->dataBytes += kAdpcmBlockBytes * st->channels;
+        }
+    }
+    return bytes;
+}
+
+static void finalizeFile(ZSDKRecStream * st)
+{
+    uint64_t frames = writtenFrames(st);
+    if (st->format == ZSDKRecordIMAADPCM && st->adpcmFrames > 0)
+    {
+        // Pad the last block with silence; the fact chunk has the real length
+        int pad = kAdpcmBlockFrames - st->adpcmFrames;
+        memset(st->adpcmPending + st->adpcmFrames * st->channels, 0, pad * st->channels * sizeof(int16_t));
+        uint8_t block[kAdpcmBlockBytes * 2];
+        imaEncodeBlock(st->adpcmPending, st->channels, st->adpcmIndex, block);
+        if (fwrite(block, kAdpcmBlockBytes * st->channels, 1, st->file) == 1)
+            st->dataBytes += kAdpcmBlockBytes * st->channels;
+        st->adpcmFrames = 0;
+    }
+
+    if (!writeHeader(st, frames) || fclose(st->file) != 0)
+        NSLog(@"ZOIPER: recorder could not finalise a file");
+    st->file = NULL;
+    free(st->adpcmPending);
+    st->adpcmPending = NULL;
+}
+
+//==============================================================================
+//  Microphone streams (I/O thread)
+//==============================================================================
+static void writeAccounted(int stream, const int16_t * pFrames, int frames)
+{
+    ZSDKRecStream * st = &gStreams[stream];
+    size_t bytes = writeFrames(st, pFrames, frames);
+
+    pthread_mutex_lock(&gRecLock);
+    st->stats.framesWritten += frames;
+    st->stats.bytesWritten += bytes;
+    gTotals.framesWritten += frames;
+    gTotals.bytesWritten += bytes;
+    if (bytes == 0 && frames > 0)
+    {
+        st->stats.writeErrors++;
+        gTotals.writeErrors++;
+    }
+    pthread_mutex_unlock(&gRecLock);
+}
+
+// Writes what the active object gained since the last poll, up to end
+static void drainRecording(int stream, int end)
+{
+    ZSDKRecStream * st = &gStreams[stream];
+    short * samples = NULL;
+    int count = 0;
+    if (gWrapperCtx.GetRecordingBuffer(st->recordings[st->active], &samples, &count) != L_OK || !samples)
+        return;
+    if (end >= 0 && end < count)
+        count = end;
+    count -= count % st->channels;
+    if (count > st->offset)
+    {
+        writeAccounted(stream, samples + st->offset, (count - st->offset) / st->channels);
+        st->offset = count;
+    }
+}
+
+static void pollMicrophone(int stream)
+{
+    ZSDKRecStream * st = &gStreams[stream];
+    drainRecording(stream, -1);
+
+    if (st->closeRequested)
+    {
+        gWrapperCtx.StopRecording(st->recordings[st->active]);
+        drainRecording(stream, -1);
+        gWrapperCtx.RemoveRecording(st->recordings[0]);
+        gWrapperCtx.RemoveRecording(st->recordings[1]);
+        return;
+    }
+
+    if (st->offset < st->segmentSamples / kRollDenominator * kRollNumerator)
+        return;
+    if (st->offset >= st->segmentSamples)
+        NSLog(@"ZOIPER: recorder fell behind, microphone object filled up");
+
+    // The incoming object starts before the outgoing one stops; cut the
+    // outgoing one where the incoming one began
+    int next = st->active ^ 1;
+    gWrapperCtx.StartRecording(st->recordings[next]);
+    short * samples = NULL;
+    int overlap = 0;
+    gWrapperCtx.GetRecordingBuffer(st->recordings[next], &samples, &overlap);
+    gWrapperCtx.StopRecording(st->recordings[st->active]);
+
+    samples = NULL;
+    int count = 0;
+    gWrapperCtx.GetRecordingBuffer(st->recordings[st->active], &samples, &count);
+    drainRecording(stream, count - overlap);
+
+    st->active = next;
+    st->offset = 0;
+}
+
+//==============================================================================
+//  Call transcodes (I/O thread)
+//==============================================================================
+static uint16_t get16(const uint8_t * p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t get32(const uint8_t * p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+
+// Positions the source at its data chunk; only 16 bit PCM is taken
+static BOOL openSource(ZSDKRecStream * st)
+{
+    st->source = fopen(st->sourcePath, "rb");
+    if (!st->source)
+        return NO;
+
+    uint8_t h[16];
+    BOOL format = NO;
+    if (fread(h, 12, 1, st->source) != 1 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0)
+        return NO;
+    while (fread(h, 8, 1, st->source) == 1)
+    {
+        uint32_t size = get32(h + 4);
+        if (memcmp(h, "fmt ", 4) == 0 && size >= 16)
+        {
+            if (fread(h, 16, 1, st->source) != 1 || get16(h) != 1 || get16(h + 14) != 16)
+                return NO;
+            st->channels   = get16(h + 2);
+            st->sampleRate = (int)get32(h + 4);
+            format = st->channels >= 1 && st->channels <= 2 && st->sampleRate > 0;
+            size -= 16;
+        }
+        else if (memcmp(h, "data", 4) == 0)
+        {
+            // A file cut short keeps 0 here: read to the end then
+            st->sourceBytes = size ? size : UINT64_MAX;
+            return format;
+        }
+        if (fseek(st->source, size + (size & 1), SEEK_CUR) != 0)
+            return NO;
+    }
+    return NO;
+}
+
+// 1: done, the file can be finalised; 0: more to do; -1: failed, the
+// stream is not open and the PCM file is kept
+static int transcodeStep(int stream)
+{
+    ZSDKRecStream * st = &gStreams[stream];
+    if (!st->file)
+    {
+        if (!openSource(st) || !openFile(st, st->destPath))
+        {
+            NSLog(@"ZOIPER: recorder could not compress %s", st->sourcePath);
+            if (st->source)
+                fclose(st->source);
+            st->source = NULL;
+            free(st->adpcmPending);
+            st->adpcmPending = NULL;
+            free(st->sourcePath);
+            free(st->destPath);
+            st->sourcePath = st->destPath = NULL;
+            pthread_mutex_lock(&gRecLock);
+            st->stats.writeErrors++;
+            gTotals.writeErrors++;
+            pthread_mutex_unlock(&gRecLock);
+            return -1;
+        }
+    }
+
+    size_t frameBytes = st->channels * sizeof(int16_t);
+    size_t maxBytes = (sizeof(gTranscodeBuffer) / frameBytes) * frameBytes;
+    for (int i = 0; i < kTranscodeBlocks && st->sourceBytes > 0; i++)
+    {
+        size_t want = st->sourceBytes < maxBytes ? (size_t)st->sourceBytes : maxBytes;
+        size_t got = fread(gTranscodeBuffer, 1, want, st->source);
+        if (got < want)
+            st->sourceBytes = 0;
+        else
+            st->sourceBytes -= got;
+        if (got >= frameBytes)
+            writeAccounted(stream, gTranscodeBuffer, (int)(got / frameBytes));
+    }
+    if (st->sourceBytes > 0)
+        return 0;
+
+    fclose(st->source);
+    st->source = NULL;
+    unlink(st->sourcePath);
+    free(st->sourcePath);
+    free(st->destPath);
+    st->sourcePath = st->destPath = NULL;
+    return 1;
+}
+
+//==============================================================================
+//  I/O thread
+//==============================================================================
+static void * recorderThreadMain( void * arg )
+{
+    pthread_setname_np("zsdk.recorder");
+    int finalize[kZSDKRecorderMaxStreams];
+
+    for (;;)
+    {
+        dispatch_semaphore_wait(gRecSignal,
+                                dispatch_time(DISPATCH_TIME_NOW, kZSDKRecorderPollMs * NSEC_PER_MSEC));
+
+        for (int i = 0; i < kZSDKRecorderMaxStreams; i++)
+        {
+            pthread_mutex_lock(&gRecLock);
+            BOOL microphone = gStreams[i].state == ZSDKStreamOpen && gStreams[i].microphone;
+            BOOL closing = microphone && gStreams[i].closeRequested;
+            pthread_mutex_unlock(&gRecLock);
+            if (!microphone)
+                continue;
+
+            pollMicrophone(i);
+            if (closing)
+            {
+                pthread_mutex_lock(&gRecLock);
+                gStreams[i].state = ZSDKStreamClosing;
+                pthread_mutex_unlock(&gRecLock);
+            }
+        }
+
+        BOOL more = NO;
+        for (int i = 0; i < kZSDKRecorderMaxStreams; i++)
+        {
+            pthread_mutex_lock(&gRecLock);
+            BOOL transcode = gStreams[i].state == ZSDKStreamOpen && gStreams[i].transcode;
+            pthread_mutex_unlock(&gRecLock);
+            if (!transcode)
+                continue;
+
+            int done = transcodeStep(i);
+            if (done == 0)
+            {
+                more = YES;
+                continue;
+            }
+            pthread_mutex_lock(&gRecLock);
+            gStreams[i].state = done > 0 ? ZSDKStreamClosing : ZSDKStreamFree;
+            pthread_mutex_unlock(&gRecLock);
+        }
+        if (more)
+            dispatch_semaphore_signal(gRecSignal);
+
+        pthread_mutex_lock(&gRecLock);
+        ZSDKRecBlock * block = gQueueHead;
+        gQueueHead = gQueueTail = NULL;
+        pthread_mutex_unlock(&gRecLock);
+
+        while (block)
+        {
+            ZSDKRecBlock * next = block->next;
+            ZSDKRecStream * st = &gStreams[block->stream];
+            size_t bytes = writeFrames(st, block->samples, block->frames);
+
+            pthread_mutex_lock(&gRecLock);
+            st->queued--;
+            st->stats.framesWritten += block->frames;
+            st->stats.bytesWritten += bytes;
+            gTotals.framesWritten += block->frames;
+            gTotals.bytesWritten += bytes;
+            if (bytes == 0 && block->frames > 0)
+            {
+                st->stats.writeErrors++;
+                gTotals.writeErrors++;
+            }
+            block->next = gFreeBlocks;
+            gFreeBlocks = block;
+            gFreeCount++;
+            pthread_mutex_unlock(&gRecLock);
+            block = next;
+        }
+
+        int count = 0;
+        pthread_mutex_lock(&gRecLock);
+        for (int i = 0; i < kZSDKRecorderMaxStreams; i++)
+        {
+            if (gStreams[i].state == ZSDKStreamClosing && gStreams[i].queued == 0)
+                finalize[count++] = i;
+        }
+        pthread_mutex_unlock(&gRecLock);
+
+        for (int i = 0; i < count; i++)
+        {
+            finalizeFile(&gStreams[finalize[i]]);
+            pthread_mutex_lock(&gRecLock);
+            gStreams[finalize[i]].state = ZSDKStreamFree;
+            pthread_mutex_unlock(&gRecLock);
+        }
+    }
+    return NULL;
+}
+
+static void startRecorder(void)
+{
+    gPool = malloc(kZSDKRecorderPoolBlocks * sizeof(ZSDKRecBlock));
+    if (!gPool)
+    {
+        NSLog(@"ERROR SETUP recorder pool");
+        return;
+    }
+    for (int i = 0; i < kZSDKRecorderPoolBlocks; i++)
+    {
+        gPool[i].next = gFreeBlocks;
+        gFreeBlocks = &gPool[i];
+    }
+    gFreeCount = kZSDKRecorderPoolBlocks;
+    gRecSignal = dispatch_semaphore_create(0);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_set_qos_class_np(&attr, QOS_CLASS_UTILITY, 0);
+    if (pthread_create(&gRecThread, &attr, recorderThreadMain, NULL) == 0)
+        gRecReady = YES;
+    else
+        NSLog(@"ERROR SETUP recorder thread");
+    pthread_attr_destroy(&attr);
+}
+
+//==============================================================================
+//  Streams
+//==============================================================================
+static int reserveStream(ZSDKRecordFormat format, int sampleRate, int channels)
+{
+    pthread_once(&gRecOnce, startRecorder);
+    if (!gRecReady || sampleRate <= 0 || channels < 1 || channels > 2)
+        return -1;
+
+    pthread_mutex_lock(&gRecLock);
+    int stream = -1;
+    for (int i = 0; i < kZSDKRecorderMaxStreams && stream < 0; i++)
+    {
+        if (gStreams[i].state == ZSDKStreamFree)
+            stream = i;
+    }
+    if (stream >= 0)
+    {
+        memset(&gStreams[stream], 0, sizeof(gStreams[stream]));
+        gStreams[stream].state      = ZSDKStreamReserved;
+        gStreams[stream].format     = format;
+        gStreams[stream].sampleRate = sampleRate;
+        gStreams[stream].channels   = channels;
+    }
+    pthread_mutex_unlock(&gRecLock);
+    return stream;
+}
+
+static void publishStream(int stream, BOOL ok)
+{
+    pthread_mutex_lock(&gRecLock);
+    gStreams[stream].state = ok ? ZSDKStreamOpen : ZSDKStreamFree;
+    pthread_mutex_unlock(&gRecLock);
+}
+
+int ZSDKRecorderOpen(const char * pPath, ZSDKRecordFormat format, int sampleRate, int channels)
+{
+    int stream = reserveStream(format, sampleRate, channels);
+    if (stream < 0)
+        return -1;
+
+    BOOL ok = openFile(&gStreams[stream], pPath);
+    publishStream(stream, ok);
+    return ok ? stream : -1;
+}
+
+int ZSDKRecorderStartMicrophone(const char * pPath, ZSDKRecordFormat format, int sampleRate, int channels)
+{
+    int stream = reserveStream(format, sampleRate, channels);
+    if (stream < 0)
+        return -1;
+
+    ZSDKRecStream * st = &gStreams[stream];
+    st->microphone = YES;
+    st->segmentSamples = sampleRate / 1000 * kZSDKRecorderSegmentMs * channels;
+    st->recordings[0] = st->recordings[1] = INVALID_HANDLE;
+
+    BOOL ok = gWrapperCtx.AddRecording2(sampleRate, channels, st->segmentSamples, &st->recordings[0]) == L_OK &&
+              gWrapperCtx.AddRecording2(sampleRate, channels, st->segmentSamples, &st->recordings[1]) == L_OK &&
+              openFile(st, pPath) &&
+              gWrapperCtx.StartRecording(st->recordings[0]) == L_OK;
+    if (!ok)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (st->recordings[i] != INVALID_HANDLE)
+                gWrapperCtx.RemoveRecording(st->recordings[i]);
+        }
+        if (st->file)
+        {
+            fclose(st->file);
+            st->file = NULL;
+        }
+        free(st->adpcmPending);
+        st->adpcmPending = NULL;
+    }
+    publishStream(stream, ok);
+    return ok ? stream : -1;
+}
+
+static BOOL writeStream(int stream, const int16_t * pSamples, int frames, BOOL countDrops)
+{
+    if (stream < 0 || stream >= kZSDKRecorderMaxStreams || frames <= 0)
+        return NO;
+
+    ZSDKRecStream * st = &gStreams[stream];
+    if (st->state != ZSDKStreamOpen || st->microphone || st->transcode)
+        return NO;
+
+    int capacity = kZSDKRecorderBlockSamples / st->channels;
+    int space = st->filling ? capacity - st->filling->frames : 0;
+    int needed = (frames > space) ? (frames - space + capacity - 1) / capacity : 0;
+
+    // All or nothing, so a file never has holes in the middle of a write
+    ZSDKRecBlock * spare = NULL;
+    pthread_mutex_lock(&gRecLock);
+    if (needed > gFreeCount)
+    {
+        if (countDrops)
+        {
+            st->stats.framesDropped += frames;
+            gTotals.framesDropped += frames;
+        }
+        pthread_mutex_unlock(&gRecLock);
+        return NO;
+    }
+    for (int i = 0; i < needed; i++)
+    {
+        ZSDKRecBlock * block = gFreeBlocks;
+        gFreeBlocks = block->next;
+        block->next = spare;
+        spare = block;
+    }
+    gFreeCount -= needed;
+    int inUse = kZSDKRecorderPoolBlocks - gFreeCount;
+    if (inUse > gTotals.blocksInUseMax)
+        gTotals.blocksInUseMax = inUse;
+    pthread_mutex_unlock(&gRecLock);
+
+    ZSDKRecBlock * fullHead = NULL;
+    ZSDKRecBlock * fullTail = NULL;
+    int full = 0;
+    while (frames > 0)
+    {
+        if (!st->filling)
+        {
+            st->filling = spare;
+            spare = spare->next;
+            st->filling->next   = NULL;
+            st->filling->stream = stream;
+            st->filling->frames = 0;
+        }
+
+        ZSDKRecBlock * block = st->filling;
+        int n = capacity - block->frames;
+        if (n > frames)
+            n = frames;
+        memcpy(block->samples + block->frames * st->channels, pSamples, n * st->channels * sizeof(int16_t));
+        block->frames += n;
+        pSamples += n * st->channels;
+        frames -= n;
+
+        if (block->frames == capacity)
+        {
+            if (fullTail)
+                fullTail->next = block;
+            else
+                fullHead = block;
+            fullTail = block;
+            full++;
+            st->filling = NULL;
+        }
+    }
+
+    if (fullHead)
+    {
+        pthread_mutex_lock(&gRecLock);
+        if (gQueueTail)
+            gQueueTail->next = fullHead;
+        else
+            gQueueHead = fullHead;
+        gQueueTail = fullTail;
+        st->queued += full;
+        pthread_mutex_unlock(&gRecLock);
+        dispatch_semaphore_signal(gRecSignal);
+    }
+    return YES;
+}
+
+BOOL ZSDKRecorderWrite(int stream, const int16_t * pSamples, int frames)
+{
+    return writeStream(stream, pSamples, frames, YES);
+}
+
+void ZSDKRecorderClose(int stream)
+{
+    if (stream < 0 || stream >= kZSDKRecorderMaxStreams)
+        return;
+
+    ZSDKRecStream * st = &gStreams[stream];
+    pthread_mutex_lock(&gRecLock);
+    if (st->state != ZSDKStreamOpen || st->transcode)
+    {
+        pthread_mutex_unlock(&gRecLock);
+        return;
+    }
+    if (st->microphone)
+    {
+        st->closeRequested = YES;
+    }
+    else
+    {
+        ZSDKRecBlock * block = st->filling;
+        st->filling = NULL;
+        if (block && block->frames > 0)
+        {
+            if (gQueueTail)
+                gQueueTail->next = block;
+            else
+                gQueueHead = block;
+            gQueueTail = block;
+            st->queued++;
+        }
+        else if (block)
+        {
+            block->next = gFreeBlocks;
+            gFreeBlocks = block;
+            gFreeCount++;
+        }
+        st->state = ZSDKStreamClosing;
+    }
+    pthread_mutex_unlock(&gRecLock);
+    dispatch_semaphore_signal(gRecSignal);
+}
+
+void ZSDKRecorderGetStats(int stream, ZSDKRecorderStats * pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    if (stream < 0 || stream >= kZSDKRecorderMaxStreams)
+        return;
+
+    pthread_mutex_lock(&gRecLock);
+    if (gStreams[stream].state != ZSDKStreamFree)
+        *pStats = gStreams[stream].stats;
+    pthread_mutex_unlock(&gRecLock);
+}
+
+void ZSDKRecorderGetTotals(ZSDKRecorderStats * pStats)
+{
+    pthread_mutex_lock(&gRecLock);
+    *pStats = gTotals;
+    pStats->blocksInUse = gRecReady ? kZSDKRecorderPoolBlocks - gFreeCount : 0;
+    pthread_mutex_unlock(&gRecLock);
+}
+
+//==============================================================================
+//  Calls
+//==============================================================================
+// Hands a finished library recording over: compressed ones to the I/O
+// thread, which frees the paths
+static void finishCall(char * pPath, char * pSource)
+{
+    if (!pSource)
+    {
+        free(pPath);
+        return;
+    }
+
+    pthread_mutex_lock(&gRecLock);
+    int stream = -1;
+    for (int i = 0; i < kZSDKRecorderMaxStreams && stream < 0; i++)
+    {
+        if (gStreams[i].state == ZSDKStreamFree)
+            stream = i;
+    }
+    if (stream >= 0)
+    {
+        memset(&gStreams[stream], 0, sizeof(gStreams[stream]));
+        gStreams[stream].state      = ZSDKStreamOpen;
+        gStreams[stream].format     = ZSDKRecordIMAADPCM;
+        gStreams[stream].transcode  = YES;
+        gStreams[stream].sourcePath = pSource;
+        gStreams[stream].destPath   = pPath;
+    }
+    pthread_mutex_unlock(&gRecLock);
+
+    if (stream < 0)
+    {
+        NSLog(@"ZOIPER: recorder has no stream free, %s stays uncompressed", pSource);
+        free(pPath);
+        free(pSource);
+        return;
+    }
+    dispatch_semaphore_signal(gRecSignal);
+}
+
+static ZSDKCallRec * findCall(CallHandler callId)
+{
+    for (int i = 0; i < kZSDKRecorderMaxCalls; i++)
+    {
+        if (gCalls[i].state != ZSDKCallRecFree && gCalls[i].callId == callId)
+            return &gCalls[i];
+    }
+    return NULL;
+}
+
+BOOL ZSDKRecorderStartCall(CallHandler callId, const char * pPath, ZSDKRecordFormat format,
+                           eCallRecording_t sides)
+{
+    pthread_once(&gRecOnce, startRecorder);
+    if (!gRecReady)
+        return NO;
+
+    char * path = strdup(pPath);
+    char * source = NULL;
+    if (!path || (format == ZSDKRecordIMAADPCM && asprintf(&source, "%s.pcm", pPath) < 0))
+    {
+        free(path);
+        return NO;
+    }
+
+    pthread_mutex_lock(&gRecLock);
+    ZSDKCallRec * rec = findCall(callId);
+    if (!rec)
+    {
+        for (int i = 0; i < kZSDKRecorderMaxCalls && !rec; i++)
+        {
+            if (gCalls[i].state == ZSDKCallRecFree)
+            {
+                rec = &gCalls[i];
+                rec->state  = ZSDKCallRecStarting;
+                rec->callId = callId;
+                rec->ended  = NO;
+                rec->path   = path;
+                rec->source = source;
+            }
+        }
+    }
+    else
+    {
+        rec = NULL;
+    }
+    pthread_mutex_unlock(&gRecLock);
+    if (!rec)
+    {
+        free(path);
+        free(source);
+        return NO;
+    }
+
+    BOOL opened = gWrapperCtx.CallOpenFile(callId, source ? source : path, sides) == L_OK;
+    BOOL ok = opened && gWrapperCtx.CallStartRecordInFile(callId) == L_OK;
+    if (opened && !ok)
+        gWrapperCtx.CallCloseFile(callId);
+
+    pthread_mutex_lock(&gRecLock);
+    BOOL ended = rec->ended;
+    if (ok && !ended)
+    {
+        rec->state = ZSDKCallRecActive;
+        pthread_mutex_unlock(&gRecLock);
+        return YES;
+    }
+    rec->state = ZSDKCallRecFree;
+    pthread_mutex_unlock(&gRecLock);
+
+    // Stopped or gone meanwhile: what was recorded is kept
+    if (ok)
+    {
+        gWrapperCtx.CallCloseFile(callId);
+        finishCall(path, source);
+        return YES;
+    }
+    free(path);
+    free(source);
+    return NO;
+}
+
+// Takes the call's record out of the table; NO while it is being started
+static BOOL takeCall(CallHandler callId, char ** ppPath, char ** ppSource)
+{
+    pthread_mutex_lock(&gRecLock);
+    ZSDKCallRec * rec = findCall(callId);
+    BOOL taken = rec && rec->state == ZSDKCallRecActive;
+    if (taken)
+    {
+        *ppPath = rec->path;
+        *ppSource = rec->source;
+        rec->state = ZSDKCallRecFree;
+    }
+    else if (rec)
+    {
+        rec->ended = YES;
+    }
+    pthread_mutex_unlock(&gRecLock);
+    return taken;
+}
+
+void ZSDKRecorderStopCall(CallHandler callId)
+{
+    char * path;
+    char * source;
+    if (!takeCall(callId, &path, &source))
+        return;
+    gWrapperCtx.CallCloseFile(callId);
+    finishCall(path, source);
+}
+
+void ZSDKRecorderOnCallEnded(CallHandler callId)
+{
+    char * path;
+    char * source;
+    if (takeCall(callId, &path, &source))
+        finishCall(path, source);
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+static BOOL allClosed(const int * pStreams, int count)
+{
+    BOOL closed = YES;
+    pthread_mutex_lock(&gRecLock);
+    for (int i = 0; i < count && closed; i++)
+        closed = (pStreams[i] < 0 || gStreams[pStreams[i]].state == ZSDKStreamFree);
+    pthread_mutex_unlock(&gRecLock);
+    return closed;
+}
+
+BOOL ZSDKRecorderBenchmark(const char * pDir, int count, int seconds, int sampleRate,
+                           ZSDKRecordFormat format, ZSDKRecorderBenchmarkResult * pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    if (count <= 0 || count > kZSDKRecorderMaxStreams || seconds <= 0 || sampleRate < 50)
+        return NO;
+
+    // One second of speech-like signal: a gliding tone under a syllable
+    // rate envelope, with some noise
+    int16_t * signal = malloc(sampleRate * sizeof(int16_t));
+    int * streams = malloc(count * sizeof(int));
+    char (* paths)[kBenchPathBytes] = malloc(count * kBenchPathBytes);
+    if (!signal || !streams || !paths)
+    {
+        free(signal); free(streams); free(paths);
+        return NO;
+    }
+    uint32_t seed = 0x1234567;
+    double phase = 0;
+    for (int i = 0; i < sampleRate; i++)
+    {
+        double t = (double)i / sampleRate;
+        phase += 2 * M_PI * (140 + 60 * sin(2 * M_PI * 1.5 * t)) / sampleRate;
+        double envelope = 0.5 + 0.5 * sin(2 * M_PI * 4 * t);
+        seed = seed * 1664525 + 1013904223;
+        signal[i] = (int16_t)(8000 * envelope * sin(phase) + (int)(seed >> 24) - 128);
+    }
+
+    BOOL ok = YES;
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(paths[i], kBenchPathBytes, "%s/zsdk_bench_%d.wav", pDir, i);
+        streams[i] = ZSDKRecorderOpen(paths[i], format, sampleRate, 1);
+        ok = ok && streams[i] >= 0;
+    }
+
+    ZSDKRecorderStats before;
+    ZSDKRecorderGetTotals(&before);
+    uint64_t startUs = ZSDKMonotonicMicros();
+
+    // 20 ms frames round robin, like that many live calls
+    int frame = sampleRate / 50;
+    for (int f = 0; ok && f < seconds * 50; f++)
+    {
+        const int16_t * src = signal + (f % 50) * frame;
+        for (int i = 0; i < count; i++)
+        {
+            while (!writeStream(streams[i], src, frame, NO))
+            {
+                pResult->stalls++;
+                usleep(200);
+            }
+        }
+    }
+    for (int i = 0; i < count; i++)
+        ZSDKRecorderClose(streams[i]);
+    while (!allClosed(streams, count))
+        usleep(1000);
+
+    uint64_t wallUs = ZSDKMonotonicMicros() - startUs;
+    ZSDKRecorderStats after;
+    ZSDKRecorderGetTotals(&after);
+
+    for (int i = 0; i < count; i++)
+        unlink(paths[i]);
+    free(signal);
+    free(streams);
+    free(paths);
+    if (!ok)
+        return NO;
+
+    pResult->recordings         = count;
+    pResult->audioSeconds       = (double)count * seconds;
+    pResult->wallSeconds        = wallUs / 1e6;
+    pResult->realtimeFactor     = pResult->audioSeconds / (pResult->wallSeconds > 0 ? pResult->wallSeconds : 1e-6);
+    pResult->megabytesPerSecond = (after.bytesWritten - before.bytesWritten) / 1e6 /
+                                  (pResult->wallSeconds > 0 ? pResult->wallSeconds : 1e-6);
+    return YES;
+}
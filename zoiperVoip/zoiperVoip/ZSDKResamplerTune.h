@@ -0,0 +1,58 @@
+//
+//  ZSDKResamplerTune.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Choice of the audio driver resampler (SetAudioResamplerType()).
+//
+//  The resamplers live inside the library, so the benchmark measures them
+//  end to end in external audio mode: for every resampler and every source
+//  rate a looped 997 Hz tone is played from a generated WAV file while the
+//  external audio thread captures the mixer output at the device rate.
+//  Reported per conversion are the CPU time ExternalAudioFrame() spent per
+//  second of audio and the SNR of the captured tone (least squares fit of
+//  the known frequency; everything else counts as noise).
+//
+//  ZSDKResamplerChoose() then picks the cheapest resampler whose worst SNR
+//  meets a quality floor within the CPU budget left by the core count and
+//  system load.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKResamplerToneHz            997
+#define kZSDKResamplerProbeMs           1500    // captured per conversion
+#define kZSDKResamplerSettleMs          300     // discarded at its start
+#define kZSDKResamplerDefaultFloorDb    50.0
+#define kZSDKResamplerBudgetMsPerCore   20.0    // CPU ms per second of audio
+
+typedef struct {
+    eAudioResampler_t   type;
+    int                 fromHz;
+    int                 toHz;
+    double              cpuMsPerSecond;
+    double              snrDb;
+    int                 samples;        // analysed; 0 = no output captured
+} ZSDKResamplerResult;
+
+typedef void (^ZSDKResamplerCompletion)(const ZSDKResamplerResult * pResults, int count);
+
+const char * ZSDKResamplerName(eAudioResampler_t type);
+
+// SNR in dB of a tone of known frequency in pSamples
+double ZSDKResamplerToneSNR(const int16_t * pSamples, int count, int rateHz, double toneHz);
+
+// Runs every resampler over 8, 16, 44.1 and 48 kHz sources on a background
+// queue; completion runs on the main queue.  Needs external audio mode and
+// no active call.  Returns NO if a benchmark is already running.
+BOOL ZSDKResamplerRunBenchmark(ZSDKResamplerCompletion completion);
+
+// Online cores and the 1 minute load average per core
+void ZSDKResamplerSystemLoad(int * pCores, double * pLoad);
+
+// Policy; E_AUDIO_DRV_RESAMPLER_DEFAULT when nothing usable was measured
+eAudioResampler_t ZSDKResamplerChoose(const ZSDKResamplerResult * pResults, int count,
+                                      double minSnrDb, int cores, double load);
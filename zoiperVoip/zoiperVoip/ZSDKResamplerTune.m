@@ -0,0 +1,295 @@
+//
+//  ZSDKResamplerTune.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKResamplerTune.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKExternalAudio.h"
+#import "ZSDKCallRegistry.h"
+#import <math.h>
+#import <unistd.h>
+
+#define kToneSeconds        2       // whole number of tone periods at every rate
+#define kCaptureMaxRateHz   96000
+#define kCaptureCapacity    (kCaptureMaxRateHz / 1000 * kZSDKResamplerProbeMs)
+#define kTapGraceUs         50000   // lets an in-flight tap call finish
+
+static const eAudioResampler_t kResamplers[] = {
+    E_AUDIO_DRV_RESAMPLER_INTERNAL
+,   E_AUDIO_DRV_RESAMPLER_IPHONE
+,   E_AUDIO_DRV_RESAMPLER_SPEEX
+,   E_AUDIO_DRV_RESAMPLER_WEBRTC
+};
+#define kResamplerCount     ((int)(sizeof(kResamplers) / sizeof(kResamplers[0])))
+
+static const int kSourceRates[] = { 8000, 16000, 44100, 48000 };
+#define kSourceRateCount    ((int)(sizeof(kSourceRates) / sizeof(kSourceRates[0])))
+
+static int          gBenchmarkRunning;
+
+// Capture, filled by the tap on the external audio thread
+static int16_t *    gCapture;
+static int          gCaptureCount;
+static uint64_t     gCaptureSamples;    // all samples seen, also past capacity
+static uint64_t     gCaptureProcessUs;
+
+const char * ZSDKResamplerName(eAudioResampler_t type)
+{
+    switch (type)
+    {
+        case E_AUDIO_DRV_RESAMPLER_DEFAULT:     return "default";
+        case E_AUDIO_DRV_RESAMPLER_INTERNAL:    return "internal";
+        case E_AUDIO_DRV_RESAMPLER_IPHONE:      return "iphone";
+        case E_AUDIO_DRV_RESAMPLER_SPEEX:       return "speex";
+        case E_AUDIO_DRV_RESAMPLER_WEBRTC:      return "webrtc";
+    }
+    return "unknown";
+}
+
+//==============================================================================
+//  Analysis
+//==============================================================================
+double ZSDKResamplerToneSNR(const int16_t * pSamples, int count, int rateHz, double toneHz)
+{
+    if (count <= 0 || rateHz <= 0)
+        return -100.0;
+
+    const double w = 2.0 * M_PI * toneHz / rateHz;
+    double mean = 0, xs = 0, xc = 0, ss = 0, cc = 0;
+    for (int i = 0; i < count; i++)
+        mean += pSamples[i];
+    mean /= count;
+
+    for (int i = 0; i < count; i++)
+    {
+        double s = sin(w * i), c = cos(w * i), x = pSamples[i] - mean;
+        xs += x * s;
+        xc += x * c;
+        ss += s * s;
+        cc += c * c;
+    }
+    double a = xs / ss, b = xc / cc;
+
+    double signal = 0, noise = 0;
+    for (int i = 0; i < count; i++)
+    {
+        double fit = a * sin(w * i) + b * cos(w * i);
+        double err = pSamples[i] - mean - fit;
+        signal += fit * fit;
+        noise  += err * err;
+    }
+    if (signal <= 0)
+        return -100.0;
+    if (noise < 1e-9)
+        noise = 1e-9;
+    return 10.0 * log10(signal / noise);
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+static BOOL writeToneFile(const char * pPath, int rateHz)
+{
+    FILE * f = fopen(pPath, "wb");
+    if (!f)
+        return NO;
+
+    uint32_t samples = rateHz * kToneSeconds;
+    uint32_t dataBytes = samples * sizeof(int16_t);
+    uint32_t riffBytes = 36 + dataBytes;
+    uint32_t fmtBytes = 16, byteRate = rateHz * 2, rate = rateHz;
+    uint16_t pcm = 1, channels = 1, blockAlign = 2, bits = 16;
+
+    // Little endian, as are all our targets
+    fwrite("RIFF", 1, 4, f);  fwrite(&riffBytes, 4, 1, f);  fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f);  fwrite(&fmtBytes, 4, 1, f);
+    fwrite(&pcm, 2, 1, f);    fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f);   fwrite(&byteRate, 4, 1, f);
+    fwrite(&blockAlign, 2, 1, f); fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f);  fwrite(&dataBytes, 4, 1, f);
+
+    const double w = 2.0 * M_PI * kZSDKResamplerToneHz / rateHz;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        int16_t v = (int16_t)lround(16384.0 * sin(w * i));
+        fwrite(&v, 2, 1, f);
+    }
+    return fclose(f) == 0;
+}
+
+static void captureTap(const int16_t * pOut, int samples, uint64_t processUs)
+{
+    int at = __atomic_load_n(&gCaptureCount, __ATOMIC_RELAXED);
+    int room = kCaptureCapacity - at;
+    int copy = (samples < room) ? samples : room;
+    if (copy > 0)
+    {
+        memcpy(gCapture + at, pOut, copy * sizeof(int16_t));
+        __atomic_store_n(&gCaptureCount, at + copy, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&gCaptureSamples, samples, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&gCaptureProcessUs, processUs, __ATOMIC_RELAXED);
+}
+
+static void probe(eAudioResampler_t type, int fromHz, const char * pPath, ZSDKResamplerResult * pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    pResult->type   = type;
+    pResult->fromHz = fromHz;
+    pResult->snrDb  = -100.0;
+
+    gWrapperCtx.SetAudioResamplerType(type);
+
+    SoundHandler sound = INVALID_HANDLE;
+    int cause = 0;
+    if (gWrapperCtx.AddSoundFromWav(pPath, 1, 0, 0, &sound, &cause) != L_OK)
+    {
+        NSLog(@"ZOIPER: resampler probe could not load %s (cause %d)", pPath, cause);
+        return;
+    }
+
+    __atomic_store_n(&gCaptureCount, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&gCaptureSamples, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&gCaptureProcessUs, 0, __ATOMIC_RELAXED);
+    ZSDKExternalAudioSetTap(captureTap);
+
+    gWrapperCtx.StartSound(sound, 0);
+    ZSDKPollEngineWakeup();
+    usleep(kZSDKResamplerProbeMs * 1000);
+
+    ZSDKExternalAudioSetTap(NULL);
+    gWrapperCtx.StopSound(sound, 0);
+    gWrapperCtx.RemoveSound(sound);
+    usleep(kTapGraceUs);
+
+    ZSDKExtAudioStats stats;
+    ZSDKExternalAudioGetStats(&stats);
+    int count = __atomic_load_n(&gCaptureCount, __ATOMIC_ACQUIRE);
+    uint64_t seen = __atomic_load_n(&gCaptureSamples, __ATOMIC_RELAXED);
+    int settle = stats.sampleRate / 1000 * kZSDKResamplerSettleMs;
+    pResult->toHz = stats.sampleRate;
+    if (stats.sampleRate <= 0 || count <= settle || seen == 0)
+        return;
+
+    pResult->samples = count - settle;
+    pResult->snrDb = ZSDKResamplerToneSNR(gCapture + settle, count - settle, stats.sampleRate,
+                                          kZSDKResamplerToneHz);
+    pResult->cpuMsPerSecond = (double)__atomic_load_n(&gCaptureProcessUs, __ATOMIC_RELAXED) / 1000.0 /
+                              ((double)seen / stats.sampleRate);
+}
+
+BOOL ZSDKResamplerRunBenchmark(ZSDKResamplerCompletion completion)
+{
+    ZSDKCallRegistryLock();
+    int calls = ZSDKCallRegistryCount();
+    ZSDKCallRegistryUnlock();
+    if (!ZSDKExternalAudioEnabled() || calls > 0)
+        return NO;
+    if (__atomic_exchange_n(&gBenchmarkRunning, 1, __ATOMIC_ACQ_REL))
+        return NO;
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        int total = kResamplerCount * kSourceRateCount, count = 0;
+        ZSDKResamplerResult * results = calloc(total, sizeof(ZSDKResamplerResult));
+        gCapture = malloc(kCaptureCapacity * sizeof(int16_t));
+
+        if (results && gCapture)
+        {
+            NSString * dir = NSTemporaryDirectory();
+            for (int r = 0; r < kSourceRateCount; r++)
+            {
+                NSString * name = [NSString stringWithFormat:@"zsdk_tone_%d.wav", kSourceRates[r]];
+                const char * path = [[dir stringByAppendingPathComponent:name] fileSystemRepresentation];
+                if (!writeToneFile(path, kSourceRates[r]))
+                {
+                    NSLog(@"ZOIPER: resampler probe could not write %s", path);
+                    continue;
+                }
+                for (int t = 0; t < kResamplerCount; t++)
+                {
+                    ZSDKResamplerResult * result = &results[count++];
+                    probe(kResamplers[t], kSourceRates[r], path, result);
+                    NSLog(@"ZOIPER: resampler %s %d -> %d Hz: %.2f ms/s, SNR %.1f dB",
+                          ZSDKResamplerName(result->type), result->fromHz, result->toHz,
+                          result->cpuMsPerSecond, result->snrDb);
+                }
+                unlink(path);
+            }
+        }
+
+        free(gCapture);
+        gCapture = NULL;
+        __atomic_store_n(&gBenchmarkRunning, 0, __ATOMIC_RELEASE);
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(results, count);
+            free(results);
+        });
+    });
+    return YES;
+}
+
+//==============================================================================
+//  Policy
+//==============================================================================
+void ZSDKResamplerSystemLoad(int * pCores, double * pLoad)
+{
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        cores = 1;
+
+    double avg[1];
+    double load = (getloadavg(avg, 1) == 1) ? avg[0] / cores : 0.0;
+    *pCores = cores;
+    *pLoad  = (load < 0) ? 0 : (load > 1 ? 1 : load);
+}
+
+eAudioResampler_t ZSDKResamplerChoose(const ZSDKResamplerResult * pResults, int count,
+                                      double minSnrDb, int cores, double load)
+{
+    // Per resampler: the worst SNR and the mean cost over the conversions
+    double worstSnr[kResamplerCount], cpu[kResamplerCount];
+    int measured[kResamplerCount];
+    for (int t = 0; t < kResamplerCount; t++)
+    {
+        worstSnr[t] = INFINITY;
+        cpu[t] = 0;
+        measured[t] = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (pResults[i].type != kResamplers[t] || pResults[i].samples == 0)
+                continue;
+            if (pResults[i].snrDb < worstSnr[t])
+                worstSnr[t] = pResults[i].snrDb;
+            cpu[t] += pResults[i].cpuMsPerSecond;
+            measured[t]++;
+        }
+        if (measured[t])
+            cpu[t] /= measured[t];
+    }
+
+    double budget = kZSDKResamplerBudgetMsPerCore * (cores < 1 ? 1 : cores) * (1.0 - load);
+    int cheapestOk = -1, bestInBudget = -1, cheapest = -1;
+    for (int t = 0; t < kResamplerCount; t++)
+    {
+        if (!measured[t])
+            continue;
+        if (cheapest < 0 || cpu[t] < cpu[cheapest])
+            cheapest = t;
+        if (cpu[t] > budget)
+            continue;
+        if (worstSnr[t] >= minSnrDb && (cheapestOk < 0 || cpu[t] < cpu[cheapestOk]))
+            cheapestOk = t;
+        if (bestInBudget < 0 || worstSnr[t] > worstSnr[bestInBudget])
+            bestInBudget = t;
+    }
+
+    // Meeting the floor cheaply first, then the best quality the budget
+    // affords, and when even that is out of reach, the cheapest
+    int chosen = (cheapestOk >= 0) ? cheapestOk : (bestInBudget >= 0 ? bestInBudget : cheapest);
+    return (chosen >= 0) ? kResamplers[chosen] : E_AUDIO_DRV_RESAMPLER_DEFAULT;
+}
@@ -0,0 +1,59 @@
+//
+//  ZSDKSoundCache.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Process wide cache of library sounds for ringtones and prompts.  A sound
+//  is decoded once by AddSoundFromWav() and its SoundHandler is handed out
+//  again for as long as the file keeps its modification time and size, so
+//  repeated prompts cost a stat() instead of a decode.
+//
+//  The decoded PCM lives in the library's sound objects (AddSoundFromWav()
+//  copies into its own buffers, AddSound() only takes 8 kHz), so the budget
+//  is applied to those: when the cached sounds exceed it, the least recently
+//  used ones that nobody holds are removed.  Sounds are held between
+//  Acquire and Release, i.e. while they may be playing.
+//
+//  Preloading loads in the library's thread (async AddSoundFromWav()); the
+//  entries become usable with onSoundLoadCompleted, which is matched to its
+//  entry by handle even when it arrives before AddSoundFromWav() returns.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKSoundCacheMaxEntries       64
+#define kZSDKSoundCacheDefaultBudget    (8 * 1024 * 1024)   // bytes of PCM
+
+typedef struct {
+    int         entries;
+    int         loading;
+    size_t      bytes;
+    size_t      budget;
+    uint64_t    hits;
+    uint64_t    misses;             // decoded synchronously
+    uint64_t    evictions;
+    uint64_t    loadFailures;
+} ZSDKSoundCacheStats;
+
+void ZSDKSoundCacheSetBudget(size_t bytes);
+
+// L_OK with a playable sound; L_WAIT with the sound while a preload is
+// still running; L_FAIL when the file cannot be loaded.  While another
+// thread decodes the same file synchronously this waits for it.  Every L_OK
+// or L_WAIT must be paired with a Release.
+LIBRESULT ZSDKSoundCacheAcquire(const char * pPath, int repeat, int pauseMs, SoundHandler * pSound);
+void      ZSDKSoundCacheRelease(SoundHandler sound);
+
+// Starts asynchronous loads for the paths not cached yet
+void ZSDKSoundCachePreload(const char * const * pPaths, int count, int repeat, int pauseMs);
+
+// From onSoundLoadCompleted
+void ZSDKSoundCacheOnLoadCompleted(SoundHandler sound, LIBRESULT result, int causeCode);
+
+// Removes every sound nobody holds
+void ZSDKSoundCacheFlush(void);
+
+void ZSDKSoundCacheGetStats(ZSDKSoundCacheStats * pStats);
@@ -0,0 +1,470 @@
+//
+//  ZSDKSoundCache.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKSoundCache.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKHandleMap.h"
+#import <pthread.h>
+#import <sys/stat.h>
+
+#define kSoundMapBits   7       // 128 buckets for 64 sounds
+#define kDoomedMax      (kZSDKSoundCacheMaxEntries + 1)     // every entry plus an orphaned load
+
+typedef enum {
+    ZSDKSoundFree = 0
+,   ZSDKSoundLoading
+,   ZSDKSoundReady
+} ZSDKSoundState;
+
+typedef struct {
+    ZSDKSoundState  state;
+    char *          path;
+    uint32_t        hash;
+    uint32_t        serial;         // tells a reused entry from the one a load started on
+    time_t          mtime;
+    off_t           size;
+    int             repeat;
+    int             pauseMs;
+    SoundHandler    sound;          // INVALID_HANDLE until AddSoundFromWav() returns
+    size_t          bytes;
+    int             refs;
+    uint64_t        lastUse;
+    BOOL            stale;          // replaced or failed; removed on last release
+} ZSDKSoundEntry;
+
+// onSoundLoadCompleted for a handle not attached to an entry yet: the
+// preload that started it has not taken the lock back
+typedef struct {
+    SoundHandler    sound;
+    LIBRESULT       result;
+    int             causeCode;
+    size_t          bytes;
+} ZSDKSoundEarlyLoad;
+
+static pthread_mutex_t      gCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       gAttachCond = PTHREAD_COND_INITIALIZER;
+static ZSDKSoundEntry       gEntries[kZSDKSoundCacheMaxEntries];
+static ZSDKHandleBucket     gBuckets[1 << kSoundMapBits];
+static ZSDKHandleMap        gSoundMap;
+static BOOL                 gMapReady = NO;
+static uint64_t             gClock;
+static uint32_t             gSerial;
+static ZSDKSoundCacheStats  gStats = { .budget = kZSDKSoundCacheDefaultBudget };
+static ZSDKSoundEarlyLoad   gEarly[kZSDKSoundCacheMaxEntries];
+static int                  gEarlyNext;
+// Sounds to RemoveSound() once the lock is released
+static SoundHandler         gDoomed[kDoomedMax];
+static int                  gDoomedCount;
+
+//==============================================================================
+//  Locking
+//
+//  The library is never called with gCacheLock held: onSoundLoadCompleted
+//  takes it on the poll thread.  Removed sounds are queued and handed to
+//  RemoveSound() by unlockCache().
+//==============================================================================
+static void lockCache(void)
+{
+    pthread_mutex_lock(&gCacheLock);
+}
+
+static void unlockCache(void)
+{
+    SoundHandler doomed[kDoomedMax];
+    int count = gDoomedCount;
+    memcpy(doomed, gDoomed, count * sizeof(doomed[0]));
+    gDoomedCount = 0;
+    pthread_mutex_unlock(&gCacheLock);
+
+    for (int i = 0; i < count; i++)
+        gWrapperCtx.RemoveSound(doomed[i]);
+}
+
+// Lock held
+static void removeSoundLater(SoundHandler sound)
+{
+    if (gDoomedCount < kDoomedMax)
+        gDoomed[gDoomedCount++] = sound;
+    else
+        NSLog(@"ZOIPER: sound %lu leaked", (unsigned long)sound);
+}
+
+// PCM bytes held by a loaded sound; lock not held
+static size_t soundBytes(SoundHandler sound)
+{
+    int freqHz, lengthSamples, lengthMs, channels, repeat, pauseMs;
+    if (gWrapperCtx.GetSoundFormat(sound, &freqHz, &lengthSamples, &lengthMs, &channels, &repeat, &pauseMs) != L_OK)
+        return 0;
+    return (size_t)lengthSamples * channels * sizeof(int16_t);
+}
+
+//==============================================================================
+//  Entries (gCacheLock held)
+//==============================================================================
+static uint32_t pathHash(const char * pPath)
+{
+    uint32_t hash = 2166136261u;
+    while (*pPath)
+        hash = (hash ^ (uint8_t)*pPath++) * 16777619u;
+    return hash;
+}
+
+static void ensureMap(void)
+{
+    if (!gMapReady)
+    {
+        ZSDKHandleMapInit(&gSoundMap, gBuckets, kSoundMapBits);
+        for (int i = 0; i < kZSDKSoundCacheMaxEntries; i++)
+            gEarly[i].sound = INVALID_HANDLE;
+        gMapReady = YES;
+    }
+}
+
+static int findEntry(const char * pPath, uint32_t hash, int repeat, int pauseMs)
+{
+    for (int i = 0; i < kZSDKSoundCacheMaxEntries; i++)
+    {
+        ZSDKSoundEntry * e = &gEntries[i];
+        if (e->state != ZSDKSoundFree && !e->stale && e->hash == hash &&
+            e->repeat == repeat && e->pauseMs == pauseMs && strcmp(e->path, pPath) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void removeEntry(int index)
+{
+    ZSDKSoundEntry * e = &gEntries[index];
+    if (e->sound != INVALID_HANDLE)
+    {
+        ZSDKHandleMapRemove(&gSoundMap, e->sound);
+        removeSoundLater(e->sound);
+    }
+    if (e->state != ZSDKSoundFree)
+        gStats.entries--;
+    if (e->state == ZSDKSoundLoading)
+        gStats.loading--;
+    gStats.bytes -= e->bytes;
+    free(e->path);
+    memset(e, 0, sizeof(*e));
+    // Wakes acquirers waiting for this entry's handle
+    pthread_cond_broadcast(&gAttachCond);
+}
+
+// Least recently used ready sound nobody holds, or -1
+static int evictionCandidate(void)
+{
+    int victim = -1;
+    for (int i = 0; i < kZSDKSoundCacheMaxEntries; i++)
+    {
+        ZSDKSoundEntry * e = &gEntries[i];
+        if (e->state == ZSDKSoundReady && e->refs == 0 &&
+            (victim < 0 || e->lastUse < gEntries[victim].lastUse))
+            victim = i;
+    }
+    return victim;
+}
+
+static void evictOverBudget(void)
+{
+    while (gStats.bytes > gStats.budget)
+    {
+        int victim = evictionCandidate();
+        if (victim < 0)
+            break;
+        removeEntry(victim);
+        gStats.evictions++;
+    }
+}
+
+static int reserveEntry(const char * pPath, uint32_t hash, const struct stat * pInfo, int repeat, int pauseMs)
+{
+    int index = -1;
+    for (int i = 0; i < kZSDKSoundCacheMaxEntries && index < 0; i++)
+    {
+        if (gEntries[i].state == ZSDKSoundFree)
+            index = i;
+    }
+    if (index < 0)
+    {
+        index = evictionCandidate();
+        if (index < 0)
+            return -1;
+        removeEntry(index);
+        gStats.evictions++;
+    }
+
+    ZSDKSoundEntry * e = &gEntries[index];
+    e->path = strdup(pPath);
+    if (!e->path)
+        return -1;
+    e->state   = ZSDKSoundLoading;
+    e->hash    = hash;
+    e->serial  = ++gSerial;
+    e->mtime   = pInfo->st_mtime;
+    e->size    = pInfo->st_size;
+    e->repeat  = repeat;
+    e->pauseMs = pauseMs;
+    e->sound   = INVALID_HANDLE;
+    e->lastUse = ++gClock;
+    gStats.entries++;
+    gStats.loading++;
+    return index;
+}
+
+// Attaches the library sound once it exists
+static void attachSound(int index, SoundHandler sound)
+{
+    gEntries[index].sound = sound;
+    ZSDKHandleMapInsert(&gSoundMap, sound, index);
+    pthread_cond_broadcast(&gAttachCond);
+}
+
+// An entry whose file changed is dropped now or, if held, on its last release
+static void retireEntry(int index)
+{
+    if (gEntries[index].refs == 0)
+        removeEntry(index);
+    else
+        gEntries[index].stale = YES;
+}
+
+static void completeLoad(int index, LIBRESULT result, int causeCode, size_t bytes)
+{
+    ZSDKSoundEntry * e = &gEntries[index];
+    e->state = ZSDKSoundReady;
+    gStats.loading--;
+    if (result == L_OK)
+    {
+        e->bytes = bytes;
+        gStats.bytes += bytes;
+        evictOverBudget();
+    }
+    else
+    {
+        gStats.loadFailures++;
+        retireEntry(index);
+        NSLog(@"ZOIPER: sound preload failed (%d)", causeCode);
+    }
+}
+
+//==============================================================================
+//  API
+//==============================================================================
+void ZSDKSoundCacheSetBudget(size_t bytes)
+{
+    lockCache();
+    gStats.budget = bytes;
+    evictOverBudget();
+    unlockCache();
+}
+
+LIBRESULT ZSDKSoundCacheAcquire(const char * pPath, int repeat, int pauseMs, SoundHandler * pSound)
+{
+    *pSound = INVALID_HANDLE;
+    struct stat info;
+    if (!pPath || stat(pPath, &info) != 0)
+        return L_FAIL;
+
+    uint32_t hash = pathHash(pPath);
+    lockCache();
+    ensureMap();
+
+    int index;
+    for (;;)
+    {
+        index = findEntry(pPath, hash, repeat, pauseMs);
+        if (index < 0)
+            break;
+        ZSDKSoundEntry * e = &gEntries[index];
+        if (e->mtime != info.st_mtime || e->size != info.st_size)
+        {
+            retireEntry(index);
+            break;
+        }
+        if (e->sound == INVALID_HANDLE)
+        {
+            // Another thread is inside AddSoundFromWav() for this path: wait
+            // for the handle, or for the entry to go if the load fails
+            uint32_t serial = e->serial;
+            while (e->serial == serial && e->sound == INVALID_HANDLE)
+                pthread_cond_wait(&gAttachCond, &gCacheLock);
+            continue;
+        }
+        e->lastUse = ++gClock;
+        e->refs++;
+        gStats.hits++;
+        *pSound = e->sound;
+        LIBRESULT res = (e->state == ZSDKSoundReady) ? L_OK : L_WAIT;
+        unlockCache();
+        return res;
+    }
+
+    index = reserveEntry(pPath, hash, &info, repeat, pauseMs);
+    if (index < 0)
+    {
+        unlockCache();
+        NSLog(@"ZOIPER: sound cache full of held sounds");
+        return L_FAIL;
+    }
+    gEntries[index].refs = 1;
+    gStats.misses++;
+    unlockCache();
+
+    // Decode without the lock; lookups of this path meanwhile wait for it.
+    // The reference keeps the entry from being removed or reused.
+    SoundHandler sound = INVALID_HANDLE;
+    int cause = 0;
+    LIBRESULT res = gWrapperCtx.AddSoundFromWav(pPath, repeat, pauseMs, 0, &sound, &cause);
+    size_t bytes = (res == L_OK) ? soundBytes(sound) : 0;
+
+    lockCache();
+    if (res != L_OK)
+    {
+        removeEntry(index);
+        gStats.loadFailures++;
+        unlockCache();
+        NSLog(@"ZOIPER: sound %s failed to load (%d)", pPath, cause);
+        return L_FAIL;
+    }
+    attachSound(index, sound);
+    gEntries[index].state = ZSDKSoundReady;
+    gEntries[index].bytes = bytes;
+    gStats.bytes += bytes;
+    gStats.loading--;
+    evictOverBudget();
+    unlockCache();
+
+    *pSound = sound;
+    return L_OK;
+}
+
+void ZSDKSoundCacheRelease(SoundHandler sound)
+{
+    if (sound == INVALID_HANDLE)
+        return;
+
+    lockCache();
+    ensureMap();
+    int index = ZSDKHandleMapFind(&gSoundMap, sound);
+    if (index != ZSDK_HANDLE_MAP_EMPTY && gEntries[index].refs > 0)
+    {
+        if (--gEntries[index].refs == 0 && gEntries[index].stale)
+            removeEntry(index);
+        else
+            evictOverBudget();
+    }
+    unlockCache();
+}
+
+void ZSDKSoundCachePreload(const char * const * pPaths, int count, int repeat, int pauseMs)
+{
+    for (int i = 0; i < count; i++)
+    {
+        struct stat info;
+        if (stat(pPaths[i], &info) != 0)
+        {
+            NSLog(@"ZOIPER: sound %s not found for preloading", pPaths[i]);
+            continue;
+        }
+
+        uint32_t hash = pathHash(pPaths[i]);
+        lockCache();
+        ensureMap();
+        int index = findEntry(pPaths[i], hash, repeat, pauseMs);
+        if (index >= 0 && gEntries[index].mtime == info.st_mtime && gEntries[index].size == info.st_size)
+        {
+            unlockCache();
+            continue;
+        }
+        if (index >= 0)
+            retireEntry(index);
+
+        index = reserveEntry(pPaths[i], hash, &info, repeat, pauseMs);
+        uint32_t serial = (index >= 0) ? gEntries[index].serial : 0;
+        unlockCache();
+        if (index < 0)
+            continue;
+
+        SoundHandler sound = INVALID_HANDLE;
+        int cause = 0;
+        LIBRESULT res = gWrapperCtx.AddSoundFromWav(pPaths[i], repeat, pauseMs, 1, &sound, &cause);
+
+        lockCache();
+        // The entry may have been retired meanwhile (the file changed again)
+        BOOL current = gEntries[index].serial == serial;
+        if (res != L_OK)
+        {
+            if (current)
+                removeEntry(index);
+            gStats.loadFailures++;
+            unlockCache();
+            NSLog(@"ZOIPER: sound %s failed to load (%d)", pPaths[i], cause);
+            continue;
+        }
+        if (!current)
+        {
+            removeSoundLater(sound);
+            unlockCache();
+            continue;
+        }
+        attachSound(index, sound);
+        // The load may have completed before the handle was attached
+        for (int j = 0; j < kZSDKSoundCacheMaxEntries; j++)
+        {
+            ZSDKSoundEarlyLoad * early = &gEarly[j];
+            if (early->sound == sound)
+            {
+                early->sound = INVALID_HANDLE;
+                completeLoad(index, early->result, early->causeCode, early->bytes);
+                break;
+            }
+        }
+        unlockCache();
+    }
+}
+
+void ZSDKSoundCacheOnLoadCompleted(SoundHandler sound, LIBRESULT result, int causeCode)
+{
+    size_t bytes = (result == L_OK) ? soundBytes(sound) : 0;
+
+    lockCache();
+    ensureMap();
+    int index = ZSDKHandleMapFind(&gSoundMap, sound);
+    if (index == ZSDK_HANDLE_MAP_EMPTY)
+    {
+        ZSDKSoundEarlyLoad * early = &gEarly[gEarlyNext];
+        gEarlyNext = (gEarlyNext + 1) % kZSDKSoundCacheMaxEntries;
+        early->sound     = sound;
+        early->result    = result;
+        early->causeCode = causeCode;
+        early->bytes     = bytes;
+    }
+    else if (gEntries[index].state == ZSDKSoundLoading)
+    {
+        completeLoad(index, result, causeCode, bytes);
+    }
+    unlockCache();
+}
+
+void ZSDKSoundCacheFlush(void)
+{
+    lockCache();
+    for (int i = 0; i < kZSDKSoundCacheMaxEntries; i++)
+    {
+        if (gEntries[i].state == ZSDKSoundReady && gEntries[i].refs == 0)
+            removeEntry(i);
+    }
+    unlockCache();
+}
+
+void ZSDKSoundCacheGetStats(ZSDKSoundCacheStats * pStats)
+{
+    lockCache();
+    *pStats = gStats;
+    unlockCache();
+}
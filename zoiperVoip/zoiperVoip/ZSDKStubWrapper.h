@@ -0,0 +1,83 @@
+//
+//  ZSDKStubWrapper.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Simulated library for load testing the event handling layer without
+//  devices, network or the prebuilt libsipwrapper.  ZSDKStubLoadWrapperContext()
+//  has the signature of LoadWrapperContext() and is plugged in with
+//  SetLibraryLoader() before InitLibrary().
+//
+//  The stub implements the account, call and timer functions this layer
+//  uses and delivers the matching callbacks from PollEvents(), exactly like
+//  the library: registrations complete after a delay, the simulated network
+//  offers incoming calls at a fixed rate, calls that are not accepted by
+//  the application are answered after answerDelayMs, and established calls
+//  produce network statistics and audio levels until the remote side hangs
+//  up.  A timer thread wakes the poll engine when events fall due.
+//
+//  Every other entry point the layer calls without checking for NULL is
+//  filled in but not simulated: video, sounds, recordings, conferences,
+//  STUN, presence and BLF accept everything, hand out fresh handles and
+//  never report back; external audio and recordings produce silence.  Sent
+//  messages are confirmed on the next poll.  Functions the layer checks
+//  before use (codec capabilities, transport probes, STUN results) stay NULL.
+//
+//  For now the stub runs inside the app or a test bundle on a device or
+//  the simulator.  A headless Linux target (CMake, clang -fblocks,
+//  libdispatch and BlocksRuntime) is a separate follow-up; what it has to
+//  port:
+//    - NSLog(@"...") in every module, and the legacy NSNotificationCenter
+//      fan-out in ZSDKEventQueue.m: a small Foundation compatibility header
+//      and notifications compiled out,
+//    - mach time, QoS classes and the one-argument pthread_setname_np() in
+//      ZSDKPollEngine, ZSDKLog, ZSDKRecorder, ZSDKExternalAudio,
+//      ZSDKVideoSender, ZSDKLoadGen and this stub,
+//    - arc4random_uniform() in ZSDKPresence and ZSDKUserManager,
+//    - a driver that runs ZSDKLoadGen on dispatch_main() in place of the
+//      app's main queue.
+//  Everything else in the layer (ZoiperVoip.m aside) is plain C.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKStubMaxEvents      16384
+#define kZSDKStubMaxCalls       1024    // simultaneous in the stub
+
+typedef struct {
+    double      callsPerSecond;         // incoming calls offered
+    int         answerDelayMs;          // offer (or outgoing create) to answer
+    int         callDurationMs;         // answer to remote hangup
+    double      mediaEventsPerSecond;   // per established call
+    int         registrationDelayMs;
+    double      reregistrationsPerSecond;
+    int         failurePermil;          // registrations and calls that fail
+    uint32_t    seed;
+} ZSDKStubConfig;
+
+typedef struct {
+    uint64_t    scheduled;
+    uint64_t    delivered;
+    uint64_t    overflows;              // event queue full, event lost
+    uint64_t    callsOffered;
+    uint64_t    callsAnswered;
+    uint64_t    callsEnded;
+    uint64_t    callsFailed;
+    uint64_t    registrations;
+    uint64_t    lagTotalUs;             // delivery later than due
+    uint64_t    lagMaxUs;
+    int         activeCalls;
+} ZSDKStubStats;
+
+// Defaults: 10 calls/s, answered after 100 ms, 2 s long, 1 media event/s
+void ZSDKStubDefaultConfig(ZSDKStubConfig * pConfig);
+
+// Applies to arrivals from now on
+void ZSDKStubConfigure(const ZSDKStubConfig * pConfig);
+
+LIBRESULT ZSDKStubLoadWrapperContext(WrapperContext * pCtx);
+
+void ZSDKStubGetStats(ZSDKStubStats * pStats);
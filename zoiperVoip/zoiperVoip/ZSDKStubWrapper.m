@@ -0,0 +1,979 @@
+//
+//  ZSDKStubWrapper.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKStubWrapper.h"
+#import "ZSDKPollEngine.h"
+#import <pthread.h>
+#import <unistd.h>
+
+#define kCallBase           0x10000
+#define kUserBase           0x100
+#define kObjectBase         0x1000000   // sounds, recordings, conferences...
+#define kMaxUsers           64
+#define kMaxArrivalsPerPoll (kZSDKStubMaxEvents / 4)
+#define kTimerMinSleepUs    250
+#define kTimerMaxSleepUs    10000
+
+typedef enum {
+    StubEvRegistered = 0
+,   StubEvUnregistered
+,   StubEvOffer
+,   StubEvCreate
+,   StubEvRinging
+,   StubEvAnswer
+,   StubEvMedia
+,   StubEvRemoteHangup
+,   StubEvHangup
+,   StubEvFailure
+,   StubEvHold
+,   StubEvUnhold
+,   StubEvActivation
+,   StubEvMessageSent
+,   StubEvCustom
+} ZSDKStubEventType;
+
+typedef struct {
+    uint64_t            dueUs;
+    uint64_t            order;          // FIFO among equal due times
+    ZSDKStubEventType   type;
+    Handler             handle;
+    pfCustomEventCbk    cbk;
+    void *              userData;
+} ZSDKStubEvent;
+
+typedef enum {
+    StubCallFree = 0
+,   StubCallOffered                     // incoming, not answered yet
+,   StubCallDialing                     // outgoing, not answered yet
+,   StubCallActive
+,   StubCallHeld
+} ZSDKStubCallState;
+
+typedef struct {
+    CallHandler         handle;
+    ZSDKStubCallState   state;
+    UserHandler         userId;
+    eCallDirection_t    direction;
+    uint32_t            generation;
+    uint64_t            answeredUs;
+} ZSDKStubCall;
+
+typedef struct {
+    BOOL                used;
+    BOOL                registered;
+} ZSDKStubUser;
+
+// What applying an event found out, for its callback
+typedef struct {
+    UserHandler         userId;
+    eCallDirection_t    direction;
+    BOOL                failed;
+} ZSDKStubOutcome;
+
+static pthread_mutex_t      gStubLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKStubConfig       gConfig;
+static BOOL                 gConfigured = NO;
+static ZSDKStubStats        gStats;
+static WrapperCallbacks     gCallbacks;
+static WrapperCallbacks *   gCbk;
+
+static ZSDKStubEvent        gHeap[kZSDKStubMaxEvents];
+static int                  gHeapCount;
+static uint64_t             gOrder;
+
+static ZSDKStubCall         gCalls[kZSDKStubMaxCalls];
+static int                  gCallCursor;
+static ZSDKStubUser         gUsers[kMaxUsers];
+static int                  gUserCursor;
+
+static uint64_t             gNextOfferUs;
+static uint64_t             gNextReregisterUs;
+static uint32_t             gRandom;
+
+static pthread_t            gTimerThread;
+static int                  gTimerRunning;
+
+static Handler              gNextObject = kObjectBase;
+static short                gSilence[160];
+
+//==============================================================================
+//  Event queue (gStubLock held)
+//==============================================================================
+static BOOL eventBefore(const ZSDKStubEvent * a, const ZSDKStubEvent * b)
+{
+    return a->dueUs < b->dueUs || (a->dueUs == b->dueUs && a->order < b->order);
+}
+
+static void schedule(uint64_t dueUs, ZSDKStubEventType type, Handler handle,
+                     pfCustomEventCbk cbk, void * pUserData)
+{
+    if (gHeapCount == kZSDKStubMaxEvents)
+    {
+        gStats.overflows++;
+        return;
+    }
+
+    ZSDKStubEvent ev = { dueUs, gOrder++, type, handle, cbk, pUserData };
+    int i = gHeapCount++;
+    while (i > 0 && eventBefore(&ev, &gHeap[(i - 1) / 2]))
+    {
+        gHeap[i] = gHeap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    gHeap[i] = ev;
+    gStats.scheduled++;
+}
+
+static void scheduleIn(int delayMs, ZSDKStubEventType type, Handler handle)
+{
+    schedule(ZSDKMonotonicMicros() + (uint64_t)(delayMs > 0 ? delayMs : 0) * 1000, type, handle, NULL, NULL);
+}
+
+static ZSDKStubEvent popEvent(void)
+{
+    ZSDKStubEvent top = gHeap[0];
+    ZSDKStubEvent last = gHeap[--gHeapCount];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= gHeapCount)
+            break;
+        if (child + 1 < gHeapCount && eventBefore(&gHeap[child + 1], &gHeap[child]))
+            child++;
+        if (!eventBefore(&gHeap[child], &last))
+            break;
+        gHeap[i] = gHeap[child];
+        i = child;
+    }
+    gHeap[i] = last;
+    return top;
+}
+
+//==============================================================================
+//  Simulated calls and users (gStubLock held)
+//==============================================================================
+static uint32_t nextRandom(void)
+{
+    gRandom ^= gRandom << 13;
+    gRandom ^= gRandom >> 17;
+    gRandom ^= gRandom << 5;
+    return gRandom;
+}
+
+static BOOL failNow(void)
+{
+    return (int)(nextRandom() % 1000) < gConfig.failurePermil;
+}
+
+static ZSDKStubCall * findCall(CallHandler callId)
+{
+    if (callId < kCallBase)
+        return NULL;
+    ZSDKStubCall * call = &gCalls[(callId - kCallBase) % kZSDKStubMaxCalls];
+    return (call->handle == callId && call->state != StubCallFree) ? call : NULL;
+}
+
+static ZSDKStubCall * newCall(UserHandler userId, eCallDirection_t direction, ZSDKStubCallState state)
+{
+    for (int n = 0; n < kZSDKStubMaxCalls; n++)
+    {
+        int slot = (gCallCursor + n) % kZSDKStubMaxCalls;
+        ZSDKStubCall * call = &gCalls[slot];
+        if (call->state != StubCallFree)
+            continue;
+
+        gCallCursor = (slot + 1) % kZSDKStubMaxCalls;
+        call->generation++;
+        call->handle     = kCallBase + (CallHandler)call->generation * kZSDKStubMaxCalls + slot;
+        call->state      = state;
+        call->userId     = userId;
+        call->direction  = direction;
+        call->answeredUs = 0;
+        gStats.activeCalls++;
+        return call;
+    }
+    return NULL;
+}
+
+static void endCall(ZSDKStubCall * call)
+{
+    call->state = StubCallFree;
+    gStats.activeCalls--;
+}
+
+static ZSDKStubUser * findUser(UserHandler userId)
+{
+    if (userId < kUserBase || userId >= kUserBase + kMaxUsers || !gUsers[userId - kUserBase].used)
+        return NULL;
+    return &gUsers[userId - kUserBase];
+}
+
+// Incoming calls go to a registered account, as a real network would
+static UserHandler registeredUser(void)
+{
+    for (int i = 0; i < kMaxUsers; i++)
+    {
+        if (gUsers[i].used && gUsers[i].registered)
+            return kUserBase + i;
+    }
+    return INVALID_HANDLE;
+}
+
+static void generateArrivals(uint64_t nowUs)
+{
+    int budget = kMaxArrivalsPerPoll;
+    if (gConfig.callsPerSecond > 0)
+    {
+        uint64_t periodUs = (uint64_t)(1e6 / gConfig.callsPerSecond);
+        if (periodUs == 0)
+            periodUs = 1;
+        for (; gNextOfferUs <= nowUs && budget > 0; budget--)
+        {
+            schedule(gNextOfferUs, StubEvOffer, INVALID_HANDLE, NULL, NULL);
+            gNextOfferUs += periodUs;
+        }
+        if (gNextOfferUs <= nowUs)
+        {
+            // Too far behind: those arrivals are lost, not queued
+            gStats.overflows += (nowUs - gNextOfferUs) / periodUs + 1;
+            gNextOfferUs = nowUs + periodUs;
+        }
+    }
+
+    if (gConfig.reregistrationsPerSecond > 0)
+    {
+        uint64_t periodUs = (uint64_t)(1e6 / gConfig.reregistrationsPerSecond);
+        if (periodUs == 0)
+            periodUs = 1;
+        for (; gNextReregisterUs <= nowUs && budget > 0; budget--)
+        {
+            for (int n = 0; n < kMaxUsers; n++)
+            {
+                int i = (gUserCursor + n) % kMaxUsers;
+                if (gUsers[i].used && gUsers[i].registered)
+                {
+                    schedule(gNextReregisterUs, StubEvRegistered, kUserBase + i, NULL, NULL);
+                    gUserCursor = i + 1;
+                    break;
+                }
+            }
+            gNextReregisterUs += periodUs;
+        }
+        if (gNextReregisterUs <= nowUs)
+            gNextReregisterUs = nowUs + periodUs;
+    }
+}
+
+//==============================================================================
+//  Delivery
+//==============================================================================
+
+// Applies the event to the simulated state under the lock; returns NO when
+// it no longer applies (call ended, answered twice...)
+static BOOL applyEvent(ZSDKStubEvent * ev, uint64_t nowUs, ZSDKStubOutcome * pOut)
+{
+    ZSDKStubCall * call = findCall(ev->handle);
+    switch (ev->type)
+    {
+        case StubEvRegistered:
+        {
+            ZSDKStubUser * user = findUser(ev->handle);
+            if (!user)
+                return NO;
+            gStats.registrations++;
+            pOut->failed = failNow();
+            user->registered = !pOut->failed;
+            return YES;
+        }
+        case StubEvUnregistered:
+        {
+            ZSDKStubUser * user = findUser(ev->handle);
+            if (!user)
+                return NO;
+            user->registered = NO;
+            return YES;
+        }
+        case StubEvOffer:
+        {
+            pOut->userId = registeredUser();
+            if (pOut->userId == INVALID_HANDLE)
+                return NO;
+            call = newCall(pOut->userId, eIncommingCall, StubCallOffered);
+            if (!call)
+            {
+                gStats.overflows++;
+                return NO;
+            }
+            ev->handle = call->handle;
+            gStats.callsOffered++;
+            scheduleIn(gConfig.answerDelayMs, failNow() ? StubEvFailure : StubEvAnswer, call->handle);
+            return YES;
+        }
+        case StubEvCreate:
+            if (!call)
+                return NO;
+            pOut->userId = call->userId;
+            return YES;
+        case StubEvRinging:
+            return call && call->state == StubCallDialing;
+        case StubEvAnswer:
+            if (!call || (call->state != StubCallOffered && call->state != StubCallDialing))
+                return NO;
+            call->state = StubCallActive;
+            call->answeredUs = nowUs;
+            pOut->direction = call->direction;
+            gStats.callsAnswered++;
+            if (gConfig.mediaEventsPerSecond > 0)
+                scheduleIn((int)(1000 / gConfig.mediaEventsPerSecond), StubEvMedia, call->handle);
+            scheduleIn(gConfig.callDurationMs, StubEvRemoteHangup, call->handle);
+            return YES;
+        case StubEvMedia:
+            if (!call || (call->state != StubCallActive && call->state != StubCallHeld))
+                return NO;
+            scheduleIn((int)(1000 / gConfig.mediaEventsPerSecond), StubEvMedia, call->handle);
+            return YES;
+        case StubEvFailure:
+            if (!call || (call->state != StubCallOffered && call->state != StubCallDialing))
+                return NO;
+            endCall(call);
+            gStats.callsFailed++;
+            return YES;
+        case StubEvRemoteHangup:
+            if (!call || (call->state != StubCallActive && call->state != StubCallHeld))
+                return NO;
+            endCall(call);
+            gStats.callsEnded++;
+            return YES;
+        case StubEvHangup:
+            if (!call)
+                return NO;
+            endCall(call);
+            gStats.callsEnded++;
+            return YES;
+        case StubEvHold:
+            if (!call || call->state != StubCallActive)
+                return NO;
+            call->state = StubCallHeld;
+            return YES;
+        case StubEvUnhold:
+            if (!call || call->state != StubCallHeld)
+                return NO;
+            call->state = StubCallActive;
+            return YES;
+        case StubEvActivation:
+        case StubEvMessageSent:
+        case StubEvCustom:
+            return YES;
+    }
+    return NO;
+}
+
+// Outside the lock: callbacks call back into the stub
+static void deliverEvent(const ZSDKStubEvent * ev, uint64_t nowUs, const ZSDKStubOutcome * pOut)
+{
+    CallHandler callId = ev->handle;
+    switch (ev->type)
+    {
+        case StubEvRegistered:
+            if (pOut->failed && gCbk->onUserRegistrationFailure)
+                gCbk->onUserRegistrationFailure(callId, 1, 408);
+            else if (!pOut->failed && gCbk->onUserRegistered)
+                gCbk->onUserRegistered(callId, "sip:stub@stub.invalid", 0, 0);
+            break;
+        case StubEvUnregistered:
+            if (gCbk->onUserUnregistered)
+                gCbk->onUserUnregistered(callId);
+            break;
+        case StubEvOffer:
+            if (gCbk->onCallCreated)
+                gCbk->onCallCreated(pOut->userId, callId, "Stub", "1000", "sip:1000@stub.invalid", "", 0);
+            break;
+        case StubEvCreate:
+            if (gCbk->onCallCreate)
+                gCbk->onCallCreate(pOut->userId, callId, "2000");
+            break;
+        case StubEvRinging:
+            if (gCbk->onCallRinging)
+                gCbk->onCallRinging(callId);
+            break;
+        case StubEvAnswer:
+            if (gCbk->onCallAccepted)
+                gCbk->onCallAccepted(callId, CODEC_OPUS_WIDE, pOut->direction);
+            break;
+        case StubEvMedia:
+        {
+            unsigned long packets = (unsigned long)(nowUs / 20000) & 0xFFFFFF;
+            if (gCbk->onCallNetworkStatistics)
+                gCbk->onCallNetworkStatistics(callId, E_CHANNEL_AUDIO,
+                                              packets, packets * 92, packets * 52, 36800, 36800,
+                                              packets, packets * 92, packets * 52, 36800, 36800,
+                                              (int)(ev->order % 20), 5 + (int)(ev->order % 25));
+            if (gCbk->onCallAudioLevels)
+                gCbk->onCallAudioLevels(callId, 0.1 * (ev->order % 10), 0.05 * (ev->order % 20));
+            break;
+        }
+        case StubEvFailure:
+            if (gCbk->onCallFailure)
+                gCbk->onCallFailure(callId, 480);
+            break;
+        case StubEvRemoteHangup:
+        case StubEvHangup:
+            if (gCbk->onCallHangup)
+                gCbk->onCallHangup(callId, ev->type == StubEvRemoteHangup ? 16 : 0);
+            break;
+        case StubEvHold:
+            if (gCbk->onCallHoldCompleted)
+                gCbk->onCallHoldCompleted(callId, L_OK);
+            break;
+        case StubEvUnhold:
+            if (gCbk->onCallUnholdCompleted)
+                gCbk->onCallUnholdCompleted(callId, L_OK);
+            break;
+        case StubEvActivation:
+            if (gCbk->onActivationCompleted)
+                gCbk->onActivationCompleted(E_ACT_SUCCESS, "ok", "", "stub", "", "", "");
+            break;
+        case StubEvMessageSent:
+            if (gCbk->onMessageSent)
+                gCbk->onMessageSent(INVALID_HANDLE, INVALID_HANDLE, ev->handle, 0, "");
+            break;
+        case StubEvCustom:
+            ev->cbk(ev->userData);
+            break;
+    }
+}
+
+static void stubPollEvents( void )
+{
+    if (!gCbk)
+        return;
+
+    // Only what is due now, so events scheduled meanwhile wait for the next poll
+    uint64_t nowUs = ZSDKMonotonicMicros();
+    pthread_mutex_lock(&gStubLock);
+    generateArrivals(nowUs);
+    pthread_mutex_unlock(&gStubLock);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&gStubLock);
+        if (gHeapCount == 0 || gHeap[0].dueUs > nowUs)
+        {
+            pthread_mutex_unlock(&gStubLock);
+            break;
+        }
+        ZSDKStubEvent ev = popEvent();
+        ZSDKStubOutcome outcome = { INVALID_HANDLE, eIncommingCall, NO };
+        uint64_t deliverUs = ZSDKMonotonicMicros();
+        BOOL applies = applyEvent(&ev, deliverUs, &outcome);
+        if (applies)
+        {
+            uint64_t lag = deliverUs - ev.dueUs;
+            gStats.delivered++;
+            gStats.lagTotalUs += lag;
+            if (lag > gStats.lagMaxUs)
+                gStats.lagMaxUs = lag;
+        }
+        pthread_mutex_unlock(&gStubLock);
+
+        if (applies)
+            deliverEvent(&ev, deliverUs, &outcome);
+    }
+}
+
+// Stands in for the library's internal threads: wakes the poll engine
+// when something falls due
+static void * stubTimerMain( void * arg )
+{
+    pthread_setname_np("zsdk.stub");
+
+    while (__atomic_load_n(&gTimerRunning, __ATOMIC_ACQUIRE))
+    {
+        uint64_t nowUs = ZSDKMonotonicMicros();
+        uint64_t nextUs = nowUs + kTimerMaxSleepUs;
+
+        pthread_mutex_lock(&gStubLock);
+        if (gHeapCount > 0 && gHeap[0].dueUs < nextUs)
+            nextUs = gHeap[0].dueUs;
+        if (gConfig.callsPerSecond > 0 && gNextOfferUs < nextUs)
+            nextUs = gNextOfferUs;
+        if (gConfig.reregistrationsPerSecond > 0 && gNextReregisterUs < nextUs)
+            nextUs = gNextReregisterUs;
+        pthread_mutex_unlock(&gStubLock);
+
+        if (nextUs <= nowUs)
+        {
+            ZSDKPollEngineWakeup();
+            usleep(kTimerMinSleepUs);
+        }
+        else
+        {
+            usleep((useconds_t)(nextUs - nowUs));
+        }
+    }
+    return NULL;
+}
+
+//==============================================================================
+//  WrapperContext functions
+//==============================================================================
+static LIBRESULT stubInitCallbackTable( int cbkVersion, WrapperCallbacks ** ppCbk )
+{
+    memset(&gCallbacks, 0, sizeof(gCallbacks));
+    *ppCbk = &gCallbacks;
+    return L_OK;
+}
+
+static LIBRESULT stubInitCallManager( WrapperCallbacks * pCbk, WORD SIPPort, WORD IAXPort )
+{
+    pthread_mutex_lock(&gStubLock);
+    gCbk = pCbk;
+    gNextOfferUs = gNextReregisterUs = ZSDKMonotonicMicros();
+    pthread_mutex_unlock(&gStubLock);
+
+    if (__atomic_load_n(&gTimerRunning, __ATOMIC_ACQUIRE))
+        return L_OK;
+    __atomic_store_n(&gTimerRunning, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&gTimerThread, NULL, stubTimerMain, NULL) != 0)
+    {
+        __atomic_store_n(&gTimerRunning, 0, __ATOMIC_RELEASE);
+        return L_FAIL;
+    }
+    return L_OK;
+}
+
+static LIBRESULT stubDestroyCallManager( void )
+{
+    if (__atomic_exchange_n(&gTimerRunning, 0, __ATOMIC_ACQ_REL))
+        pthread_join(gTimerThread, NULL);
+    pthread_mutex_lock(&gStubLock);
+    gCbk = NULL;
+    gHeapCount = 0;
+    pthread_mutex_unlock(&gStubLock);
+    return L_OK;
+}
+
+static LIBRESULT stubAddTimedCustomEvent( pfCustomEventCbk pCbk, void * pUserData, long delayMs )
+{
+    pthread_mutex_lock(&gStubLock);
+    BOOL full = (gHeapCount == kZSDKStubMaxEvents);
+    schedule(ZSDKMonotonicMicros() + (uint64_t)(delayMs > 0 ? delayMs : 0) * 1000,
+             StubEvCustom, INVALID_HANDLE, pCbk, pUserData);
+    pthread_mutex_unlock(&gStubLock);
+    ZSDKPollEngineWakeup();
+    return full ? L_NO_MEM : L_OK;
+}
+
+static LIBRESULT stubAddCustomEvent( pfCustomEventCbk pCbk, void * pUserData )
+{
+    return stubAddTimedCustomEvent(pCbk, pUserData, 0);
+}
+
+static UserHandler stubAddUser( ProtoType_t Proto, const char * pszName, const char * pszPassw,
+                                const char * pszOutboundProxy, const char * pszRealm,
+                                const char * pszCallerId, const char * pszCallerNumber )
+{
+    UserHandler userId = INVALID_HANDLE;
+    pthread_mutex_lock(&gStubLock);
+    for (int i = 0; i < kMaxUsers && userId == INVALID_HANDLE; i++)
+    {
+        if (!gUsers[i].used)
+        {
+            gUsers[i].used = YES;
+            gUsers[i].registered = NO;
+            userId = kUserBase + i;
+        }
+    }
+    pthread_mutex_unlock(&gStubLock);
+    return userId;
+}
+
+static LIBRESULT stubRemoveUser( UserHandler userId )
+{
+    pthread_mutex_lock(&gStubLock);
+    ZSDKStubUser * user = findUser(userId);
+    if (user)
+        user->used = user->registered = NO;
+    pthread_mutex_unlock(&gStubLock);
+    return user ? L_OK : L_FAIL;
+}
+
+static LIBRESULT scheduleForUser( UserHandler userId, ZSDKStubEventType type )
+{
+    pthread_mutex_lock(&gStubLock);
+    BOOL known = findUser(userId) != NULL;
+    if (known)
+        scheduleIn(gConfig.registrationDelayMs, type, userId);
+    pthread_mutex_unlock(&gStubLock);
+    return known ? L_OK : L_FAIL;
+}
+
+static LIBRESULT stubRegisterUser( UserHandler userId )
+{
+    return scheduleForUser(userId, StubEvRegistered);
+}
+
+static LIBRESULT stubUnregisterUser( UserHandler userId )
+{
+    return scheduleForUser(userId, StubEvUnregistered);
+}
+
+static LIBRESULT stubCallCreate( UserHandler userId, const char * pCallee, CallHandler * CallId )
+{
+    pthread_mutex_lock(&gStubLock);
+    ZSDKStubCall * call = findUser(userId) ? newCall(userId, eOutgoingCall, StubCallDialing) : NULL;
+    if (call)
+    {
+        *CallId = call->handle;
+        scheduleIn(0, StubEvCreate, call->handle);
+        scheduleIn(gConfig.answerDelayMs / 2, StubEvRinging, call->handle);
+        scheduleIn(gConfig.answerDelayMs, failNow() ? StubEvFailure : StubEvAnswer, call->handle);
+    }
+    pthread_mutex_unlock(&gStubLock);
+    return call ? L_OK : L_FAIL;
+}
+
+// Schedules type now if the call is in one of the states (0 = any)
+static LIBRESULT scheduleForCall( CallHandler callId, ZSDKStubEventType type,
+                                  ZSDKStubCallState state1, ZSDKStubCallState state2 )
+{
+    pthread_mutex_lock(&gStubLock);
+    ZSDKStubCall * call = findCall(callId);
+    BOOL ok = call && (state1 == StubCallFree || call->state == state1 || call->state == state2);
+    if (ok)
+        scheduleIn(0, type, callId);
+    pthread_mutex_unlock(&gStubLock);
+    return ok ? L_OK : L_FAIL;
+}
+
+static LIBRESULT stubCallAccept( CallHandler callId )
+{
+    return scheduleForCall(callId, StubEvAnswer, StubCallOffered, StubCallOffered);
+}
+
+static LIBRESULT stubCallReject( CallHandler callId )
+{
+    return scheduleForCall(callId, StubEvHangup, StubCallOffered, StubCallOffered);
+}
+
+static LIBRESULT stubCallHangup( CallHandler callId )
+{
+    return scheduleForCall(callId, StubEvHangup, StubCallFree, StubCallFree);
+}
+
+static LIBRESULT stubCallHold( CallHandler callId )
+{
+    return scheduleForCall(callId, StubEvHold, StubCallActive, StubCallActive);
+}
+
+static LIBRESULT stubCallUnhold( CallHandler callId )
+{
+    return scheduleForCall(callId, StubEvUnhold, StubCallHeld, StubCallHeld);
+}
+
+// A transferred call leaves this side
+static LIBRESULT stubUnattendedCallTransfer( CallHandler callId, const char * pTransferee )
+{
+    return scheduleForCall(callId, StubEvHangup, StubCallActive, StubCallHeld);
+}
+
+static LIBRESULT stubAttendedCallTransfer( CallHandler callId, CallHandler toCallId )
+{
+    return scheduleForCall(callId, StubEvHangup, StubCallActive, StubCallHeld);
+}
+
+static LIBRESULT stubStartActivationSDK( const char * certCacheFile, const char * username,
+                                         const char * password, const char * devId )
+{
+    pthread_mutex_lock(&gStubLock);
+    scheduleIn(gConfig.registrationDelayMs, StubEvActivation, INVALID_HANDLE);
+    pthread_mutex_unlock(&gStubLock);
+    return L_OK;
+}
+
+// Settings the stub accepts and ignores
+static LIBRESULT stubIgnoreVoid( void )                                       { return L_OK; }
+static LIBRESULT stubIgnoreInt( int value )                                   { return L_OK; }
+static LIBRESULT stubIgnoreString( const char * pValue )                      { return L_OK; }
+static LIBRESULT stubAddCodec( CodecEnum_t eCodec )                           { return L_OK; }
+static LIBRESULT stubSetUserDtmfBand( UserHandler UserId, eDtmfBand_t band )  { return L_OK; }
+static LIBRESULT stubSetUserRegistrationTime( UserHandler UserId, int secs )  { return L_OK; }
+static LIBRESULT stubAddVideoFormat( int width, int height, float fps )       { return L_OK; }
+static LIBRESULT stubSetAudioResamplerType( eAudioResampler_t type )          { return L_OK; }
+static LIBRESULT stubSetAudioDriverConfiguration( eAudioDriverEngine_t type, int rate, int frames )
+{
+    return L_OK;
+}
+
+//==============================================================================
+//  Not simulated: accepted without effect
+//==============================================================================
+static Handler newObject(void)
+{
+    return __atomic_fetch_add(&gNextObject, 1, __ATOMIC_RELAXED);
+}
+
+static LIBRESULT stubIgnoreHandle( Handler handle )                           { return L_OK; }
+static LIBRESULT stubIgnoreHandles( Handler handle, Handler other )           { return L_OK; }
+static LIBRESULT stubSetUserTransport( UserHandler UserId, eUserTransport_t proto ) { return L_OK; }
+static LIBRESULT stubAddUserCodec( UserHandler UserId, CodecEnum_t eCodec )   { return L_OK; }
+static LIBRESULT stubSetUserCodecParameters( UserHandler UserId, CodecEnum_t eCodec, int bps,
+                                             int useDTX, int useVBR )         { return L_OK; }
+
+// Video
+static LIBRESULT stubSetVideoFrameIYUVCbk( CallHandler CallId, pfVideoFrameIYUVCbk2 pCbk,
+                                           void * const pUserData )          { return L_OK; }
+static LIBRESULT stubVideoSendFrame( void * pThreadId, const void * pBuffer, int bufLen ) { return L_OK; }
+static LIBRESULT stubVideoSendFrame2( void * pThreadId, const void * pBuffer, int bufLen,
+                                      int width, int height, eVideoFrameFormat_t format ) { return L_OK; }
+static LIBRESULT stubVideoResetEncoder( void * pThreadId, int width, int height, float fps, int bps )
+{
+    return L_OK;
+}
+
+// External audio: silence out
+static LIBRESULT stubExternalAudioInit( int sampleRateHz, int samplesPerFrame ) { return L_OK; }
+static LIBRESULT stubSetExternalAudioSyncStopCallback( pfExternalAudioSyncStopCbk pCbk, void * pUserData )
+{
+    return L_OK;
+}
+
+static LIBRESULT stubExternalAudioFrame( const short * samplesIn, short * samplesOut, int samplesCount,
+                                         int latencyMs )
+{
+    memset(samplesOut, 0, samplesCount * sizeof(short));
+    return L_OK;
+}
+
+// Sounds load at once, whether asked asynchronously or not
+static LIBRESULT stubAddSoundFromWav( const char * utf8Name, int bRepeat, int pauseMs, int async,
+                                      SoundHandler * handle, int * causeCode )
+{
+    *handle = newObject();
+    if (causeCode)
+        *causeCode = 0;
+    return L_OK;
+}
+
+static LIBRESULT stubGetSoundFormat( SoundHandler sndId, int * freqHz, int * lengthSamples,
+                                     int * approxLengthMs, int * channelCount, int * repeat, int * pauseMs )
+{
+    *freqHz = 8000;
+    *lengthSamples = 8000;
+    *approxLengthMs = 1000;
+    *channelCount = 1;
+    *repeat = 0;
+    *pauseMs = 0;
+    return L_OK;
+}
+
+static LIBRESULT stubSoundOnDevice( SoundHandler SndId, BYTE DeviceId )          { return L_OK; }
+
+// Recordings hold silence
+static LIBRESULT stubAddRecording( int maxLengthMS, RecordingHandler * pRecordingId )
+{
+    *pRecordingId = newObject();
+    return L_OK;
+}
+
+static LIBRESULT stubAddRecording2( int sampleRateHz, int channels, int maxLengthSamples,
+                                    RecordingHandler * pRecordingId )
+{
+    *pRecordingId = newObject();
+    return L_OK;
+}
+
+static LIBRESULT stubGetRecordingBuffer( RecordingHandler recordingId, short ** ppSamples, int * pSampleCount )
+{
+    *ppSamples = gSilence;
+    *pSampleCount = sizeof(gSilence) / sizeof(gSilence[0]);
+    return L_OK;
+}
+
+static ConferenceHandler stubCreateConference( BYTE InDeviceId, BYTE OutDeviceId )
+{
+    return newObject();
+}
+
+// STUN never resolves: the layer keeps using the local address
+static LIBRESULT stubAddStunServer( StunHandler * StunId )
+{
+    *StunId = newObject();
+    return L_OK;
+}
+
+static LIBRESULT stubSetStunServer( StunHandler StunId, const char * pStunServer ) { return L_OK; }
+static LIBRESULT stubSetStunPort( StunHandler StunId, WORD Port )             { return L_OK; }
+static LIBRESULT stubSetStunRefreshPeriod( StunHandler StunId, long ms )      { return L_OK; }
+
+// Presence and BLF subscriptions that never report
+static LIBRESULT stubAddContact2( UserHandler UserId, const char * pContactNumber, ContactHandler * pContact,
+                                  int subscribeSeconds, int refreshSeconds, int subscribeFlags )
+{
+    *pContact = newObject();
+    return L_OK;
+}
+
+static LIBRESULT stubPublishStatus( UserHandler UserId, eContactState_t eStatus, const char * pNote,
+                                    int refreshSeconds )
+{
+    return L_OK;
+}
+
+static LIBRESULT stubAddPeer( UserHandler UserId, const char * peerName, const char * peerNumber,
+                              PeerHandler * PeerId )
+{
+    *PeerId = newObject();
+    return L_OK;
+}
+
+// Messages are reported sent on the next poll
+static LIBRESULT stubSendPlainMessage( ContactHandler ContactId, int contentLength, const char * body,
+                                       MessageHandler * pMessageId )
+{
+    *pMessageId = newObject();
+    pthread_mutex_lock(&gStubLock);
+    scheduleIn(0, StubEvMessageSent, *pMessageId);
+    pthread_mutex_unlock(&gStubLock);
+    return L_OK;
+}
+
+static LIBRESULT stubSetMessageComposingState( ContactHandler ContactId, int active ) { return L_OK; }
+
+//==============================================================================
+//  Setup
+//==============================================================================
+void ZSDKStubDefaultConfig(ZSDKStubConfig * pConfig)
+{
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->callsPerSecond       = 10;
+    pConfig->answerDelayMs        = 100;
+    pConfig->callDurationMs       = 2000;
+    pConfig->mediaEventsPerSecond = 1;
+    pConfig->registrationDelayMs  = 20;
+    pConfig->seed                 = 1;
+}
+
+void ZSDKStubConfigure(const ZSDKStubConfig * pConfig)
+{
+    pthread_mutex_lock(&gStubLock);
+    gConfig = *pConfig;
+    gRandom = pConfig->seed ? pConfig->seed : 1;
+    gConfigured = YES;
+    pthread_mutex_unlock(&gStubLock);
+}
+
+LIBRESULT ZSDKStubLoadWrapperContext(WrapperContext * pCtx)
+{
+    if (!gConfigured)
+    {
+        ZSDKStubConfig config;
+        ZSDKStubDefaultConfig(&config);
+        ZSDKStubConfigure(&config);
+    }
+
+    pCtx->InitCallbackTable             = stubInitCallbackTable;
+    pCtx->InitCallManager               = stubInitCallManager;
+    pCtx->DestroyCallManager            = stubDestroyCallManager;
+    pCtx->PollEvents                    = stubPollEvents;
+    pCtx->AddCustomEvent                = stubAddCustomEvent;
+    pCtx->AddTimedCustomEvent           = stubAddTimedCustomEvent;
+
+    pCtx->AddUser                       = stubAddUser;
+    pCtx->RemoveUser                    = stubRemoveUser;
+    pCtx->RegisterUser                  = stubRegisterUser;
+    pCtx->UnregisterUser                = stubUnregisterUser;
+    pCtx->SetUserDtmfBand               = stubSetUserDtmfBand;
+    pCtx->SetUserRegistrationTime       = stubSetUserRegistrationTime;
+    pCtx->StartActivationSDK            = stubStartActivationSDK;
+
+    pCtx->CallCreate                    = stubCallCreate;
+    pCtx->CallAccept                    = stubCallAccept;
+    pCtx->CallReject                    = stubCallReject;
+    pCtx->CallHangup                    = stubCallHangup;
+    pCtx->CallHold                      = stubCallHold;
+    pCtx->CallUnhold                    = stubCallUnhold;
+    pCtx->UnattendedCallTransfer        = stubUnattendedCallTransfer;
+    pCtx->AttendedCallTransfer          = stubAttendedCallTransfer;
+
+    pCtx->ClearCodecList                = stubIgnoreVoid;
+    pCtx->AddCodec                      = stubAddCodec;
+    pCtx->ClearVideoFormats             = stubIgnoreVoid;
+    pCtx->AddVideoFormat                = stubAddVideoFormat;
+    pCtx->SetRTPSessionName             = stubIgnoreString;
+    pCtx->SetRTPUsername                = stubIgnoreString;
+    pCtx->UseEchoCancellation           = stubIgnoreInt;
+    pCtx->UseAutomaticGainControl       = stubIgnoreInt;
+    pCtx->UseNoiseSuppression           = stubIgnoreInt;
+    pCtx->SetAudioDriverConfiguration   = stubSetAudioDriverConfiguration;
+    pCtx->SetAudioResamplerType         = stubSetAudioResamplerType;
+    pCtx->SetUserTransport              = stubSetUserTransport;
+    pCtx->ClearUserCodecList            = stubIgnoreHandle;
+    pCtx->AddUserCodec                  = stubAddUserCodec;
+    pCtx->SetUserCodecParameters        = stubSetUserCodecParameters;
+
+    pCtx->SetVideoBitrate               = stubIgnoreInt;
+    pCtx->CallSetVideoFrameIYUVCbk      = stubSetVideoFrameIYUVCbk;
+    pCtx->VideoSendFrame                = stubVideoSendFrame;
+    pCtx->VideoSendFrame2               = stubVideoSendFrame2;
+    pCtx->VideoResetEncoder             = stubVideoResetEncoder;
+
+    pCtx->ExternalAudioInit             = stubExternalAudioInit;
+    pCtx->ExternalAudioFrame            = stubExternalAudioFrame;
+    pCtx->SetExternalAudioSyncStopCallback = stubSetExternalAudioSyncStopCallback;
+
+    pCtx->AddSoundFromWav               = stubAddSoundFromWav;
+    pCtx->GetSoundFormat                = stubGetSoundFormat;
+    pCtx->StartSound                    = stubSoundOnDevice;
+    pCtx->StopSound                     = stubSoundOnDevice;
+    pCtx->RemoveSound                   = stubIgnoreHandle;
+
+    pCtx->AddRecording                  = stubAddRecording;
+    pCtx->AddRecording2                 = stubAddRecording2;
+    pCtx->StartRecording                = stubIgnoreHandle;
+    pCtx->StopRecording                 = stubIgnoreHandle;
+    pCtx->RemoveRecording               = stubIgnoreHandle;
+    pCtx->GetRecordingBuffer            = stubGetRecordingBuffer;
+
+    pCtx->CreateConference              = stubCreateConference;
+    pCtx->DestroyConference             = stubIgnoreHandle;
+    pCtx->StartConference               = stubIgnoreHandle;
+    pCtx->StopConference                = stubIgnoreHandle;
+    pCtx->HoldConference                = stubIgnoreHandle;
+    pCtx->UnholdConference              = stubIgnoreHandle;
+    pCtx->JoinCallToConference          = stubIgnoreHandles;
+    pCtx->LeaveCallFromConference       = stubIgnoreHandles;
+    pCtx->MuteConferenceParticipant     = stubIgnoreHandles;
+    pCtx->UnmuteConferenceParticipant   = stubIgnoreHandles;
+
+    pCtx->AddStunServer                 = stubAddStunServer;
+    pCtx->SetStunServer                 = stubSetStunServer;
+    pCtx->SetStunPort                   = stubSetStunPort;
+    pCtx->SetStunRefreshPeriod          = stubSetStunRefreshPeriod;
+    pCtx->SetDefaultStunServer          = stubIgnoreHandle;
+    pCtx->AssignStunServer              = stubIgnoreHandles;
+    pCtx->StartStunResolve              = stubIgnoreHandle;
+    pCtx->StopStunResolve               = stubIgnoreHandle;
+
+    pCtx->AddContact2                   = stubAddContact2;
+    pCtx->RemoveContact                 = stubIgnoreHandle;
+    pCtx->RefreshContact                = stubIgnoreHandle;
+    pCtx->PublishStatus                 = stubPublishStatus;
+    pCtx->AddPeer                       = stubAddPeer;
+    pCtx->RemovePeer                    = stubIgnoreHandle;
+    pCtx->SendPlainMessage              = stubSendPlainMessage;
+    pCtx->SetMessageComposingState      = stubSetMessageComposingState;
+    return L_OK;
+}
+
+void ZSDKStubGetStats(ZSDKStubStats * pStats)
+{
+    pthread_mutex_lock(&gStubLock);
+    *pStats = gStats;
+    pthread_mutex_unlock(&gStubLock);
+}
@@ -0,0 +1,88 @@
+//
+//  ZSDKStunManager.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Takes NAT discovery off the call setup path.  ZSDKStunManagerStart()
+//  configures one STUN server (AddStunServer, SetStunRefreshPeriod, ...),
+//  assigns it to every account and starts resolving in the background.  The
+//  network fingerprint of ZSDKTransportProbe is checked every
+//  kZSDKStunNetworkCheckMs and resolving restarts whenever it changes.
+//
+//  Once the network is found to be a NAT that STUN can cross, media ports
+//  are prepared ahead of time with PrepareStunPort() for the accounts that
+//  place calls (ZSDKStunManagerWarmUser()).  The library queues the ready
+//  ports and hands one to the next outgoing call of the account, so
+//  callNumber: dials immediately: with a warm port when one is ready,
+//  without STUN otherwise.  Each port used is replaced straight away.
+//
+//  Time to first media (CallCreate() to early media or answer) is recorded
+//  separately for calls that had a warm port and for the others.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKStunPortDefault        3478
+#define kZSDKStunRefreshDefaultMs   30000
+#define kZSDKStunNetworkCheckMs     5000
+#define kZSDKStunWarmUsers          8       // accounts kept pre-warmed
+#define kZSDKStunMaxWarmPorts       4       // per account (2 per video call)
+
+typedef enum {
+    ZSDKStunOff = 0
+,   ZSDKStunResolving
+,   ZSDKStunUsable                  // full cone / restricted NAT
+,   ZSDKStunUnusable                // open, blocked, symmetric: no STUN ports
+} ZSDKStunState;
+
+typedef struct {
+    ZSDKStunState       state;
+    eNetworkTypeEnum_t  networkType;
+    uint32_t            externalAddress;    // network byte order, 0 unknown
+    int                 externalPort;
+    uint64_t            resolves;
+    uint64_t            networkChanges;
+    uint64_t            resolveTimeLastUs;  // StartStunResolve() -> discovery
+    uint64_t            resolveTimeMaxUs;
+    uint64_t            portsRequested;
+    uint64_t            portsReady;
+    uint64_t            portsFailed;
+    uint64_t            portsStale;         // ready after a network change
+    uint64_t            portLatencyTotalUs; // PrepareStunPort() -> ready
+    uint64_t            portLatencyMaxUs;
+    int                 warmPorts;          // ready and not used yet
+    uint64_t            callsWarm;          // outgoing calls that used one
+    uint64_t            callsCold;
+} ZSDKStunStats;
+
+// Starts (or reconfigures) STUN; port 0 and refreshMs 0 take the defaults.
+// Returns NO if the library has no STUN support.
+BOOL ZSDKStunManagerStart(const char * pServer, int port, long refreshMs);
+void ZSDKStunManagerStop(void);
+
+// Resolves again now, e.g. on a reachability change the app noticed first
+void ZSDKStunManagerNetworkChanged(void);
+
+// New accounts get the STUN server
+void ZSDKStunManagerOnUserAdded(UserHandler userId);
+
+// Keeps ports (0..kZSDKStunMaxWarmPorts) ready for the account; 0 stops.
+// Returns NO when all kZSDKStunWarmUsers entries are taken.
+BOOL ZSDKStunManagerWarmUser(UserHandler userId, int ports);
+
+void ZSDKStunManagerGetStats(ZSDKStunStats * pStats);
+
+// Histogram JSON (ZSDKHistogramFormatJSON) of the time to first media
+int  ZSDKStunManagerFirstMediaJSON(BOOL warm, char * pBuf, size_t size);
+void ZSDKStunManagerResetFirstMedia(void);
+
+// Call hooks (poll thread); slot is the ZSDKCallRegistry slot
+void ZSDKStunManagerOnCallCreate(UserHandler userId, CallHandler callId, int slot, uint64_t createdUs);
+void ZSDKStunManagerOnFirstMedia(CallHandler callId, int slot);
+
+// STUN callbacks (poll thread)
+void ZSDKStunManagerOnNetworkDiscovered(StunHandler stunId, eNetworkTypeEnum_t netType);
+void ZSDKStunManagerOnPortReady(UserHandler userId, void * pUserData, LIBRESULT result);
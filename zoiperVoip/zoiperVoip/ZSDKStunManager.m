@@ -0,0 +1,569 @@
+//
+//  ZSDKStunManager.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKStunManager.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import "ZSDKTransportProbe.h"
+#import "ZSDKHistogram.h"
+#import <pthread.h>
+
+#define kPortRequests   (kZSDKStunWarmUsers * kZSDKStunMaxWarmPorts)
+
+typedef struct {
+    UserHandler userId;             // INVALID_HANDLE: entry free
+    int         target;
+    int         ready;
+    int         pending;
+    BOOL        failed;             // last port failed; no refill until a call or rediscovery
+} ZSDKStunWarmUser;
+
+// Outstanding PrepareStunPort(); its index + 1 is the callback's user data
+typedef struct {
+    BOOL        used;
+    UserHandler userId;
+    uint32_t    generation;
+    uint64_t    requestedUs;
+} ZSDKStunPortRequest;
+
+// Requests reserved under the lock, issued with PrepareStunPort() after it
+typedef struct {
+    int         count;
+    int         reqs[kPortRequests];
+    UserHandler userIds[kPortRequests];
+} ZSDKStunPortBatch;
+
+typedef struct {
+    CallHandler callId;
+    uint64_t    createdUs;
+    BOOL        warm;
+    BOOL        waiting;            // first media not seen yet
+} ZSDKStunCall;
+
+static pthread_mutex_t      gStunLock = PTHREAD_MUTEX_INITIALIZER;
+static StunHandler          gStunId = INVALID_HANDLE;
+static BOOL                 gStarted = NO;
+static BOOL                 gWatchScheduled = NO;
+static uint64_t             gFingerprint = 0;
+static uint32_t             gGeneration = 0;    // bumped when ports go stale
+static BOOL                 gResolvePending = NO;
+static uint64_t             gResolveStartUs = 0;
+static ZSDKStunStats        gStats;
+static ZSDKStunWarmUser     gWarm[kZSDKStunWarmUsers];
+static ZSDKStunPortRequest  gRequests[kPortRequests];
+static ZSDKStunCall         gCalls[kZSDKMaxCalls];
+static ZSDKHistogram        gFirstMediaWarm;
+static ZSDKHistogram        gFirstMediaCold;
+static BOOL                 gTablesReady = NO;
+
+static void lockStun(void)
+{
+    pthread_mutex_lock(&gStunLock);
+    if (!gTablesReady)
+    {
+        for (int i = 0; i < kZSDKStunWarmUsers; i++)
+            gWarm[i].userId = INVALID_HANDLE;
+        ZSDKHistogramReset(&gFirstMediaWarm);
+        ZSDKHistogramReset(&gFirstMediaCold);
+        gTablesReady = YES;
+    }
+}
+
+static void unlockStun(void)
+{
+    pthread_mutex_unlock(&gStunLock);
+}
+
+static ZSDKStunWarmUser * findWarmUser(UserHandler userId)
+{
+    for (int i = 0; i < kZSDKStunWarmUsers; i++)
+    {
+        if (gWarm[i].userId == userId)
+            return &gWarm[i];
+    }
+    return NULL;
+}
+
+//==============================================================================
+//  Port pre-warming
+//
+//  The library is never called with gStunLock held: its callbacks take the
+//  lock on the poll thread.  State changes are made under the lock and the
+//  calls they need are made once it is released.
+//==============================================================================
+// Lock held
+static void refill(ZSDKStunWarmUser * warm, ZSDKStunPortBatch * batch)
+{
+    if (gStats.state != ZSDKStunUsable || warm->failed || !gWrapperCtx.PrepareStunPort)
+        return;
+
+    int req = 0;
+    while (warm->ready + warm->pending < warm->target)
+    {
+        while (req < kPortRequests && gRequests[req].used)
+            req++;
+        if (req == kPortRequests)
+            return;
+        gRequests[req].used        = YES;
+        gRequests[req].userId      = warm->userId;
+        gRequests[req].generation  = gGeneration;
+        gRequests[req].requestedUs = ZSDKMonotonicMicros();
+        warm->pending++;
+        gStats.portsRequested++;
+        batch->reqs[batch->count]    = req;
+        batch->userIds[batch->count] = warm->userId;
+        batch->count++;
+    }
+}
+
+// Lock held
+static void refillAll(ZSDKStunPortBatch * batch)
+{
+    for (int i = 0; i < kZSDKStunWarmUsers; i++)
+    {
+        if (gWarm[i].userId != INVALID_HANDLE)
+            refill(&gWarm[i], batch);
+    }
+}
+
+// Lock held.  A request the library refused never gets a callback.
+static void cancelRequest(int req)
+{
+    ZSDKStunPortRequest * request = &gRequests[req];
+    request->used = NO;
+    gStats.portsRequested--;
+    if (request->generation != gGeneration)
+        return;
+    ZSDKStunWarmUser * warm = findWarmUser(request->userId);
+    if (warm)
+    {
+        if (warm->pending > 0)
+            warm->pending--;
+        warm->failed = YES;
+    }
+}
+
+// Lock not held
+static void preparePorts(const ZSDKStunPortBatch * batch)
+{
+    UserHandler failedUser = INVALID_HANDLE;
+
+    for (int i = 0; i < batch->count; i++)
+    {
+        // After a refusal the account gets no more requests until a call or rediscovery
+        if (batch->userIds[i] != failedUser &&
+            gWrapperCtx.PrepareStunPort(batch->userIds[i],
+                                        (void *)(uintptr_t)(batch->reqs[i] + 1)) == L_OK)
+            continue;
+
+        failedUser = batch->userIds[i];
+        lockStun();
+        cancelRequest(batch->reqs[i]);
+        unlockStun();
+    }
+}
+
+// Ports prepared so far belong to the old network.  The library still
+// hands queued ones out, they just no longer count as warm.  Lock held.
+static void dropPorts(void)
+{
+    gGeneration++;
+    for (int i = 0; i < kZSDKStunWarmUsers; i++)
+    {
+        gWarm[i].ready   = 0;
+        gWarm[i].pending = 0;
+        gWarm[i].failed  = NO;
+    }
+}
+
+// Lock held.  Returns the generation to hand to resolve() once unlocked.
+static uint32_t restartResolve(void)
+{
+    dropPorts();
+    gStats.state           = ZSDKStunResolving;
+    gStats.networkType     = E_NETWORK_UNKNOWN;
+    gStats.externalAddress = 0;
+    gStats.externalPort    = 0;
+    gResolvePending        = YES;
+    gResolveStartUs        = ZSDKMonotonicMicros();
+    return gGeneration;
+}
+
+// Lock not held.  A later restart or a stop may have overtaken this one.
+static void resolve(StunHandler stunId, uint32_t generation)
+{
+    gWrapperCtx.StopStunResolve(stunId);
+    LIBRESULT result = gWrapperCtx.StartStunResolve(stunId);
+
+    lockStun();
+    BOOL started = gStarted;
+    if (started && gGeneration == generation && result != L_OK)
+        gResolvePending = NO;
+    unlockStun();
+
+    if (result == L_OK && !started)
+        gWrapperCtx.StopStunResolve(stunId);
+}
+
+//==============================================================================
+//  Network watch (poll thread)
+//==============================================================================
+static void onNetworkCheck( void * pUserData )
+{
+    uint64_t fingerprint = ZSDKTransportProbeFingerprint();
+    BOOL restart = NO;
+    uint32_t generation = 0;
+    StunHandler stunId = INVALID_HANDLE;
+
+    lockStun();
+    gWatchScheduled = NO;
+    if (gStarted)
+    {
+        if (fingerprint != gFingerprint)
+        {
+            gFingerprint = fingerprint;
+            gStats.networkChanges++;
+            generation = restartResolve();
+            stunId     = gStunId;
+            restart    = YES;
+        }
+        gWatchScheduled = YES;
+        ZSDKPollEngineAddTimedEvent(onNetworkCheck, NULL, kZSDKStunNetworkCheckMs);
+    }
+    unlockStun();
+
+    if (restart)
+    {
+        NSLog(@"ZOIPER: network changed, resolving STUN again");
+        resolve(stunId, generation);
+    }
+}
+
+//==============================================================================
+//  Configuration
+//==============================================================================
+BOOL ZSDKStunManagerStart(const char * pServer, int port, long refreshMs)
+{
+    if (!gWrapperCtx.AddStunServer || !gWrapperCtx.StartStunResolve)
+        return NO;
+    uint64_t fingerprint = ZSDKTransportProbeFingerprint();
+
+    // Created once and reconfigured: RemoveStunServer() has a known issue.
+    // Only the main thread writes gStunId.
+    lockStun();
+    StunHandler stunId = gStunId;
+    unlockStun();
+    if (stunId == INVALID_HANDLE)
+    {
+        if (gWrapperCtx.AddStunServer(&stunId) != L_OK)
+        {
+            NSLog(@"ERROR SETUP AddStunServer");
+            return NO;
+        }
+        lockStun();
+        gStunId = stunId;
+        unlockStun();
+    }
+    gWrapperCtx.SetStunServer(stunId, pServer ? pServer : "");
+    gWrapperCtx.SetStunPort(stunId, (WORD)(port > 0 ? port : kZSDKStunPortDefault));
+    gWrapperCtx.SetStunRefreshPeriod(stunId, refreshMs > 0 ? refreshMs : kZSDKStunRefreshDefaultMs);
+    gWrapperCtx.SetDefaultStunServer(stunId);
+
+    lockStun();
+    gStarted     = YES;
+    gFingerprint = fingerprint;
+    uint32_t generation = restartResolve();
+    if (!gWatchScheduled)
+    {
+        gWatchScheduled = YES;
+        ZSDKPollEngineAddTimedEvent(onNetworkCheck, NULL, kZSDKStunNetworkCheckMs);
+    }
+    unlockStun();
+
+    resolve(stunId, generation);
+    ZSDKPollEngineWakeup();
+    return YES;
+}
+
+void ZSDKStunManagerStop(void)
+{
+    lockStun();
+    BOOL started = gStarted;
+    StunHandler stunId = gStunId;
+    if (started)
+    {
+        gStarted        = NO;
+        gResolvePending = NO;
+        gStats.state    = ZSDKStunOff;
+        dropPorts();
+    }
+    unlockStun();
+
+    if (started)
+    {
+        gWrapperCtx.StopStunResolve(stunId);
+        gWrapperCtx.SetDefaultStunServer(INVALID_HANDLE);
+    }
+}
+
+void ZSDKStunManagerNetworkChanged(void)
+{
+    uint64_t fingerprint = ZSDKTransportProbeFingerprint();
+    BOOL restart = NO;
+    uint32_t generation = 0;
+    StunHandler stunId = INVALID_HANDLE;
+
+    lockStun();
+    if (gStarted)
+    {
+        gFingerprint = fingerprint;
+        gStats.networkChanges++;
+        generation = restartResolve();
+        stunId     = gStunId;
+        restart    = YES;
+    }
+    unlockStun();
+
+    if (restart)
+        resolve(stunId, generation);
+    ZSDKPollEngineWakeup();
+}
+
+void ZSDKStunManagerOnUserAdded(UserHandler userId)
+{
+    lockStun();
+    StunHandler stunId = gStarted ? gStunId : INVALID_HANDLE;
+    unlockStun();
+
+    if (stunId != INVALID_HANDLE)
+        gWrapperCtx.AssignStunServer(stunId, userId);
+}
+
+BOOL ZSDKStunManagerWarmUser(UserHandler userId, int ports)
+{
+    ZSDKStunPortBatch batch = { 0 };
+    ports = (ports < 0) ? 0 : (ports > kZSDKStunMaxWarmPorts ? kZSDKStunMaxWarmPorts : ports);
+
+    lockStun();
+    ZSDKStunWarmUser * warm = findWarmUser(userId);
+    if (!warm && ports > 0)
+    {
+        warm = findWarmUser(INVALID_HANDLE);
+        if (!warm)
+        {
+            unlockStun();
+            return NO;
+        }
+        memset(warm, 0, sizeof(*warm));
+        warm->userId = userId;
+    }
+    if (warm)
+    {
+        // Ports already queued in the library stay there
+        warm->target = ports;
+        if (ports == 0)
+            warm->userId = INVALID_HANDLE;
+        else
+            refill(warm, &batch);
+    }
+    unlockStun();
+
+    preparePorts(&batch);
+    ZSDKPollEngineWakeup();
+    return YES;
+}
+
+//==============================================================================
+//  Statistics
+//==============================================================================
+void ZSDKStunManagerGetStats(ZSDKStunStats * pStats)
+{
+    lockStun();
+    *pStats = gStats;
+    pStats->warmPorts = 0;
+    for (int i = 0; i < kZSDKStunWarmUsers; i++)
+    {
+        if (gWarm[i].userId != INVALID_HANDLE)
+            pStats->warmPorts += gWarm[i].ready;
+    }
+    unlockStun();
+}
+
+int ZSDKStunManagerFirstMediaJSON(BOOL warm, char * pBuf, size_t size)
+{
+    lockStun();
+    int len = ZSDKHistogramFormatJSON(warm ? &gFirstMediaWarm : &gFirstMediaCold, pBuf, size);
+    unlockStun();
+    return len;
+}
+
+void ZSDKStunManagerResetFirstMedia(void)
+{
+    lockStun();
+    ZSDKHistogramReset(&gFirstMediaWarm);
+    ZSDKHistogramReset(&gFirstMediaCold);
+    gStats.callsWarm = 0;
+    gStats.callsCold = 0;
+    unlockStun();
+}
+
+//==============================================================================
+//  Call hooks (poll thread)
+//==============================================================================
+void ZSDKStunManagerOnCallCreate(UserHandler userId, CallHandler callId, int slot, uint64_t createdUs)
+{
+    if (slot < 0 || slot >= kZSDKMaxCalls)
+        return;
+    ZSDKStunPortBatch batch = { 0 };
+
+    lockStun();
+    // CallCreate() took the oldest port queued for the account, if any
+    ZSDKStunWarmUser * warm = findWarmUser(userId);
+    BOOL used = warm && warm->ready > 0;
+    ZSDKStunCall * call = &gCalls[slot];
+    call->callId    = callId;
+    call->createdUs = createdUs;
+    call->warm      = used;
+    call->waiting   = YES;
+    if (used)
+    {
+        warm->ready--;
+        gStats.callsWarm++;
+    }
+    else
+    {
+        gStats.callsCold++;
+    }
+    if (warm)
+    {
+        warm->failed = NO;
+        refill(warm, &batch);
+    }
+    unlockStun();
+
+    preparePorts(&batch);
+}
+
+void ZSDKStunManagerOnFirstMedia(CallHandler callId, int slot)
+{
+    if (slot < 0 || slot >= kZSDKMaxCalls)
+        return;
+
+    lockStun();
+    ZSDKStunCall * call = &gCalls[slot];
+    if (call->waiting && call->callId == callId)
+    {
+        call->waiting = NO;
+        ZSDKHistogramRecord(call->warm ? &gFirstMediaWarm : &gFirstMediaCold,
+                            ZSDKMonotonicMicros() - call->createdUs);
+    }
+    unlockStun();
+}
+
+//==============================================================================
+//  STUN callbacks (poll thread)
+//==============================================================================
+void ZSDKStunManagerOnNetworkDiscovered(StunHandler stunId, eNetworkTypeEnum_t netType)
+{
+    ZSDKStunPortBatch batch = { 0 };
+    BOOL resolved = gWrapperCtx.GetStunResolvedAddress && gWrapperCtx.IsStunResolved &&
+                    gWrapperCtx.IsStunResolved(stunId);
+    uint32_t address = resolved ? (uint32_t)gWrapperCtx.GetStunResolvedAddress(stunId) : 0;
+    WORD port = resolved ? gWrapperCtx.GetStunResolvedPort(stunId) : 0;
+
+    lockStun();
+    if (!gStarted || stunId != gStunId)
+    {
+        unlockStun();
+        return;
+    }
+    gStats.resolves++;
+    if (gResolvePending)
+    {
+        uint64_t elapsedUs = ZSDKMonotonicMicros() - gResolveStartUs;
+        gStats.resolveTimeLastUs = elapsedUs;
+        if (elapsedUs > gStats.resolveTimeMaxUs)
+            gStats.resolveTimeMaxUs = elapsedUs;
+        gResolvePending = NO;
+    }
+
+    BOOL wasUsable = (gStats.state == ZSDKStunUsable);
+    gStats.networkType = netType;
+    switch (netType)
+    {
+        case E_NETWORK_FULLCONE_NAT:
+        case E_NETWORK_PORTRESTRICTED_NAT:
+        case E_NETWORK_RESTRICTEDCONE_NAT:
+            gStats.state = ZSDKStunUsable;
+            break;
+        default:
+            // Blocked stays active: the library keeps retrying discovery
+            gStats.state = ZSDKStunUnusable;
+            break;
+    }
+    if (resolved)
+    {
+        gStats.externalAddress = address;
+        gStats.externalPort    = port;
+    }
+    if (gStats.state == ZSDKStunUsable && !wasUsable)
+    {
+        for (int i = 0; i < kZSDKStunWarmUsers; i++)
+            gWarm[i].failed = NO;
+        refillAll(&batch);
+    }
+    unlockStun();
+
+    preparePorts(&batch);
+}
+
+void ZSDKStunManagerOnPortReady(UserHandler userId, void * pUserData, LIBRESULT result)
+{
+    int req = (int)(uintptr_t)pUserData - 1;
+    if (req < 0 || req >= kPortRequests)
+        return;
+    ZSDKStunPortBatch batch = { 0 };
+
+    lockStun();
+    ZSDKStunPortRequest * request = &gRequests[req];
+    if (!request->used || request->userId != userId)
+    {
+        unlockStun();
+        return;
+    }
+    request->used = NO;
+
+    ZSDKStunWarmUser * warm = findWarmUser(userId);
+    if (request->generation != gGeneration)
+    {
+        gStats.portsStale++;
+    }
+    else if (warm)
+    {
+        if (warm->pending > 0)
+            warm->pending--;
+        if (result == L_OK)
+        {
+            uint64_t latencyUs = ZSDKMonotonicMicros() - request->requestedUs;
+            gStats.portLatencyTotalUs += latencyUs;
+            if (latencyUs > gStats.portLatencyMaxUs)
+                gStats.portLatencyMaxUs = latencyUs;
+            gStats.portsReady++;
+            warm->ready++;
+            refill(warm, &batch);
+        }
+        else
+        {
+            gStats.portsFailed++;
+            warm->failed = YES;
+        }
+    }
+    unlockStun();
+
+    preparePorts(&batch);
+}
@@ -0,0 +1,87 @@
+//
+//  ZSDKTelemetry.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Call quality telemetry.  Every call slot owns one fixed-stride ring per
+//  channel (audio, video and audio levels) in static storage.  The
+//  callbacks append 32 byte samples in O(1) without locks or allocation;
+//  readers copy a consistent snapshot from any thread and can export it as
+//  a binary dump or CSV.  Rings keep the newest kZSDKTelemetryRingSize
+//  samples and stay readable after the call ends, until the slot is reused.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKTelemetryRingSize          256     // samples per channel, power of two
+#define kZSDKTelemetryLevelIntervalMs   1000    // audio levels: one peak sample per interval
+#define kZSDKTelemetryMagic             0x4D4C545A  // "ZTLM"
+#define kZSDKTelemetryVersion           1
+
+typedef enum {
+    ZSDKTelemetryAudio = 0              // E_CHANNEL_AUDIO
+,   ZSDKTelemetryVideo                  // E_CHANNEL_VIDEO
+,   ZSDKTelemetryLevels                 // onCallAudioLevels
+,   ZSDKTelemetryChannelCount
+} ZSDKTelemetryChannel;
+
+typedef enum {
+    ZSDKTelemetryKindNetwork = 0        // onCallNetworkStatistics
+,   ZSDKTelemetryKindQuality            // onCallNetworkQualityLevel
+,   ZSDKTelemetryKindLevels             // onCallAudioLevels
+} ZSDKTelemetryKind;
+
+typedef struct {
+    uint32_t    timeMs;         // since the call started
+    uint8_t     kind;           // ZSDKTelemetryKind
+    uint8_t     quality;        // last eNetworkQualityLevel_t of the channel
+    int16_t     lossPermil;
+    int16_t     jitterMs;
+    int16_t     inLevel;        // dBm0 x 10 (peak of the interval)
+    int16_t     outLevel;
+    int16_t     reserved;
+    uint32_t    inBitrate;      // bps, current
+    uint32_t    outBitrate;
+    uint32_t    inPackets;      // totals
+    uint32_t    outPackets;
+} ZSDKTelemetrySample;
+
+// Binary export: this header, then counts[0] audio, counts[1] video and
+// counts[2] level samples, oldest first, in host byte order
+typedef struct {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    sampleSize;
+    uint64_t    callId;
+    uint64_t    startUs;        // ZSDKMonotonicMicros() at call start
+    uint32_t    counts[ZSDKTelemetryChannelCount];
+    uint32_t    reserved;
+} ZSDKTelemetryHeader;
+
+// Call lifecycle (poll thread)
+void ZSDKTelemetryStart(CallHandler callId, int callSlot);
+
+// Writers (poll thread)
+void ZSDKTelemetryOnStatistics(CallHandler callId, int callSlot, eCallChannel_t channel,
+                               unsigned long inBitrate, unsigned long outBitrate,
+                               unsigned long inPackets, unsigned long outPackets,
+                               int lossPermil, int jitterMs);
+void ZSDKTelemetryOnQuality(CallHandler callId, int callSlot, eCallChannel_t channel,
+                            eNetworkQualityLevel_t quality);
+void ZSDKTelemetryOnAudioLevels(CallHandler callId, int callSlot, double inLevel, double outLevel);
+
+// Slot still holding the call's telemetry (also after it ended), or -1
+int ZSDKTelemetryFindCall(CallHandler callId);
+
+// Readers (any thread).  Copies up to maxSamples newest samples, oldest
+// first; returns the count, or -1 if the slot no longer holds that call.
+int ZSDKTelemetrySnapshot(CallHandler callId, int callSlot, ZSDKTelemetryChannel channel,
+                          ZSDKTelemetrySample * pOut, int maxSamples);
+
+// Export every channel of the call; malloc'ed buffer the caller frees, or
+// NULL if the slot no longer holds that call
+uint8_t * ZSDKTelemetryExportBinary(CallHandler callId, int callSlot, size_t * pLength);
+char *    ZSDKTelemetryExportCSV(CallHandler callId, int callSlot, size_t * pLength);
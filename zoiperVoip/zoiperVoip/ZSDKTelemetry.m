@@ -0,0 +1,327 @@
+//
+//  ZSDKTelemetry.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKTelemetry.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import <math.h>
+
+typedef struct {
+    uint64_t                head;       // samples ever written
+    ZSDKTelemetrySample     samples[kZSDKTelemetryRingSize];
+} ZSDKTelemetryRing;
+
+typedef struct {
+    // epoch is odd while the slot is being reset (seqlock for readers)
+    uint32_t                epoch;
+    CallHandler             callId;
+    uint64_t                startUs;
+    uint8_t                 quality[ZSDKTelemetryChannelCount];
+    // Audio level decimation (writer only)
+    uint32_t                levelWindowMs;
+    BOOL                    levelPending;
+    int16_t                 levelIn;
+    int16_t                 levelOut;
+    ZSDKTelemetryRing       rings[ZSDKTelemetryChannelCount];
+} ZSDKTelemetryCall;
+
+static ZSDKTelemetryCall    gTelemetry[kZSDKMaxCalls];
+
+static const char * kChannelNames[ZSDKTelemetryChannelCount] = { "audio", "video", "levels" };
+static const char * kKindNames[] = { "network", "quality", "levels" };
+
+//==============================================================================
+//  Writers
+//==============================================================================
+static ZSDKTelemetryCall * writerCall(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NULL;
+    ZSDKTelemetryCall * tc = &gTelemetry[callSlot];
+    return (tc->callId == callId) ? tc : NULL;
+}
+
+static inline uint32_t elapsedMs(ZSDKTelemetryCall * tc)
+{
+    return (uint32_t)((ZSDKMonotonicMicros() - tc->startUs) / 1000);
+}
+
+static inline int16_t clamp16(long v)
+{
+    return (int16_t)(v < INT16_MIN ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v));
+}
+
+static inline uint32_t clamp32(unsigned long v)
+{
+    return (v > UINT32_MAX) ? UINT32_MAX : (uint32_t)v;
+}
+
+// Clears the next record in place; endAppend() publishes it
+static ZSDKTelemetrySample * beginAppend(ZSDKTelemetryCall * tc, ZSDKTelemetryChannel channel,
+                                         ZSDKTelemetryKind kind, uint32_t timeMs)
+{
+    ZSDKTelemetryRing * ring = &tc->rings[channel];
+    ZSDKTelemetrySample * sample = &ring->samples[ring->head & (kZSDKTelemetryRingSize - 1)];
+    memset(sample, 0, sizeof(*sample));
+    sample->timeMs  = timeMs;
+    sample->kind    = kind;
+    sample->quality = tc->quality[channel];
+    return sample;
+}
+
+static inline void endAppend(ZSDKTelemetryCall * tc, ZSDKTelemetryChannel channel)
+{
+    ZSDKTelemetryRing * ring = &tc->rings[channel];
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+static void flushLevels(ZSDKTelemetryCall * tc)
+{
+    if (!tc->levelPending)
+        return;
+    ZSDKTelemetrySample * sample = beginAppend(tc, ZSDKTelemetryLevels, ZSDKTelemetryKindLevels,
+                                               tc->levelWindowMs);
+    sample->quality  = tc->quality[ZSDKTelemetryAudio];
+    sample->inLevel  = tc->levelIn;
+    sample->outLevel = tc->levelOut;
+    endAppend(tc, ZSDKTelemetryLevels);
+    tc->levelPending = NO;
+}
+
+void ZSDKTelemetryStart(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKTelemetryCall * tc = &gTelemetry[callSlot];
+    __atomic_add_fetch(&tc->epoch, 1, __ATOMIC_ACQ_REL);
+    tc->callId       = callId;
+    tc->startUs      = ZSDKMonotonicMicros();
+    tc->levelPending = NO;
+    for (int c = 0; c < ZSDKTelemetryChannelCount; c++)
+    {
+        tc->quality[c] = E_NET_QUALITY_PENDING;
+        tc->rings[c].head = 0;
+    }
+    __atomic_add_fetch(&tc->epoch, 1, __ATOMIC_RELEASE);
+}
+
+void ZSDKTelemetryOnStatistics(CallHandler callId, int callSlot, eCallChannel_t channel,
+                               unsigned long inBitrate, unsigned long outBitrate,
+                               unsigned long inPackets, unsigned long outPackets,
+                               int lossPermil, int jitterMs)
+{
+    ZSDKTelemetryCall * tc = writerCall(callId, callSlot);
+    if (!tc || channel > E_CHANNEL_VIDEO)
+        return;
+
+    ZSDKTelemetryChannel ch = (ZSDKTelemetryChannel)channel;
+    ZSDKTelemetrySample * sample = beginAppend(tc, ch, ZSDKTelemetryKindNetwork, elapsedMs(tc));
+    sample->lossPermil = clamp16(lossPermil);
+    sample->jitterMs   = clamp16(jitterMs);
+    sample->inBitrate  = clamp32(inBitrate);
+    sample->outBitrate = clamp32(outBitrate);
+    sample->inPackets  = clamp32(inPackets);
+    sample->outPackets = clamp32(outPackets);
+    endAppend(tc, ch);
+}
+
+void ZSDKTelemetryOnQuality(CallHandler callId, int callSlot, eCallChannel_t channel,
+                            eNetworkQualityLevel_t quality)
+{
+    ZSDKTelemetryCall * tc = writerCall(callId, callSlot);
+    if (!tc || channel > E_CHANNEL_VIDEO)
+        return;
+
+    ZSDKTelemetryChannel ch = (ZSDKTelemetryChannel)channel;
+    tc->quality[ch] = (uint8_t)quality;
+    beginAppend(tc, ch, ZSDKTelemetryKindQuality, elapsedMs(tc));
+    endAppend(tc, ch);
+}
+
+// Level callbacks come much faster than the network statistics; keep the
+// peak of each interval so they do not push the rest out of the ring
+void ZSDKTelemetryOnAudioLevels(CallHandler callId, int callSlot, double inLevel, double outLevel)
+{
+    ZSDKTelemetryCall * tc = writerCall(callId, callSlot);
+    if (!tc)
+        return;
+
+    uint32_t now = elapsedMs(tc);
+    int16_t in  = clamp16(lround(inLevel * 10));
+    int16_t out = clamp16(lround(outLevel * 10));
+
+    if (tc->levelPending && now - tc->levelWindowMs >= kZSDKTelemetryLevelIntervalMs)
+        flushLevels(tc);
+    if (!tc->levelPending)
+    {
+        tc->levelPending  = YES;
+        tc->levelWindowMs = now;
+        tc->levelIn       = in;
+        tc->levelOut      = out;
+        return;
+    }
+    if (in > tc->levelIn)
+        tc->levelIn = in;
+    if (out > tc->levelOut)
+        tc->levelOut = out;
+}
+
+//==============================================================================
+//  Readers
+//==============================================================================
+int ZSDKTelemetryFindCall(CallHandler callId)
+{
+    for (int i = 0; i < kZSDKMaxCalls; i++)
+    {
+        if (__atomic_load_n(&gTelemetry[i].callId, __ATOMIC_ACQUIRE) == callId &&
+            gTelemetry[i].startUs != 0)
+            return i;
+    }
+    return -1;
+}
+
+int ZSDKTelemetrySnapshot(CallHandler callId, int callSlot, ZSDKTelemetryChannel channel,
+                          ZSDKTelemetrySample * pOut, int maxSamples)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls || channel >= ZSDKTelemetryChannelCount)
+        return -1;
+
+    ZSDKTelemetryCall * tc = &gTelemetry[callSlot];
+    ZSDKTelemetryRing * ring = &tc->rings[channel];
+
+    uint32_t epoch = __atomic_load_n(&tc->epoch, __ATOMIC_ACQUIRE);
+    if ((epoch & 1) || tc->callId != callId)
+        return -1;
+
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t count = head < kZSDKTelemetryRingSize ? head : kZSDKTelemetryRingSize;
+    if (count > (uint64_t)maxSamples)
+        count = maxSamples;
+    uint64_t first = head - count;
+
+    for (uint64_t i = 0; i < count; i++)
+        pOut[i] = ring->samples[(first + i) & (kZSDKTelemetryRingSize - 1)];
+
+    // Samples the writer lapped while we copied may be torn; drop them
+    uint64_t after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&tc->epoch, __ATOMIC_ACQUIRE) != epoch)
+        return -1;
+    uint64_t overwritten = (after >= kZSDKTelemetryRingSize) ? after - kZSDKTelemetryRingSize + 1 : 0;
+    if (overwritten > first)
+    {
+        uint64_t torn = overwritten - first;
+        if (torn >= count)
+            return 0;
+        memmove(pOut, pOut + torn, (size_t)(count - torn) * sizeof(*pOut));
+        count -= torn;
+    }
+    return (int)count;
+}
+
+// Snapshot of all channels into one allocation
+static ZSDKTelemetrySample * snapshotAll(CallHandler callId, int callSlot,
+                                         int counts[ZSDKTelemetryChannelCount], uint64_t * pStartUs)
+{
+    ZSDKTelemetrySample * samples = malloc(sizeof(ZSDKTelemetrySample) *
+                                           kZSDKTelemetryRingSize * ZSDKTelemetryChannelCount);
+    if (!samples)
+        return NULL;
+
+    for (int c = 0; c < ZSDKTelemetryChannelCount; c++)
+    {
+        counts[c] = ZSDKTelemetrySnapshot(callId, callSlot, c, samples + c * kZSDKTelemetryRingSize,
+                                          kZSDKTelemetryRingSize);
+        if (counts[c] < 0)
+        {
+            free(samples);
+            return NULL;
+        }
+    }
+    *pStartUs = gTelemetry[callSlot].startUs;
+    return samples;
+}
+
+uint8_t * ZSDKTelemetryExportBinary(CallHandler callId, int callSlot, size_t * pLength)
+{
+    int counts[ZSDKTelemetryChannelCount];
+    uint64_t startUs = 0;
+    ZSDKTelemetrySample * samples = snapshotAll(callId, callSlot, counts, &startUs);
+    if (!samples)
+        return NULL;
+
+    size_t total = 0;
+    for (int c = 0; c < ZSDKTelemetryChannelCount; c++)
+        total += counts[c];
+
+    size_t length = sizeof(ZSDKTelemetryHeader) + total * sizeof(ZSDKTelemetrySample);
+    uint8_t * buffer = malloc(length);
+    if (buffer)
+    {
+        ZSDKTelemetryHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic      = kZSDKTelemetryMagic;
+        header.version    = kZSDKTelemetryVersion;
+        header.sampleSize = sizeof(ZSDKTelemetrySample);
+        header.callId     = callId;
+        header.startUs    = startUs;
+        memcpy(buffer, &header, sizeof(header));
+
+        uint8_t * p = buffer + sizeof(header);
+        for (int c = 0; c < ZSDKTelemetryChannelCount; c++)
+        {
+            header.counts[c] = counts[c];
+            memcpy(p, samples + c * kZSDKTelemetryRingSize, counts[c] * sizeof(ZSDKTelemetrySample));
+            p += counts[c] * sizeof(ZSDKTelemetrySample);
+        }
+        memcpy(buffer, &header, sizeof(header));
+        *pLength = length;
+    }
+    free(samples);
+    return buffer;
+}
+
+char * ZSDKTelemetryExportCSV(CallHandler callId, int callSlot, size_t * pLength)
+{
+    int counts[ZSDKTelemetryChannelCount];
+    uint64_t startUs = 0;
+    ZSDKTelemetrySample * samples = snapshotAll(callId, callSlot, counts, &startUs);
+    if (!samples)
+        return NULL;
+
+    static const char kHeader[] = "channel,kind,timeMs,quality,lossPermil,jitterMs,"
+                                  "inBitrate,outBitrate,inPackets,outPackets,inLevelDb,outLevelDb\n";
+    enum { kMaxLine = 128 };
+
+    size_t total = 0;
+    for (int c = 0; c < ZSDKTelemetryChannelCount; c++)
+        total += counts[c];
+
+    size_t capacity = sizeof(kHeader) + total * kMaxLine;
+    char * csv = malloc(capacity);
+    if (csv)
+    {
+        size_t length = strlcpy(csv, kHeader, capacity);
+        for (int c = 0; c < ZSDKTelemetryChannelCount; c++)
+        {
+            for (int i = 0; i < counts[c]; i++)
+            {
+                const ZSDKTelemetrySample * s = &samples[c * kZSDKTelemetryRingSize + i];
+                int n = snprintf(csv + length, capacity - length,
+                                 "%s,%s,%u,%u,%d,%d,%u,%u,%u,%u,%.1f,%.1f\n",
+                                 kChannelNames[c], kKindNames[s->kind], s->timeMs, s->quality,
+                                 s->lossPermil, s->jitterMs, s->inBitrate, s->outBitrate,
+                                 s->inPackets, s->outPackets, s->inLevel / 10.0, s->outLevel / 10.0);
+                if (n > 0 && (size_t)n < capacity - length)
+                    length += n;
+            }
+        }
+        *pLength = length;
+    }
+    free(samples);
+    return csv;
+}
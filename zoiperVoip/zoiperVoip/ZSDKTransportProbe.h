@@ -0,0 +1,99 @@
+//
+//  ZSDKTransportProbe.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  SIP transport discovery for new accounts.  Before an account's first
+//  REGISTER the user manager asks for the transport of its server on the
+//  current network:
+//
+//  - A cached answer is applied with SetUserTransport() and the account
+//    registers straight away.
+//  - Otherwise ProbeSipTransport() runs (the library tries TLS, TCP and UDP
+//    and reports the first that registers) and the account waits in
+//    ZSDKUserStateProbing.  Probes for different servers run in parallel;
+//    accounts on a server already being probed join that probe.  The
+//    winner is cached, and every waiting account is released to the pacer
+//    with it (or with the default transport if the probe fails or times
+//    out).
+//
+//  Cache entries are keyed by network fingerprint, server and proxy.  The
+//  fingerprint is the set of active Wi-Fi/cellular interfaces with their
+//  IPv4 subnets plus an optional network name (SSID) supplied by the
+//  application, so a known network skips probing after a relaunch or a
+//  network change.  An entry is dropped when a registration that used it
+//  fails or starts retrying.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKProbeMaxProbes         8       // servers probed at once
+#define kZSDKProbeCacheEntries      64
+#define kZSDKProbeTimeoutMs         20000
+#define kZSDKProbeCacheMaxAgeSecs   (14 * 24 * 3600)
+#define kZSDKProbeNetworkNameLen    64
+
+typedef enum {
+    ZSDKProbeCached = 0             // *pTransport is set
+,   ZSDKProbeStarted                // *pProbeId is set; wait for the result
+,   ZSDKProbeUnavailable            // disabled, no library support or no slot
+} ZSDKProbeLookup;
+
+typedef struct {
+    uint64_t            key;        // fingerprint, server and proxy
+    eUserTransport_t    transport;
+    int64_t             storedAt;   // seconds since 1970
+} ZSDKProbeCacheEntry;
+
+typedef struct {
+    uint64_t    lookups;
+    uint64_t    cacheHits;
+    uint64_t    probesStarted;
+    uint64_t    probesJoined;       // account waited on a running probe
+    uint64_t    successes;
+    uint64_t    failures;
+    uint64_t    timeouts;
+    uint64_t    errors;             // onProbeError, per transport tried
+    uint64_t    invalidations;
+    uint64_t    probeTimeTotalUs;
+    uint64_t    probeTimeMaxUs;
+    int         running;
+    int         cacheEntries;
+} ZSDKProbeStats;
+
+typedef void (^ZSDKProbeCacheChanged)(void);
+
+// Enabled by default
+void ZSDKTransportProbeSetEnabled(BOOL enabled);
+
+// Wi-Fi network name (SSID) mixed into the fingerprint; NULL clears it
+void ZSDKTransportProbeSetNetworkName(const char * pName);
+
+// Fingerprint of the current network, for diagnostics
+uint64_t ZSDKTransportProbeFingerprint(void);
+
+// Cached transport, or a probe started/joined for the server
+ZSDKProbeLookup ZSDKTransportProbeLookup(const char * pServer, const char * pProxy,
+                                         const char * pUser, const char * pPass,
+                                         eUserTransport_t * pTransport, ProbeHandler * pProbeId);
+
+// A registration that used a cached transport failed
+void ZSDKTransportProbeInvalidate(const char * pServer, const char * pProxy);
+
+// Cache persistence: export returns the number of entries copied; import
+// replaces the cache.  changed runs on the main queue after every update.
+int  ZSDKTransportProbeExportCache(ZSDKProbeCacheEntry * pOut, int maxEntries);
+void ZSDKTransportProbeImportCache(const ZSDKProbeCacheEntry * pEntries, int count);
+void ZSDKTransportProbeSetCacheChanged(ZSDKProbeCacheChanged changed);
+void ZSDKTransportProbeClearCache(void);
+
+void ZSDKTransportProbeGetStats(ZSDKProbeStats * pStats);
+
+// Probe callbacks (poll thread)
+void ZSDKTransportProbeOnState(ProbeHandler probeId, eProbeState_t state);
+void ZSDKTransportProbeOnError(ProbeHandler probeId, eProbeState_t state, int causeCode);
+void ZSDKTransportProbeOnSuccess(ProbeHandler probeId, eUserTransport_t transport);
+void ZSDKTransportProbeOnFailed(ProbeHandler probeId, int causeCode);
@@ -0,0 +1,387 @@
+//
+//  ZSDKTransportProbe.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKTransportProbe.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKUserManager.h"
+#import <pthread.h>
+#import <ifaddrs.h>
+#import <net/if.h>
+#import <netinet/in.h>
+
+typedef struct {
+    BOOL            used;
+    ProbeHandler    probeId;
+    uint64_t        key;
+    uint64_t        startedUs;
+    eProbeState_t   state;
+    uint32_t        generation;     // stale timeouts are ignored
+} ZSDKProbe;
+
+static pthread_mutex_t          gProbeLock = PTHREAD_MUTEX_INITIALIZER;
+static ZSDKProbe                gProbes[kZSDKProbeMaxProbes];
+static ZSDKProbeCacheEntry      gCache[kZSDKProbeCacheEntries];
+static int                      gCacheCount = 0;
+static BOOL                     gEnabled = YES;
+static char                     gNetworkName[kZSDKProbeNetworkNameLen];
+static ZSDKProbeStats           gStats;
+static ZSDKProbeCacheChanged    gCacheChanged = nil;
+
+//==============================================================================
+//  Keys
+//==============================================================================
+static uint64_t fnv1a(uint64_t hash, const void * pData, size_t len)
+{
+    const uint8_t * p = pData;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char * pText)
+{
+    // The terminator separates consecutive fields
+    return fnv1a(hash, pText ? pText : "", pText ? strlen(pText) + 1 : 1);
+}
+
+// Expects the lock to be held (gNetworkName)
+static uint64_t fingerprintLocked(void)
+{
+    uint64_t hash = hashString(14695981039346656037ull, gNetworkName);
+
+    struct ifaddrs * pList = NULL;
+    if (getifaddrs(&pList) != 0)
+        return hash;
+    for (struct ifaddrs * p = pList; p; p = p->ifa_next)
+    {
+        if (!p->ifa_addr || p->ifa_addr->sa_family != AF_INET || !p->ifa_netmask)
+            continue;
+        if ((p->ifa_flags & (IFF_UP | IFF_RUNNING)) != (IFF_UP | IFF_RUNNING) ||
+            (p->ifa_flags & IFF_LOOPBACK))
+            continue;
+        // Wi-Fi / Ethernet and cellular; tunnels and bridges come and go
+        if (strncmp(p->ifa_name, "en", 2) != 0 && strncmp(p->ifa_name, "pdp_ip", 6) != 0)
+            continue;
+
+        uint32_t addr = ((struct sockaddr_in *)p->ifa_addr)->sin_addr.s_addr;
+        uint32_t mask = ((struct sockaddr_in *)p->ifa_netmask)->sin_addr.s_addr;
+        uint32_t subnet = addr & mask;
+        hash = hashString(hash, p->ifa_name);
+        hash = fnv1a(hash, &subnet, sizeof(subnet));
+        hash = fnv1a(hash, &mask, sizeof(mask));
+    }
+    freeifaddrs(pList);
+    return hash;
+}
+
+static uint64_t cacheKey(uint64_t fingerprint, const char * pServer, const char * pProxy)
+{
+    uint64_t hash = fnv1a(14695981039346656037ull, &fingerprint, sizeof(fingerprint));
+    hash = hashString(hash, pServer);
+    return hashString(hash, pProxy);
+}
+
+//==============================================================================
+//  Cache (lock held)
+//==============================================================================
+static ZSDKProbeCacheEntry * findEntry(uint64_t key)
+{
+    for (int i = 0; i < gCacheCount; i++)
+    {
+        if (gCache[i].key == key)
+            return &gCache[i];
+    }
+    return NULL;
+}
+
+static void removeEntry(ZSDKProbeCacheEntry * entry)
+{
+    *entry = gCache[--gCacheCount];
+}
+
+static void storeEntry(uint64_t key, eUserTransport_t transport)
+{
+    ZSDKProbeCacheEntry * entry = findEntry(key);
+    if (!entry && gCacheCount < kZSDKProbeCacheEntries)
+        entry = &gCache[gCacheCount++];
+    if (!entry)
+    {
+        // Full: replace the oldest
+        entry = &gCache[0];
+        for (int i = 1; i < gCacheCount; i++)
+        {
+            if (gCache[i].storedAt < entry->storedAt)
+                entry = &gCache[i];
+        }
+    }
+    entry->key       = key;
+    entry->transport = transport;
+    entry->storedAt  = (int64_t)time(NULL);
+}
+
+static void notifyCacheChanged(void)
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (gCacheChanged)
+            gCacheChanged();
+    });
+}
+
+//==============================================================================
+//  Probes
+//==============================================================================
+static ZSDKProbe * findProbe(ProbeHandler probeId)
+{
+    for (int i = 0; i < kZSDKProbeMaxProbes; i++)
+    {
+        if (gProbes[i].used && gProbes[i].probeId == probeId)
+            return &gProbes[i];
+    }
+    return NULL;
+}
+
+// Ends the probe and releases the accounts waiting for it
+static void finishProbe(ZSDKProbe * probe, BOOL ok, eUserTransport_t transport)
+{
+    uint64_t elapsedUs = ZSDKMonotonicMicros() - probe->startedUs;
+    gStats.probeTimeTotalUs += elapsedUs;
+    if (elapsedUs > gStats.probeTimeMaxUs)
+        gStats.probeTimeMaxUs = elapsedUs;
+    gStats.running--;
+
+    ProbeHandler probeId = probe->probeId;
+    if (ok)
+        storeEntry(probe->key, transport);
+    probe->used = NO;
+    pthread_mutex_unlock(&gProbeLock);
+
+    NSLog(@"ZOIPER: transport probe %s", ok ? "succeeded" : "failed");
+    ZSDKUserManagerOnTransportProbed(probeId, ok, transport);
+    if (ok)
+        notifyCacheChanged();
+}
+
+static void onProbeTimeout( void * pUserData )
+{
+    uintptr_t token = (uintptr_t)pUserData;
+    int slot = (int)(token & 0xFF);
+    uint32_t generation = (uint32_t)(token >> 8);
+
+    pthread_mutex_lock(&gProbeLock);
+    ZSDKProbe * probe = &gProbes[slot];
+    if (!probe->used || probe->generation != generation)
+    {
+        pthread_mutex_unlock(&gProbeLock);
+        return;
+    }
+    gStats.timeouts++;
+    finishProbe(probe, NO, E_TRANSPORT_UNKNOWN);
+}
+
+ZSDKProbeLookup ZSDKTransportProbeLookup(const char * pServer, const char * pProxy,
+                                         const char * pUser, const char * pPass,
+                                         eUserTransport_t * pTransport, ProbeHandler * pProbeId)
+{
+    pthread_mutex_lock(&gProbeLock);
+    gStats.lookups++;
+    if (!gEnabled)
+    {
+        pthread_mutex_unlock(&gProbeLock);
+        return ZSDKProbeUnavailable;
+    }
+
+    uint64_t key = cacheKey(fingerprintLocked(), pServer, pProxy);
+    ZSDKProbeCacheEntry * entry = findEntry(key);
+    if (entry && (int64_t)time(NULL) - entry->storedAt > kZSDKProbeCacheMaxAgeSecs)
+    {
+        removeEntry(entry);
+        entry = NULL;
+    }
+    if (entry)
+    {
+        *pTransport = entry->transport;
+        gStats.cacheHits++;
+        pthread_mutex_unlock(&gProbeLock);
+        return ZSDKProbeCached;
+    }
+
+    // Another account on the same server and network is probing already
+    int freeSlot = -1;
+    for (int i = 0; i < kZSDKProbeMaxProbes; i++)
+    {
+        if (gProbes[i].used && gProbes[i].key == key)
+        {
+            *pProbeId = gProbes[i].probeId;
+            gStats.probesJoined++;
+            pthread_mutex_unlock(&gProbeLock);
+            return ZSDKProbeStarted;
+        }
+        if (!gProbes[i].used && freeSlot < 0)
+            freeSlot = i;
+    }
+
+    ProbeHandler probeId = INVALID_HANDLE;
+    if (freeSlot < 0 || !gWrapperCtx.ProbeSipTransport ||
+        gWrapperCtx.ProbeSipTransport(pServer ? pServer : "", pProxy ? pProxy : "",
+                                      pUser ? pUser : "", pUser ? pUser : "",
+                                      pPass ? pPass : "", &probeId) != L_OK)
+    {
+        pthread_mutex_unlock(&gProbeLock);
+        return ZSDKProbeUnavailable;
+    }
+
+    ZSDKProbe * probe = &gProbes[freeSlot];
+    probe->used      = YES;
+    probe->probeId   = probeId;
+    probe->key       = key;
+    probe->startedUs = ZSDKMonotonicMicros();
+    probe->state     = E_PROBE_UNKNOWN;
+    probe->generation++;
+    uintptr_t token = ((uintptr_t)(probe->generation & 0xFFFFFF) << 8) | (uintptr_t)freeSlot;
+    gStats.probesStarted++;
+    gStats.running++;
+    pthread_mutex_unlock(&gProbeLock);
+
+    ZSDKPollEngineAddTimedEvent(onProbeTimeout, (void *)token, kZSDKProbeTimeoutMs);
+    *pProbeId = probeId;
+    return ZSDKProbeStarted;
+}
+
+void ZSDKTransportProbeInvalidate(const char * pServer, const char * pProxy)
+{
+    pthread_mutex_lock(&gProbeLock);
+    ZSDKProbeCacheEntry * entry = findEntry(cacheKey(fingerprintLocked(), pServer, pProxy));
+    if (entry)
+    {
+        removeEntry(entry);
+        gStats.invalidations++;
+    }
+    pthread_mutex_unlock(&gProbeLock);
+
+    if (entry)
+        notifyCacheChanged();
+}
+
+//==============================================================================
+//  Settings and persistence
+//==============================================================================
+void ZSDKTransportProbeSetEnabled(BOOL enabled)
+{
+    pthread_mutex_lock(&gProbeLock);
+    gEnabled = enabled;
+    pthread_mutex_unlock(&gProbeLock);
+}
+
+void ZSDKTransportProbeSetNetworkName(const char * pName)
+{
+    pthread_mutex_lock(&gProbeLock);
+    strlcpy(gNetworkName, pName ? pName : "", sizeof(gNetworkName));
+    pthread_mutex_unlock(&gProbeLock);
+}
+
+uint64_t ZSDKTransportProbeFingerprint(void)
+{
+    pthread_mutex_lock(&gProbeLock);
+    uint64_t fingerprint = fingerprintLocked();
+    pthread_mutex_unlock(&gProbeLock);
+    return fingerprint;
+}
+
+int ZSDKTransportProbeExportCache(ZSDKProbeCacheEntry * pOut, int maxEntries)
+{
+    pthread_mutex_lock(&gProbeLock);
+    int count = (gCacheCount < maxEntries) ? gCacheCount : maxEntries;
+    memcpy(pOut, gCache, count * sizeof(*pOut));
+    pthread_mutex_unlock(&gProbeLock);
+    return count;
+}
+
+void ZSDKTransportProbeImportCache(const ZSDKProbeCacheEntry * pEntries, int count)
+{
+    pthread_mutex_lock(&gProbeLock);
+    gCacheCount = 0;
+    for (int i = 0; i < count && gCacheCount < kZSDKProbeCacheEntries; i++)
+    {
+        if (pEntries[i].transport < E_TRANSPORT_COUNT)
+            gCache[gCacheCount++] = pEntries[i];
+    }
+    pthread_mutex_unlock(&gProbeLock);
+}
+
+void ZSDKTransportProbeSetCacheChanged(ZSDKProbeCacheChanged changed)
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        gCacheChanged = changed;
+    });
+}
+
+void ZSDKTransportProbeClearCache(void)
+{
+    pthread_mutex_lock(&gProbeLock);
+    gCacheCount = 0;
+    pthread_mutex_unlock(&gProbeLock);
+    notifyCacheChanged();
+}
+
+void ZSDKTransportProbeGetStats(ZSDKProbeStats * pStats)
+{
+    pthread_mutex_lock(&gProbeLock);
+    *pStats = gStats;
+    pStats->cacheEntries = gCacheCount;
+    pthread_mutex_unlock(&gProbeLock);
+}
+
+//==============================================================================
+//  Callback handlers (poll thread)
+//==============================================================================
+void ZSDKTransportProbeOnState(ProbeHandler probeId, eProbeState_t state)
+{
+    pthread_mutex_lock(&gProbeLock);
+    ZSDKProbe * probe = findProbe(probeId);
+    if (probe)
+        probe->state = state;
+    pthread_mutex_unlock(&gProbeLock);
+}
+
+void ZSDKTransportProbeOnError(ProbeHandler probeId, eProbeState_t state, int causeCode)
+{
+    // The library goes on with the next transport
+    pthread_mutex_lock(&gProbeLock);
+    if (findProbe(probeId))
+        gStats.errors++;
+    pthread_mutex_unlock(&gProbeLock);
+}
+
+void ZSDKTransportProbeOnSuccess(ProbeHandler probeId, eUserTransport_t transport)
+{
+    pthread_mutex_lock(&gProbeLock);
+    ZSDKProbe * probe = findProbe(probeId);
+    if (!probe)
+    {
+        pthread_mutex_unlock(&gProbeLock);
+        return;
+    }
+    gStats.successes++;
+    finishProbe(probe, YES, transport);
+}
+
+void ZSDKTransportProbeOnFailed(ProbeHandler probeId, int causeCode)
+{
+    pthread_mutex_lock(&gProbeLock);
+    ZSDKProbe * probe = findProbe(probeId);
+    if (!probe)
+    {
+        pthread_mutex_unlock(&gProbeLock);
+        return;
+    }
+    gStats.failures++;
+    finishProbe(probe, NO, E_TRANSPORT_UNKNOWN);
+}
@@ -0,0 +1,123 @@
+//
+//  ZSDKUserManager.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Keeps any number of SIP accounts (up to kZSDKMaxUsers) registered.
+//  Initial REGISTERs are released in paced bursts with a cap on the number
+//  of registrations in flight, and every account gets a jittered refresh
+//  period so refreshes do not line up into REGISTER storms.  Per-account
+//  state is driven by the onUser* callbacks.
+//
+//  New accounts first get their transport from ZSDKTransportProbe: cached
+//  per network, or probed while the account waits in ZSDKUserStateProbing.
+//
+//  Library functions are never called with the manager's lock held, since
+//  the callbacks take it on the poll thread.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKMaxUsers                   512
+#define kZSDKUserTableBits              10      // 1024 buckets
+#define kZSDKUserNameLen                64
+#define kZSDKUserServerLen              128
+
+#define kZSDKRegisterBurst              16      // REGISTERs released per pace tick
+#define kZSDKRegisterPaceMs             50
+#define kZSDKRegisterMaxInFlight        64
+#define kZSDKRegistrationTimeDefault    3600    // seconds
+#define kZSDKRegistrationJitterDefault  20      // percent
+
+typedef enum {
+    ZSDKUserStateFree = 0
+,   ZSDKUserStateQueued             // waiting for a pacing slot
+,   ZSDKUserStateRegistering        // RegisterUser() sent
+,   ZSDKUserStateRegistered
+,   ZSDKUserStateRetrying
+,   ZSDKUserStateFailed
+,   ZSDKUserStateUnregistered
+,   ZSDKUserStateProbing            // waiting for the transport probe
+,   ZSDKUserStateAdding             // AddUser() in progress, not reported
+} ZSDKUserState;
+
+typedef struct {
+    UserHandler     userId;
+    int             slot;
+    ZSDKUserState   state;
+    int             registrationSeconds;    // jittered refresh period
+    int             retrySeconds;
+    int             retries;
+    int             causeCode;
+    int             newMsg;
+    int             oldMsg;
+    uint64_t        registerSentUs;
+    uint64_t        registeredUs;
+    char            user[kZSDKUserNameLen];
+    char            server[kZSDKUserServerLen];
+    char            proxy[kZSDKUserServerLen];
+    ProbeHandler    probeId;
+    eUserTransport_t transport;             // E_TRANSPORT_UNKNOWN: library default
+    BOOL            transportCached;
+} ZSDKUser;
+
+typedef struct {
+    int             accounts;
+    int             queued;
+    int             probing;
+    int             inFlight;
+    int             registered;
+    int             failed;
+    uint64_t        registrationLatencyTotalUs;     // RegisterUser() -> onUserRegistered
+    uint64_t        registrationLatencyMaxUs;
+    uint64_t        registrations;
+} ZSDKUserStats;
+
+// Refresh period applied to accounts added afterwards: each account gets
+// baseSeconds minus a random 0..jitterPercent% of it.
+void ZSDKUserManagerSetRegistrationTime(int baseSeconds, int jitterPercent);
+
+// AddUser() + per-account settings; the REGISTER itself is queued and sent by
+// the pacer.  Returns INVALID_HANDLE on failure.
+UserHandler ZSDKUserManagerAdd(const char * pUser, const char * pPass,
+                               const char * pServer, const char * pProxy);
+void ZSDKUserManagerRemove(UserHandler userId);
+
+// Copies the current account records; returns the number copied
+int  ZSDKUserManagerSnapshot(ZSDKUser * pOut, int maxUsers);
+BOOL ZSDKUserManagerIsRegistered(UserHandler userId);
+void ZSDKUserManagerGetStats(ZSDKUserStats * pStats);
+
+// Fed from the WrapperCallbacks handlers
+void ZSDKUserManagerOnRegistered(UserHandler userId, int newMsg, int oldMsg);
+void ZSDKUserManagerOnRetrying(UserHandler userId, int retrySeconds);
+void ZSDKUserManagerOnFailure(UserHandler userId, int isRegister, int causeCode);
+void ZSDKUserManagerOnUnregistered(UserHandler userId);
+
+// Fed from ZSDKTransportProbe; transport is only valid when ok
+void ZSDKUserManagerOnTransportProbed(ProbeHandler probeId, BOOL ok, eUserTransport_t transport);
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+typedef struct {
+    int         accounts;
+    int         registered;
+    double      addNs;              // per ZSDKUserManagerAdd(), transport probing off
+    int         ticks;              // pacer ticks until all were registered
+    double      registerMs;         // those ticks at kZSDKRegisterPaceMs
+    double      tickUs;             // pacer work per tick
+    double      callbackNs;         // per onUserRegistered
+    int         maxInFlight;
+    int         refreshMinSeconds;  // jittered refresh periods handed out
+    int         refreshMaxSeconds;
+} ZSDKUserManagerBenchResult;
+
+// Adds accounts (up to kZSDKMaxUsers) through a stand-in library whose
+// registrar answers every REGISTER four pacer ticks after it was sent, and
+// ticks the pacer until all are registered; then removes them again.  Main
+// thread; returns NO if accounts exist.
+BOOL ZSDKUserManagerBenchmark(int accounts, ZSDKUserManagerBenchResult * pResult);
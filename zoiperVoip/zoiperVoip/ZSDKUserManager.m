@@ -0,0 +1,697 @@
+//
+//  ZSDKUserManager.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKUserManager.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKHandleMap.h"
+#import "ZSDKTransportProbe.h"
+#import <pthread.h>
+
+#define kBenchRegistrarTicks    4       // stand-in registrar answers after 200 ms
+
+// Outcome of a finished probe, for accounts that got its id but were not
+// waiting for it yet
+typedef struct {
+    ProbeHandler        probeId;
+    BOOL                ok;
+    eUserTransport_t    transport;
+} ZSDKProbeResult;
+
+// Library calls are made outside gUserLock: the onUser* callbacks take it on
+// the poll thread, possibly while the library waits for them to return
+static pthread_mutex_t  gUserLock = PTHREAD_MUTEX_INITIALIZER;
+static WrapperContext * gUserCtx = &gWrapperCtx;
+static ZSDKUser         gUsers[kZSDKMaxUsers];
+static BOOL             gUserRemoving[kZSDKMaxUsers];
+static ZSDKHandleBucket gUserBuckets[1 << kZSDKUserTableBits];
+static ZSDKHandleMap    gUserMap;
+static BOOL             gUserTablesReady = NO;
+
+static int              gRegistrationSeconds = kZSDKRegistrationTimeDefault;
+static int              gRegistrationJitter  = kZSDKRegistrationJitterDefault;
+
+static int              gInFlight = 0;
+static int              gPacerCursor = 0;
+static BOOL             gPacerScheduled = NO;
+static uint64_t         gRegistrations = 0;
+static uint64_t         gRegLatencyTotalUs = 0;
+static uint64_t         gRegLatencyMaxUs = 0;
+
+static ZSDKProbeResult  gProbeResults[kZSDKProbeMaxProbes];
+static int              gProbeResultNext = 0;
+static BOOL             gBenchRunning = NO;
+
+static void lockUsers(void)
+{
+    pthread_mutex_lock(&gUserLock);
+    if (!gUserTablesReady)
+    {
+        ZSDKHandleMapInit(&gUserMap, gUserBuckets, kZSDKUserTableBits);
+        for (int i = 0; i < kZSDKProbeMaxProbes; i++)
+            gProbeResults[i].probeId = INVALID_HANDLE;
+        gUserTablesReady = YES;
+    }
+}
+
+static void unlockUsers(void)
+{
+    pthread_mutex_unlock(&gUserLock);
+}
+
+static ZSDKUser * findUser(UserHandler userId)
+{
+    int slot = ZSDKHandleMapFind(&gUserMap, userId);
+    return (slot == ZSDK_HANDLE_MAP_EMPTY) ? NULL : &gUsers[slot];
+}
+
+static void freeUser(ZSDKUser * user)
+{
+    ZSDKHandleMapRemove(&gUserMap, user->userId);
+    gUserRemoving[user->slot] = NO;
+    user->state = ZSDKUserStateFree;
+}
+
+static int jitteredRegistrationTime(void)
+{
+    int spread = gRegistrationSeconds * gRegistrationJitter / 100;
+    return gRegistrationSeconds - (spread > 0 ? (int)arc4random_uniform(spread + 1) : 0);
+}
+
+//==============================================================================
+//  Registration pacer
+//==============================================================================
+static void schedulePacer(long delayMs);
+static void registrationSettled(ZSDKUser * user);
+
+// Moves up to kZSDKRegisterBurst queued accounts to Registering while
+// keeping at most kZSDKRegisterMaxInFlight outstanding; their ids go to
+// pIds for sendRegistrations().  Expects the lock to be held.
+static int takeQueued(UserHandler * pIds)
+{
+    int released = 0;
+    BOOL pending = NO;
+    for (int n = 0; n < kZSDKMaxUsers; n++)
+    {
+        ZSDKUser * user = &gUsers[gPacerCursor];
+        if (user->state == ZSDKUserStateQueued)
+        {
+            if (released == kZSDKRegisterBurst || gInFlight >= kZSDKRegisterMaxInFlight)
+            {
+                pending = YES;
+                break;
+            }
+            user->state = ZSDKUserStateRegistering;
+            user->registerSentUs = ZSDKMonotonicMicros();
+            pIds[released++] = user->userId;
+            gInFlight++;
+        }
+        gPacerCursor = (gPacerCursor + 1) % kZSDKMaxUsers;
+    }
+
+    // When capped by in-flight registrations the completions reschedule us
+    if (pending && gInFlight < kZSDKRegisterMaxInFlight)
+        schedulePacer(kZSDKRegisterPaceMs);
+    return released;
+}
+
+static void sendRegistrations(const UserHandler * pIds, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (gUserCtx->RegisterUser(pIds[i]) == L_OK)
+            continue;
+
+        lockUsers();
+        ZSDKUser * user = findUser(pIds[i]);
+        if (user && user->state == ZSDKUserStateRegistering)
+        {
+            registrationSettled(user);
+            user->state = ZSDKUserStateFailed;
+        }
+        unlockUsers();
+    }
+}
+
+// Runs on the poll thread
+static void onPacerTick( void * pUserData )
+{
+    UserHandler ids[kZSDKRegisterBurst];
+    lockUsers();
+    gPacerScheduled = NO;
+    int count = gBenchRunning ? 0 : takeQueued(ids);
+    unlockUsers();
+
+    sendRegistrations(ids, count);
+}
+
+// Expects the lock to be held; the benchmark ticks the pacer itself
+static void schedulePacer(long delayMs)
+{
+    if (gPacerScheduled || gBenchRunning)
+        return;
+    gPacerScheduled = YES;
+    ZSDKPollEngineAddTimedEvent(onPacerTick, NULL, delayMs);
+}
+
+// The cached transport did not work out; probe again next time
+static void transportFailed(ZSDKUser * user)
+{
+    if (!user->transportCached)
+        return;
+    user->transportCached = NO;
+    ZSDKTransportProbeInvalidate(user->server, user->proxy);
+}
+
+// A registration left the in-flight window; expects the lock to be held
+static void registrationSettled(ZSDKUser * user)
+{
+    if (user->state == ZSDKUserStateRegistering && gInFlight > 0)
+        gInFlight--;
+    schedulePacer(kZSDKRegisterPaceMs);
+}
+
+//==============================================================================
+//  Transports
+//==============================================================================
+// Expects the lock to be held
+static void rememberProbe(ProbeHandler probeId, BOOL ok, eUserTransport_t transport)
+{
+    ZSDKProbeResult * result = &gProbeResults[gProbeResultNext];
+    gProbeResultNext = (gProbeResultNext + 1) % kZSDKProbeMaxProbes;
+    result->probeId   = probeId;
+    result->ok        = ok;
+    result->transport = transport;
+}
+
+static const ZSDKProbeResult * findProbe(ProbeHandler probeId)
+{
+    for (int i = 0; i < kZSDKProbeMaxProbes; i++)
+    {
+        if (gProbeResults[i].probeId == probeId)
+            return &gProbeResults[i];
+    }
+    return NULL;
+}
+
+// The accounts wait in Probing with no probe id while SetUserTransport()
+// runs, then go to the pacer
+static void applyTransport(const UserHandler * pIds, int count, eUserTransport_t transport)
+{
+    for (int i = 0; i < count; i++)
+        gUserCtx->SetUserTransport(pIds[i], transport);
+
+    lockUsers();
+    for (int i = 0; i < count; i++)
+    {
+        ZSDKUser * user = findUser(pIds[i]);
+        if (user && user->state == ZSDKUserStateProbing && user->probeId == INVALID_HANDLE)
+            user->state = ZSDKUserStateQueued;
+    }
+    schedulePacer(0);
+    unlockUsers();
+}
+
+//==============================================================================
+//  Account management
+//==============================================================================
+void ZSDKUserManagerSetRegistrationTime(int baseSeconds, int jitterPercent)
+{
+    lockUsers();
+    gRegistrationSeconds = baseSeconds;
+    gRegistrationJitter  = (jitterPercent < 0) ? 0 : (jitterPercent > 90 ? 90 : jitterPercent);
+    unlockUsers();
+}
+
+static UserHandler addUser(const char * pUser, const char * pPass,
+                           const char * pServer, const char * pProxy, BOOL probe)
+{
+    lockUsers();
+    int slot = -1;
+    for (int i = 0; i < kZSDKMaxUsers; i++)
+    {
+        if (gUsers[i].state == ZSDKUserStateFree)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+    {
+        unlockUsers();
+        NSLog(@"ZOIPER: user table full");
+        return INVALID_HANDLE;
+    }
+
+    ZSDKUser * user = &gUsers[slot];
+    memset(user, 0, sizeof(*user));
+    user->userId  = INVALID_HANDLE;
+    user->slot    = slot;
+    user->state   = ZSDKUserStateAdding;
+    user->newMsg  = -1;
+    user->oldMsg  = -1;
+    user->probeId = INVALID_HANDLE;
+    user->registrationSeconds = jitteredRegistrationTime();
+    strlcpy(user->user, pUser ? pUser : "", sizeof(user->user));
+    strlcpy(user->server, pServer ? pServer : "", sizeof(user->server));
+    strlcpy(user->proxy, pProxy ? pProxy : "", sizeof(user->proxy));
+    user->transport = E_TRANSPORT_UNKNOWN;
+    int registrationSeconds = user->registrationSeconds;
+    unlockUsers();
+
+    UserHandler userId = gUserCtx->AddUser(PROTO_SIP, pUser, pPass, pProxy, pServer, "", "");
+    if (userId == INVALID_HANDLE)
+    {
+        lockUsers();
+        user->state = ZSDKUserStateFree;
+        unlockUsers();
+        return INVALID_HANDLE;
+    }
+    gUserCtx->SetUserDtmfBand(userId, E_DTMF_MEDIA_OUTBAND);
+    gUserCtx->SetUserRegistrationTime(userId, registrationSeconds);
+
+    eUserTransport_t transport = E_TRANSPORT_UNKNOWN;
+    ProbeHandler probeId = INVALID_HANDLE;
+    ZSDKProbeLookup lookup = ZSDKProbeUnavailable;
+    if (probe)
+        lookup = ZSDKTransportProbeLookup(pServer, pProxy, pUser, pPass, &transport, &probeId);
+    if (lookup == ZSDKProbeCached)
+        gUserCtx->SetUserTransport(userId, transport);
+
+    lockUsers();
+    user->userId = userId;
+    ZSDKHandleMapInsert(&gUserMap, userId, slot);
+    BOOL apply = NO;
+    switch (lookup)
+    {
+        case ZSDKProbeCached:
+            user->transport       = transport;
+            user->transportCached = YES;
+            user->state           = ZSDKUserStateQueued;
+            schedulePacer(0);
+            break;
+        case ZSDKProbeStarted:
+        {
+            // The probe may have finished before the account was waiting for it
+            const ZSDKProbeResult * result = findProbe(probeId);
+            user->state   = ZSDKUserStateProbing;
+            user->probeId = result ? INVALID_HANDLE : probeId;
+            if (result && result->ok)
+            {
+                transport       = result->transport;
+                user->transport = transport;
+                apply = YES;
+            }
+            else if (result)
+            {
+                user->state = ZSDKUserStateQueued;
+                schedulePacer(0);
+            }
+            break;
+        }
+        case ZSDKProbeUnavailable:
+            user->state = ZSDKUserStateQueued;
+            schedulePacer(0);
+            break;
+    }
+    unlockUsers();
+
+    if (apply)
+        applyTransport(&userId, 1, transport);
+    return userId;
+}
+
+UserHandler ZSDKUserManagerAdd(const char * pUser, const char * pPass,
+                               const char * pServer, const char * pProxy)
+{
+    return addUser(pUser, pPass, pServer, pProxy, YES);
+}
+
+void ZSDKUserManagerRemove(UserHandler userId)
+{
+    BOOL remove = NO, unregister = NO;
+    lockUsers();
+    ZSDKUser * user = findUser(userId);
+    if (user)
+    {
+        if (user->state == ZSDKUserStateQueued || user->state == ZSDKUserStateProbing ||
+            user->state == ZSDKUserStateFailed || user->state == ZSDKUserStateUnregistered)
+        {
+            freeUser(user);
+            remove = YES;
+        }
+        else
+        {
+            // Finished in onUserUnregistered / unregistration failure
+            if (user->state == ZSDKUserStateRegistering && gInFlight > 0)
+                gInFlight--;
+            user->state = ZSDKUserStateUnregistered;
+            gUserRemoving[user->slot] = YES;
+            unregister = YES;
+        }
+    }
+    unlockUsers();
+
+    if (remove)
+        gUserCtx->RemoveUser(userId);
+    else if (unregister)
+        gUserCtx->UnregisterUser(userId);
+}
+
+int ZSDKUserManagerSnapshot(ZSDKUser * pOut, int maxUsers)
+{
+    int n = 0;
+    lockUsers();
+    for (int i = 0; i < kZSDKMaxUsers && n < maxUsers; i++)
+    {
+        if (gUsers[i].state != ZSDKUserStateFree && gUsers[i].state != ZSDKUserStateAdding)
+            pOut[n++] = gUsers[i];
+    }
+    unlockUsers();
+    return n;
+}
+
+BOOL ZSDKUserManagerIsRegistered(UserHandler userId)
+{
+    lockUsers();
+    ZSDKUser * user = findUser(userId);
+    BOOL registered = user && user->state == ZSDKUserStateRegistered;
+    unlockUsers();
+    return registered;
+}
+
+void ZSDKUserManagerGetStats(ZSDKUserStats * pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    lockUsers();
+    for (int i = 0; i < kZSDKMaxUsers; i++)
+    {
+        switch (gUsers[i].state)
+        {
+            case ZSDKUserStateFree:         continue;
+            case ZSDKUserStateAdding:       continue;
+            case ZSDKUserStateQueued:       pStats->queued++;       break;
+            case ZSDKUserStateProbing:      pStats->probing++;      break;
+            case ZSDKUserStateRegistered:   pStats->registered++;   break;
+            case ZSDKUserStateFailed:       pStats->failed++;       break;
+            default:                                                break;
+        }
+        pStats->accounts++;
+    }
+    pStats->inFlight                   = gInFlight;
+    pStats->registrations              = gRegistrations;
+    pStats->registrationLatencyTotalUs = gRegLatencyTotalUs;
+    pStats->registrationLatencyMaxUs   = gRegLatencyMaxUs;
+    unlockUsers();
+}
+
+//==============================================================================
+//  Callback handlers (poll thread)
+//==============================================================================
+void ZSDKUserManagerOnRegistered(UserHandler userId, int newMsg, int oldMsg)
+{
+    BOOL unregister = NO;
+    lockUsers();
+    ZSDKUser * user = findUser(userId);
+    if (user)
+    {
+        if (user->state == ZSDKUserStateRegistering)
+        {
+            uint64_t now = ZSDKMonotonicMicros();
+            uint64_t latency = now - user->registerSentUs;
+            gRegistrations++;
+            gRegLatencyTotalUs += latency;
+            if (latency > gRegLatencyMaxUs)
+                gRegLatencyMaxUs = latency;
+        }
+        registrationSettled(user);
+        user->newMsg = newMsg;
+        user->oldMsg = oldMsg;
+        if (gUserRemoving[user->slot])
+        {
+            // Removed while its REGISTER was on the way out
+            unregister = YES;
+        }
+        else
+        {
+            user->state        = ZSDKUserStateRegistered;
+            user->registeredUs = ZSDKMonotonicMicros();
+            user->retries      = 0;
+        }
+    }
+    unlockUsers();
+
+    if (unregister)
+        gUserCtx->UnregisterUser(userId);
+}
+
+void ZSDKUserManagerOnRetrying(UserHandler userId, int retrySeconds)
+{
+    lockUsers();
+    ZSDKUser * user = findUser(userId);
+    if (user && !gUserRemoving[user->slot])
+    {
+        // The library retries on its own; free the window for the others
+        registrationSettled(user);
+        transportFailed(user);
+        user->state        = ZSDKUserStateRetrying;
+        user->retrySeconds = retrySeconds;
+        user->retries++;
+    }
+    unlockUsers();
+}
+
+// Frees a removed account's record; the caller then calls RemoveUser()
+// outside the lock.  Expects the lock to be held.
+static BOOL finishRemoval(ZSDKUser * user)
+{
+    if (!gUserRemoving[user->slot])
+        return NO;
+    freeUser(user);
+    return YES;
+}
+
+void ZSDKUserManagerOnFailure(UserHandler userId, int isRegister, int causeCode)
+{
+    BOOL remove = NO;
+    lockUsers();
+    ZSDKUser * user = findUser(userId);
+    if (user)
+    {
+        registrationSettled(user);
+        if (isRegister)
+            transportFailed(user);
+        user->causeCode = causeCode;
+        remove = finishRemoval(user);
+        if (!remove)
+            user->state = ZSDKUserStateFailed;
+    }
+    unlockUsers();
+
+    if (remove)
+        gUserCtx->RemoveUser(userId);
+}
+
+void ZSDKUserManagerOnUnregistered(UserHandler userId)
+{
+    BOOL remove = NO;
+    lockUsers();
+    ZSDKUser * user = findUser(userId);
+    if (user)
+    {
+        remove = finishRemoval(user);
+        if (!remove)
+            user->state = ZSDKUserStateUnregistered;
+    }
+    unlockUsers();
+
+    if (remove)
+        gUserCtx->RemoveUser(userId);
+}
+
+void ZSDKUserManagerOnTransportProbed(ProbeHandler probeId, BOOL ok, eUserTransport_t transport)
+{
+    static UserHandler ids[kZSDKMaxUsers];      // poll thread only
+    int count = 0;
+
+    lockUsers();
+    rememberProbe(probeId, ok, transport);
+    BOOL released = NO;
+    for (int i = 0; i < kZSDKMaxUsers; i++)
+    {
+        ZSDKUser * user = &gUsers[i];
+        if (user->state != ZSDKUserStateProbing || user->probeId != probeId)
+            continue;
+        user->probeId = INVALID_HANDLE;
+        // On failure the account registers with the library default
+        if (ok)
+        {
+            user->transport = transport;
+            ids[count++] = user->userId;
+        }
+        else
+        {
+            user->state = ZSDKUserStateQueued;
+            released = YES;
+        }
+    }
+    if (released)
+        schedulePacer(0);
+    unlockUsers();
+
+    if (count > 0)
+        applyTransport(ids, count, transport);
+}
+
+//==============================================================================
+//  Benchmark
+//==============================================================================
+static WrapperContext   gBenchCtx;
+static UserHandler      gBenchNextUser;
+static UserHandler      gBenchSent[kZSDKMaxUsers];     // REGISTERs the registrar holds
+static int              gBenchSentTick[kZSDKMaxUsers];
+static int              gBenchSentHead;
+static int              gBenchSentCount;
+static int              gBenchTick;
+static int              gBenchRefreshMin;
+static int              gBenchRefreshMax;
+
+static UserHandler benchAddUser(ProtoType_t proto, const char * pName, const char * pPassword,
+                                const char * pProxy, const char * pRealm, const char * pCallerId,
+                                const char * pCallerNumber)
+{
+    return gBenchNextUser++;
+}
+
+static LIBRESULT benchRegisterUser(UserHandler userId)
+{
+    int index = (gBenchSentHead + gBenchSentCount) % kZSDKMaxUsers;
+    gBenchSent[index]     = userId;
+    gBenchSentTick[index] = gBenchTick;
+    gBenchSentCount++;
+    return L_OK;
+}
+
+static LIBRESULT benchUser(UserHandler userId)
+{
+    return L_OK;
+}
+
+static LIBRESULT benchSetUserDtmfBand(UserHandler userId, eDtmfBand_t band)
+{
+    return L_OK;
+}
+
+static LIBRESULT benchSetUserRegistrationTime(UserHandler userId, int seconds)
+{
+    if (gBenchRefreshMin == 0 || seconds < gBenchRefreshMin)
+        gBenchRefreshMin = seconds;
+    if (seconds > gBenchRefreshMax)
+        gBenchRefreshMax = seconds;
+    return L_OK;
+}
+
+BOOL ZSDKUserManagerBenchmark(int accounts, ZSDKUserManagerBenchResult * pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    if (accounts <= 0 || accounts > kZSDKMaxUsers)
+        return NO;
+
+    UserHandler * ids = malloc(accounts * sizeof(UserHandler));
+    if (!ids)
+        return NO;
+
+    lockUsers();
+    BOOL busy = gBenchRunning;
+    for (int i = 0; i < kZSDKMaxUsers && !busy; i++)
+        busy = gUsers[i].state != ZSDKUserStateFree;
+    if (busy)
+    {
+        unlockUsers();
+        free(ids);
+        return NO;
+    }
+    memset(&gBenchCtx, 0, sizeof(gBenchCtx));
+    gBenchCtx.AddUser                 = benchAddUser;
+    gBenchCtx.RegisterUser            = benchRegisterUser;
+    gBenchCtx.UnregisterUser          = benchUser;
+    gBenchCtx.RemoveUser              = benchUser;
+    gBenchCtx.SetUserDtmfBand         = benchSetUserDtmfBand;
+    gBenchCtx.SetUserRegistrationTime = benchSetUserRegistrationTime;
+    gBenchNextUser   = 0x10000;
+    gBenchSentHead   = gBenchSentCount = gBenchTick = 0;
+    gBenchRefreshMin = gBenchRefreshMax = 0;
+    uint64_t savedRegistrations = gRegistrations;
+    uint64_t savedLatencyTotal  = gRegLatencyTotalUs;
+    uint64_t savedLatencyMax    = gRegLatencyMaxUs;
+    gUserCtx      = &gBenchCtx;
+    gBenchRunning = YES;
+    unlockUsers();
+
+    char name[kZSDKUserNameLen];
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int i = 0; i < accounts; i++)
+    {
+        snprintf(name, sizeof(name), "%d", 10000 + i);
+        ids[i] = addUser(name, "bench", "registrar.invalid", "", NO);
+    }
+    pResult->addNs = (double)(ZSDKMonotonicMicros() - startUs) * 1000.0 / accounts;
+
+    // Pacer ticks; the registrar answers each REGISTER kBenchRegistrarTicks later
+    int registered = 0;
+    uint64_t tickUs = 0, callbackUs = 0;
+    while (registered < accounts && gBenchTick < accounts * kBenchRegistrarTicks + 100)
+    {
+        UserHandler batch[kZSDKRegisterBurst];
+        startUs = ZSDKMonotonicMicros();
+        lockUsers();
+        int count = takeQueued(batch);
+        if (gInFlight > pResult->maxInFlight)
+            pResult->maxInFlight = gInFlight;
+        unlockUsers();
+        sendRegistrations(batch, count);
+        tickUs += ZSDKMonotonicMicros() - startUs;
+        gBenchTick++;
+
+        startUs = ZSDKMonotonicMicros();
+        while (gBenchSentCount > 0 && gBenchTick - gBenchSentTick[gBenchSentHead] >= kBenchRegistrarTicks)
+        {
+            ZSDKUserManagerOnRegistered(gBenchSent[gBenchSentHead], 0, 0);
+            gBenchSentHead = (gBenchSentHead + 1) % kZSDKMaxUsers;
+            gBenchSentCount--;
+            registered++;
+        }
+        callbackUs += ZSDKMonotonicMicros() - startUs;
+    }
+
+    pResult->accounts          = accounts;
+    pResult->registered        = registered;
+    pResult->ticks             = gBenchTick;
+    pResult->registerMs        = (double)gBenchTick * kZSDKRegisterPaceMs;
+    pResult->tickUs            = (double)tickUs / gBenchTick;
+    pResult->callbackNs        = registered ? (double)callbackUs * 1000.0 / registered : 0;
+    pResult->refreshMinSeconds = gBenchRefreshMin;
+    pResult->refreshMaxSeconds = gBenchRefreshMax;
+
+    for (int i = 0; i < accounts; i++)
+    {
+        ZSDKUserManagerRemove(ids[i]);
+        ZSDKUserManagerOnUnregistered(ids[i]);
+    }
+
+    lockUsers();
+    gInFlight          = 0;
+    gRegistrations     = savedRegistrations;
+    gRegLatencyTotalUs = savedLatencyTotal;
+    gRegLatencyMaxUs   = savedLatencyMax;
+    gUserCtx           = &gWrapperCtx;
+    gBenchRunning      = NO;
+    unlockUsers();
+
+    free(ids);
+    return registered == accounts;
+}
@@ -0,0 +1,66 @@
+//
+//  ZSDKVideoReceiver.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Receive side of video calls.  A per-call CallSetVideoFrameIYUVCbk() hook
+//  copies each decoded frame once, plane by plane, into a refcounted buffer
+//  from a fixed pool and publishes it in the call's single-entry mailbox.
+//  Renderers take the latest frame, read the planes in place and release
+//  it.  A frame that is still in the mailbox when the next one arrives is
+//  dropped (latest wins), so a slow renderer never builds up a queue.
+//
+//  Each call slot has its own kZSDKVideoFramesPerCall buffers, enough for
+//  the mailbox plus two frames held by the renderer.  A renderer holding
+//  more only starves its own call; other calls never lose frames to it.
+//  Buffer storage is allocated on first use and freed when the call's
+//  video stops.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+
+#define kZSDKVideoFramesPerCall     3
+#define kZSDKVideoAlignment         64
+
+typedef struct ZSDKVideoFrame {
+    CallHandler         callId;
+    int                 width;
+    int                 height;
+    const uint8_t *     planes[3];      // Y, U, V
+    int                 strides[3];
+    uint64_t            sequence;       // per call, starting at 1
+    uint64_t            timestampUs;    // when the decoder handed it over
+    // Pool bookkeeping
+    int                 refCount;
+    int                 slot;           // call slot owning the buffer
+    size_t              capacity;
+    uint8_t *           storage;
+    struct ZSDKVideoFrame * nextFree;
+} ZSDKVideoFrame;
+
+typedef struct {
+    uint64_t            framesReceived;
+    uint64_t            framesDelivered;    // taken by a renderer
+    uint64_t            framesDropped;      // overwritten or no free buffer
+    uint64_t            copyBytes;
+} ZSDKVideoReceiveStats;
+
+// Install / remove the per-call frame hook (from onVideoStarted/Stopped)
+void ZSDKVideoReceiverAttach(CallHandler callId, int callSlot);
+void ZSDKVideoReceiverDetach(CallHandler callId, int callSlot);
+
+// Latest frame of the call, or NULL if none arrived since the last take.
+// The caller owns one reference and must ZSDKVideoFrameRelease() it.
+ZSDKVideoFrame * ZSDKVideoReceiverTakeFrame(int callSlot);
+
+void ZSDKVideoFrameRetain(ZSDKVideoFrame * pFrame);
+void ZSDKVideoFrameRelease(ZSDKVideoFrame * pFrame);
+
+// Optional hint, called on the video thread whenever a new frame is ready
+typedef void (* pfZSDKVideoFrameReady)( CallHandler callId, int callSlot, void * pUserData );
+void ZSDKVideoReceiverSetFrameReadyCbk(pfZSDKVideoFrameReady pCbk, void * pUserData);
+
+void ZSDKVideoReceiverGetStats(int callSlot, ZSDKVideoReceiveStats * pStats);
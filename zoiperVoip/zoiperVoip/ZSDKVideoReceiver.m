@@ -0,0 +1,254 @@
+//
+//  ZSDKVideoReceiver.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKVideoReceiver.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import <pthread.h>
+
+typedef struct {
+    CallHandler             callId;         // INVALID_HANDLE when detached
+    ZSDKVideoFrame *        mailbox;        // latest unrendered frame
+    uint64_t                sequence;
+    ZSDKVideoReceiveStats   stats;
+} ZSDKVideoCallReceiver;
+
+static ZSDKVideoCallReceiver    gReceivers[kZSDKMaxCalls];
+static ZSDKVideoFrame           gFrames[kZSDKMaxCalls][kZSDKVideoFramesPerCall];
+static ZSDKVideoFrame *         gFreeFrames[kZSDKMaxCalls];
+static BOOL                     gPoolReady = NO;
+static pthread_mutex_t          gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pfZSDKVideoFrameReady    gFrameReadyCbk = NULL;
+static void *                   gFrameReadyData = NULL;
+
+#define STAT_ADD(rx, field, v)  __atomic_fetch_add(&(rx)->stats.field, (v), __ATOMIC_RELAXED)
+
+//==============================================================================
+//  Frame pool (one free list per call slot)
+//==============================================================================
+// Expects gPoolLock
+static void preparePool(void)
+{
+    if (gPoolReady)
+        return;
+    for (int slot = 0; slot < kZSDKMaxCalls; slot++)
+    {
+        for (int i = kZSDKVideoFramesPerCall - 1; i >= 0; i--)
+        {
+            gFrames[slot][i].slot     = slot;
+            gFrames[slot][i].nextFree = gFreeFrames[slot];
+            gFreeFrames[slot] = &gFrames[slot][i];
+        }
+    }
+    gPoolReady = YES;
+}
+
+static ZSDKVideoFrame * acquireFrame(int slot)
+{
+    pthread_mutex_lock(&gPoolLock);
+    preparePool();
+    ZSDKVideoFrame * frame = gFreeFrames[slot];
+    if (frame)
+        gFreeFrames[slot] = frame->nextFree;
+    pthread_mutex_unlock(&gPoolLock);
+
+    if (frame)
+        frame->refCount = 1;
+    return frame;
+}
+
+void ZSDKVideoFrameRetain(ZSDKVideoFrame * pFrame)
+{
+    __atomic_fetch_add(&pFrame->refCount, 1, __ATOMIC_RELAXED);
+}
+
+void ZSDKVideoFrameRelease(ZSDKVideoFrame * pFrame)
+{
+    if (!pFrame || __atomic_sub_fetch(&pFrame->refCount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    // Storage is kept for reuse; it only grows when the resolution does
+    pthread_mutex_lock(&gPoolLock);
+    pFrame->nextFree = gFreeFrames[pFrame->slot];
+    gFreeFrames[pFrame->slot] = pFrame;
+    pthread_mutex_unlock(&gPoolLock);
+}
+
+// Frees the storage of the slot's idle buffers; frames still held by a
+// renderer keep theirs until they come back and are reused
+static void trimSlot(int slot)
+{
+    pthread_mutex_lock(&gPoolLock);
+    for (ZSDKVideoFrame * frame = gFreeFrames[slot]; frame; frame = frame->nextFree)
+    {
+        free(frame->storage);
+        frame->storage  = NULL;
+        frame->capacity = 0;
+    }
+    pthread_mutex_unlock(&gPoolLock);
+}
+
+static BOOL reserveStorage(ZSDKVideoFrame * frame, size_t bytes)
+{
+    if (frame->capacity >= bytes)
+        return YES;
+
+    void * storage = NULL;
+    if (posix_memalign(&storage, kZSDKVideoAlignment, bytes) != 0)
+        return NO;
+    free(frame->storage);
+    frame->storage  = storage;
+    frame->capacity = bytes;
+    return YES;
+}
+
+static inline size_t alignUp(size_t v)
+{
+    return (v + kZSDKVideoAlignment - 1) & ~(size_t)(kZSDKVideoAlignment - 1);
+}
+
+//==============================================================================
+//  Frame hook (video processing thread)
+//==============================================================================
+static void onVideoFrame( CallHandler callId, void * pUserData, int width, int height,
+                          const unsigned char * y_plane, const unsigned char * u_plane,
+                          const unsigned char * v_plane,
+                          int y_linesize, int u_linesize, int v_linesize )
+{
+    ZSDKVideoCallReceiver * rx = (ZSDKVideoCallReceiver *)pUserData;
+    if (__atomic_load_n(&rx->callId, __ATOMIC_ACQUIRE) != callId)
+        return;
+
+    STAT_ADD(rx, framesReceived, 1);
+
+    int slot = (int)(rx - gReceivers);
+    ZSDKVideoFrame * frame = acquireFrame(slot);
+    if (!frame)
+    {
+        // The renderer holds the call's other buffers; reclaim the
+        // unrendered one if any
+        ZSDKVideoFrame * stale = __atomic_exchange_n(&rx->mailbox, NULL, __ATOMIC_ACQ_REL);
+        if (stale)
+        {
+            STAT_ADD(rx, framesDropped, 1);
+            ZSDKVideoFrameRelease(stale);
+            frame = acquireFrame(slot);
+        }
+        if (!frame)
+        {
+            STAT_ADD(rx, framesDropped, 1);
+            return;
+        }
+    }
+
+    // Keep the decoder's line sizes so every plane is one contiguous memcpy
+    int chromaHeight = (height + 1) / 2;
+    size_t ySize = (size_t)y_linesize * height;
+    size_t uSize = (size_t)u_linesize * chromaHeight;
+    size_t vSize = (size_t)v_linesize * chromaHeight;
+    size_t uOffset = alignUp(ySize);
+    size_t vOffset = uOffset + alignUp(uSize);
+    if (!reserveStorage(frame, vOffset + vSize))
+    {
+        ZSDKVideoFrameRelease(frame);
+        STAT_ADD(rx, framesDropped, 1);
+        return;
+    }
+
+    memcpy(frame->storage, y_plane, ySize);
+    memcpy(frame->storage + uOffset, u_plane, uSize);
+    memcpy(frame->storage + vOffset, v_plane, vSize);
+
+    frame->callId      = callId;
+    frame->width       = width;
+    frame->height      = height;
+    frame->planes[0]   = frame->storage;
+    frame->planes[1]   = frame->storage + uOffset;
+    frame->planes[2]   = frame->storage + vOffset;
+    frame->strides[0]  = y_linesize;
+    frame->strides[1]  = u_linesize;
+    frame->strides[2]  = v_linesize;
+    frame->sequence    = ++rx->sequence;
+    frame->timestampUs = ZSDKMonotonicMicros();
+    STAT_ADD(rx, copyBytes, ySize + uSize + vSize);
+
+    ZSDKVideoFrame * previous = __atomic_exchange_n(&rx->mailbox, frame, __ATOMIC_ACQ_REL);
+    if (previous)
+    {
+        STAT_ADD(rx, framesDropped, 1);
+        ZSDKVideoFrameRelease(previous);
+    }
+
+    if (gFrameReadyCbk)
+        gFrameReadyCbk(callId, slot, gFrameReadyData);
+}
+
+//==============================================================================
+//  Public interface
+//==============================================================================
+void ZSDKVideoReceiverAttach(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallReceiver * rx = &gReceivers[callSlot];
+    ZSDKVideoFrameRelease(__atomic_exchange_n(&rx->mailbox, NULL, __ATOMIC_ACQ_REL));
+    memset(&rx->stats, 0, sizeof(rx->stats));
+    rx->sequence = 0;
+    __atomic_store_n(&rx->callId, callId, __ATOMIC_RELEASE);
+
+    if (gWrapperCtx.CallSetVideoFrameIYUVCbk(callId, onVideoFrame, rx) != L_OK)
+        NSLog(@"ZOIPER: CallSetVideoFrameIYUVCbk failed for call %lu", callId);
+}
+
+void ZSDKVideoReceiverDetach(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallReceiver * rx = &gReceivers[callSlot];
+    if (rx->callId != callId)
+        return;
+
+    gWrapperCtx.CallSetVideoFrameIYUVCbk(callId, NULL, NULL);
+    __atomic_store_n(&rx->callId, INVALID_HANDLE, __ATOMIC_RELEASE);
+    ZSDKVideoFrameRelease(__atomic_exchange_n(&rx->mailbox, NULL, __ATOMIC_ACQ_REL));
+    trimSlot(callSlot);
+}
+
+ZSDKVideoFrame * ZSDKVideoReceiverTakeFrame(int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NULL;
+
+    ZSDKVideoCallReceiver * rx = &gReceivers[callSlot];
+    ZSDKVideoFrame * frame = __atomic_exchange_n(&rx->mailbox, NULL, __ATOMIC_ACQ_REL);
+    if (frame)
+        STAT_ADD(rx, framesDelivered, 1);
+    return frame;
+}
+
+void ZSDKVideoReceiverSetFrameReadyCbk(pfZSDKVideoFrameReady pCbk, void * pUserData)
+{
+    gFrameReadyData = pUserData;
+    gFrameReadyCbk  = pCbk;
+}
+
+void ZSDKVideoReceiverGetStats(int callSlot, ZSDKVideoReceiveStats * pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallReceiver * rx = &gReceivers[callSlot];
+    pStats->framesReceived  = __atomic_load_n(&rx->stats.framesReceived, __ATOMIC_RELAXED);
+    pStats->framesDelivered = __atomic_load_n(&rx->stats.framesDelivered, __ATOMIC_RELAXED);
+    pStats->framesDropped   = __atomic_load_n(&rx->stats.framesDropped, __ATOMIC_RELAXED);
+    pStats->copyBytes       = __atomic_load_n(&rx->stats.copyBytes, __ATOMIC_RELAXED);
+}
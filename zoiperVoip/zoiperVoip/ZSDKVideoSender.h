@@ -0,0 +1,71 @@
+//
+//  ZSDKVideoSender.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Send side of video calls.  Capture sources submit frames from their own
+//  thread; each accepted frame is converted straight into a buffer from a
+//  fixed pool and parked in the call's single pending slot.  A dedicated
+//  sender thread hands pending frames to VideoSendFrame2().
+//
+//  Frames are skipped instead of queued when
+//    - they arrive ahead of the fps negotiated in onVideoFormatSelected,
+//    - no pool buffer is free or the pending one was not sent yet,
+//    - the sender is lagging (an adaptive 1-of-N skip, relaxed again once
+//      submissions keep up),
+//  so memory is bounded by the pool and latency by one frame interval.
+//
+//  One capture source per call: the submit functions of a call must not
+//  run concurrently.
+//
+
+#import <Foundation/Foundation.h>
+#import "wrapper_defs.h"
+#import "wrapper.h"
+#import "ZSDKColorConvert.h"
+
+#define kZSDKVideoSendPoolSize      6
+#define kZSDKVideoSendDefaultFps    15
+#define kZSDKVideoSendMaxSkip       3       // at most 3 of 4 due frames skipped
+
+typedef struct {
+    uint64_t    framesSubmitted;
+    uint64_t    framesSent;
+    uint64_t    droppedPacing;      // ahead of the negotiated frame rate
+    uint64_t    droppedBusy;        // no free buffer or superseded unsent
+    uint64_t    droppedLag;         // skipped by the lag backoff
+    uint64_t    sendErrors;
+    uint64_t    sendLatencyMaxUs;   // duration of VideoSendFrame2()
+    uint64_t    queueLatencyMaxUs;  // submit to VideoSendFrame2()
+    int         width;              // negotiated, 0 = as captured
+    int         height;
+    float       fps;
+    int         bitrate;            // set by rate control, 0 = default
+    int         skip;               // current lag backoff
+} ZSDKVideoSendStats;
+
+// From onVideoStarted / onVideoStopped / call end
+void ZSDKVideoSenderAttach(CallHandler callId, int callSlot, void * pThreadId);
+void ZSDKVideoSenderDetach(CallHandler callId, int callSlot);
+
+// From every onVideoStopped, whether or not the call is still known (the
+// hangup usually comes first): VideoSendFrame(pThreadId, 0, 0) releases the
+// video thread's resources.  Call without the registry lock.
+void ZSDKVideoSenderRelease(void * pThreadId);
+
+// From onVideoFormatSelected; may arrive before or after Attach
+void ZSDKVideoSenderSetFormat(CallHandler callId, int callSlot, int width, int height, float fps);
+
+// Re-creates the call's encoder (VideoResetEncoder) and scales/paces
+// captured frames to match; used by the rate controller
+void ZSDKVideoSenderReconfigure(CallHandler callId, int callSlot, int width, int height,
+                                float fps, int bitrate);
+
+// Capture side.  Return NO when the frame was skipped.
+BOOL ZSDKVideoSenderSubmitI420(int callSlot, const ZSDKI420Planes * pPlanes, int width, int height);
+BOOL ZSDKVideoSenderSubmitNV12(int callSlot, const uint8_t * pY, int yStride,
+                               const uint8_t * pUV, int uvStride, int width, int height);
+BOOL ZSDKVideoSenderSubmitBGRA(int callSlot, const uint8_t * pBGRA, int stride, int width, int height);
+
+void ZSDKVideoSenderGetStats(int callSlot, ZSDKVideoSendStats * pStats);
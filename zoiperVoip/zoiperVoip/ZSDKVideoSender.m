@@ -0,0 +1,509 @@
+//
+//  ZSDKVideoSender.m
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKVideoSender.h"
+#import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import <pthread.h>
+
+typedef struct ZSDKSendBuffer {
+    uint8_t *               data;
+    size_t                  capacity;
+    size_t                  length;
+    int                     width;
+    int                     height;
+    CallHandler             callId;         // call the frame was captured for
+    uint64_t                submittedUs;
+    struct ZSDKSendBuffer * nextFree;
+} ZSDKSendBuffer;
+
+typedef struct {
+    BOOL                sending;        // between Attach and Detach
+    CallHandler         callId;
+    void *              threadId;
+    CallHandler         formatCallId;   // call the format below belongs to
+    int                 width;
+    int                 height;
+    float               fps;
+    int                 bitrate;        // 0 = library default
+    uint64_t            intervalUs;
+    uint64_t            nextDueUs;
+    int                 skip;
+    unsigned            skipCounter;
+    uint64_t            costEwmaUs;
+    ZSDKSendBuffer *    pending;
+    ZSDKVideoSendStats  stats;
+    // Capture side only
+    uint8_t *           staging;
+    size_t              stagingCapacity;
+    uint8_t *           scratch;
+    size_t              scratchCapacity;
+} ZSDKVideoCallSender;
+
+static ZSDKVideoCallSender  gSenders[kZSDKMaxCalls];
+static ZSDKSendBuffer       gBuffers[kZSDKVideoSendPoolSize];
+static ZSDKSendBuffer *     gFreeBuffers = NULL;
+static BOOL                 gBuffersReady = NO;
+
+// gSenderLock guards the sender state and the pool; gSendLock is held
+// around VideoSendFrame2() so Detach never races an in-flight send.
+static pthread_mutex_t      gSenderLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t      gSendLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t       gSenderOnce = PTHREAD_ONCE_INIT;
+static pthread_t            gSenderThread;
+static dispatch_semaphore_t gSenderSignal;
+static uint32_t             gPendingMask = 0;   // one bit per call slot
+
+//==============================================================================
+//  Buffer pool (gSenderLock held)
+//==============================================================================
+static ZSDKSendBuffer * popBuffer(void)
+{
+    if (!gBuffersReady)
+    {
+        for (int i = kZSDKVideoSendPoolSize - 1; i >= 0; i--)
+        {
+            gBuffers[i].nextFree = gFreeBuffers;
+            gFreeBuffers = &gBuffers[i];
+        }
+        gBuffersReady = YES;
+    }
+    ZSDKSendBuffer * buffer = gFreeBuffers;
+    if (buffer)
+        gFreeBuffers = buffer->nextFree;
+    return buffer;
+}
+
+static void pushBuffer(ZSDKSendBuffer * buffer)
+{
+    if (!buffer)
+        return;
+    buffer->nextFree = gFreeBuffers;
+    gFreeBuffers = buffer;
+}
+
+static BOOL reserve(uint8_t ** ppData, size_t * pCapacity, size_t bytes)
+{
+    if (*pCapacity >= bytes)
+        return YES;
+
+    void * data = NULL;
+    if (posix_memalign(&data, 64, bytes) != 0)
+        return NO;
+    free(*ppData);
+    *ppData = data;
+    *pCapacity = bytes;
+    return YES;
+}
+
+static inline uint64_t frameInterval(float fps)
+{
+    return (uint64_t)(1000000.0f / (fps > 0 ? fps : kZSDKVideoSendDefaultFps));
+}
+
+//==============================================================================
+//  Sender thread
+//==============================================================================
+static void sendPending(int slot)
+{
+    ZSDKVideoCallSender * tx = &gSenders[slot];
+
+    pthread_mutex_lock(&gSendLock);
+    pthread_mutex_lock(&gSenderLock);
+    ZSDKSendBuffer * buffer = tx->pending;
+    void * threadId = tx->threadId;
+    tx->pending = NULL;
+    pthread_mutex_unlock(&gSenderLock);
+
+    if (buffer)
+    {
+        uint64_t start = ZSDKMonotonicMicros();
+        LIBRESULT res = gWrapperCtx.VideoSendFrame2(threadId, buffer->data, (int)buffer->length,
+                                                    buffer->width, buffer->height, E_VIDEO_FRAME_YUV420p);
+        uint64_t end = ZSDKMonotonicMicros();
+        uint64_t sendUs  = end - start;
+        uint64_t queueUs = start - buffer->submittedUs;
+
+        pthread_mutex_lock(&gSenderLock);
+        if (res == L_OK)
+            tx->stats.framesSent++;
+        else
+            tx->stats.sendErrors++;
+        if (sendUs > tx->stats.sendLatencyMaxUs)
+            tx->stats.sendLatencyMaxUs = sendUs;
+        if (queueUs > tx->stats.queueLatencyMaxUs)
+            tx->stats.queueLatencyMaxUs = queueUs;
+
+        // Lag backoff: the time a frame spends waiting plus being handed over
+        // should stay well inside one frame interval
+        tx->costEwmaUs = (tx->costEwmaUs * 7 + sendUs + queueUs) / 8;
+        uint64_t interval = tx->intervalUs ? tx->intervalUs : frameInterval(0);
+        if (tx->costEwmaUs > interval / 2 && tx->skip < kZSDKVideoSendMaxSkip)
+            tx->skip++;
+        else if (tx->costEwmaUs < interval / 4 && tx->skip > 0)
+            tx->skip--;
+
+        pushBuffer(buffer);
+        pthread_mutex_unlock(&gSenderLock);
+    }
+    pthread_mutex_unlock(&gSendLock);
+}
+
+static void * senderThreadMain( void * arg )
+{
+    pthread_setname_np("zsdk.vsend");
+
+    for (;;)
+    {
+        dispatch_semaphore_wait(gSenderSignal, DISPATCH_TIME_FOREVER);
+
+        uint32_t mask = __atomic_exchange_n(&gPendingMask, 0, __ATOMIC_ACQ_REL);
+        while (mask)
+        {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            sendPending(slot);
+        }
+    }
+    return NULL;
+}
+
+static void startSenderThread(void)
+{
+    gSenderSignal = dispatch_semaphore_create(0);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_set_qos_class_np(&attr, QOS_CLASS_USER_INITIATED, 0);
+    if (pthread_create(&gSenderThread, &attr, senderThreadMain, NULL) != 0)
+        NSLog(@"ERROR SETUP video sender thread");
+    pthread_attr_destroy(&attr);
+}
+
+//==============================================================================
+//  Call lifecycle
+//==============================================================================
+void ZSDKVideoSenderAttach(CallHandler callId, int callSlot, void * pThreadId)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+    pthread_once(&gSenderOnce, startSenderThread);
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    pthread_mutex_lock(&gSenderLock);
+    if (tx->formatCallId != callId)
+    {
+        tx->formatCallId = callId;
+        tx->width  = 0;
+        tx->height = 0;
+        tx->fps    = kZSDKVideoSendDefaultFps;
+    }
+    tx->bitrate     = 0;
+    tx->sending     = YES;
+    tx->callId      = callId;
+    tx->threadId    = pThreadId;
+    tx->intervalUs  = frameInterval(tx->fps);
+    tx->nextDueUs   = 0;
+    tx->skip        = 0;
+    tx->skipCounter = 0;
+    tx->costEwmaUs  = 0;
+    pushBuffer(tx->pending);
+    tx->pending = NULL;
+    memset(&tx->stats, 0, sizeof(tx->stats));
+    pthread_mutex_unlock(&gSenderLock);
+}
+
+void ZSDKVideoSenderDetach(CallHandler callId, int callSlot)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    pthread_mutex_lock(&gSendLock);
+    pthread_mutex_lock(&gSenderLock);
+    if (tx->sending && tx->callId == callId)
+    {
+        tx->sending  = NO;
+        tx->threadId = NULL;
+        pushBuffer(tx->pending);
+        tx->pending = NULL;
+    }
+    pthread_mutex_unlock(&gSenderLock);
+    pthread_mutex_unlock(&gSendLock);
+}
+
+// Taking gSendLock waits out a send that picked up the thread id before
+// Detach cleared it
+void ZSDKVideoSenderRelease(void * pThreadId)
+{
+    if (!pThreadId)
+        return;
+
+    pthread_mutex_lock(&gSendLock);
+    gWrapperCtx.VideoSendFrame(pThreadId, NULL, 0);
+    pthread_mutex_unlock(&gSendLock);
+}
+
+void ZSDKVideoSenderSetFormat(CallHandler callId, int callSlot, int width, int height, float fps)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    pthread_mutex_lock(&gSenderLock);
+    tx->formatCallId = callId;
+    tx->width  = width & ~1;
+    tx->height = height & ~1;
+    tx->fps    = (fps > 0) ? fps : kZSDKVideoSendDefaultFps;
+    if (tx->sending && tx->callId == callId)
+        tx->intervalUs = frameInterval(tx->fps);
+    pthread_mutex_unlock(&gSenderLock);
+}
+
+// Rate control: re-create the encoder with new settings and follow them on
+// the capture side.  Serialised with sends through gSendLock.
+void ZSDKVideoSenderReconfigure(CallHandler callId, int callSlot, int width, int height,
+                                float fps, int bitrate)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    pthread_mutex_lock(&gSendLock);
+    pthread_mutex_lock(&gSenderLock);
+    void * threadId = (tx->sending && tx->callId == callId) ? tx->threadId : NULL;
+    pthread_mutex_unlock(&gSenderLock);
+
+    if (threadId && gWrapperCtx.VideoResetEncoder(threadId, width, height, fps, bitrate) == L_OK)
+    {
+        pthread_mutex_lock(&gSenderLock);
+        tx->width      = width & ~1;
+        tx->height     = height & ~1;
+        tx->fps        = (fps > 0) ? fps : kZSDKVideoSendDefaultFps;
+        tx->intervalUs = frameInterval(tx->fps);
+        tx->bitrate    = bitrate;
+        pthread_mutex_unlock(&gSenderLock);
+    }
+    pthread_mutex_unlock(&gSendLock);
+}
+
+//==============================================================================
+//  Capture side
+//==============================================================================
+
+static void abortSubmit(ZSDKSendBuffer * buffer);
+
+// Pacing and backpressure; returns a buffer sized for the outgoing frame or
+// NULL if this frame is skipped
+static ZSDKSendBuffer * beginSubmit(ZSDKVideoCallSender * tx, int srcWidth, int srcHeight)
+{
+    uint64_t now = ZSDKMonotonicMicros();
+
+    pthread_mutex_lock(&gSenderLock);
+    if (!tx->sending)
+    {
+        pthread_mutex_unlock(&gSenderLock);
+        return NULL;
+    }
+    tx->stats.framesSubmitted++;
+
+    // A quarter interval of slack absorbs capture jitter
+    if (now + tx->intervalUs / 4 < tx->nextDueUs)
+    {
+        tx->stats.droppedPacing++;
+        pthread_mutex_unlock(&gSenderLock);
+        return NULL;
+    }
+    if (tx->nextDueUs + tx->intervalUs < now)
+        tx->nextDueUs = now;
+    tx->nextDueUs += tx->intervalUs;
+
+    if (tx->skip > 0 && (tx->skipCounter++ % (tx->skip + 1)) != 0)
+    {
+        tx->stats.droppedLag++;
+        pthread_mutex_unlock(&gSenderLock);
+        return NULL;
+    }
+
+    ZSDKSendBuffer * buffer = popBuffer();
+    if (!buffer)
+    {
+        tx->stats.droppedBusy++;
+        pthread_mutex_unlock(&gSenderLock);
+        return NULL;
+    }
+    buffer->width  = tx->width  ? tx->width  : (srcWidth & ~1);
+    buffer->height = tx->height ? tx->height : (srcHeight & ~1);
+    buffer->callId = tx->callId;
+    pthread_mutex_unlock(&gSenderLock);
+
+    buffer->length = ZSDKI420FrameSize(buffer->width, buffer->height);
+    if (!reserve(&buffer->data, &buffer->capacity, buffer->length))
+    {
+        abortSubmit(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+static void abortSubmit(ZSDKSendBuffer * buffer)
+{
+    pthread_mutex_lock(&gSenderLock);
+    pushBuffer(buffer);
+    pthread_mutex_unlock(&gSenderLock);
+}
+
+static void finishSubmit(ZSDKVideoCallSender * tx, int callSlot, ZSDKSendBuffer * buffer)
+{
+    buffer->submittedUs = ZSDKMonotonicMicros();
+
+    pthread_mutex_lock(&gSenderLock);
+    if (!tx->sending || tx->callId != buffer->callId)
+    {
+        // Detached while converting, possibly attached to the next call
+        pushBuffer(buffer);
+        pthread_mutex_unlock(&gSenderLock);
+        return;
+    }
+    ZSDKSendBuffer * superseded = tx->pending;
+    tx->pending = buffer;
+    if (superseded)
+    {
+        tx->stats.droppedBusy++;
+        pushBuffer(superseded);
+    }
+    pthread_mutex_unlock(&gSenderLock);
+
+    uint32_t bit = 1u << callSlot;
+    if ((__atomic_fetch_or(&gPendingMask, bit, __ATOMIC_ACQ_REL) & bit) == 0)
+        dispatch_semaphore_signal(gSenderSignal);
+}
+
+// Scales (or copies) an I420 source into the buffer
+static BOOL scaleInto(ZSDKVideoCallSender * tx, ZSDKSendBuffer * buffer,
+                      const ZSDKI420Planes * pSrc, int width, int height)
+{
+    if ((width != buffer->width || height != buffer->height) &&
+        !reserve(&tx->scratch, &tx->scratchCapacity, ZSDKScaleScratchSize(width, height) + 1))
+        return NO;
+
+    ZSDKI420Planes dst;
+    ZSDKI420PlanesInBuffer(buffer->data, buffer->width, buffer->height, &dst);
+    ZSDKScaleI420(pSrc, width, height, &dst, buffer->width, buffer->height, tx->scratch);
+    return YES;
+}
+
+// Planes to convert into: the buffer itself when no scaling is needed,
+// otherwise the capture-side staging area
+static BOOL conversionTarget(ZSDKVideoCallSender * tx, ZSDKSendBuffer * buffer,
+                             int width, int height, ZSDKI420Planes * pPlanes)
+{
+    uint8_t * base = buffer->data;
+    if (width != buffer->width || height != buffer->height)
+    {
+        if (!reserve(&tx->staging, &tx->stagingCapacity, ZSDKI420FrameSize(width, height)))
+            return NO;
+        base = tx->staging;
+    }
+    ZSDKI420PlanesInBuffer(base, width, height, pPlanes);
+    return YES;
+}
+
+BOOL ZSDKVideoSenderSubmitI420(int callSlot, const ZSDKI420Planes * pPlanes, int width, int height)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NO;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    ZSDKSendBuffer * buffer = beginSubmit(tx, width, height);
+    if (!buffer)
+        return NO;
+
+    if (!scaleInto(tx, buffer, pPlanes, width & ~1, height & ~1))
+    {
+        abortSubmit(buffer);
+        return NO;
+    }
+    finishSubmit(tx, callSlot, buffer);
+    return YES;
+}
+
+BOOL ZSDKVideoSenderSubmitNV12(int callSlot, const uint8_t * pY, int yStride,
+                               const uint8_t * pUV, int uvStride, int width, int height)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NO;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    ZSDKSendBuffer * buffer = beginSubmit(tx, width, height);
+    if (!buffer)
+        return NO;
+
+    width &= ~1;
+    height &= ~1;
+    ZSDKI420Planes planes;
+    if (!conversionTarget(tx, buffer, width, height, &planes))
+    {
+        abortSubmit(buffer);
+        return NO;
+    }
+    ZSDKConvertNV12ToI420(pY, yStride, pUV, uvStride, &planes, width, height);
+    if (planes.y != buffer->data && !scaleInto(tx, buffer, &planes, width, height))
+    {
+        abortSubmit(buffer);
+        return NO;
+    }
+    finishSubmit(tx, callSlot, buffer);
+    return YES;
+}
+
+BOOL ZSDKVideoSenderSubmitBGRA(int callSlot, const uint8_t * pBGRA, int stride, int width, int height)
+{
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return NO;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    ZSDKSendBuffer * buffer = beginSubmit(tx, width, height);
+    if (!buffer)
+        return NO;
+
+    width &= ~1;
+    height &= ~1;
+    ZSDKI420Planes planes;
+    if (!conversionTarget(tx, buffer, width, height, &planes))
+    {
+        abortSubmit(buffer);
+        return NO;
+    }
+    ZSDKConvertBGRAToI420(pBGRA, stride, &planes, width, height);
+    if (planes.y != buffer->data && !scaleInto(tx, buffer, &planes, width, height))
+    {
+        abortSubmit(buffer);
+        return NO;
+    }
+    finishSubmit(tx, callSlot, buffer);
+    return YES;
+}
+
+void ZSDKVideoSenderGetStats(int callSlot, ZSDKVideoSendStats * pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    if (callSlot < 0 || callSlot >= kZSDKMaxCalls)
+        return;
+
+    ZSDKVideoCallSender * tx = &gSenders[callSlot];
+    pthread_mutex_lock(&gSenderLock);
+    *pStats = tx->stats;
+    pStats->width  = tx->width;
+    pStats->height = tx->height;
+    pStats->fps    = tx->fps;
+    pStats->bitrate = tx->bitrate;
+    pStats->skip   = tx->skip;
+    pthread_mutex_unlock(&gSenderLock);
+}
@@ -0,0 +1,405 @@
+//
+//  ZSDKWrapper.hpp
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Header-only C++ layer over the WrapperContext function table for
+//  Objective-C++ code.  Everything is inline and calls straight through the
+//  context it is given, so it compiles to the same pointer call as
+//  ctx.X(...):
+//
+//  - Typed ids (UserId, CallId, SoundId, RecordingId, ConferenceId) keep the
+//    handle kinds apart although the library declares them all as Handler.
+//  - Owning handles (User, Call, Sound, Recording, Conference) release what
+//    they hold when they go out of scope: RemoveUser, CallHangup,
+//    RemoveSound, RemoveRecording, DestroyConference.  They are move-only
+//    and hold the handle and the context it came from.
+//  - Results carry the LIBRESULT with the value and warn when ignored.
+//  - The signatures of the context members used here are checked at
+//    compile time, so a libsipwrapper header that changes them breaks the
+//    build instead of the call.
+//
+//  Written for C++11 (the project's dialect) without the standard library,
+//  which the target links as the old libstdc++.  Every function takes the
+//  context as its first argument (gWrapperCtx, or a private table such as
+//  the benchmark's), so translation units using different contexts share
+//  the same inline definitions.
+//
+
+#ifndef ZSDK_WRAPPER_HPP
+#define ZSDK_WRAPPER_HPP
+
+#include <stddef.h>
+#include "wrapper_defs.h"
+#include "wrapper.h"
+
+#define ZSDK_CHECK_RESULT __attribute__((warn_unused_result))
+
+namespace zsdk {
+
+namespace detail {
+template <typename A, typename B> struct IsSame       { static const bool value = false; };
+template <typename A>             struct IsSame<A, A> { static const bool value = true; };
+}
+
+// Context layout this header was written against.  Later layouts only
+// append members, so newer headers and libraries are accepted.
+static const int kContextVersion = 46;
+
+static_assert(WRAPPER_CONTEXT_VERSION >= kContextVersion,
+              "libsipwrapper headers older than ZSDKWrapper.hpp");
+
+#define ZSDK_CHECK_MEMBER(member, type) \
+    static_assert(detail::IsSame<decltype(WrapperContext::member), type>::value, \
+                  "WrapperContext::" #member " changed signature")
+
+ZSDK_CHECK_MEMBER(AddUser, UserHandler (*)(ProtoType_t, const char *, const char *, const char *,
+                                           const char *, const char *, const char *));
+ZSDK_CHECK_MEMBER(RemoveUser, LIBRESULT (*)(UserHandler));
+ZSDK_CHECK_MEMBER(RegisterUser, LIBRESULT (*)(UserHandler));
+ZSDK_CHECK_MEMBER(UnregisterUser, LIBRESULT (*)(UserHandler));
+ZSDK_CHECK_MEMBER(CallCreate, LIBRESULT (*)(UserHandler, const char *, CallHandler *));
+ZSDK_CHECK_MEMBER(CallAccept, LIBRESULT (*)(CallHandler));
+ZSDK_CHECK_MEMBER(CallReject, LIBRESULT (*)(CallHandler));
+ZSDK_CHECK_MEMBER(CallHold, LIBRESULT (*)(CallHandler));
+ZSDK_CHECK_MEMBER(CallUnhold, LIBRESULT (*)(CallHandler));
+ZSDK_CHECK_MEMBER(CallHangup, LIBRESULT (*)(CallHandler));
+ZSDK_CHECK_MEMBER(UnattendedCallTransfer, LIBRESULT (*)(CallHandler, const char *));
+ZSDK_CHECK_MEMBER(AttendedCallTransfer, LIBRESULT (*)(CallHandler, CallHandler));
+ZSDK_CHECK_MEMBER(AddSoundFromWav, LIBRESULT (*)(const char *, int, int, int, SoundHandler *, int *));
+ZSDK_CHECK_MEMBER(StartSound, LIBRESULT (*)(SoundHandler, BYTE));
+ZSDK_CHECK_MEMBER(StopSound, LIBRESULT (*)(SoundHandler, BYTE));
+ZSDK_CHECK_MEMBER(RemoveSound, LIBRESULT (*)(SoundHandler));
+ZSDK_CHECK_MEMBER(AddRecording, LIBRESULT (*)(int, RecordingHandler *));
+ZSDK_CHECK_MEMBER(StartRecording, LIBRESULT (*)(RecordingHandler));
+ZSDK_CHECK_MEMBER(StopRecording, LIBRESULT (*)(RecordingHandler));
+ZSDK_CHECK_MEMBER(RemoveRecording, LIBRESULT (*)(RecordingHandler));
+ZSDK_CHECK_MEMBER(CreateConference, ConferenceHandler (*)(BYTE, BYTE));
+ZSDK_CHECK_MEMBER(DestroyConference, LIBRESULT (*)(ConferenceHandler));
+ZSDK_CHECK_MEMBER(StartConference, LIBRESULT (*)(ConferenceHandler));
+ZSDK_CHECK_MEMBER(StopConference, LIBRESULT (*)(ConferenceHandler));
+ZSDK_CHECK_MEMBER(HoldConference, LIBRESULT (*)(ConferenceHandler));
+ZSDK_CHECK_MEMBER(UnholdConference, LIBRESULT (*)(ConferenceHandler));
+ZSDK_CHECK_MEMBER(JoinCallToConference, LIBRESULT (*)(ConferenceHandler, CallHandler));
+ZSDK_CHECK_MEMBER(LeaveCallFromConference, LIBRESULT (*)(ConferenceHandler, CallHandler));
+ZSDK_CHECK_MEMBER(MuteConferenceParticipant, LIBRESULT (*)(ConferenceHandler, CallHandler));
+ZSDK_CHECK_MEMBER(UnmuteConferenceParticipant, LIBRESULT (*)(ConferenceHandler, CallHandler));
+
+#undef ZSDK_CHECK_MEMBER
+
+// The loaded library must fill at least the layout above
+inline bool contextUsable(const WrapperContext & ctx)
+{
+    return ctx.ctxVersion >= kContextVersion;
+}
+
+//==============================================================================
+//  Results
+//==============================================================================
+class Status
+{
+public:
+    Status(LIBRESULT code) : code_(code) {}
+
+    bool        ok() const          { return code_ == L_OK; }
+    bool        pending() const     { return code_ == L_WAIT; }
+    LIBRESULT   code() const        { return code_; }
+    explicit    operator bool() const { return ok(); }
+
+private:
+    LIBRESULT   code_;
+};
+
+// A value and the LIBRESULT that produced it; value() is meaningful when
+// ok() (or pending() for operations that complete asynchronously)
+template <typename T>
+class Result
+{
+public:
+    Result(LIBRESULT code) : value_(), code_(code) {}
+    Result(T && value, LIBRESULT code) : value_(static_cast<T &&>(value)), code_(code) {}
+
+    bool        ok() const          { return code_ == L_OK; }
+    bool        pending() const     { return code_ == L_WAIT; }
+    LIBRESULT   code() const        { return code_; }
+    explicit    operator bool() const { return ok(); }
+
+    T &         value()             { return value_; }
+    const T &   value() const       { return value_; }
+    T           take()              { return static_cast<T &&>(value_); }
+
+private:
+    T           value_;
+    LIBRESULT   code_;
+};
+
+//==============================================================================
+//  Ids and owning handles
+//==============================================================================
+// Non-owning, trivially copyable, one kind per Tag
+template <typename Tag>
+class Id
+{
+public:
+    Id() : handle_(INVALID_HANDLE) {}
+    explicit Id(Handler handle) : handle_(handle) {}
+
+    Handler     get() const         { return handle_; }
+    bool        valid() const       { return handle_ != INVALID_HANDLE; }
+
+    bool operator==(Id other) const { return handle_ == other.handle_; }
+    bool operator!=(Id other) const { return handle_ != other.handle_; }
+
+private:
+    Handler     handle_;
+};
+
+struct UserTag;
+struct CallTag;
+struct SoundTag;
+struct RecordingTag;
+struct ConferenceTag;
+
+typedef Id<UserTag>         UserId;
+typedef Id<CallTag>         CallId;
+typedef Id<SoundTag>        SoundId;
+typedef Id<RecordingTag>    RecordingId;
+typedef Id<ConferenceTag>   ConferenceId;
+
+// Releases through Traits::release(ctx, Handler) unless release() handed
+// the handle back to the caller
+template <typename Tag, typename Traits>
+class Unique
+{
+public:
+    Unique() : ctx_(0), handle_(INVALID_HANDLE) {}
+    Unique(WrapperContext & ctx, Handler handle) : ctx_(&ctx), handle_(handle) {}
+    Unique(Unique && other) : ctx_(other.ctx_), handle_(other.handle_) { other.handle_ = INVALID_HANDLE; }
+    ~Unique() { reset(); }
+
+    Unique & operator=(Unique && other)
+    {
+        if (this != &other)
+        {
+            reset();
+            ctx_    = other.ctx_;
+            handle_ = other.handle_;
+            other.handle_ = INVALID_HANDLE;
+        }
+        return *this;
+    }
+
+    Unique(const Unique &) = delete;
+    Unique & operator=(const Unique &) = delete;
+
+    Id<Tag>     id() const          { return Id<Tag>(handle_); }
+    operator    Id<Tag>() const     { return id(); }
+    Handler     get() const         { return handle_; }
+    bool        valid() const       { return handle_ != INVALID_HANDLE; }
+
+    Handler release()
+    {
+        Handler handle = handle_;
+        handle_ = INVALID_HANDLE;
+        return handle;
+    }
+
+    // Result of the release call; L_OK when nothing was held
+    Status reset()
+    {
+        LIBRESULT res = L_OK;
+        if (handle_ != INVALID_HANDLE)
+            res = Traits::release(*ctx_, handle_);
+        handle_ = INVALID_HANDLE;
+        return res;
+    }
+
+private:
+    WrapperContext *    ctx_;
+    Handler             handle_;
+};
+
+struct UserTraits       { static LIBRESULT release(WrapperContext & ctx, Handler h) { return ctx.RemoveUser(h); } };
+struct CallTraits       { static LIBRESULT release(WrapperContext & ctx, Handler h) { return ctx.CallHangup(h); } };
+struct SoundTraits      { static LIBRESULT release(WrapperContext & ctx, Handler h) { return ctx.RemoveSound(h); } };
+struct RecordingTraits  { static LIBRESULT release(WrapperContext & ctx, Handler h) { return ctx.RemoveRecording(h); } };
+struct ConferenceTraits { static LIBRESULT release(WrapperContext & ctx, Handler h) { return ctx.DestroyConference(h); } };
+
+typedef Unique<UserTag, UserTraits>             User;
+typedef Unique<CallTag, CallTraits>             Call;
+typedef Unique<SoundTag, SoundTraits>           Sound;
+typedef Unique<RecordingTag, RecordingTraits>   Recording;
+typedef Unique<ConferenceTag, ConferenceTraits> Conference;
+
+static_assert(sizeof(Call) == sizeof(WrapperContext *) + sizeof(CallHandler),
+              "owning handles must stay two words");
+static_assert(__is_trivially_copyable(CallId), "ids must stay trivially copyable");
+
+//==============================================================================
+//  Users
+//==============================================================================
+inline Result<User> addUser(WrapperContext & ctx, ProtoType_t proto, const char * pUser,
+                            const char * pPassword, const char * pDomain, const char * pProxy = "",
+                            const char * pAuthUser = "", const char * pCallerId = "") ZSDK_CHECK_RESULT;
+inline Result<User> addUser(WrapperContext & ctx, ProtoType_t proto, const char * pUser,
+                            const char * pPassword, const char * pDomain, const char * pProxy,
+                            const char * pAuthUser, const char * pCallerId)
+{
+    UserHandler userId = ctx.AddUser(proto, pUser, pPassword, pDomain, pProxy, pAuthUser, pCallerId);
+    if (userId == INVALID_HANDLE)
+        return Result<User>(L_FAIL);
+    return Result<User>(User(ctx, userId), L_OK);
+}
+
+inline Status registerUser(WrapperContext & ctx, UserId user) ZSDK_CHECK_RESULT;
+inline Status registerUser(WrapperContext & ctx, UserId user)   { return ctx.RegisterUser(user.get()); }
+
+inline Status unregisterUser(WrapperContext & ctx, UserId user) ZSDK_CHECK_RESULT;
+inline Status unregisterUser(WrapperContext & ctx, UserId user) { return ctx.UnregisterUser(user.get()); }
+
+//==============================================================================
+//  Calls
+//==============================================================================
+inline Result<Call> createCall(WrapperContext & ctx, UserId user, const char * pCallee) ZSDK_CHECK_RESULT;
+inline Result<Call> createCall(WrapperContext & ctx, UserId user, const char * pCallee)
+{
+    CallHandler callId = INVALID_HANDLE;
+    LIBRESULT res = ctx.CallCreate(user.get(), pCallee, &callId);
+    if (res != L_OK)
+        return Result<Call>(res);
+    return Result<Call>(Call(ctx, callId), res);
+}
+
+inline Status accept(WrapperContext & ctx, CallId call) ZSDK_CHECK_RESULT;
+inline Status accept(WrapperContext & ctx, CallId call) { return ctx.CallAccept(call.get()); }
+
+inline Status reject(WrapperContext & ctx, CallId call) ZSDK_CHECK_RESULT;
+inline Status reject(WrapperContext & ctx, CallId call) { return ctx.CallReject(call.get()); }
+
+inline Status hold(WrapperContext & ctx, CallId call) ZSDK_CHECK_RESULT;
+inline Status hold(WrapperContext & ctx, CallId call)   { return ctx.CallHold(call.get()); }
+
+inline Status unhold(WrapperContext & ctx, CallId call) ZSDK_CHECK_RESULT;
+inline Status unhold(WrapperContext & ctx, CallId call) { return ctx.CallUnhold(call.get()); }
+
+inline Status hangup(WrapperContext & ctx, CallId call) ZSDK_CHECK_RESULT;
+inline Status hangup(WrapperContext & ctx, CallId call) { return ctx.CallHangup(call.get()); }
+
+inline Status transfer(WrapperContext & ctx, CallId call, const char * pTransferee) ZSDK_CHECK_RESULT;
+inline Status transfer(WrapperContext & ctx, CallId call, const char * pTransferee)
+{
+    return ctx.UnattendedCallTransfer(call.get(), pTransferee);
+}
+
+inline Status transfer(WrapperContext & ctx, CallId call, CallId toCall) ZSDK_CHECK_RESULT;
+inline Status transfer(WrapperContext & ctx, CallId call, CallId toCall)
+{
+    return ctx.AttendedCallTransfer(call.get(), toCall.get());
+}
+
+//==============================================================================
+//  Sounds
+//==============================================================================
+// pending() when loaded asynchronously; causeCode is set on failure
+inline Result<Sound> addSoundFromWav(WrapperContext & ctx, const char * pUtf8Path, bool repeat,
+                                     int pauseMs, bool async, int * pCauseCode = 0) ZSDK_CHECK_RESULT;
+inline Result<Sound> addSoundFromWav(WrapperContext & ctx, const char * pUtf8Path, bool repeat,
+                                     int pauseMs, bool async, int * pCauseCode)
+{
+    SoundHandler soundId = INVALID_HANDLE;
+    int cause = 0;
+    LIBRESULT res = ctx.AddSoundFromWav(pUtf8Path, repeat ? 1 : 0, pauseMs, async ? 1 : 0,
+                                        &soundId, &cause);
+    if (pCauseCode)
+        *pCauseCode = cause;
+    if (res != L_OK && res != L_WAIT)
+        return Result<Sound>(res);
+    return Result<Sound>(Sound(ctx, soundId), res);
+}
+
+inline Status start(WrapperContext & ctx, SoundId sound, BYTE deviceId) ZSDK_CHECK_RESULT;
+inline Status start(WrapperContext & ctx, SoundId sound, BYTE deviceId)
+{
+    return ctx.StartSound(sound.get(), deviceId);
+}
+
+inline Status stop(WrapperContext & ctx, SoundId sound, BYTE deviceId) ZSDK_CHECK_RESULT;
+inline Status stop(WrapperContext & ctx, SoundId sound, BYTE deviceId)
+{
+    return ctx.StopSound(sound.get(), deviceId);
+}
+
+//==============================================================================
+//  Recordings
+//==============================================================================
+inline Result<Recording> addRecording(WrapperContext & ctx, int maxLengthMs) ZSDK_CHECK_RESULT;
+inline Result<Recording> addRecording(WrapperContext & ctx, int maxLengthMs)
+{
+    RecordingHandler recordingId = INVALID_HANDLE;
+    LIBRESULT res = ctx.AddRecording(maxLengthMs, &recordingId);
+    if (res != L_OK)
+        return Result<Recording>(res);
+    return Result<Recording>(Recording(ctx, recordingId), res);
+}
+
+inline Status start(WrapperContext & ctx, RecordingId recording) ZSDK_CHECK_RESULT;
+inline Status start(WrapperContext & ctx, RecordingId recording) { return ctx.StartRecording(recording.get()); }
+
+inline Status stop(WrapperContext & ctx, RecordingId recording) ZSDK_CHECK_RESULT;
+inline Status stop(WrapperContext & ctx, RecordingId recording)  { return ctx.StopRecording(recording.get()); }
+
+//==============================================================================
+//  Conferences
+//==============================================================================
+inline Result<Conference> createConference(WrapperContext & ctx, BYTE inDeviceId,
+                                           BYTE outDeviceId) ZSDK_CHECK_RESULT;
+inline Result<Conference> createConference(WrapperContext & ctx, BYTE inDeviceId, BYTE outDeviceId)
+{
+    ConferenceHandler conferenceId = ctx.CreateConference(inDeviceId, outDeviceId);
+    if (conferenceId == INVALID_HANDLE)
+        return Result<Conference>(L_FAIL);
+    return Result<Conference>(Conference(ctx, conferenceId), L_OK);
+}
+
+inline Status start(WrapperContext & ctx, ConferenceId conference) ZSDK_CHECK_RESULT;
+inline Status start(WrapperContext & ctx, ConferenceId conference)  { return ctx.StartConference(conference.get()); }
+
+inline Status stop(WrapperContext & ctx, ConferenceId conference) ZSDK_CHECK_RESULT;
+inline Status stop(WrapperContext & ctx, ConferenceId conference)   { return ctx.StopConference(conference.get()); }
+
+inline Status hold(WrapperContext & ctx, ConferenceId conference) ZSDK_CHECK_RESULT;
+inline Status hold(WrapperContext & ctx, ConferenceId conference)   { return ctx.HoldConference(conference.get()); }
+
+inline Status unhold(WrapperContext & ctx, ConferenceId conference) ZSDK_CHECK_RESULT;
+inline Status unhold(WrapperContext & ctx, ConferenceId conference) { return ctx.UnholdConference(conference.get()); }
+
+inline Status join(WrapperContext & ctx, ConferenceId conference, CallId call) ZSDK_CHECK_RESULT;
+inline Status join(WrapperContext & ctx, ConferenceId conference, CallId call)
+{
+    return ctx.JoinCallToConference(conference.get(), call.get());
+}
+
+inline Status leave(WrapperContext & ctx, ConferenceId conference, CallId call) ZSDK_CHECK_RESULT;
+inline Status leave(WrapperContext & ctx, ConferenceId conference, CallId call)
+{
+    return ctx.LeaveCallFromConference(conference.get(), call.get());
+}
+
+inline Status mute(WrapperContext & ctx, ConferenceId conference, CallId call) ZSDK_CHECK_RESULT;
+inline Status mute(WrapperContext & ctx, ConferenceId conference, CallId call)
+{
+    return ctx.MuteConferenceParticipant(conference.get(), call.get());
+}
+
+inline Status unmute(WrapperContext & ctx, ConferenceId conference, CallId call) ZSDK_CHECK_RESULT;
+inline Status unmute(WrapperContext & ctx, ConferenceId conference, CallId call)
+{
+    return ctx.UnmuteConferenceParticipant(conference.get(), call.get());
+}
+
+} // namespace zsdk
+
+#undef ZSDK_CHECK_RESULT
+
+#endif // ZSDK_WRAPPER_HPP
@@ -0,0 +1,35 @@
+//
+//  ZSDKWrapperBench.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Cost of the ZSDKWrapper.hpp layer against direct context calls.  Both
+//  variants call the same do-nothing functions through a private
+//  WrapperContext, so only the dispatch itself is timed: a hold (one
+//  checked call) and a call lifecycle (create, then hangup by the owning
+//  handle going out of scope).  Each variant is run in alternating rounds
+//  and the best round is reported.
+//
+
+#import <Foundation/Foundation.h>
+
+#define kZSDKWrapperBenchRounds 5
+
+typedef struct {
+    int         iterations;         // per round
+    double      directHoldNs;
+    double      facadeHoldNs;
+    double      directLifecycleNs;
+    double      facadeLifecycleNs;
+} ZSDKWrapperBenchResult;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+void ZSDKWrapperBenchmark(int iterations, ZSDKWrapperBenchResult * pResult);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,114 @@
+//
+//  ZSDKWrapperBench.mm
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+
+#import "ZSDKWrapperBench.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKWrapper.hpp"
+
+// External linkage so the compiler cannot see which functions it holds
+__attribute__((visibility("hidden"))) WrapperContext gZSDKBenchCtx;
+
+static volatile unsigned long gBenchCalls;
+
+__attribute__((noinline)) static LIBRESULT benchHold(CallHandler callId)
+{
+    gBenchCalls = gBenchCalls + 1;
+    return L_OK;
+}
+
+__attribute__((noinline)) static LIBRESULT benchHangup(CallHandler callId)
+{
+    gBenchCalls = gBenchCalls + 1;
+    return L_OK;
+}
+
+__attribute__((noinline)) static LIBRESULT benchCallCreate(UserHandler userId, const char * pCallee,
+                                                           CallHandler * pCallId)
+{
+    gBenchCalls = gBenchCalls + 1;
+    *pCallId = (CallHandler)gBenchCalls;
+    return L_OK;
+}
+
+static double nsPerOp(uint64_t startUs, int iterations)
+{
+    return (double)(ZSDKMonotonicMicros() - startUs) * 1000.0 / iterations;
+}
+
+static double directHold(int iterations)
+{
+    unsigned long failures = 0;
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int i = 0; i < iterations; i++)
+        failures += gZSDKBenchCtx.CallHold((CallHandler)i) != L_OK;
+    double ns = nsPerOp(startUs, iterations);
+    return failures ? -1.0 : ns;
+}
+
+static double facadeHold(int iterations)
+{
+    unsigned long failures = 0;
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int i = 0; i < iterations; i++)
+        failures += !zsdk::hold(gZSDKBenchCtx, zsdk::CallId((CallHandler)i)).ok();
+    double ns = nsPerOp(startUs, iterations);
+    return failures ? -1.0 : ns;
+}
+
+static double directLifecycle(int iterations)
+{
+    unsigned long failures = 0;
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int i = 0; i < iterations; i++)
+    {
+        CallHandler callId = INVALID_HANDLE;
+        if (gZSDKBenchCtx.CallCreate(1, "bench", &callId) != L_OK)
+            failures++;
+        else
+            gZSDKBenchCtx.CallHangup(callId);
+    }
+    double ns = nsPerOp(startUs, iterations);
+    return failures ? -1.0 : ns;
+}
+
+static double facadeLifecycle(int iterations)
+{
+    unsigned long failures = 0;
+    uint64_t startUs = ZSDKMonotonicMicros();
+    for (int i = 0; i < iterations; i++)
+    {
+        zsdk::Result<zsdk::Call> call = zsdk::createCall(gZSDKBenchCtx, zsdk::UserId(1), "bench");
+        failures += !call.ok();
+    }
+    double ns = nsPerOp(startUs, iterations);
+    return failures ? -1.0 : ns;
+}
+
+static void keepBest(double * pBest, double ns)
+{
+    if (*pBest == 0.0 || ns < *pBest)
+        *pBest = ns;
+}
+
+void ZSDKWrapperBenchmark(int iterations, ZSDKWrapperBenchResult * pResult)
+{
+    memset(&gZSDKBenchCtx, 0, sizeof(gZSDKBenchCtx));
+    gZSDKBenchCtx.ctxVersion = WRAPPER_CONTEXT_VERSION;
+    gZSDKBenchCtx.CallHold   = benchHold;
+    gZSDKBenchCtx.CallHangup = benchHangup;
+    gZSDKBenchCtx.CallCreate = benchCallCreate;
+
+    memset(pResult, 0, sizeof(*pResult));
+    pResult->iterations = iterations > 0 ? iterations : 1;
+    for (int round = 0; round < kZSDKWrapperBenchRounds; round++)
+    {
+        keepBest(&pResult->directHoldNs, directHold(pResult->iterations));
+        keepBest(&pResult->facadeHoldNs, facadeHold(pResult->iterations));
+        keepBest(&pResult->directLifecycleNs, directLifecycle(pResult->iterations));
+        keepBest(&pResult->facadeLifecycleNs, facadeLifecycle(pResult->iterations));
+    }
+}
@@ -0,0 +1,86 @@
+//
+//  ZoiperVoip+Benchmark.h
+//  zoiperVoip
+//
+//  Copyright © 2016 Depa. All rights reserved.
+//
+//  Benchmarks and load generation, for test builds.  Internal: this header
+//  is not copied with ZoiperVoip.h, import it from the library sources.
+//  The methods are implemented in ZoiperVoip.m next to what they measure.
+//
+
+#import "ZoiperVoip.h"
+
+@interface ZoiperVoip (Benchmark)
+
+// Registers accounts (up to 512, e.g. 500) against a stand-in registrar
+// answering after 200 ms, driving the pacer directly; nil if accounts
+// exist. accounts, registered, addNs, ticks, registerMs, tickUs,
+// callbackNs, maxInFlight, refreshMinSeconds, refreshMaxSeconds
+- (NSDictionary*)benchmarkRegistrationWithAccounts:(int)accounts;
+
+// Contact table, pacer and delivery against a stand-in library (no contacts
+// may be added): addNs, subscribeMs, updateNs, drainNs per delivered change,
+// delivered, tableBytes. nil if contacts are in use.
+- (NSDictionary*)benchmarkPresenceWithContacts:(int)contacts updates:(int)updates;
+
+// Queue, pump and callbacks against a stand-in SIP MESSAGE sender (no
+// messages may be queued): messagesPerSecond, queueNs, pumpTicks,
+// maxInFlight, retries, failed, arenaHighWater. nil if messages are queued.
+- (NSDictionary*)benchmarkMessagingWithContacts:(int)contacts messages:(int)messages bodyBytes:(int)bodyBytes failPercent:(int)failPercent;
+
+// Mix cost in nanoseconds per participant per frame for each kernel this
+// CPU supports (scalar, sse2, avx2, neon)
+- (NSDictionary*)benchmarkConferenceMixWithParticipants:(int)participants samplesPerFrame:(int)samples;
+
+// Capture conversion cost in nanoseconds per frame for each kernel this CPU
+// supports: { kernel : { nv12, bgra, halve } }, where halve is the 2x luma
+// downscale
+- (NSDictionary*)benchmarkColorConvertWithWidth:(int)width height:(int)height;
+
+// Measures every audio driver resampler over 8, 16, 44.1 and 48 kHz
+// sources (needs external audio mode and no calls; takes about 25 s).
+// Results (resampler, fromHz, toHz, cpuMsPerSecond, snrDb, samples) are
+// kept for the startup policy, which picks the cheapest resampler meeting
+// the floor for the core count and load; chosen is the one now applied.
+- (BOOL)benchmarkResamplersWithCompletion:(void (^)(NSArray * results, NSString * chosen))completion;
+
+// Records count 8 kHz streams of synthetic speech in the temporary
+// directory as fast as they are written, then deletes them. Blocks the
+// caller. recordings, audioSeconds, wallSeconds, realtimeFactor,
+// megabytesPerSecond, stalls
+- (NSDictionary*)benchmarkRecorderWithRecordings:(int)count seconds:(int)seconds compressed:(BOOL)compressed;
+
+// Runs on a simulated library instead of libsipwrapper (call before
+// setupSIP): a registered account is offered callsPerSecond incoming
+// calls, answered after answerDelayMs unless accepted earlier, lasting
+// callDurationMs with mediaEventsPerSecond statistics each. For load
+// testing the event handling without devices or network.
+- (void)useSimulatedLibraryWithCallsPerSecond:(double)callsPerSecond answerDelayMs:(int)answerDelayMs callDurationMs:(int)callDurationMs mediaEventsPerSecond:(double)mediaEventsPerSecond;
+
+// scheduled, delivered, overflows, callsOffered, callsAnswered, callsEnded,
+// callsFailed, registrations, lagAvgUs, lagMaxUs, activeCalls
+- (NSDictionary*)simulatedLibraryStatistics;
+
+// Places outgoing calls from the default account for seconds following a
+// calls-per-second pattern: "constant" (callsPerSecond), "ramp"
+// (callsPerSecond to peakCallsPerSecond) or "burst" (peakCallsPerSecond for
+// 1 s in every 5 s, callsPerSecond otherwise), hanging each up holdMs after
+// it is answered. completion gets a JSON report with the call counts and a
+// latency histogram (count, min, mean, p50/p90/p99/p99.9, max in us) for
+// every state transition. Returns NO if a run is in progress.
+- (BOOL)runCallLoadWithPattern:(NSString*)pattern callsPerSecond:(double)callsPerSecond peakCallsPerSecond:(double)peakCallsPerSecond seconds:(int)seconds holdMs:(int)holdMs completion:(void (^)(NSString * json))completion;
+
+// Stops placing calls; the report follows once the calls in flight end
+- (void)stopCallLoad;
+
+// offered, created, createErrors, throttled, accepted, completed,
+// remoteEnded, rejected, failed, timedOut, inFlight
+- (NSDictionary*)callLoadStatistics;
+
+// Nanoseconds per call through the C++ wrapper layer and through the bare
+// function table, best of 5 rounds of iterations: directHoldNs,
+// facadeHoldNs, directLifecycleNs, facadeLifecycleNs
+- (NSDictionary*)benchmarkWrapperFacadeWithIterations:(int)iterations;
+
+@end
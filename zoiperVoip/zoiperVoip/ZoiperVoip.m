@@ -7,10 +7,53 @@
 //
 
 #import "ZoiperVoip.h"
+#import "ZoiperVoip+Benchmark.h"
 #import "ZSDKLibControl.h"
+#import "ZSDKPollEngine.h"
+#import "ZSDKCallRegistry.h"
+#import "ZSDKUserManager.h"
+#import "ZSDKEventQueue.h"
+#import "ZSDKVideoReceiver.h"
+#import "ZSDKColorConvert.h"
+#import "ZSDKVideoSender.h"
+#import "ZSDKRateControl.h"
+#import "ZSDKTelemetry.h"
+#import "ZSDKExternalAudio.h"
+#import "ZSDKConference.h"
+#import "ZSDKMix.h"
+#import "ZSDKResamplerTune.h"
+#import "ZSDKRecorder.h"
+#import "ZSDKSoundCache.h"
+#import "ZSDKLog.h"
+#import "ZSDKStubWrapper.h"
+#import "ZSDKLoadGen.h"
+#import "ZSDKAsync.h"
+#import "ZSDKWrapperBench.h"
+#import "ZSDKTransportProbe.h"
+#import "ZSDKStunManager.h"
+#import "ZSDKCodecPolicy.h"
+#import "ZSDKPresence.h"
+#import "ZSDKBlf.h"
+#import "ZSDKMessaging.h"
 
 static ZoiperVoip * sharedInstance = nil;
-NSTimer*                    timerLibEvents;
+
+// Negotiated video format and encoder bitrate; the rate controller scales
+// down from here
+static const int   kVideoWidth   = 352;
+static const int   kVideoHeight  = 288;
+static const float kVideoFps     = 15;
+static const int   kVideoBitrate = 256000;
+
+// Last resampler benchmark, applied by the startup policy
+static NSString * const kResamplerProfileKey = @"ZSDKResamplerProfile";
+static double gResamplerFloorDb = kZSDKResamplerDefaultFloorDb;
+
+// Sounds preloaded into the sound cache by setupSIP
+static NSString * const kSoundManifestKey = @"ZSDKSoundManifest";
+
+// Probed SIP transports per network and server (ZSDKProbeCacheEntry array)
+static NSString * const kTransportCacheKey = @"ZSDKTransportCache";
 
 
 @implementation ZoiperVoip
@@ -43,61 +86,479 @@ NSTimer*                    timerLibEvents;
     InitLibrary(37248, 0);
     NSLog(@"Init SETUP SIP");
     
-    timerLibEvents = [NSTimer scheduledTimerWithTimeInterval:0.10 target:[ZoiperVoip sharedInstance] selector:@selector(onLibraryEventsPollTimer:) userInfo:nil repeats:YES];
+    ZSDKKernel kernel = ZSDKColorConvertInit(ZSDKKernelAuto);
+    NSLog(@"ZOIPER: colour conversion kernel %s", ZSDKColorConvertKernelName(kernel));
+    kernel = ZSDKMixInit(ZSDKKernelAuto);
+    NSLog(@"ZOIPER: audio mix kernel %s", ZSDKMixKernelName(kernel));
+    
+    [self applyResamplerPolicy];
+    [self preloadSounds:[[NSUserDefaults standardUserDefaults] arrayForKey:kSoundManifestKey]];
+    [self loadTransportCache];
+    
+    ZSDKPollEngineStart();
 }
 
 - (void)activationRegister:(NSString*)user password:(NSString*)pass {
     gWrapperCtx.StartActivationSDK(nil, [user UTF8String] , [pass UTF8String], NULL);
+    ZSDKPollEngineWakeup();
+}
+
+// Global media settings shared by every account; applied once
+- (void)configureMediaDefaults {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // Initialize codecs
+        gWrapperCtx.ClearCodecList();
+        
+        gWrapperCtx.AddCodec(CODEC_OPUS_FULL);
+        gWrapperCtx.AddCodec(CODEC_OPUS_NARROW);
+        gWrapperCtx.AddCodec(CODEC_OPUS_WIDE);
+        
+        gWrapperCtx.AddCodec(CODEC_PCMU);   // Audio codecs
+        gWrapperCtx.AddCodec(CODEC_GSM);
+        //gWrapperCtx.AddCodec(CODEC_VP8);    // Video codecs
+        gWrapperCtx.AddCodec(CODEC_H263);
+        gWrapperCtx.AddCodec(CODEC_H263_PLUS);
+        
+        // Per-account lists (ZSDKCodecPolicy) start from the same order
+        ZSDKCodecPolicyInit();
+        
+        // RTP parameters
+        gWrapperCtx.SetRTPSessionName( "Zoiper" );
+        gWrapperCtx.SetRTPUsername( "Zoiper" );
+        
+        // Set-up audio subsystem parameters
+        gWrapperCtx.UseEchoCancellation(0);
+        gWrapperCtx.UseAutomaticGainControl(0);
+        gWrapperCtx.UseNoiseSuppression(0);
+        
+        // Sets up video negotiation parameters
+        gWrapperCtx.ClearVideoFormats();
+        gWrapperCtx.AddVideoFormat(kVideoWidth, kVideoHeight, kVideoFps);   // Could add multiple formats if needed
+        gWrapperCtx.SetVideoBitrate(kVideoBitrate);
+        ZSDKRateControlSetBaseBitrate(kVideoBitrate);
+    });
 }
 
 - (void)registerSIPWithUser:(NSString*)user pass:(NSString*)pass server:(NSString*)server proxy:(NSString*)proxy {
- 
+    // The account registered last becomes the default for callNumber:
+    NSUInteger userId = [self addAccountWithUser:user pass:pass server:server proxy:proxy];
+    if (userId != INVALID_HANDLE)
+    {
+        gUserId = (UserHandler)userId;
+        ZSDKStunManagerWarmUser(userId, 1);
+    }
+    NSLog(@"PROBAAAAAANDDOO userID:%lu", gUserId);
+}
+
+- (NSUInteger)addAccountWithUser:(NSString*)user pass:(NSString*)pass server:(NSString*)server proxy:(NSString*)proxy {
     const char *cstrUser = [user cStringUsingEncoding:[NSString defaultCStringEncoding]];
     const char *cstrPassword = [pass cStringUsingEncoding:[NSString defaultCStringEncoding]];
     const char *cstrServer = [server cStringUsingEncoding:[NSString defaultCStringEncoding]];
     const char *cstrProxy = [proxy cStringUsingEncoding:[NSString defaultCStringEncoding]];
     
-    // Wrapper initialization
-    // First create a user
-    gUserId = gWrapperCtx.AddUser(PROTO_SIP, cstrUser, cstrPassword, cstrProxy, cstrServer, "", "");
+    [self configureMediaDefaults];
     
-    // Initialize codecs
-    gWrapperCtx.ClearCodecList();
+    // The REGISTER itself is paced by the user manager
+    UserHandler userId = ZSDKUserManagerAdd(cstrUser, cstrPassword, cstrServer, cstrProxy);
+    if (userId != INVALID_HANDLE)
+    {
+        ZSDKStunManagerOnUserAdded(userId);
+        ZSDKCodecPolicyApply(userId);
+    }
+    ZSDKPollEngineWakeup();
+    return userId;
+}
+
+- (NSUInteger)addAccountWithUser:(NSString*)user pass:(NSString*)pass server:(NSString*)server proxy:(NSString*)proxy timeoutMs:(int)timeoutMs completion:(void (^)(NSUInteger userId, BOOL registered, int causeCode))completion {
+    NSUInteger userId = [self addAccountWithUser:user pass:pass server:server proxy:proxy];
+    if (userId == INVALID_HANDLE)
+        return INVALID_HANDLE;
     
-    LIBRESULT res;
-    res = gWrapperCtx.AddCodec(CODEC_OPUS_FULL);
-    res = gWrapperCtx.AddCodec(CODEC_OPUS_NARROW);
-    res = gWrapperCtx.AddCodec(CODEC_OPUS_WIDE);
+    // Started in the same main queue turn, so the outcome cannot be missed
+    ZSDKAsyncOp op = ZSDKAsyncAwait(ZSDKAsyncRegistration, userId, timeoutMs, ^(Handler handle, LIBRESULT result, int causeCode) {
+        completion(handle, result == L_OK, causeCode);
+    });
+    if (!op)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(userId, NO, kZSDKAsyncCauseTimeout);
+        });
+    }
+    return userId;
+}
+
+- (void)removeAccount:(NSUInteger)userId {
+    ZSDKStunManagerWarmUser(userId, 0);
+    ZSDKUserManagerRemove(userId);
+    if (gUserId == (UserHandler)userId)
+        gUserId = INVALID_HANDLE;
+    ZSDKPollEngineWakeup();
+}
+
+- (void)setRegistrationTime:(int)seconds jitterPercent:(int)jitter {
+    ZSDKUserManagerSetRegistrationTime(seconds, jitter);
+}
+
+- (NSDictionary*)benchmarkRegistrationWithAccounts:(int)accounts {
+    ZSDKUserManagerBenchResult r;
+    if (!ZSDKUserManagerBenchmark(accounts, &r))
+        return nil;
+    return @{ @"accounts"          : @(r.accounts),
+              @"registered"        : @(r.registered),
+              @"addNs"             : @(r.addNs),
+              @"ticks"             : @(r.ticks),
+              @"registerMs"        : @(r.registerMs),
+              @"tickUs"            : @(r.tickUs),
+              @"callbackNs"        : @(r.callbackNs),
+              @"maxInFlight"       : @(r.maxInFlight),
+              @"refreshMinSeconds" : @(r.refreshMinSeconds),
+              @"refreshMaxSeconds" : @(r.refreshMaxSeconds) };
+}
+
+- (void)loadTransportCache {
+    NSData * data = [[NSUserDefaults standardUserDefaults] dataForKey:kTransportCacheKey];
+    if (data.length % sizeof(ZSDKProbeCacheEntry) == 0)
+        ZSDKTransportProbeImportCache(data.bytes, (int)(data.length / sizeof(ZSDKProbeCacheEntry)));
     
-    gWrapperCtx.AddCodec(CODEC_PCMU);   // Audio codecs
-    //gWrapperCtx.AddCodec(CODEC_PCMU);
-    gWrapperCtx.AddCodec(CODEC_GSM);
-    //gWrapperCtx.AddCodec(CODEC_VP8);    // Video codecs
-    gWrapperCtx.AddCodec(CODEC_H263);
-    gWrapperCtx.AddCodec(CODEC_H263_PLUS);
+    ZSDKTransportProbeSetCacheChanged(^{
+        ZSDKProbeCacheEntry entries[kZSDKProbeCacheEntries];
+        int count = ZSDKTransportProbeExportCache(entries, kZSDKProbeCacheEntries);
+        [[NSUserDefaults standardUserDefaults] setObject:[NSData dataWithBytes:entries length:count * sizeof(entries[0])]
+                                                  forKey:kTransportCacheKey];
+    });
+}
+
+- (void)setTransportProbingEnabled:(BOOL)enabled {
+    ZSDKTransportProbeSetEnabled(enabled);
+}
+
+- (void)setNetworkName:(NSString*)name {
+    ZSDKTransportProbeSetNetworkName([name UTF8String]);
+}
+
+- (void)clearTransportCache {
+    ZSDKTransportProbeClearCache();
+}
+
+- (NSDictionary*)transportProbeStatistics {
+    ZSDKProbeStats stats;
+    ZSDKTransportProbeGetStats(&stats);
     
-    // Set DTMF parameters
-    gWrapperCtx.SetUserDtmfBand( gUserId, E_DTMF_MEDIA_OUTBAND );
+    uint64_t ended = stats.successes + stats.failures + stats.timeouts;
+    return @{ @"lookups"       : @(stats.lookups),
+              @"cacheHits"     : @(stats.cacheHits),
+              @"probesStarted" : @(stats.probesStarted),
+              @"probesJoined"  : @(stats.probesJoined),
+              @"successes"     : @(stats.successes),
+              @"failures"      : @(stats.failures),
+              @"timeouts"      : @(stats.timeouts),
+              @"errors"        : @(stats.errors),
+              @"invalidations" : @(stats.invalidations),
+              @"meanProbeUs"   : @(ended ? stats.probeTimeTotalUs / ended : 0),
+              @"maxProbeUs"    : @(stats.probeTimeMaxUs),
+              @"running"       : @(stats.running),
+              @"cacheEntries"  : @(stats.cacheEntries),
+              @"fingerprint"   : @(ZSDKTransportProbeFingerprint()) };
+}
+
+- (BOOL)useStunServer:(NSString*)server port:(int)port refreshMs:(long)refreshMs {
+    if (!ZSDKStunManagerStart([server UTF8String], port, refreshMs))
+        return NO;
+    for (NSDictionary * account in [self accounts])
+        ZSDKStunManagerOnUserAdded([account[@"userId"] unsignedLongValue]);
+    return YES;
+}
+
+- (void)stopStun {
+    ZSDKStunManagerStop();
+}
+
+- (void)networkChanged {
+    ZSDKStunManagerNetworkChanged();
+}
+
+- (BOOL)setWarmStunPorts:(int)ports forAccount:(NSUInteger)userId {
+    return ZSDKStunManagerWarmUser(userId, ports);
+}
+
+- (NSDictionary*)stunStatistics {
+    ZSDKStunStats stats;
+    ZSDKStunManagerGetStats(&stats);
+    char warm[256], cold[256];
+    ZSDKStunManagerFirstMediaJSON(YES, warm, sizeof(warm));
+    ZSDKStunManagerFirstMediaJSON(NO, cold, sizeof(cold));
     
-    // RTP parameters
-    gWrapperCtx.SetRTPSessionName( "Zoiper" );
-    gWrapperCtx.SetRTPUsername( "Zoiper" );
+    const uint8_t * addr = (const uint8_t *)&stats.externalAddress;   // network byte order
+    NSString * external = [NSString stringWithFormat:@"%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]];
     
-    // Set-up audio subsystem parameters
-    gWrapperCtx.UseEchoCancellation(0);
-    gWrapperCtx.UseAutomaticGainControl(0);
-    gWrapperCtx.UseNoiseSuppression(0);
+    uint64_t ready = stats.portsReady;
+    return @{ @"state"             : @(stats.state),
+              @"networkType"       : @(stats.networkType),
+              @"externalAddress"   : external,
+              @"externalPort"      : @(stats.externalPort),
+              @"resolves"          : @(stats.resolves),
+              @"networkChanges"    : @(stats.networkChanges),
+              @"resolveTimeLastUs" : @(stats.resolveTimeLastUs),
+              @"resolveTimeMaxUs"  : @(stats.resolveTimeMaxUs),
+              @"portsRequested"    : @(stats.portsRequested),
+              @"portsReady"        : @(stats.portsReady),
+              @"portsFailed"       : @(stats.portsFailed),
+              @"portsStale"        : @(stats.portsStale),
+              @"meanPortUs"        : @(ready ? stats.portLatencyTotalUs / ready : 0),
+              @"maxPortUs"         : @(stats.portLatencyMaxUs),
+              @"warmPorts"         : @(stats.warmPorts),
+              @"callsWarm"         : @(stats.callsWarm),
+              @"callsCold"         : @(stats.callsCold),
+              @"firstMediaWarm"    : [NSString stringWithUTF8String:warm],
+              @"firstMediaCold"    : [NSString stringWithUTF8String:cold] };
+}
+
+- (void)resetFirstMediaStatistics {
+    ZSDKStunManagerResetFirstMedia();
+}
+
+- (void)setCodecPolicyEnabled:(BOOL)enabled {
+    ZSDKCodecPolicySetEnabled(enabled);
+    for (NSDictionary * account in [self accounts])
+        ZSDKCodecPolicyApply([account[@"userId"] unsignedLongValue]);
+}
+
+- (NSDictionary*)codecPolicyStatistics {
+    ZSDKCodecPolicyStats stats;
+    ZSDKCodecPolicyGetStats(&stats);
+    ZSDKCodecCallReport reports[kZSDKCodecCallReports];
+    int count = ZSDKCodecPolicyCallReports(reports, kZSDKCodecCallReports);
     
-    // Sets up video negotiation parameters
-    gWrapperCtx.ClearVideoFormats();
-    gWrapperCtx.AddVideoFormat(352, 288, 15);   // Could add multiple formats if needed
-    gWrapperCtx.SetVideoBitrate(256000);
+    NSMutableArray * recent = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        [recent addObject:@{ @"callId"     : @(reports[i].callId),
+                             @"userId"     : @(reports[i].userId),
+                             @"profile"    : @(reports[i].profile),
+                             @"codec"      : @(reports[i].codec),
+                             @"durationMs" : @(reports[i].durationMs),
+                             @"bytesSent"  : @(reports[i].bytesSent),
+                             @"bytesSaved" : @(reports[i].bytesSaved) }];
+    }
+    return @{ @"supportedCodecs"  : @(stats.supportedCodecs),
+              @"listsApplied"     : @(stats.listsApplied),
+              @"profileChanges"   : @(stats.profileChanges),
+              @"calls"            : @(stats.calls),
+              @"callsConstrained" : @(stats.callsConstrained),
+              @"bytesSent"        : @(stats.bytesSent),
+              @"bytesSaved"       : @(stats.bytesSaved),
+              @"baselineBps"      : @(stats.baselineBps),
+              @"recentCalls"      : recent };
+}
+
+- (void)setPresenceHandler:(void (^)(NSArray * changes))handler {
+    if (!handler)
+    {
+        ZSDKPresenceSetHandler(nil);
+        return;
+    }
     
-    // finally, register the user
-    gWrapperCtx.RegisterUser(gUserId);
-    NSLog(@"PROBAAAAAANDDOO userID:%d", gUserId);
+    ZSDKPresenceSetHandler(^(const ZSDKPresenceChange * changes, int count) {
+        NSMutableArray * batch = [NSMutableArray arrayWithCapacity:count];
+        for (int i = 0; i < count; i++)
+        {
+            [batch addObject:@{ @"contact" : @(changes[i].contact),
+                                @"status"  : @(changes[i].status),
+                                @"phase"   : @(changes[i].phase),
+                                @"note"    : [NSString stringWithUTF8String:changes[i].note] }];
+        }
+        handler(batch);
+    });
+}
+
+- (NSInteger)addContact:(NSString*)number forAccount:(NSUInteger)userId {
+    return ZSDKPresenceAdd((UserHandler)userId, [number UTF8String], CONTACT_SUBSCRIBE_PRESENCE);
+}
+
+- (void)removeContact:(NSInteger)contactId {
+    ZSDKPresenceRemove((ZSDKContactId)contactId);
 }
 
+- (void)refreshContacts {
+    ZSDKPresenceRefreshAll();
+}
+
+- (BOOL)publishStatus:(int)status note:(NSString*)note forAccount:(NSUInteger)userId {
+    return ZSDKPresencePublish((UserHandler)userId, (eContactState_t)status, [note UTF8String]);
+}
+
+- (NSDictionary*)presenceStatistics {
+    ZSDKPresenceStats stats;
+    ZSDKPresenceGetStats(&stats);
+    return @{ @"contacts"            : @(stats.contacts),
+              @"subscribed"          : @(stats.subscribed),
+              @"pending"             : @(stats.pending),
+              @"subscribes"          : @(stats.subscribes),
+              @"refreshes"           : @(stats.refreshes),
+              @"statusCallbacks"     : @(stats.statusCallbacks),
+              @"changesDelivered"    : @(stats.changesDelivered),
+              @"batches"             : @(stats.batches),
+              @"maxBatch"            : @(stats.maxBatch),
+              @"terminations"        : @(stats.terminations),
+              @"publications"        : @(stats.publications),
+              @"publicationFailures" : @(stats.publicationFailures) };
+}
+
+- (NSDictionary*)benchmarkPresenceWithContacts:(int)contacts updates:(int)updates {
+    ZSDKPresenceBenchResult r;
+    if (!ZSDKPresenceBenchmark(contacts, updates, &r))
+        return nil;
+    return @{ @"contacts"    : @(r.contacts),
+              @"updates"     : @(r.updates),
+              @"addNs"       : @(r.addNs),
+              @"subscribeMs" : @(r.subscribeMs),
+              @"updateNs"    : @(r.updateNs),
+              @"drainNs"     : @(r.drainNs),
+              @"delivered"   : @(r.delivered),
+              @"tableBytes"  : @(r.tableBytes) };
+}
+
+- (NSInteger)addPeer:(NSString*)number name:(NSString*)name forAccount:(NSUInteger)userId {
+    return ZSDKBlfAddPeer((UserHandler)userId, [name UTF8String], [number UTF8String]);
+}
+
+- (void)removePeer:(NSInteger)peerId {
+    ZSDKBlfRemovePeer((ZSDKBlfPeerId)peerId);
+}
+
+- (void)setPeerChangedHandler:(void (^)(NSUInteger version))handler {
+    if (!handler)
+    {
+        ZSDKBlfSetChangedHandler(nil);
+        return;
+    }
+    
+    ZSDKBlfSetChangedHandler(^(uint32_t version) {
+        handler(version);
+    });
+}
+
+- (NSDictionary*)peerChangesSinceVersion:(NSUInteger)version {
+    static ZSDKBlfPeerState states[kZSDKBlfMaxPeers];
+    uint32_t next = 0;
+    int count = ZSDKBlfChangesSince((uint32_t)version, states, kZSDKBlfMaxPeers, &next);
+    
+    NSMutableArray * peers = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        [peers addObject:@{ @"peer"    : @(states[i].peer),
+                            @"lamp"    : @(states[i].lamp),
+                            @"dialogs" : @(states[i].dialogs),
+                            @"name"    : [NSString stringWithUTF8String:states[i].name],
+                            @"number"  : [NSString stringWithUTF8String:states[i].number] }];
+    }
+    return @{ @"version" : @(next),
+              @"peers"   : peers };
+}
+
+- (NSDictionary*)peerStatistics {
+    ZSDKBlfStats stats;
+    ZSDKBlfGetStats(&stats);
+    return @{ @"peers"           : @(stats.peers),
+              @"dialogs"         : @(stats.dialogs),
+              @"version"         : @(stats.version),
+              @"callbacks"       : @(stats.callbacks),
+              @"updates"         : @(stats.updates),
+              @"flushes"         : @(stats.flushes),
+              @"dialogTableFull" : @(stats.dialogTableFull),
+              @"unknownDialogs"  : @(stats.unknownDialogs) };
+}
+
+- (void)setMessageHandler:(void (^)(NSArray * messages))handler {
+    if (!handler)
+    {
+        ZSDKMessagingSetHandler(nil);
+        return;
+    }
+    
+    ZSDKMessagingSetHandler(^(const ZSDKMessageEvent * events, int count) {
+        static NSString * const kinds[] = { @"sent", @"failed", @"received" };
+        NSMutableArray * batch = [NSMutableArray arrayWithCapacity:count];
+        for (int i = 0; i < count; i++)
+        {
+            NSString * body = [[NSString alloc] initWithBytes:events[i].body
+                                                       length:events[i].length
+                                                     encoding:NSUTF8StringEncoding];
+            [batch addObject:@{ @"kind"      : kinds[events[i].kind],
+                                @"message"   : @(events[i].message),
+                                @"contact"   : @(events[i].contact),
+                                @"attempts"  : @(events[i].attempts),
+                                @"causeCode" : @(events[i].causeCode),
+                                @"body"      : body ? body : @"",
+                                @"from"      : [NSString stringWithUTF8String:events[i].from] }];
+        }
+        handler(batch);
+    });
+}
+
+- (NSUInteger)sendMessage:(NSString*)text toContact:(NSInteger)contactId {
+    NSData * body = [text dataUsingEncoding:NSUTF8StringEncoding];
+    return ZSDKMessagingSend((ZSDKContactId)contactId, [body bytes], (int)[body length]);
+}
+
+- (void)setComposing:(BOOL)active toContact:(NSInteger)contactId {
+    ZSDKMessagingSetComposing((ZSDKContactId)contactId, active);
+}
+
+- (NSDictionary*)messagingStatistics {
+    ZSDKMessagingStats stats;
+    ZSDKMessagingGetStats(&stats);
+    return @{ @"queued"              : @(stats.queued),
+              @"inFlight"            : @(stats.inFlight),
+              @"arenaBytes"          : @(stats.arenaBytes),
+              @"arenaHighWater"      : @(stats.arenaHighWater),
+              @"sent"                : @(stats.sent),
+              @"failed"              : @(stats.failed),
+              @"retries"             : @(stats.retries),
+              @"received"            : @(stats.received),
+              @"receivedDropped"     : @(stats.receivedDropped),
+              @"queueFull"           : @(stats.queueFull),
+              @"composingSent"       : @(stats.composingSent),
+              @"composingSuppressed" : @(stats.composingSuppressed),
+              @"batches"             : @(stats.batches) };
+}
+
+- (NSDictionary*)benchmarkMessagingWithContacts:(int)contacts messages:(int)messages bodyBytes:(int)bodyBytes failPercent:(int)failPercent {
+    ZSDKMessagingBenchResult r;
+    if (!ZSDKMessagingBenchmark(contacts, messages, bodyBytes, failPercent, &r))
+        return nil;
+    return @{ @"contacts"          : @(r.contacts),
+              @"messages"          : @(r.messages),
+              @"bodyBytes"         : @(r.bodyBytes),
+              @"failPercent"       : @(r.failPercent),
+              @"messagesPerSecond" : @(r.messagesPerSecond),
+              @"queueNs"           : @(r.queueNs),
+              @"pumpTicks"         : @(r.pumpTicks),
+              @"maxInFlight"       : @(r.maxInFlight),
+              @"retries"           : @(r.retries),
+              @"failed"            : @(r.failed),
+              @"arenaHighWater"    : @(r.arenaHighWater) };
+}
+
+- (NSArray*)accounts {
+    static ZSDKUser users[kZSDKMaxUsers];   // too large for the stack; main thread only
+    int count = ZSDKUserManagerSnapshot(users, kZSDKMaxUsers);
+    
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        [result addObject:@{ @"userId"              : @(users[i].userId),
+                             @"user"                : [NSString stringWithUTF8String:users[i].user],
+                             @"server"              : [NSString stringWithUTF8String:users[i].server],
+                             @"state"               : @(users[i].state),
+                             @"transport"           : @(users[i].transport),
+                             @"registrationSeconds" : @(users[i].registrationSeconds),
+                             @"retries"             : @(users[i].retries),
+                             @"causeCode"           : @(users[i].causeCode) }];
+    }
+    return result;
+}
 
 - (void)ctxRegistrationSucceeded:(NSNotification*)notification {
     //[[NSNotificationCenter defaultCenter] removeObserver:self
@@ -106,22 +567,744 @@ NSTimer*                    timerLibEvents;
     NSLog(@"------ ZOIPER: La registracion fue exitosa -------");
 }
 
-- (void)callNumber:(NSString*)tel {
+- (NSUInteger)callNumber:(NSString*)tel {
+    return [self callNumber:tel fromAccount:gUserId];
+}
+
+- (NSUInteger)callNumber:(NSString*)tel fromAccount:(NSUInteger)userId {
     const char *cstrNumber = [tel cStringUsingEncoding:[NSString defaultCStringEncoding]];
-    gWrapperCtx.CallCreate(gUserId, cstrNumber, &gCallId);
+    CallHandler callId = INVALID_HANDLE;
+    if (gWrapperCtx.CallCreate(userId, cstrNumber, &callId) != L_OK)
+        return INVALID_HANDLE;
+    
+    // onCallCreate adds the record and keeps polling on; the call may end
+    // before CallCreate() even returns
+    ZSDKPollEngineWakeup();
+    return callId;
+}
+
+- (NSUInteger)callNumber:(NSString*)tel fromAccount:(NSUInteger)userId timeoutMs:(int)timeoutMs completion:(void (^)(NSUInteger callId, BOOL accepted, int causeCode))completion {
+    NSUInteger callId = [self callNumber:tel fromAccount:userId];
+    if (callId == INVALID_HANDLE)
+        return INVALID_HANDLE;
+    
+    ZSDKAsyncOp op = ZSDKAsyncAwait(ZSDKAsyncCall, callId, timeoutMs, ^(Handler handle, LIBRESULT result, int causeCode) {
+        completion(handle, result == L_OK, causeCode);
+    });
+    if (!op)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(callId, NO, kZSDKAsyncCauseTimeout);
+        });
+    }
+    return callId;
 }
 
 - (void)callHangout {
-    if (gbInCall)
-        gWrapperCtx.CallHangup(gCallId);
+    ZSDKCallRegistryLock();
+    ZSDKCall * call = ZSDKCallRegistryCurrent();
+    CallHandler callId = call ? call->callId : INVALID_HANDLE;
+    ZSDKCallRegistryUnlock();
+    
+    if (callId != INVALID_HANDLE)
+        [self hangupCall:callId];
+}
+
+- (void)hangupCall:(NSUInteger)callId {
+    gWrapperCtx.CallHangup(callId);
+    ZSDKPollEngineWakeup();
+}
+
+- (void)answerCall:(NSUInteger)callId {
+    gWrapperCtx.CallAccept(callId);
+    ZSDKPollEngineWakeup();
+}
+
+- (void)holdCall:(NSUInteger)callId {
+    gWrapperCtx.CallHold(callId);
+    ZSDKPollEngineWakeup();
+}
+
+- (void)unholdCall:(NSUInteger)callId {
+    gWrapperCtx.CallUnhold(callId);
+    ZSDKPollEngineWakeup();
+}
+
+- (void)holdCall:(NSUInteger)callId completion:(void (^)(BOOL done))completion {
+    [self awaitCall:callId kind:ZSDKAsyncHold afterResult:gWrapperCtx.CallHold(callId) completion:completion];
+}
+
+- (void)unholdCall:(NSUInteger)callId completion:(void (^)(BOOL done))completion {
+    [self awaitCall:callId kind:ZSDKAsyncUnhold afterResult:gWrapperCtx.CallUnhold(callId) completion:completion];
+}
+
+- (void)awaitCall:(NSUInteger)callId kind:(ZSDKAsyncKind)kind afterResult:(LIBRESULT)res completion:(void (^)(BOOL done))completion {
+    ZSDKPollEngineWakeup();
+    ZSDKAsyncOp op = 0;
+    if (res == L_OK)
+    {
+        op = ZSDKAsyncAwait(kind, callId, kZSDKAsyncHoldTimeoutMs, ^(Handler handle, LIBRESULT result, int causeCode) {
+            completion(result == L_OK);
+        });
+    }
+    if (!op)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(NO);
+        });
+    }
+}
+
+- (NSDictionary*)asyncOperationStatistics {
+    ZSDKAsyncStats stats;
+    ZSDKAsyncGetStats(&stats);
+    
+    return @{ @"started"    : @(stats.started),
+              @"succeeded"  : @(stats.succeeded),
+              @"failed"     : @(stats.failed),
+              @"timedOut"   : @(stats.timedOut),
+              @"cancelled"  : @(stats.cancelled),
+              @"exhausted"  : @(stats.exhausted),
+              @"pending"    : @(stats.pending),
+              @"maxPending" : @(stats.maxPending) };
+}
+
+- (void)transferCall:(NSUInteger)callId toNumber:(NSString*)number {
+    gWrapperCtx.UnattendedCallTransfer(callId, [number UTF8String]);
+    ZSDKPollEngineWakeup();
+}
+
+- (void)transferCall:(NSUInteger)callId toCall:(NSUInteger)otherCallId {
+    gWrapperCtx.AttendedCallTransfer(callId, otherCallId);
+    ZSDKPollEngineWakeup();
+}
+
+- (NSArray*)activeCalls {
+    ZSDKCall calls[kZSDKMaxCalls];
+    ZSDKCallRegistryLock();
+    int count = ZSDKCallRegistrySnapshot(calls, kZSDKMaxCalls);
+    ZSDKCallRegistryUnlock();
+    
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        [result addObject:@{ @"callId"     : @(calls[i].callId),
+                             @"userId"     : @(calls[i].userId),
+                             @"state"      : @(calls[i].state),
+                             @"incoming"   : @(calls[i].direction == eIncommingCall),
+                             @"codec"      : @(calls[i].codec),
+                             @"video"      : @(calls[i].videoThreadId != NULL),
+                             @"peer"       : [NSString stringWithUTF8String:calls[i].peer],
+                             @"createdUs"  : @(calls[i].createdUs),
+                             @"acceptedUs" : @(calls[i].acceptedUs) }];
+    }
+    return result;
+}
+
+- (BOOL)takeVideoFrameForCall:(NSUInteger)callId handler:(ZoiperVideoFrameHandler)handler {
+    ZSDKVideoFrame * frame = ZSDKVideoReceiverTakeFrame(ZSDKCallRegistrySlot(callId));
+    if (!frame)
+        return NO;
+    
+    handler(frame->width, frame->height,
+            frame->planes[0], frame->planes[1], frame->planes[2],
+            frame->strides[0], frame->strides[1], frame->strides[2]);
+    ZSDKVideoFrameRelease(frame);
+    return YES;
+}
+
+- (NSDictionary*)videoStatisticsForCall:(NSUInteger)callId {
+    ZSDKVideoReceiveStats stats;
+    ZSDKVideoReceiverGetStats(ZSDKCallRegistrySlot(callId), &stats);
+    
+    return @{ @"framesReceived"  : @(stats.framesReceived),
+              @"framesDelivered" : @(stats.framesDelivered),
+              @"framesDropped"   : @(stats.framesDropped),
+              @"copyBytes"       : @(stats.copyBytes) };
+}
+
+- (BOOL)sendVideoFrameForCall:(NSUInteger)callId bgra:(const uint8_t *)pixels stride:(int)stride width:(int)width height:(int)height {
+    return ZSDKVideoSenderSubmitBGRA(ZSDKCallRegistrySlot(callId), pixels, stride, width, height);
+}
+
+- (BOOL)sendVideoFrameForCall:(NSUInteger)callId nv12Y:(const uint8_t *)y yStride:(int)yStride uv:(const uint8_t *)uv uvStride:(int)uvStride width:(int)width height:(int)height {
+    return ZSDKVideoSenderSubmitNV12(ZSDKCallRegistrySlot(callId), y, yStride, uv, uvStride, width, height);
+}
+
+- (NSDictionary*)videoSendStatisticsForCall:(NSUInteger)callId {
+    ZSDKVideoSendStats stats;
+    ZSDKVideoSenderGetStats(ZSDKCallRegistrySlot(callId), &stats);
+    
+    return @{ @"framesSubmitted"   : @(stats.framesSubmitted),
+              @"framesSent"        : @(stats.framesSent),
+              @"droppedPacing"     : @(stats.droppedPacing),
+              @"droppedBusy"       : @(stats.droppedBusy),
+              @"droppedLag"        : @(stats.droppedLag),
+              @"sendErrors"        : @(stats.sendErrors),
+              @"sendLatencyMaxUs"  : @(stats.sendLatencyMaxUs),
+              @"queueLatencyMaxUs" : @(stats.queueLatencyMaxUs),
+              @"width"             : @(stats.width),
+              @"height"            : @(stats.height),
+              @"fps"               : @(stats.fps),
+              @"skip"              : @(stats.skip) };
+}
+
+- (void)setAdaptiveVideoEnabled:(BOOL)enabled {
+    ZSDKRateControlSetEnabled(enabled);
 }
 
-/************************************
- *  onLibraryEventsPollTimer
- ************************************/
-- (void)onLibraryEventsPollTimer:(NSTimer *)timer
+static NSDictionary * rungDictionary(int level, const ZSDKRateRung * rung)
 {
-    PollLibrary();
+    return @{ @"level"   : @(level),
+              @"bitrate" : @(rung->bitrate),
+              @"width"   : @(rung->width),
+              @"height"  : @(rung->height),
+              @"fps"     : @(rung->fps) };
+}
+
+- (NSDictionary*)videoRateStateForCall:(NSUInteger)callId {
+    ZSDKRateState state;
+    ZSDKRateRung rung;
+    int slot = ZSDKCallRegistrySlot(callId);
+    ZSDKRateControlGetState(slot, &state, &rung);
+    
+    NSMutableDictionary * result = [rungDictionary(state.level, &rung) mutableCopy];
+    [result addEntriesFromDictionary:@{ @"lossPermil" : @(state.lossPermil),
+                                        @"jitterMs"   : @(state.jitterMs),
+                                        @"quality"    : @(state.quality),
+                                        @"changes"    : @(state.changes),
+                                        @"impairedMs" : @(state.impairedMs) }];
+    
+    ZSDKRateChange changes[kZSDKRateHistory];
+    int count = ZSDKRateControlGetChanges(slot, changes, kZSDKRateHistory);
+    NSMutableArray * recent = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        NSMutableDictionary * change = [rungDictionary(changes[i].level, &changes[i].rung) mutableCopy];
+        [change addEntriesFromDictionary:@{ @"timeMs"     : @(changes[i].timeMs),
+                                            @"lossPermil" : @(changes[i].lossPermil),
+                                            @"jitterMs"   : @(changes[i].jitterMs),
+                                            @"quality"    : @(changes[i].quality) }];
+        [recent addObject:change];
+    }
+    result[@"recentChanges"] = recent;
+    return result;
+}
+
+- (NSArray*)replayVideoRateTrace:(NSArray*)samples {
+    int count = (int)samples.count;
+    ZSDKRateSample * trace = calloc(count ? count : 1, sizeof(ZSDKRateSample));
+    int * levels = calloc(count ? count : 1, sizeof(int));
+    
+    for (int i = 0; i < count; i++)
+    {
+        NSDictionary * sample = samples[i];
+        trace[i].timeMs     = [sample[@"timeMs"] unsignedLongLongValue];
+        trace[i].lossPermil = sample[@"lossPermil"] ? [sample[@"lossPermil"] intValue] : -1;
+        trace[i].jitterMs   = [sample[@"jitterMs"] intValue];
+        trace[i].quality    = sample[@"quality"] ? [sample[@"quality"] intValue] : -1;
+    }
+    ZSDKRateControlReplay(trace, count, levels, NULL);
+    
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        ZSDKRateRung rung;
+        ZSDKRateControlRung(levels[i], kVideoWidth, kVideoHeight, kVideoFps, kVideoBitrate, &rung);
+        [result addObject:rungDictionary(levels[i], &rung)];
+    }
+    free(trace);
+    free(levels);
+    return result;
+}
+
+- (NSData*)telemetryDataForCall:(NSUInteger)callId {
+    size_t length = 0;
+    uint8_t * bytes = ZSDKTelemetryExportBinary(callId, ZSDKTelemetryFindCall(callId), &length);
+    if (!bytes)
+        return nil;
+    return [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
+- (NSString*)telemetryCSVForCall:(NSUInteger)callId {
+    size_t length = 0;
+    char * csv = ZSDKTelemetryExportCSV(callId, ZSDKTelemetryFindCall(callId), &length);
+    if (!csv)
+        return nil;
+    return [[NSString alloc] initWithBytesNoCopy:csv length:length
+                                        encoding:NSUTF8StringEncoding freeWhenDone:YES];
+}
+
+- (BOOL)useExternalAudioWithSampleRate:(int)sampleRate samplesPerFrame:(int)samplesPerFrame {
+    return ZSDKExternalAudioConfigure(sampleRate, samplesPerFrame);
+}
+
+- (int)writeExternalAudioInput:(const int16_t *)samples count:(int)count {
+    return ZSDKExternalAudioWrite(samples, count);
+}
+
+- (int)readExternalAudioOutput:(int16_t *)samples count:(int)count {
+    return ZSDKExternalAudioRead(samples, count);
+}
+
+- (void)setExternalAudioDeviceLatency:(int)latencyMs {
+    ZSDKExternalAudioSetDeviceLatency(latencyMs);
+}
+
+- (NSDictionary*)externalAudioStatistics {
+    ZSDKExtAudioStats stats;
+    ZSDKExternalAudioGetStats(&stats);
+    
+    return @{ @"frames"          : @(stats.frames),
+              @"underruns"       : @(stats.underruns),
+              @"overruns"        : @(stats.overruns),
+              @"lateFrames"      : @(stats.lateFrames),
+              @"processMaxUs"    : @(stats.processMaxUs),
+              @"latencyMs"       : @(stats.latencyMs),
+              @"latencyMaxMs"    : @(stats.latencyMaxMs),
+              @"sampleRate"      : @(stats.sampleRate),
+              @"samplesPerFrame" : @(stats.samplesPerFrame),
+              @"running"         : @(stats.running) };
+}
+
+- (NSUInteger)createConference {
+    return ZSDKConferenceCreate();
+}
+
+- (BOOL)destroyConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceDestroy(conferenceId) == L_OK;
+}
+
+- (BOOL)holdConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceHold(conferenceId, YES) == L_OK;
+}
+
+- (BOOL)unholdConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceHold(conferenceId, NO) == L_OK;
+}
+
+- (BOOL)joinCall:(NSUInteger)callId toConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceJoin(conferenceId, callId) == L_OK;
+}
+
+- (BOOL)removeCall:(NSUInteger)callId fromConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceLeave(conferenceId, callId) == L_OK;
+}
+
+- (BOOL)setMuted:(BOOL)muted forCall:(NSUInteger)callId inConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceSetMuted(conferenceId, callId, muted) == L_OK;
+}
+
+- (BOOL)setGain:(float)gain forCall:(NSUInteger)callId inConference:(NSUInteger)conferenceId {
+    return ZSDKConferenceSetGain(conferenceId, callId, gain) == L_OK;
+}
+
+- (NSArray*)conferenceParticipants:(NSUInteger)conferenceId {
+    ZSDKParticipant participants[kZSDKMaxParticipants];
+    int count = ZSDKConferenceParticipants(conferenceId, participants, kZSDKMaxParticipants);
+    if (count < 0)
+        return nil;
+    
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++)
+    {
+        [result addObject:@{ @"callId" : @(participants[i].callId),
+                             @"gain"   : @(participants[i].gain),
+                             @"muted"  : @(participants[i].muted) }];
+    }
+    return result;
+}
+
+- (BOOL)mixConference:(NSUInteger)conferenceId inputs:(const int16_t * const *)inputs outputs:(int16_t * const *)outputs count:(int)count samples:(int)samples {
+    return ZSDKConferenceMix(conferenceId, inputs, outputs, count, samples);
+}
+
+- (NSDictionary*)conferenceMixStatistics:(NSUInteger)conferenceId {
+    ZSDKConferenceMixStats stats;
+    ZSDKConferenceGetMixStats(conferenceId, &stats);
+    
+    return @{ @"frames"     : @(stats.frames),
+              @"mixMaxUs"   : @(stats.mixMaxUs),
+              @"mixAvgUs"   : @(stats.frames ? stats.mixTotalUs / stats.frames : 0) };
+}
+
+- (NSDictionary*)benchmarkConferenceMixWithParticipants:(int)participants samplesPerFrame:(int)samples {
+    static const ZSDKKernel kernels[] = { ZSDKKernelScalar, ZSDKKernelSSE2, ZSDKKernelAVX2, ZSDKKernelNEON };
+    NSMutableDictionary * result = [NSMutableDictionary dictionary];
+    for (int i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++)
+    {
+        // 500 frames of 20 ms: 10 s of audio per kernel
+        double ns = ZSDKMixBenchmark(kernels[i], participants, samples, 500);
+        if (ns >= 0)
+            result[[NSString stringWithUTF8String:ZSDKMixKernelName(kernels[i])]] = @(ns);
+    }
+    return result;
+}
+
+- (NSDictionary*)benchmarkColorConvertWithWidth:(int)width height:(int)height {
+    static const ZSDKKernel kernels[] = { ZSDKKernelScalar, ZSDKKernelSSE4, ZSDKKernelAVX2, ZSDKKernelNEON };
+    NSMutableDictionary * result = [NSMutableDictionary dictionary];
+    for (int i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++)
+    {
+        // 100 frames: a few seconds of capture at 30 fps
+        double nv12  = ZSDKColorConvertBenchmark(kernels[i], ZSDKConvertBenchNV12, width, height, 100);
+        double bgra  = ZSDKColorConvertBenchmark(kernels[i], ZSDKConvertBenchBGRA, width, height, 100);
+        double halve = ZSDKColorConvertBenchmark(kernels[i], ZSDKConvertBenchHalve, width, height, 100);
+        if (nv12 >= 0 && bgra >= 0 && halve >= 0)
+            result[[NSString stringWithUTF8String:ZSDKColorConvertKernelName(kernels[i])]] =
+                @{ @"nv12"  : @(nv12),
+                   @"bgra"  : @(bgra),
+                   @"halve" : @(halve) };
+    }
+    return result;
+}
+
+- (void)setResamplerQualityFloor:(double)snrDb {
+    gResamplerFloorDb = snrDb;
+}
+
+// Picks the resampler from the stored benchmark profile for the current
+// core count and load; keeps the driver default without a profile
+- (eAudioResampler_t)applyResamplerPolicy {
+    NSArray * profile = [[NSUserDefaults standardUserDefaults] arrayForKey:kResamplerProfileKey];
+    int count = (int)profile.count;
+    if (count == 0)
+        return E_AUDIO_DRV_RESAMPLER_DEFAULT;
+    
+    ZSDKResamplerResult * results = calloc(count, sizeof(ZSDKResamplerResult));
+    if (!results)
+        return E_AUDIO_DRV_RESAMPLER_DEFAULT;
+    
+    for (int i = 0; i < count; i++)
+    {
+        NSDictionary * entry = profile[i];
+        results[i].type           = (eAudioResampler_t)[entry[@"type"] intValue];
+        results[i].fromHz         = [entry[@"fromHz"] intValue];
+        results[i].toHz           = [entry[@"toHz"] intValue];
+        results[i].cpuMsPerSecond = [entry[@"cpuMsPerSecond"] doubleValue];
+        results[i].snrDb          = [entry[@"snrDb"] doubleValue];
+        results[i].samples        = [entry[@"samples"] intValue];
+    }
+    
+    int cores;
+    double load;
+    ZSDKResamplerSystemLoad(&cores, &load);
+    eAudioResampler_t type = ZSDKResamplerChoose(results, count, gResamplerFloorDb, cores, load);
+    free(results);
+    
+    if (gWrapperCtx.SetAudioResamplerType)
+        gWrapperCtx.SetAudioResamplerType(type);
+    NSLog(@"ZOIPER: resampler %s (floor %.0f dB, %d cores, load %.2f)",
+          ZSDKResamplerName(type), gResamplerFloorDb, cores, load);
+    return type;
+}
+
+- (BOOL)benchmarkResamplersWithCompletion:(void (^)(NSArray * results, NSString * chosen))completion {
+    return ZSDKResamplerRunBenchmark(^(const ZSDKResamplerResult * results, int count) {
+        NSMutableArray * profile = [NSMutableArray arrayWithCapacity:count];
+        for (int i = 0; i < count; i++)
+        {
+            [profile addObject:@{ @"type"           : @(results[i].type),
+                                  @"resampler"      : [NSString stringWithUTF8String:ZSDKResamplerName(results[i].type)],
+                                  @"fromHz"         : @(results[i].fromHz),
+                                  @"toHz"           : @(results[i].toHz),
+                                  @"cpuMsPerSecond" : @(results[i].cpuMsPerSecond),
+                                  @"snrDb"          : @(results[i].snrDb),
+                                  @"samples"        : @(results[i].samples) }];
+        }
+        [[NSUserDefaults standardUserDefaults] setObject:profile forKey:kResamplerProfileKey];
+        
+        eAudioResampler_t chosen = [self applyResamplerPolicy];
+        if (completion)
+            completion(profile, [NSString stringWithUTF8String:ZSDKResamplerName(chosen)]);
+    });
+}
+
+- (NSInteger)startMicrophoneRecordingToFile:(NSString*)path compressed:(BOOL)compressed sampleRate:(int)sampleRate channels:(int)channels {
+    return ZSDKRecorderStartMicrophone([path fileSystemRepresentation],
+                                       compressed ? ZSDKRecordIMAADPCM : ZSDKRecordPCM, sampleRate, channels);
+}
+
+- (NSInteger)openRecordingToFile:(NSString*)path compressed:(BOOL)compressed sampleRate:(int)sampleRate channels:(int)channels {
+    return ZSDKRecorderOpen([path fileSystemRepresentation],
+                            compressed ? ZSDKRecordIMAADPCM : ZSDKRecordPCM, sampleRate, channels);
+}
+
+- (BOOL)writeRecording:(NSInteger)recordingId samples:(const int16_t *)samples frames:(int)frames {
+    return ZSDKRecorderWrite((int)recordingId, samples, frames);
+}
+
+- (void)closeRecording:(NSInteger)recordingId {
+    ZSDKRecorderClose((int)recordingId);
+}
+
+- (BOOL)startCallRecording:(NSUInteger)callId toFile:(NSString*)path compressed:(BOOL)compressed stereo:(BOOL)stereo {
+    return ZSDKRecorderStartCall((CallHandler)callId, [path fileSystemRepresentation],
+                                 compressed ? ZSDKRecordIMAADPCM : ZSDKRecordPCM,
+                                 stereo ? E_RECORDING_STEREO : E_RECORDING_MIXED);
+}
+
+- (void)stopCallRecording:(NSUInteger)callId {
+    ZSDKRecorderStopCall((CallHandler)callId);
+}
+
+- (NSDictionary*)recordingStatistics:(NSInteger)recordingId {
+    ZSDKRecorderStats stats;
+    if (recordingId < 0)
+        ZSDKRecorderGetTotals(&stats);
+    else
+        ZSDKRecorderGetStats((int)recordingId, &stats);
+    
+    NSMutableDictionary * result = [@{ @"framesWritten" : @(stats.framesWritten),
+                                       @"framesDropped" : @(stats.framesDropped),
+                                       @"bytesWritten"  : @(stats.bytesWritten),
+                                       @"writeErrors"   : @(stats.writeErrors) } mutableCopy];
+    if (recordingId < 0)
+    {
+        result[@"blocksInUse"]    = @(stats.blocksInUse);
+        result[@"blocksInUseMax"] = @(stats.blocksInUseMax);
+    }
+    return result;
+}
+
+- (NSDictionary*)benchmarkRecorderWithRecordings:(int)count seconds:(int)seconds compressed:(BOOL)compressed {
+    ZSDKRecorderBenchmarkResult r;
+    if (!ZSDKRecorderBenchmark([NSTemporaryDirectory() fileSystemRepresentation], count, seconds, 8000,
+                               compressed ? ZSDKRecordIMAADPCM : ZSDKRecordPCM, &r))
+        return nil;
+    
+    return @{ @"recordings"         : @(r.recordings),
+              @"audioSeconds"       : @(r.audioSeconds),
+              @"wallSeconds"        : @(r.wallSeconds),
+              @"realtimeFactor"     : @(r.realtimeFactor),
+              @"megabytesPerSecond" : @(r.megabytesPerSecond),
+              @"stalls"             : @(r.stalls) };
+}
+
+- (NSUInteger)acquireSound:(NSString*)path repeat:(BOOL)repeat pauseMs:(int)pauseMs ready:(BOOL*)ready {
+    SoundHandler sound;
+    LIBRESULT res = ZSDKSoundCacheAcquire([path fileSystemRepresentation], repeat ? 1 : 0, pauseMs, &sound);
+    if (ready)
+        *ready = (res == L_OK);
+    return (res == L_OK || res == L_WAIT) ? (NSUInteger)sound : (NSUInteger)INVALID_HANDLE;
+}
+
+- (void)releaseSound:(NSUInteger)soundId {
+    ZSDKSoundCacheRelease((SoundHandler)soundId);
+}
+
+- (void)preloadSounds:(NSArray*)paths {
+    int count = (int)paths.count;
+    const char ** names = calloc(count ? count : 1, sizeof(char*));
+    if (!names)
+        return;
+    for (int i = 0; i < count; i++)
+        names[i] = [paths[i] fileSystemRepresentation];
+    ZSDKSoundCachePreload(names, count, 0, 0);
+    free(names);
+}
+
+- (void)setSoundManifest:(NSArray*)paths {
+    [[NSUserDefaults standardUserDefaults] setObject:paths forKey:kSoundManifestKey];
+}
+
+- (void)setSoundCacheBudget:(NSUInteger)bytes {
+    ZSDKSoundCacheSetBudget(bytes);
+}
+
+- (NSDictionary*)soundCacheStatistics {
+    ZSDKSoundCacheStats stats;
+    ZSDKSoundCacheGetStats(&stats);
+    
+    return @{ @"entries"      : @(stats.entries),
+              @"loading"      : @(stats.loading),
+              @"bytes"        : @(stats.bytes),
+              @"budget"       : @(stats.budget),
+              @"hits"         : @(stats.hits),
+              @"misses"       : @(stats.misses),
+              @"evictions"    : @(stats.evictions),
+              @"loadFailures" : @(stats.loadFailures) };
+}
+
+- (BOOL)startDebugLogInDirectory:(NSString*)directory maxFileBytes:(NSUInteger)maxFileBytes keepFiles:(int)keepFiles {
+    if (!ZSDKLogStart([directory fileSystemRepresentation], maxFileBytes, keepFiles))
+        return NO;
+    SetDebugLogEnabled(YES);
+    return YES;
+}
+
+- (void)stopDebugLog {
+    SetDebugLogEnabled(NO);
+    ZSDKLogStop();
+}
+
+- (void)logDebugMessage:(NSString*)message {
+    ZSDKLogMessage([message UTF8String]);
+}
+
+- (BOOL)setDebugLogSampling:(int)keepOneIn forSubsystem:(NSString*)subsystem {
+    for (int i = 0; i < ZSDKLogSubsystemCount; i++)
+    {
+        if (strcmp([subsystem UTF8String], ZSDKLogSubsystemName(i)) == 0)
+        {
+            ZSDKLogSetSampling(i, keepOneIn);
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (NSDictionary*)debugLogStatistics {
+    ZSDKLogStats stats;
+    ZSDKLogGetStats(&stats);
+    
+    return @{ @"messages"    : @(stats.messages),
+              @"written"     : @(stats.written),
+              @"dropped"     : @(stats.dropped),
+              @"sampledOut"  : @(stats.sampledOut),
+              @"truncated"   : @(stats.truncated),
+              @"bytes"       : @(stats.bytes),
+              @"batches"     : @(stats.batches),
+              @"rotations"   : @(stats.rotations),
+              @"writeErrors" : @(stats.writeErrors) };
+}
+
+- (void)useSimulatedLibraryWithCallsPerSecond:(double)callsPerSecond answerDelayMs:(int)answerDelayMs callDurationMs:(int)callDurationMs mediaEventsPerSecond:(double)mediaEventsPerSecond {
+    ZSDKStubConfig config;
+    ZSDKStubDefaultConfig(&config);
+    config.callsPerSecond       = callsPerSecond;
+    config.answerDelayMs        = answerDelayMs;
+    config.callDurationMs       = callDurationMs;
+    config.mediaEventsPerSecond = mediaEventsPerSecond;
+    ZSDKStubConfigure(&config);
+    SetLibraryLoader(ZSDKStubLoadWrapperContext);
+}
+
+- (NSDictionary*)simulatedLibraryStatistics {
+    ZSDKStubStats stats;
+    ZSDKStubGetStats(&stats);
+    
+    return @{ @"scheduled"     : @(stats.scheduled),
+              @"delivered"     : @(stats.delivered),
+              @"overflows"     : @(stats.overflows),
+              @"callsOffered"  : @(stats.callsOffered),
+              @"callsAnswered" : @(stats.callsAnswered),
+              @"callsEnded"    : @(stats.callsEnded),
+              @"callsFailed"   : @(stats.callsFailed),
+              @"registrations" : @(stats.registrations),
+              @"lagAvgUs"      : @(stats.delivered ? stats.lagTotalUs / stats.delivered : 0),
+              @"lagMaxUs"      : @(stats.lagMaxUs),
+              @"activeCalls"   : @(stats.activeCalls) };
+}
+
+- (BOOL)runCallLoadWithPattern:(NSString*)pattern callsPerSecond:(double)callsPerSecond peakCallsPerSecond:(double)peakCallsPerSecond seconds:(int)seconds holdMs:(int)holdMs completion:(void (^)(NSString * json))completion {
+    ZSDKLoadGenConfig config;
+    ZSDKLoadGenDefaultConfig(&config);
+    config.pattern = ZSDKLoadPatternCount;
+    for (int i = 0; i < ZSDKLoadPatternCount; i++)
+    {
+        if ([pattern isEqualToString:[NSString stringWithUTF8String:ZSDKLoadPatternName(i)]])
+            config.pattern = (ZSDKLoadPattern)i;
+    }
+    config.callsPerSecond     = callsPerSecond;
+    config.peakCallsPerSecond = peakCallsPerSecond;
+    config.durationMs         = seconds * 1000;
+    config.holdMs             = holdMs;
+    
+    return ZSDKLoadGenStart(gUserId, &config, ^(const char * pJSON) {
+        if (completion)
+            completion([NSString stringWithUTF8String:pJSON]);
+    });
+}
+
+- (void)stopCallLoad {
+    ZSDKLoadGenStop();
+}
+
+- (NSDictionary*)callLoadStatistics {
+    ZSDKLoadGenStats stats;
+    ZSDKLoadGenGetStats(&stats);
+    
+    return @{ @"offered"      : @(stats.offered),
+              @"created"      : @(stats.created),
+              @"createErrors" : @(stats.createErrors),
+              @"throttled"    : @(stats.throttled),
+              @"accepted"     : @(stats.accepted),
+              @"completed"    : @(stats.completed),
+              @"remoteEnded"  : @(stats.remoteEnded),
+              @"rejected"     : @(stats.rejected),
+              @"failed"       : @(stats.failed),
+              @"timedOut"     : @(stats.timedOut),
+              @"inFlight"     : @(stats.inFlight) };
+}
+
+- (NSDictionary*)benchmarkWrapperFacadeWithIterations:(int)iterations {
+    ZSDKWrapperBenchResult r;
+    ZSDKWrapperBenchmark(iterations, &r);
+    
+    return @{ @"iterations"        : @(r.iterations),
+              @"directHoldNs"      : @(r.directHoldNs),
+              @"facadeHoldNs"      : @(r.facadeHoldNs),
+              @"directLifecycleNs" : @(r.directLifecycleNs),
+              @"facadeLifecycleNs" : @(r.facadeLifecycleNs) };
+}
+
+- (void)setEventHandler:(void (^)(NSArray * events))handler {
+    if (!handler)
+    {
+        ZSDKEventQueueSetHandler(nil);
+        return;
+    }
+    
+    ZSDKEventQueueSetHandler(^(const ZSDKEvent * events, int count) {
+        NSMutableArray * batch = [NSMutableArray arrayWithCapacity:count];
+        for (int i = 0; i < count; i++)
+        {
+            [batch addObject:@{ @"type"        : [NSString stringWithUTF8String:ZSDKEventTypeName(events[i].type)],
+                                @"handle"      : @(events[i].handle),
+                                @"codec"       : @(events[i].codec),
+                                @"causeCode"   : @(events[i].causeCode),
+                                @"arg0"        : @(events[i].arg0),
+                                @"arg1"        : @(events[i].arg1),
+                                @"text"        : [NSString stringWithUTF8String:events[i].text],
+                                @"timestampUs" : @(events[i].timestampUs) }];
+        }
+        handler(batch);
+    });
+}
+
+- (void)setLegacyNotificationsEnabled:(BOOL)enabled {
+    ZSDKEventQueueSetNotificationBridge(enabled);
+}
+
+- (NSDictionary*)eventQueueStatistics {
+    ZSDKEventQueueStats stats;
+    ZSDKEventQueueGetStats(&stats);
+    
+    return @{ @"pushed"           : @(stats.pushed),
+              @"dropped"          : @(stats.dropped),
+              @"outcomesDeferred" : @(stats.outcomesDeferred),
+              @"outcomesDropped"  : @(stats.outcomesDropped),
+              @"batches"          : @(stats.batches),
+              @"maxBatch"         : @(stats.maxBatch) };
+}
+
+- (NSDictionary*)pollStatistics {
+    ZSDKPollStats stats;
+    ZSDKPollEngineGetStats(&stats);
+    
+    return @{ @"polls"                : @(stats.polls),
+              @"wakeups"              : @(stats.wakeups),
+              @"timeouts"             : @(stats.timeouts),
+              @"events"               : @(stats.events),
+              @"emptyPolls"           : @(stats.emptyPolls),
+              @"wakeupLatencyAvgUs"   : @(stats.wakeups ? stats.wakeupLatencyTotalUs / stats.wakeups : 0),
+              @"wakeupLatencyMaxUs"   : @(stats.wakeupLatencyMaxUs),
+              @"timedEvents"          : @(stats.timedEvents),
+              @"timedLatencyAvgUs"    : @(stats.timedEvents ? stats.timedLatencyTotalUs / stats.timedEvents : 0),
+              @"timedLatencyMaxUs"    : @(stats.timedLatencyMaxUs),
+              @"currentIntervalMs"    : @(stats.currentIntervalMs),
+              @"active"               : @(stats.active) };
 }
 
 @end